@@ -0,0 +1,254 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2017-2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* Micro-benchmark of the per-entity skinning palette update ('A_Update'), 
+ * comparing stepping whole keyframes to blending between adjacent ones, for
+ * models with and without baked palettes. The original update, which walked
+ * up to the root for every joint, is measured as the baseline. It runs on a synthetic skeleton, 
+ * so that it needs no assets and no GL context: the animation module is 
+ * compiled in directly and the engine functions it calls are stubbed out.
+ *
+ * Build and run with 'make run_anim_bench'.
+ */
+
+#include "../../src/anim/anim.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_NUM_JOINTS    64
+#define BENCH_NUM_FRAMES    16
+#define BENCH_KEY_FPS       24
+#define BENCH_ITERATIONS    20000
+
+/*****************************************************************************/
+/* STUBS                                                                     */
+/*****************************************************************************/
+
+static uint32_t s_ticks;
+static volatile float s_sink;
+
+Uint32 SDL_GetTicks(void)
+{
+    return s_ticks;
+}
+
+void E_Entity_Notify(enum eventtype event, uint32_t ent_uid, void *event_arg, 
+                     enum event_source source)
+{
+}
+
+void R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, size_t count)
+{
+    /* Keep the compiler from optimizing the palette away */
+    s_sink += curr_poses[count - 1].m12;
+}
+
+void A_UpdateAnimTex(const struct anim_data *data, void *render_private, 
+                     const struct anim_clip *clip)
+{
+}
+
+bool A_LoadClip(const struct anim_data *data, struct anim_clip *clip)
+{
+    return true;
+}
+
+bool AL_QueueClipLoad(void *anim_private, void *render_private, int clip_idx)
+{
+    return false;
+}
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static float rand_range(float min, float max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void random_sqt(struct SQT *out)
+{
+    out->scale = (vec3_t){1.0f, 1.0f, 1.0f};
+    out->trans = (vec3_t){rand_range(-1.0f, 1.0f), rand_range(-1.0f, 1.0f), rand_range(-1.0f, 1.0f)};
+
+    quat_t q = {rand_range(-1.0f, 1.0f), rand_range(-1.0f, 1.0f), 
+                rand_range(-1.0f, 1.0f), rand_range(-1.0f, 1.0f)};
+    float len = sqrtf(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+    out->quat_rotation = (quat_t){q.x/len, q.y/len, q.z/len, q.w/len};
+}
+
+static double now_us(void)
+{
+    return clock() * (1e6 / CLOCKS_PER_SEC);
+}
+
+/* The palette update as it was before the poses were memoized, baked and 
+ * blended: the chain of parent transforms is rebuilt for every joint. */
+static void baseline_make_pose_mat(const struct entity *ent, int joint_idx, 
+                                   const struct skeleton *skel, mat4x4_t *out)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    const struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+
+    mat4x4_t pose_trans;
+    PFM_Mat4x4_Identity(&pose_trans);
+
+    while(joint_idx >= 0) {
+
+        const struct joint *joint = &skel->joints[joint_idx];
+        const struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
+        mat4x4_t to_parent, to_curr = pose_trans;
+
+        a_mat_from_sqt(pose_sqt, &to_parent);
+        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
+
+        joint_idx = joint->parent_idx;
+    }
+
+    *out = pose_trans;
+}
+
+static void baseline_set_uniforms(const struct entity *ent)
+{
+    struct anim_data *priv = (struct anim_data*)ent->anim_private;
+    size_t num_joints = priv->skel.num_joints;
+
+    mat4x4_t curr_pose_mats[num_joints];
+    for(int j = 0; j < num_joints; j++) {
+        baseline_make_pose_mat(ent, j, &priv->skel, &curr_pose_mats[j]);
+    }
+
+    R_GL_SetAnimUniforms(priv->skel.inv_bind_poses, curr_pose_mats, num_joints);
+}
+
+static double bench(void (*update)(const struct entity*), const struct entity *ent, uint32_t ticks)
+{
+    s_ticks = ticks;
+    for(int i = 0; i < BENCH_ITERATIONS / 10; i++)
+        update(ent);
+
+    double start = now_us();
+    for(int i = 0; i < BENCH_ITERATIONS; i++)
+        update(ent);
+    return (now_us() - start) / BENCH_ITERATIONS;
+}
+
+/*****************************************************************************/
+/* ENTRY POINT                                                               */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    static struct joint     joints[BENCH_NUM_JOINTS];
+    static struct SQT       bind_sqts[BENCH_NUM_JOINTS];
+    static mat4x4_t         inv_bind_poses[BENCH_NUM_JOINTS];
+    static struct SQT       poses[BENCH_NUM_FRAMES * BENCH_NUM_JOINTS];
+    static mat4x4_t         pose_mats[BENCH_NUM_FRAMES * BENCH_NUM_JOINTS];
+    static struct anim_sample samples[BENCH_NUM_FRAMES];
+
+    srand(1);
+
+    /* A binary tree of joints, about as deep as a typical humanoid rig */
+    for(int j = 0; j < BENCH_NUM_JOINTS; j++) {
+        joints[j].parent_idx = (j == 0) ? -1 : (j - 1) / 2;
+        random_sqt(&bind_sqts[j]);
+    }
+    for(int i = 0; i < BENCH_NUM_FRAMES * BENCH_NUM_JOINTS; i++)
+        random_sqt(&poses[i]);
+
+    struct anim_data data = {
+        .num_anims = 1,
+        .baked = true,
+        .skel = {
+            .num_joints = BENCH_NUM_JOINTS,
+            .joints = joints,
+            .bind_sqts = bind_sqts,
+            .inv_bind_poses = inv_bind_poses,
+        },
+        .num_samples = BENCH_NUM_FRAMES,
+    };
+    A_PrepareInvBindMatrices(&data.skel);
+    A_PrepareBakedPalettes(&data.skel, poses, BENCH_NUM_FRAMES, pose_mats);
+
+    struct anim_clip clip = {
+        .name = "Bench",
+        .skel = &data.skel,
+        .num_frames = BENCH_NUM_FRAMES,
+        .samples = samples,
+        .state = CLIP_LOADED,
+    };
+    data.anims = &clip;
+
+    struct anim_ctx ctx = {
+        .active = &clip,
+        .idle = &clip,
+        .mode = ANIM_MODE_LOOP,
+        .key_fps = BENCH_KEY_FPS,
+    };
+    struct entity ent = {
+        .anim_private = &data,
+        .anim_ctx = &ctx,
+    };
+
+    /* Halfway between two keyframes, without reaching the next one */
+    const uint32_t stepped_ticks = 0;
+    const uint32_t blended_ticks = 1000 / BENCH_KEY_FPS / 2;
+
+    printf("%d joints, %d iterations, CONFIG_ANIM_INTERPOLATE=%d\n", 
+        BENCH_NUM_JOINTS, BENCH_ITERATIONS, (int)CONFIG_ANIM_INTERPOLATE);
+
+    for(int baked = 0; baked < 2; baked++) {
+
+        for(int f = 0; f < BENCH_NUM_FRAMES; f++) {
+            samples[f].local_joint_poses = poses + f * BENCH_NUM_JOINTS;
+            samples[f].pose_mats = baked ? pose_mats + f * BENCH_NUM_JOINTS : NULL;
+        }
+
+        if(!baked) {
+            printf("%-10s stepped: %8.3f us/update\n",
+                "baseline", bench(baseline_set_uniforms, &ent, stepped_ticks));
+        }
+
+        printf("%-10s stepped: %8.3f us/update  blended: %8.3f us/update\n",
+            baked ? "baked" : "not baked", 
+            bench(a_set_uniforms_curr_frame, &ent, stepped_ticks), 
+            bench(a_set_uniforms_curr_frame, &ent, blended_ticks));
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2018 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Helpers shared by the benchmark scripts.
+
+import pf
+import os
+
+def available_scene(path, out_path):
+    """
+    Write a copy of the scene at 'path' to 'out_path', leaving out the entities 
+    whose models are not present in this checkout. This way the benchmark still
+    runs on a partial set of assets.
+    """
+    with open(path, "r") as f:
+        lines = f.readlines()
+
+    header, entities = [], []
+    for line in lines:
+        tokens = line.split()
+        if tokens and tokens[0] == "entity":
+            entities.append([line])
+        elif entities:
+            entities[-1].append(line)
+        elif not (tokens and tokens[0] == "num_entities"):
+            header.append(line)
+
+    basedir = pf.get_basedir()
+    present = [e for e in entities if os.path.isfile(os.path.join(basedir, e[0].split()[2]))]
+
+    with open(out_path, "w") as f:
+        f.writelines(header)
+        f.write("num_entities %d\n" % len(present))
+        for ent in present:
+            f.writelines(ent)
@@ -0,0 +1,101 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2018 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Asset loading benchmark.
+#
+# Times loading the demo map and scene, prints the results and writes them to 
+# 'load.txt' in the output directory. The entity models are only loaded once 
+# per run, so every number is for a cold load. The engine quits when done.
+#
+# To compare two builds, run the script on the old build first, then point 
+# PF_BENCH_BASELINE at the 'load.txt' it wrote and run it on the new build. 
+# Every time is then printed next to the baseline time and the speedup.
+
+import pf
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(pf.get_basedir(), "scripts", "demo"))
+sys.path.insert(0, os.path.join(pf.get_basedir(), "scripts", "bench"))
+from units import *
+from common import available_scene
+
+OUT_DIR = os.environ.get("PF_BENCH_OUT", "bench_out")
+BASELINE = os.environ.get("PF_BENCH_BASELINE")
+
+def read_results(path):
+    results = {}
+    with open(path, "r") as f:
+        for line in f:
+            tokens = line.split()
+            if len(tokens) == 2:
+                results[tokens[0]] = float(tokens[1])
+    return results
+
+# Read the baseline up front so that a bad path is reported before the slow part
+baseline = read_results(BASELINE) if BASELINE else {}
+
+if not os.path.isdir(OUT_DIR):
+    os.makedirs(OUT_DIR)
+
+scene_path = os.path.join(OUT_DIR, "bench.pfscene")
+available_scene("assets/maps/demo.pfscene", scene_path)
+
+start = time.time()
+pf.new_game("assets/maps", "demo.pfmap")
+map_secs = time.time() - start
+
+start = time.time()
+scene_objs = pf.load_scene(scene_path)
+scene_secs = time.time() - start
+
+results = [("map", map_secs), ("scene", scene_secs)]
+with open(os.path.join(OUT_DIR, "load.txt"), "w") as f:
+    for name, secs in results:
+        f.write("%s %.6f\n" % (name, secs))
+
+print "scene entities: %d" % len(scene_objs)
+for name, secs in results:
+    if name in baseline:
+        print "%s load: %.3f s (baseline %.3f s, %.2fx)" % (name, secs, baseline[name], 
+            baseline[name] / max(secs, 1e-6))
+    else:
+        print "%s load: %.3f s" % (name, secs)
+
+def on_update_start(user, event):
+    pf.unregister_event_handler(pf.EVENT_UPDATE_START, on_update_start)
+    pf.global_event(pf.SDL_QUIT, None)
+
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update_start, None)
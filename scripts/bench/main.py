@@ -0,0 +1,146 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2018 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Scripted camera fly-through over the demo map for render benchmarking.
+#
+# The camera orbits the center of the map for a fixed number of frames. The 
+# CPU and GPU time of every frame is written to a CSV file and a frame is 
+# dumped as a PPM image at regular intervals. The engine quits when done.
+# Build with 'make HEADLESS=1' to run on machines with no display.
+
+import pf
+import os
+import sys
+import math
+
+# Make the custom entity classes used by the demo scene available
+sys.path.insert(0, os.path.join(pf.get_basedir(), "scripts", "demo"))
+sys.path.insert(0, os.path.join(pf.get_basedir(), "scripts", "bench"))
+from units import *
+from common import available_scene
+
+############################################################
+# Benchmark parameters                                     #
+############################################################
+
+NUM_FRAMES      = 600
+DUMP_INTERVAL   = 100
+ORBIT_RADIUS    = 300.0
+CAM_HEIGHT      = 175.0
+CAM_PITCH       = -40.0
+OUT_DIR         = os.environ.get("PF_BENCH_OUT", "bench_out")
+
+############################################################
+# Setup map/scene                                          #
+############################################################
+
+pf.set_ambient_light_color([1.0, 1.0, 1.0])
+pf.set_emit_light_color([1.0, 1.0, 1.0])
+pf.set_emit_light_pos([1024.0, 768.0, 768.0])
+
+if not os.path.isdir(OUT_DIR):
+    os.makedirs(OUT_DIR)
+
+pf.new_game("assets/maps", "demo.pfmap")
+pf.set_map_render_mode(pf.CHUNK_RENDER_MODE_PREBAKED)
+
+scene_path = os.path.join(OUT_DIR, "bench.pfscene")
+available_scene("assets/maps/demo.pfscene", scene_path)
+scene_objs = pf.load_scene(scene_path)
+
+# The FPS camera is not restricted to the map bounds and does not scroll 
+# when the mouse is at the edge of the screen.
+pf.activate_camera(1, pf.CAM_MODE_FPS)
+
+############################################################
+# Fly-through                                              #
+############################################################
+
+frame_idx = 0
+# The GPU times are reported some frames after the CPU times of the same frame
+cpu_samples = {}
+gpu_samples = {}
+
+def place_camera(frame):
+    angle = 2.0 * math.pi * frame / NUM_FRAMES
+    x = ORBIT_RADIUS * math.cos(angle)
+    z = ORBIT_RADIUS * math.sin(angle)
+    # Face the center of the map
+    yaw = math.degrees(math.atan2(z, -x))
+    pf.set_active_camera_pos([x, CAM_HEIGHT, z])
+    pf.set_active_camera_orientation(CAM_PITCH, yaw)
+
+def percentile(values, pc):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pc / 100.0))]
+
+def write_results():
+    # The GPU times of the last few frames never come in
+    frames = sorted(f for f in cpu_samples if f in gpu_samples)
+    with open(os.path.join(OUT_DIR, "frames.csv"), "w") as f:
+        f.write("frame,cpu_ms,gpu_ms\n")
+        for frame in frames:
+            f.write("%d,%.3f,%.3f\n" % (frame, cpu_samples[frame], gpu_samples[frame]))
+
+    # The first few frames include one-time setup costs
+    steady = frames[10:] if len(frames) > 20 else frames
+    for name, samples in (("cpu", cpu_samples), ("gpu", gpu_samples)):
+        vals = [samples[f] for f in steady]
+        print "%s ms: mean %.3f p50 %.3f p95 %.3f max %.3f" % (name, sum(vals) / len(vals),
+            percentile(vals, 50), percentile(vals, 95), max(vals))
+
+def on_update_start(user, event):
+    global frame_idx
+
+    if frame_idx > 0:
+        cpu_ms, gpu_ms, gpu_lag = pf.prev_frame_perf()
+        cpu_samples[frame_idx - 1] = cpu_ms
+        # Frames from before the fly-through started are dropped
+        if frame_idx - 1 - gpu_lag >= 0:
+            gpu_samples[frame_idx - 1 - gpu_lag] = gpu_ms
+
+    if frame_idx == NUM_FRAMES:
+        pf.unregister_event_handler(pf.EVENT_UPDATE_START, on_update_start)
+        write_results()
+        pf.global_event(pf.SDL_QUIT, None)
+        return
+
+    place_camera(frame_idx)
+    if frame_idx % DUMP_INTERVAL == 0:
+        pf.dump_next_frame(os.path.join(OUT_DIR, "frame_%04d.ppm" % frame_idx))
+
+    frame_idx += 1
+
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update_start, None)
+
@@ -52,6 +52,8 @@ class AnimCombatable(pf.AnimEntity, pf.CombatableEntity, cont.Controllable):
     def __init__(self, path, pfobj, name, **kwargs):
         super(AnimCombatable, self).__init__(path, pfobj, name, **kwargs)
         self.attacking = False
+        # Load the clip up front so that the first death doesn't stall on a disk read
+        self.prefetch_anim(self.death_anim())
         self.register(pf.EVENT_ATTACK_START, AnimCombatable.__on_attack_begin, weakref.ref(self))
         self.register(pf.EVENT_ATTACK_END, AnimCombatable.__on_attack_end, weakref.ref(self))
         self.register(pf.EVENT_ENTITY_DEATH, AnimCombatable.__on_death, weakref.ref(self))
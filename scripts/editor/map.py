@@ -35,6 +35,7 @@
 import pf
 import traceback
 import copy
+import pfmapb
 
 
 EDITOR_PFMAP_VERSION = 1.0
@@ -234,6 +235,7 @@ class Map(object):
         if self.filename is not None:
             with open(self.filename, "w") as mapfile:
                 mapfile.write(self.pfmap_str())
+            pfmapb.convert(self.filename)
 
     def update_tile_mat(self, tile_coords, top_material):
 
@@ -0,0 +1,183 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2018 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Converts ASCII PFMAP files to the binary PFMAP ('.pfmapb') format, which the
+# engine loads in place of the ASCII file when it is present and up to date.
+# The editor writes the binary file every time a map is saved. This module 
+# does not depend on the engine and can also be run as a standalone tool:
+#
+#     python pfmapb.py map.pfmap [map2.pfmap ...]
+#
+# Each file is written next to its' source, as '<name>.pfmapb'.
+#
+# All values are little-endian. The file starts with the following header:
+#
+#     uint32 magic                  0x424d4650 ('PFMB')
+#     uint32 version                1
+#     float  pfmap_version          The 'version' of the PFMAP file
+#     uint32 num_rows               
+#     uint32 num_cols               
+#     uint32 chunk_width            32 (tiles)
+#     uint32 chunk_height           32 (tiles)
+#     uint32 mats_per_chunk         8
+#
+# It is followed by the chunk table: (num_rows * num_cols) uint32 file offsets 
+# of the chunks, in row-major order. The offsets are multiples of 4. A chunk is 
+# made up of (chunk_width * chunk_height) tile records, in row-major order:
+#
+#     uint8  type
+#     uint8  pathable
+#     int8   base_height
+#     int8   ramp_height
+#     uint8  top_mat_idx
+#     uint8  sides_mat_idx
+#
+# followed by zero padding to the next multiple of 4 and 'mats_per_chunk' 
+# material records:
+#
+#     float  ambient, diffuse[3], specular[3]
+#     char   texture[32]            NUL-terminated, empty for unused slots
+
+import struct
+import sys
+
+PFMAPB_MAGIC    = 0x424d4650 # 'PFMB'
+PFMAPB_VERSION  = 1
+PFMAPB_NAME_LEN = 32
+
+TILES_PER_CHUNK_WIDTH  = 32
+TILES_PER_CHUNK_HEIGHT = 32
+MATERIALS_PER_CHUNK    = 8
+
+HEADER_FMT      = "<IIfIIIII"
+TILE_FMT        = "<BBbbBB"
+MATERIAL_FMT    = "<f3f3f32s"
+
+class PFMAPError(Exception):
+    pass
+
+class LineReader(object):
+
+    def __init__(self, path):
+        with open(path, "r") as f:
+            self.lines = f.read().splitlines()
+        self.idx = 0
+
+    def next(self, attr=None):
+        if self.idx == len(self.lines):
+            raise PFMAPError("Unexpected end of file")
+        tokens = self.lines[self.idx].split()
+        self.idx += 1
+        if attr is not None and (not tokens or tokens[0] != attr):
+            raise PFMAPError("Expected '%s' on line %d" % (attr, self.idx))
+        return tokens[1:] if attr is not None else tokens
+
+def tile(token):
+    if len(token) != 6:
+        raise PFMAPError("Bad tile '%s'" % token)
+    digits = [ord(ch) - ord("0") for ch in token[1:]]
+    # Same order as the ASCII format: pathable, base height, top material, 
+    # sides material, ramp height
+    return struct.pack(TILE_FMT, int(token[0], 16), digits[0], digits[1], digits[4], 
+        digits[2], digits[3])
+
+def material(reader):
+    if reader.next("material")[0] == "__none__":
+        return struct.pack(MATERIAL_FMT, *([0.0] * 7 + [b""]))
+    ambient  = float(reader.next("ambient")[0])
+    diffuse  = [float(v) for v in reader.next("diffuse")]
+    specular = [float(v) for v in reader.next("specular")]
+    texture  = reader.next("texture")[0].encode("ascii")
+    if len(texture) >= PFMAPB_NAME_LEN:
+        raise PFMAPError("Texture name '%s' is too long" % texture)
+    return struct.pack(MATERIAL_FMT, *([ambient] + diffuse + specular + [texture]))
+
+def read_pfmap(path):
+    reader = LineReader(path)
+
+    version  = float(reader.next("version")[0])
+    num_rows = int(reader.next("num_rows")[0])
+    num_cols = int(reader.next("num_cols")[0])
+
+    chunks = []
+    for i in range(num_rows * num_cols):
+        data = []
+        for r in range(TILES_PER_CHUNK_HEIGHT):
+            tokens = reader.next()
+            if len(tokens) != TILES_PER_CHUNK_WIDTH:
+                raise PFMAPError("Expected %d tiles on line %d" % (TILES_PER_CHUNK_WIDTH, reader.idx))
+            data += [tile(t) for t in tokens]
+        size = len(data) * struct.calcsize(TILE_FMT)
+        data.append(b"\0" * (-size % 4))
+        data += [material(reader) for m in range(MATERIALS_PER_CHUNK)]
+        chunks.append(b"".join(data))
+
+    return version, num_rows, num_cols, chunks
+
+def convert(src_path, dst_path=None):
+    """
+    Write the binary version of the ASCII PFMAP file at 'src_path'. By default, 
+    it is written next to the source file.
+    """
+    if dst_path is None:
+        dst_path = src_path + "b"
+
+    version, num_rows, num_cols, chunks = read_pfmap(src_path)
+
+    offsets = []
+    offset = struct.calcsize(HEADER_FMT) + 4 * len(chunks)
+    for data in chunks:
+        offsets.append(offset)
+        offset += len(data)
+
+    header = struct.pack(HEADER_FMT, PFMAPB_MAGIC, PFMAPB_VERSION, version, num_rows, num_cols,
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, MATERIALS_PER_CHUNK)
+
+    with open(dst_path, "wb") as ofile:
+        ofile.write(header)
+        ofile.write(struct.pack("<%dI" % len(offsets), *offsets))
+        for data in chunks:
+            ofile.write(data)
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write("Usage: %s <file.pfmap> [<file.pfmap> ...]\n" % sys.argv[0])
+        sys.exit(1)
+
+    for path in sys.argv[1:]:
+        try:
+            convert(path)
+        except (PFMAPError, ValueError, IndexError) as e:
+            sys.stderr.write("%s: %s\n" % (path, e))
+            sys.exit(1)
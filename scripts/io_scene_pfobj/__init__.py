@@ -95,6 +95,13 @@ class ExportPFOBJ(bpy.types.Operator, ExportHelper):
         default=False
     )
 
+    export_binary = BoolProperty(
+        name="Also Export Binary (.pfobjb)",
+        description="Write a binary copy of the model next to the PFOBJ file. The engine loads it " \
+            "in place of the PFOBJ file, which is much faster.",
+        default=False
+    )
+
     def execute(self, context):
         from . import export_pfobj
         from mathutils import Matrix
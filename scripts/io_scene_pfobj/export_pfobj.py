@@ -67,7 +67,7 @@ def current_pose_bbox(global_matrix, mesh_objs, local_origin):
 
     return min_x, max_x, min_y, max_y, min_z, max_z
 
-def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
+def save(operator, context, filepath, global_matrix, export_bbox, local_origin, export_binary):
     with open(filepath, "w", encoding="ascii") as ofile:
 
         mesh_objs = [obj for obj in bpy.context.selected_objects if obj.type == 'MESH']
@@ -301,5 +301,8 @@ def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
         line = "z_bounds {a:.6f} {b:.6f}\n".format(a=min_z, b=max_z)
         ofile.write(line)
 
-        return {'FINISHED'}
+    if export_binary:
+        from . import pfobjb
+        pfobjb.convert(filepath)
 
+    return {'FINISHED'}
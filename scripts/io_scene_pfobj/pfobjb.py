@@ -0,0 +1,214 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2017-2018 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+# Converts ASCII PFOBJ files to the binary PFOBJ ('.pfobjb') format, which the
+# engine loads in place of the ASCII file when it is present and up to date.
+# See 'docs/pfobj.txt' for the layout of the binary file. This module does not
+# depend on Blender and can also be run as a standalone tool:
+#
+#     python pfobjb.py model.pfobj [model2.pfobj ...]
+#
+# Each file is written next to its' source, as '<name>.pfobjb'.
+
+import struct
+import sys
+
+PFOBJB_MAGIC    = 0x424f4650 # 'PFOB'
+PFOBJB_VERSION  = 1
+PFOBJB_NAME_LEN = 32
+PFOBJB_ALIGN    = 16
+
+MAX_ANIM_SETS   = 16
+MAX_WEIGHTS     = 6
+NUM_SECTIONS    = 8
+
+# Layouts of the engine structures stored in the file (little-endian)
+VERTEX_FMT      = "<3f2f3fi6i6fi4i"   # struct vertex
+MATERIAL_FMT    = "<f3f3f32s"         # struct pfobjb_material
+JOINT_FMT       = "<32si3f"           # struct joint
+SQT_FMT         = "<3f4f3f"           # struct SQT
+AABB_FMT        = "<6f"               # struct aabb
+HEADER_FMT      = "<IIfIIII%dIIIII%dI" % (MAX_ANIM_SETS, NUM_SECTIONS)
+
+class PFOBJError(Exception):
+    pass
+
+class LineReader(object):
+
+    def __init__(self, path):
+        with open(path, "r") as f:
+            self.lines = f.read().splitlines()
+        self.idx = 0
+
+    def next(self, attr=None):
+        if self.idx == len(self.lines):
+            raise PFOBJError("Unexpected end of file")
+        tokens = self.lines[self.idx].split()
+        self.idx += 1
+        if attr is not None and (not tokens or tokens[0] != attr):
+            raise PFOBJError("Expected '%s' on line %d" % (attr, self.idx))
+        return tokens[1:] if attr is not None else tokens
+
+def floats(token, count):
+    vals = [float(v) for v in token.split("/")]
+    if len(vals) != count:
+        raise PFOBJError("Expected %d components in '%s'" % (count, token))
+    return vals
+
+def name(string):
+    data = string.encode("ascii")
+    if len(data) >= PFOBJB_NAME_LEN:
+        raise PFOBJError("Name '%s' is too long" % string)
+    return data
+
+def aabb(reader):
+    x = [float(v) for v in reader.next("x_bounds")]
+    y = [float(v) for v in reader.next("y_bounds")]
+    z = [float(v) for v in reader.next("z_bounds")]
+    return struct.pack(AABB_FMT, *(x + y + z))
+
+def read_pfobj(path):
+    reader = LineReader(path)
+
+    version       = float(reader.next("version")[0])
+    num_verts     = int(reader.next("num_verts")[0])
+    num_joints    = int(reader.next("num_joints")[0])
+    num_materials = int(reader.next("num_materials")[0])
+    num_as        = int(reader.next("num_as")[0])
+    frame_counts  = [int(c) for c in reader.next("frame_counts")]
+    has_collision = int(reader.next("has_collision")[0])
+
+    if num_as > MAX_ANIM_SETS or len(frame_counts) < num_as:
+        raise PFOBJError("Bad animation set counts")
+    frame_counts = frame_counts[:num_as]
+
+    sections = [b""] * NUM_SECTIONS
+    chunks = []
+    for i in range(num_verts):
+        pos    = [float(v) for v in reader.next("v")]
+        uv     = [float(v) for v in reader.next("vt")]
+        normal = [float(v) for v in reader.next("vn")]
+        pairs  = [p.split("/") for p in reader.next("vw")]
+        if len(pairs) > MAX_WEIGHTS:
+            raise PFOBJError("Too many vertex weights on vertex %d" % i)
+        pairs += [("0", "0")] * (MAX_WEIGHTS - len(pairs))
+        mat    = int(reader.next("vm")[0])
+        chunks.append(struct.pack(VERTEX_FMT, *(pos + uv + normal + [mat]
+            + [int(p[0]) for p in pairs] + [float(p[1]) for p in pairs]
+            + [0] + [0] * 4)))
+    sections[0] = b"".join(chunks)
+
+    chunks = []
+    for i in range(num_materials):
+        reader.next("material")
+        ambient  = float(reader.next("ambient")[0])
+        diffuse  = [float(v) for v in reader.next("diffuse")]
+        specular = [float(v) for v in reader.next("specular")]
+        texture  = name(reader.next("texture")[0])
+        chunks.append(struct.pack(MATERIAL_FMT, *([ambient] + diffuse + specular + [texture])))
+    sections[1] = b"".join(chunks)
+
+    joints, binds = [], []
+    for i in range(num_joints):
+        tokens = reader.next("j")
+        parent = int(tokens[0]) - 1
+        scale, rot, trans, tip = floats(tokens[2], 3), floats(tokens[3], 4), \
+            floats(tokens[4], 3), floats(tokens[5], 3)
+        joints.append(struct.pack(JOINT_FMT, *([name(tokens[1]), parent] + tip)))
+        binds.append(struct.pack(SQT_FMT, *(scale + rot + trans)))
+    sections[2] = b"".join(joints)
+    sections[3] = b"".join(binds)
+
+    names, samples, sample_aabbs = [], [], []
+    for i in range(num_as):
+        tokens = reader.next("as")
+        if int(tokens[1]) != frame_counts[i]:
+            raise PFOBJError("Frame count of '%s' does not match the header" % tokens[0])
+        names.append(struct.pack("32s", name(tokens[0])))
+        for f in range(frame_counts[i]):
+            for j in range(num_joints):
+                tokens = reader.next()
+                samples.append(struct.pack(SQT_FMT, *(floats(tokens[1], 3)
+                    + floats(tokens[2], 4) + floats(tokens[3], 3))))
+            if has_collision:
+                sample_aabbs.append(aabb(reader))
+    sections[4] = b"".join(names)
+    sections[5] = b"".join(samples)
+    sections[6] = b"".join(sample_aabbs)
+
+    if has_collision:
+        sections[7] = aabb(reader)
+
+    counts = [version, num_verts, num_joints, num_materials, num_as]
+    return counts, frame_counts, has_collision, sections
+
+def convert(src_path, dst_path=None):
+    """
+    Write the binary version of the ASCII PFOBJ file at 'src_path'. By default, 
+    it is written next to the source file.
+    """
+    if dst_path is None:
+        dst_path = src_path + "b"
+
+    counts, frame_counts, has_collision, sections = read_pfobj(src_path)
+
+    offsets = []
+    offset = struct.calcsize(HEADER_FMT)
+    for data in sections:
+        offset += -offset % PFOBJB_ALIGN
+        offsets.append(offset)
+        offset += len(data)
+
+    header = struct.pack(HEADER_FMT, *([PFOBJB_MAGIC, PFOBJB_VERSION] + counts
+        + frame_counts + [0] * (MAX_ANIM_SETS - len(frame_counts))
+        + [has_collision, struct.calcsize(VERTEX_FMT), struct.calcsize(JOINT_FMT),
+           struct.calcsize(SQT_FMT)] + offsets))
+
+    with open(dst_path, "wb") as ofile:
+        ofile.write(header)
+        for off, data in zip(offsets, sections):
+            ofile.write(b"\0" * (off - ofile.tell()))
+            ofile.write(data)
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write("Usage: %s <file.pfobj> [<file.pfobj> ...]\n" % sys.argv[0])
+        sys.exit(1)
+
+    for path in sys.argv[1:]:
+        try:
+            convert(path)
+        except (PFOBJError, ValueError, IndexError) as e:
+            sys.stderr.write("%s: %s\n" % (path, e))
+            sys.exit(1)
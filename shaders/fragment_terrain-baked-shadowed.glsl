@@ -36,6 +36,8 @@
 #version 330 core
 
 #define MAX_MATERIALS 8
+#define MAX_MATERIAL_ARRS 4
+#define NUM_SHADOW_CASCADES 3
 
 /* TODO: Make these as material parameters */
 #define SPECULAR_STRENGTH  0.5
@@ -53,7 +55,7 @@ in VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
-         vec4 light_space_pos;
+         vec4 light_space_pos[NUM_SHADOW_CASCADES];
 }from_vertex;
 
 /*****************************************************************************/
@@ -71,23 +73,17 @@ uniform vec3 light_color;
 uniform vec3 light_pos;
 uniform vec3 view_pos;
 
-uniform sampler2D shadow_map;
-
-uniform sampler2D texture0;
-uniform sampler2D texture1;
-uniform sampler2D texture2;
-uniform sampler2D texture3;
-uniform sampler2D texture4;
-uniform sampler2D texture5;
-uniform sampler2D texture6;
-uniform sampler2D texture7;
-uniform sampler2D texture8;
-uniform sampler2D texture9;
-uniform sampler2D texture10;
-uniform sampler2D texture11;
-uniform sampler2D texture12;
-uniform sampler2D texture13;
-uniform sampler2D texture14;
+uniform sampler2DArray shadow_map;
+/* Bit i is set when cascade i has been rendered to this frame */
+uniform int cascade_mask;
+
+/* The material textures are grouped by size into array textures. Each 
+ * material's slot holds the index of its' array in bits 8 and up, and its' 
+ * layer in bits 0-7. It is negative for materials without a texture.
+ */
+uniform sampler2DArray material_arrs[MAX_MATERIAL_ARRS];
+uniform int            material_slots[MAX_MATERIALS];
+uniform sampler2D      baked_tex;
 
 struct material{
     float ambient_intensity;
@@ -101,39 +97,57 @@ uniform material materials[MAX_MATERIALS];
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
-float shadow_factor(vec4 light_space_pos)
+vec4 material_texture(int mat_idx, vec2 uv)
+{
+    int slot = material_slots[mat_idx];
+    vec3 coord = vec3(uv, slot & 0xff);
+
+    switch(slot >> 8) {
+    case 0: return texture(material_arrs[0], coord);
+    case 1: return texture(material_arrs[1], coord);
+    case 2: return texture(material_arrs[2], coord);
+    case 3: return texture(material_arrs[3], coord);
+    }
+    return vec4(0.0);
+}
+
+float shadow_factor()
 {
-    vec3 proj_coords = (light_space_pos.xyz / light_space_pos.w) * 0.5 + 0.5;
-    float closest_depth = texture(shadow_map, proj_coords.xy).r;
-    float current_depth = proj_coords.z;
-    if(current_depth - SHADOW_MAP_BIAS > closest_depth) {
-        return 1.0;
-    }else {
-        return 0.0;
+    /* The cascades are ordered from nearest to furthest, so the first one 
+     * holding this fragment has the most detailed shadows for it. */
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+
+        if((cascade_mask & (1 << i)) == 0)
+            continue;
+
+        vec4 light_space_pos = from_vertex.light_space_pos[i];
+        vec3 proj_coords = (light_space_pos.xyz / light_space_pos.w) * 0.5 + 0.5;
+
+        if(!all(greaterThanEqual(proj_coords, vec3(0.0))) 
+        || !all(lessThanEqual(proj_coords, vec3(1.0))))
+            continue;
+
+        float closest_depth = texture(shadow_map, vec3(proj_coords.xy, i)).r;
+        float current_depth = proj_coords.z;
+        if(current_depth - SHADOW_MAP_BIAS > closest_depth) {
+            return 1.0;
+        }else {
+            return 0.0;
+        }
     }
+    return 0.0;
 }
 
 void main()
 {
     vec4 tex_color;
 
-    switch(from_vertex.mat_idx) {
-    case 0: tex_color = texture(texture0, from_vertex.uv); break;
-    case 1: tex_color = texture(texture1, from_vertex.uv); break;
-    case 2: tex_color = texture(texture2, from_vertex.uv); break;
-    case 3: tex_color = texture(texture3, from_vertex.uv); break;
-    case 4: tex_color = texture(texture4, from_vertex.uv); break;
-    case 5: tex_color = texture(texture5, from_vertex.uv); break;
-    case 6: tex_color = texture(texture6, from_vertex.uv); break;
-    case 7: tex_color = texture(texture7, from_vertex.uv); break;
-    case 8: tex_color = texture(texture8, from_vertex.uv); break;
-    case 9: tex_color = texture(texture9, from_vertex.uv); break;
-    case 10: tex_color = texture(texture10, from_vertex.uv); break;
-    case 11: tex_color = texture(texture11, from_vertex.uv); break;
-    case 12: tex_color = texture(texture12, from_vertex.uv); break;
-    case 13: tex_color = texture(texture13, from_vertex.uv); break;
-    case 14: tex_color = texture(texture14, from_vertex.uv); break;
-    }
+    /* The top face texture is the only material that is not in any of the 
+     * material arrays. */
+    if(material_slots[from_vertex.mat_idx] < 0)
+        tex_color = texture(baked_tex, from_vertex.uv);
+    else
+        tex_color = material_texture(from_vertex.mat_idx, from_vertex.uv);
 
     /* Simple alpha test to reject transparent pixels */
     if(tex_color.a == 0.0)
@@ -150,12 +164,12 @@ void main()
         float diff = max(dot(from_vertex.normal, light_dir), 0.0);
         vec3 diffuse = light_color * (diff * materials[from_vertex.mat_idx].diffuse_clr);
 
-        float shadow = shadow_factor(from_vertex.light_space_pos);
+        float shadow = shadow_factor();
         o_frag_color = vec4( (ambient + (1.0 - shadow) * diffuse) * tex_color.xyz, 1.0);
     
     }else{
 
-        float shadow = shadow_factor(from_vertex.light_space_pos);
+        float shadow = shadow_factor();
         if(shadow > 0.0) {
             o_frag_color = vec4(tex_color.xyz * SHADOW_MULTIPLIER, 1.0);
         }else{
@@ -36,6 +36,7 @@
 #version 330 core
 
 #define MAX_MATERIALS 8
+#define MAX_MATERIAL_ARRS 4
 
 /* TODO: Make these as material parameters */
 #define SPECULAR_STRENGTH  0.5
@@ -75,21 +76,12 @@ uniform vec3 light_color;
 uniform vec3 light_pos;
 uniform vec3 view_pos;
 
-uniform sampler2D texture0;
-uniform sampler2D texture1;
-uniform sampler2D texture2;
-uniform sampler2D texture3;
-uniform sampler2D texture4;
-uniform sampler2D texture5;
-uniform sampler2D texture6;
-uniform sampler2D texture7;
-uniform sampler2D texture8;
-uniform sampler2D texture9;
-uniform sampler2D texture10;
-uniform sampler2D texture11;
-uniform sampler2D texture12;
-uniform sampler2D texture13;
-uniform sampler2D texture14;
+/* The material textures are grouped by size into array textures. Each 
+ * material's slot holds the index of its' array in bits 8 and up, and its' 
+ * layer in bits 0-7. It is negative for materials without a texture.
+ */
+uniform sampler2DArray material_arrs[MAX_MATERIAL_ARRS];
+uniform int            material_slots[MAX_MATERIALS];
 
 struct material{
     float ambient_intensity;
@@ -104,26 +96,25 @@ uniform bool skip_lighting = false;
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
-vec4 texture_val(int mat_idx, vec2 uv)
+vec4 material_texture(int mat_idx, vec2 uv)
 {
-    switch(mat_idx) {
-    case 0:  return texture2D(texture0,  uv);
-    case 1:  return texture2D(texture1,  uv);
-    case 2:  return texture2D(texture2,  uv);
-    case 3:  return texture2D(texture3,  uv);
-    case 4:  return texture2D(texture4,  uv);
-    case 5:  return texture2D(texture5,  uv);
-    case 6:  return texture2D(texture6,  uv);
-    case 7:  return texture2D(texture7,  uv);
-    case 8:  return texture2D(texture8,  uv);
-    case 9:  return texture2D(texture9,  uv);
-    case 10: return texture2D(texture10, uv);
-    case 11: return texture2D(texture11, uv);
-    case 12: return texture2D(texture12, uv);
-    case 13: return texture2D(texture13, uv);
-    case 14: return texture2D(texture14, uv);
-    default: return vec4(0.0);
+    int slot = material_slots[mat_idx];
+    vec3 coord = vec3(uv, slot & 0xff);
+
+    switch(slot >> 8) {
+    case 0: return texture(material_arrs[0], coord);
+    case 1: return texture(material_arrs[1], coord);
+    case 2: return texture(material_arrs[2], coord);
+    case 3: return texture(material_arrs[3], coord);
     }
+    return vec4(0.0);
+}
+
+vec4 texture_val(int mat_idx, vec2 uv)
+{
+    if(mat_idx >= MAX_MATERIALS)
+        return vec4(0.0);
+    return material_texture(mat_idx, uv);
 }
 
 vec4 mixed_texture_val(int adjacency_mats, vec2 uv)
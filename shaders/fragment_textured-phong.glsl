@@ -36,6 +36,7 @@
 #version 330 core
 
 #define MAX_MATERIALS 8
+#define MAX_MATERIAL_ARRS 4
 
 /* TODO: Make these as material parameters */
 #define SPECULAR_STRENGTH  0.5
@@ -67,21 +68,12 @@ uniform vec3 light_color;
 uniform vec3 light_pos;
 uniform vec3 view_pos;
 
-uniform sampler2D texture0;
-uniform sampler2D texture1;
-uniform sampler2D texture2;
-uniform sampler2D texture3;
-uniform sampler2D texture4;
-uniform sampler2D texture5;
-uniform sampler2D texture6;
-uniform sampler2D texture7;
-uniform sampler2D texture8;
-uniform sampler2D texture9;
-uniform sampler2D texture10;
-uniform sampler2D texture11;
-uniform sampler2D texture12;
-uniform sampler2D texture13;
-uniform sampler2D texture14;
+/* The material textures are grouped by size into array textures. Each 
+ * material's slot holds the index of its' array in bits 8 and up, and its' 
+ * layer in bits 0-7. It is negative for materials without a texture.
+ */
+uniform sampler2DArray material_arrs[MAX_MATERIAL_ARRS];
+uniform int            material_slots[MAX_MATERIALS];
 
 struct material{
     float ambient_intensity;
@@ -95,27 +87,25 @@ uniform material materials[MAX_MATERIALS];
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
+vec4 material_texture(int mat_idx, vec2 uv)
+{
+    int slot = material_slots[mat_idx];
+    vec3 coord = vec3(uv, slot & 0xff);
+
+    switch(slot >> 8) {
+    case 0: return texture(material_arrs[0], coord);
+    case 1: return texture(material_arrs[1], coord);
+    case 2: return texture(material_arrs[2], coord);
+    case 3: return texture(material_arrs[3], coord);
+    }
+    return vec4(0.0);
+}
+
 void main()
 {
     vec4 tex_color;
 
-    switch(from_vertex.mat_idx) {
-    case 0:  tex_color = texture(texture0,  from_vertex.uv); break;
-    case 1:  tex_color = texture(texture1,  from_vertex.uv); break;
-    case 2:  tex_color = texture(texture2,  from_vertex.uv); break;
-    case 3:  tex_color = texture(texture3,  from_vertex.uv); break;
-    case 4:  tex_color = texture(texture4,  from_vertex.uv); break;
-    case 5:  tex_color = texture(texture5,  from_vertex.uv); break;
-    case 6:  tex_color = texture(texture6,  from_vertex.uv); break;
-    case 7:  tex_color = texture(texture7,  from_vertex.uv); break;
-    case 8:  tex_color = texture(texture8,  from_vertex.uv); break;
-    case 9:  tex_color = texture(texture9,  from_vertex.uv); break;
-    case 10: tex_color = texture(texture10, from_vertex.uv); break;
-    case 11: tex_color = texture(texture11, from_vertex.uv); break;
-    case 12: tex_color = texture(texture12, from_vertex.uv); break;
-    case 13: tex_color = texture(texture13, from_vertex.uv); break;
-    case 14: tex_color = texture(texture14, from_vertex.uv); break;
-    }
+    tex_color = material_texture(from_vertex.mat_idx, from_vertex.uv);
 
     /* Simple alpha test to reject transparent pixels */
     if(tex_color.a== 0.0)
@@ -0,0 +1,161 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+layout (location = 0)  in vec3   in_pos;
+layout (location = 1)  in vec2   in_uv;
+layout (location = 2)  in vec3   in_normal;
+layout (location = 3)  in int    in_material_idx;
+layout (location = 4)  in mat2x3 in_joint_indices; /* 2x3 mat to alias array of 6 floats */
+layout (location = 6)  in mat2x3 in_joint_weights; /* 2x3 mat to alias array of 6 floats */
+/* Per-instance attributes */
+layout (location = 8)  in mat4   in_inst_model;    /* Takes up locations 8-11 */
+layout (location = 12) in vec3   in_inst_anim;     /* (current sample, next sample, fraction) */
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+}to_fragment;
+
+out VertexToGeo {
+    vec3 normal;
+}to_geometry;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 view;
+uniform mat4 projection;
+
+/* Skinning transforms of every joint for every sample of every animation clip 
+ * of the model. Each row holds one sample, with 3 texels per joint: the 
+ * rotation quaternion, the translation and the scale.
+ */
+uniform sampler2D anim_palette;
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+vec4 anim_sample_texel(int sample, int joint, int field)
+{
+    return texelFetch(anim_palette, ivec2(joint * 3 + field, sample), 0);
+}
+
+/* Blend the two samples as a transform rather than as a matrix, so that the 
+ * result stays a rotation. Lerping matrices component-wise shears and 
+ * shrinks the mesh between keys that rotate a joint. 
+ */
+mat4 anim_skin_mat(int joint)
+{
+    int curr = int(in_inst_anim.x);
+    int next = int(in_inst_anim.y);
+    float frac = in_inst_anim.z;
+
+    vec4 q0 = anim_sample_texel(curr, joint, 0);
+    vec4 q1 = anim_sample_texel(next, joint, 0);
+    if(dot(q0, q1) < 0.0)
+        q1 = -q1;
+    vec4 q = normalize(mix(q0, q1, frac));
+
+    vec3 t = mix(anim_sample_texel(curr, joint, 1).xyz, anim_sample_texel(next, joint, 1).xyz, frac);
+    vec3 s = mix(anim_sample_texel(curr, joint, 2).xyz, anim_sample_texel(next, joint, 2).xyz, frac);
+
+    /* Same layout as 'PFM_Mat4x4_RotFromQuat' */
+    mat3 rot = mat3(
+        1.0 - 2.0*q.y*q.y - 2.0*q.z*q.z, 2.0*q.x*q.y - 2.0*q.w*q.z,       2.0*q.x*q.z + 2.0*q.w*q.y,
+        2.0*q.x*q.y + 2.0*q.w*q.z,       1.0 - 2.0*q.x*q.x - 2.0*q.z*q.z, 2.0*q.y*q.z - 2.0*q.w*q.x,
+        2.0*q.x*q.z - 2.0*q.w*q.y,       2.0*q.y*q.z + 2.0*q.w*q.x,       1.0 - 2.0*q.x*q.x - 2.0*q.y*q.y
+    );
+
+    return mat4(
+        vec4(rot[0] * s.x, 0.0),
+        vec4(rot[1] * s.y, 0.0),
+        vec4(rot[2] * s.z, 0.0),
+        vec4(t, 1.0)
+    );
+}
+
+void main()
+{
+    to_fragment.uv = in_uv;
+    to_fragment.mat_idx = in_material_idx;
+
+    mat4 model = in_inst_model;
+    mat3 normal_matrix = mat3(model);
+
+    float tot_weight = in_joint_weights[0][0] + in_joint_weights[0][1] + in_joint_weights[0][2]
+                     + in_joint_weights[1][0] + in_joint_weights[1][1] + in_joint_weights[1][2];
+
+    vec3 new_pos = in_pos;
+    vec3 new_normal = in_normal;
+
+    /* If all weights are 0, treat this vertex as a static one.
+     * Non-animated vertices will have their weights explicitly zeroed out. 
+     */
+    if(tot_weight > 0.0) {
+
+        new_pos = vec3(0.0, 0.0, 0.0);
+        new_normal = vec3(0.0, 0.0, 0.0);
+
+        for(int w_idx = 0; w_idx < 6; w_idx++) {
+
+            int r = w_idx / 3;
+            int c = w_idx % 3;
+
+            int joint_idx = int(in_joint_indices[r][c]);
+            float fraction = in_joint_weights[r][c] / tot_weight;
+
+            mat4 bone_mat = fraction * anim_skin_mat(joint_idx);
+            
+            new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
+            new_normal += mat3(bone_mat) * in_normal;
+        }
+    }
+
+    to_geometry.normal = normalize(mat3(view) * normal_matrix * new_normal);
+    to_fragment.normal = normalize(normal_matrix * new_normal);
+    to_fragment.world_pos = (model * vec4(new_pos, 1.0)).xyz;
+
+    gl_Position = projection * view * model * vec4(new_pos, 1.0f);
+}
@@ -36,6 +36,7 @@
 #version 330 core
 
 #define MAX_JOINTS 96
+#define NUM_SHADOW_CASCADES 3
 
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
@@ -53,7 +54,7 @@ out VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
-         vec4 light_space_pos;
+         vec4 light_space_pos[NUM_SHADOW_CASCADES];
 }to_fragment;
 
 out VertexToGeo {
@@ -67,7 +68,7 @@ out VertexToGeo {
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 light_space_transform;
+uniform mat4 light_space_transforms[NUM_SHADOW_CASCADES];
 
 uniform mat4 anim_curr_pose_mats[MAX_JOINTS];
 uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
@@ -98,7 +99,9 @@ void main()
 
         to_fragment.normal = normalize(normal_matrix * in_normal);
         to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
-        to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
+        for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+            to_fragment.light_space_pos[i] = light_space_transforms[i] * vec4(to_fragment.world_pos, 1.0);
+        }
 
         gl_Position = projection * view * model * vec4(in_pos, 1.0);
 
@@ -131,7 +134,9 @@ void main()
 
         to_fragment.normal = normalize(normal_matrix * new_normal);
         to_fragment.world_pos = (model * vec4(new_pos, 1.0)).xyz;
-        to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
+        for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+            to_fragment.light_space_pos[i] = light_space_transforms[i] * vec4(to_fragment.world_pos, 1.0);
+        }
 
         gl_Position = projection * view * model * vec4(new_pos, 1.0f);
 
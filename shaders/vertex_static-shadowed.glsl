@@ -35,6 +35,8 @@
 
 #version 330 core
 
+#define NUM_SHADOW_CASCADES 3
+
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
 layout (location = 2) in vec3 in_normal;
@@ -49,7 +51,7 @@ out VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
-         vec4 light_space_pos;
+         vec4 light_space_pos[NUM_SHADOW_CASCADES];
 }to_fragment;
 
 out VertexToGeo {
@@ -63,7 +65,7 @@ out VertexToGeo {
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 light_space_transform;
+uniform mat4 light_space_transforms[NUM_SHADOW_CASCADES];
 
 /*****************************************************************************/
 /* PROGRAM
@@ -75,7 +77,9 @@ void main()
     to_fragment.mat_idx = in_material_idx;
     to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
     to_fragment.normal = normalize(mat3(model) * in_normal);
-    to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+        to_fragment.light_space_pos[i] = light_space_transforms[i] * vec4(to_fragment.world_pos, 1.0);
+    }
 
     to_geometry.normal = normalize(mat3(projection * view * model) * in_normal);
 
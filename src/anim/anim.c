@@ -40,23 +40,44 @@
 #include "../entity.h"
 #include "../event.h"
 #include "../render/public/render.h"
+#include "../asset_load.h"
+#include "../config.h"
 
 #include <SDL.h>
 
 #include <string.h>
 #include <assert.h>
 
+#if defined(__SSE__)
+    #include <xmmintrin.h>
+#endif
+
+
+/* Below this fraction of the way to the next keyframe, the current keyframe 
+ * is used as-is. */
+#define ANIM_INTERP_EPSILON (1.0f / 256.0f)
+
+/* The record written by 'A_SaveCtx'. Clips are referred to by name. */
+struct anim_ctx_rec{
+    char     idle[ANIM_NAME_LEN];
+    char     active[ANIM_NAME_LEN];
+    uint32_t mode;
+    uint32_t key_fps;
+    uint32_t curr_frame;
+    uint32_t curr_frame_elapsed_ms;
+};
+
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static const struct anim_clip *a_clip_for_name(const struct entity *ent, const char *name)
+static struct anim_clip *a_clip_for_name(const struct entity *ent, const char *name)
 {
     struct anim_data *priv = ent->anim_private;
     for(int i = 0; i < priv->num_anims; i++) {
 
-        const struct anim_clip *curr = &priv->anims[i];
+        struct anim_clip *curr = &priv->anims[i];
         if(!strcmp(curr->name, name)) 
             return curr;
     }
@@ -64,6 +85,77 @@ static const struct anim_clip *a_clip_for_name(const struct entity *ent, const c
     return NULL;
 }
 
+/* Makes sure the clip's samples are in memory before it gets played, reading
+ * them on this thread if necessary. The first time around, they are also 
+ * baked into the model's animation texture. */
+static bool a_load_clip(const struct entity *ent, struct anim_clip *clip)
+{
+    struct anim_data *priv = ent->anim_private;
+    if(clip->state == CLIP_LOADED)
+        return true;
+
+    if(!A_LoadClip(priv, clip))
+        return false;
+
+    A_UpdateAnimTex(priv, ent->render_private, clip);
+    return true;
+}
+
+/* Has the clip's samples read on a loader thread, unless they are already in 
+ * memory or on their' way. If the job can't be queued, they are read right
+ * away. Returns false if the samples could not be read. */
+static bool a_queue_clip(const struct entity *ent, struct anim_clip *clip)
+{
+    struct anim_data *priv = ent->anim_private;
+
+    switch(clip->state) {
+    case CLIP_LOADED:
+    case CLIP_LOADING:
+        return true;
+    case CLIP_FAILED:
+        return false;
+    case CLIP_UNLOADED:
+        break;
+    }
+
+    if(!AL_QueueClipLoad(priv, ent->render_private, clip - priv->anims))
+        return a_load_clip(ent, clip);
+
+    clip->state = CLIP_LOADING;
+    return true;
+}
+
+static void a_play_clip(struct anim_ctx *ctx, const struct anim_clip *clip, 
+                        enum anim_mode mode, unsigned key_fps)
+{
+    ctx->active = clip;
+    ctx->mode = mode;
+    ctx->key_fps = key_fps;
+    ctx->curr_frame = 0;
+    ctx->curr_frame_start_ticks = SDL_GetTicks();
+    ctx->curr_frame_carry_ms = 0.0f;
+    ctx->pending = NULL;
+}
+
+/* Starts playing the pending clip once its' samples have been read */
+static void a_start_pending(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    if(!ctx->pending)
+        return;
+
+    switch(ctx->pending->state) {
+    case CLIP_LOADED:
+        a_play_clip(ctx, ctx->pending, ctx->pending_mode, ctx->pending_key_fps);
+        break;
+    case CLIP_FAILED:
+        ctx->pending = NULL;
+        break;
+    default:
+        break;
+    }
+}
+
 static void a_mat_from_sqt(const struct SQT *sqt, mat4x4_t *out)
 {
     mat4x4_t rot, trans, scale;
@@ -105,12 +197,9 @@ static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t
     *out = bind_trans;
 }
 
-static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+static void a_make_pose_mat(const struct SQT *local_poses, int joint_idx, 
+                            const struct skeleton *skel, mat4x4_t *out)
 {
-    struct anim_data *priv = ent->anim_private;
-    struct anim_ctx *ctx = ent->anim_ctx;
-    struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
-
     mat4x4_t pose_trans;
     PFM_Mat4x4_Identity(&pose_trans);
 
@@ -118,7 +207,7 @@ static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struc
     while(joint_idx >= 0) {
 
         struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
+        const struct SQT *pose_sqt = &local_poses[joint_idx];
         mat4x4_t to_parent, to_curr = pose_trans;
 
         a_mat_from_sqt(pose_sqt, &to_parent);
@@ -130,18 +219,191 @@ static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struc
     *out = pose_trans;
 }
 
+/* Builds the pose matrices of all the joints at once. Every joint's matrix is 
+ * its' parent's matrix times its' own local transform, so each parent is only 
+ * computed once instead of once per descendant. */
+static void a_make_pose_mats_rec(const struct SQT *local_poses, int joint_idx, 
+                                 const struct skeleton *skel, bool *done, mat4x4_t *out)
+{
+    if(done[joint_idx])
+        return;
+
+    mat4x4_t to_parent;
+    a_mat_from_sqt(&local_poses[joint_idx], &to_parent);
+
+    int parent_idx = skel->joints[joint_idx].parent_idx;
+    if(parent_idx >= 0) {
+        a_make_pose_mats_rec(local_poses, parent_idx, skel, done, out);
+        PFM_Mat4x4_Mult4x4(&out[parent_idx], &to_parent, &out[joint_idx]);
+    }else{
+        out[joint_idx] = to_parent;
+    }
+    done[joint_idx] = true;
+}
+
+static void a_make_pose_mats(const struct SQT *local_poses, const struct skeleton *skel, 
+                             mat4x4_t *out)
+{
+    bool done[skel->num_joints];
+    memset(done, 0, sizeof(done));
+
+    for(int j = 0; j < skel->num_joints; j++) {
+        a_make_pose_mats_rec(local_poses, j, skel, done, out);
+    }
+}
+
+static void a_lerp_vec3(const vec3_t *a, const vec3_t *b, float t, vec3_t *out)
+{
+    out->x = a->x + t * (b->x - a->x);
+    out->y = a->y + t * (b->y - a->y);
+    out->z = a->z + t * (b->z - a->z);
+}
+
+/* Blends 'count' pairs of joint transforms: scale and translation are linearly 
+ * interpolated and the rotations are normalized-lerped along the shorter arc. 
+ * Adjacent keyframes are close enough that nlerp's non-constant angular velocity 
+ * is not noticeable, and it is much cheaper than slerp. When SSE is available, 
+ * the quaternions are processed 4 joints at a time in SoA form. 
+ */
+static void a_interp_sqts(const struct SQT *a, const struct SQT *b, float t, 
+                          size_t count, struct SQT *out)
+{
+    size_t i = 0;
+
+    for(size_t j = 0; j < count; j++) {
+        a_lerp_vec3(&a[j].scale, &b[j].scale, t, &out[j].scale);
+        a_lerp_vec3(&a[j].trans, &b[j].trans, t, &out[j].trans);
+    }
+
+#if defined(__SSE__)
+    const __m128 vt = _mm_set1_ps(t);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+    for(; i + 4 <= count; i += 4) {
+
+        __m128 ax = _mm_loadu_ps(a[i + 0].quat_rotation.raw);
+        __m128 ay = _mm_loadu_ps(a[i + 1].quat_rotation.raw);
+        __m128 az = _mm_loadu_ps(a[i + 2].quat_rotation.raw);
+        __m128 aw = _mm_loadu_ps(a[i + 3].quat_rotation.raw);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+
+        __m128 bx = _mm_loadu_ps(b[i + 0].quat_rotation.raw);
+        __m128 by = _mm_loadu_ps(b[i + 1].quat_rotation.raw);
+        __m128 bz = _mm_loadu_ps(b[i + 2].quat_rotation.raw);
+        __m128 bw = _mm_loadu_ps(b[i + 3].quat_rotation.raw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        /* Flip the sign of 'b' wherever the dot product is negative so that 
+         * we always interpolate along the shorter arc. */
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                                _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        __m128 sign = _mm_and_ps(dot, sign_mask);
+        bx = _mm_xor_ps(bx, sign);
+        by = _mm_xor_ps(by, sign);
+        bz = _mm_xor_ps(bz, sign);
+        bw = _mm_xor_ps(bw, sign);
+
+        __m128 rx = _mm_add_ps(ax, _mm_mul_ps(vt, _mm_sub_ps(bx, ax)));
+        __m128 ry = _mm_add_ps(ay, _mm_mul_ps(vt, _mm_sub_ps(by, ay)));
+        __m128 rz = _mm_add_ps(az, _mm_mul_ps(vt, _mm_sub_ps(bz, az)));
+        __m128 rw = _mm_add_ps(aw, _mm_mul_ps(vt, _mm_sub_ps(bw, aw)));
+
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+                                 _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+        __m128 inv_len = _mm_div_ps(one, _mm_sqrt_ps(len2));
+        rx = _mm_mul_ps(rx, inv_len);
+        ry = _mm_mul_ps(ry, inv_len);
+        rz = _mm_mul_ps(rz, inv_len);
+        rw = _mm_mul_ps(rw, inv_len);
+
+        _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+        _mm_storeu_ps(out[i + 0].quat_rotation.raw, rx);
+        _mm_storeu_ps(out[i + 1].quat_rotation.raw, ry);
+        _mm_storeu_ps(out[i + 2].quat_rotation.raw, rz);
+        _mm_storeu_ps(out[i + 3].quat_rotation.raw, rw);
+    }
+#endif
+
+    for(; i < count; i++) {
+
+        const quat_t *qa = &a[i].quat_rotation;
+        const quat_t *qb = &b[i].quat_rotation;
+        quat_t *qo = &out[i].quat_rotation;
+
+        float dot = qa->x * qb->x + qa->y * qb->y + qa->z * qb->z + qa->w * qb->w;
+        float sign = dot < 0.0f ? -1.0f : 1.0f;
+
+        for(int c = 0; c < 4; c++)
+            qo->raw[c] = qa->raw[c] + t * (sign * qb->raw[c] - qa->raw[c]);
+
+        float len = sqrtf(qo->x * qo->x + qo->y * qo->y + qo->z * qo->z + qo->w * qo->w);
+        for(int c = 0; c < 4; c++)
+            qo->raw[c] /= len;
+    }
+}
+
+static float a_curr_frame_elapsed_ms(const struct anim_ctx *ctx, uint32_t curr_ticks)
+{
+    return (curr_ticks - ctx->curr_frame_start_ticks) + ctx->curr_frame_carry_ms;
+}
+
+/* Returns the fraction of the way that the current frame is to the next one,
+ * in the range of [0, 1], and the index of the next frame. When the next frame 
+ * is due but 'A_Tick' has not advanced to it yet, the pose is held at the next
+ * frame rather than snapping back to the current one. */
+static float a_curr_frame_fraction(const struct anim_ctx *ctx, int *out_next)
+{
+    *out_next = (ctx->curr_frame + 1) % ctx->active->num_frames;
+
+#if CONFIG_ANIM_INTERPOLATE
+    /* Clips that are played once go back to the idle clip afterwards, so
+     * don't blend the last frame back into the first one. */
+    if(ctx->mode == ANIM_MODE_ONCE && *out_next == 0)
+        return 0.0f;
+
+    float frame_period_ms = 1000.0f/ctx->key_fps;
+    float ret = a_curr_frame_elapsed_ms(ctx, SDL_GetTicks()) / frame_period_ms;
+    return ret < 1.0f ? ret : 1.0f;
+#else
+    return 0.0f;
+#endif
+}
+
 void a_set_uniforms_curr_frame(const struct entity *ent)
 {
     struct anim_data *priv = (struct anim_data*)ent->anim_private;
+    struct anim_ctx *ctx = ent->anim_ctx;
+    const struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
 
-    size_t float_per_mat = sizeof(mat4x4_t) / sizeof(float);
     size_t num_joints = priv->skel.num_joints;
 
-    mat4x4_t curr_pose_mats[num_joints];
-    for(int j = 0; j < num_joints; j++) {
-        a_make_pose_mat(ent, j, &priv->skel, &curr_pose_mats[j]);
+    int next_frame;
+    float t = a_curr_frame_fraction(ctx, &next_frame);
+
+    /* With a baked palette, the pose matrices for this frame are already
+     * sitting in memory and can be uploaded as-is. In between keyframes, the
+     * matrices are rebuilt from the blended SQTs: lerping the matrices 
+     * directly does not preserve the rotations and would shear the limbs. */
+    if(sample->pose_mats && t < ANIM_INTERP_EPSILON) {
+        R_GL_SetAnimUniforms(priv->skel.inv_bind_poses, sample->pose_mats, num_joints);
+        return;
     }
 
+    const struct SQT *local_poses = sample->local_joint_poses;
+    struct SQT interp_poses[num_joints];
+
+    if(t >= ANIM_INTERP_EPSILON) {
+
+        const struct anim_sample *next = &ctx->active->samples[next_frame];
+        a_interp_sqts(sample->local_joint_poses, next->local_joint_poses, t, 
+            num_joints, interp_poses);
+        local_poses = interp_poses;
+    }
+
+    mat4x4_t curr_pose_mats[num_joints];
+    a_make_pose_mats(local_poses, &priv->skel, curr_pose_mats);
+
     R_GL_SetAnimUniforms(priv->skel.inv_bind_poses, curr_pose_mats, num_joints);
 }
 
@@ -150,49 +412,71 @@ void a_set_uniforms_curr_frame(const struct entity *ent)
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void A_InitCtx(const struct entity *ent, const char *idle_clip, unsigned key_fps)
+bool A_InitCtx(const struct entity *ent, const char *idle_clip, unsigned key_fps)
 {
-    struct anim_data *priv = ent->anim_private;
     struct anim_ctx *ctx = ent->anim_ctx;
 
-    const struct anim_clip *idle = a_clip_for_name(ent, idle_clip);
-    assert(idle);
+    struct anim_clip *idle = a_clip_for_name(ent, idle_clip);
+    if(!idle || !a_load_clip(ent, idle))
+        return false;
 
     ctx->idle = idle;
-    A_SetActiveClip(ent, idle_clip, ANIM_MODE_LOOP, key_fps);
+    a_play_clip(ctx, idle, ANIM_MODE_LOOP, key_fps);
+    return true;
 }
 
-void A_SetActiveClip(const struct entity *ent, const char *name, 
+bool A_SetActiveClip(const struct entity *ent, const char *name, 
                      enum anim_mode mode, unsigned key_fps)
 {
-    struct anim_data *priv = ent->anim_private;
     struct anim_ctx *ctx = ent->anim_ctx;
 
-    const struct anim_clip *clip = a_clip_for_name(ent, name);
-    assert(clip);
+    struct anim_clip *clip = a_clip_for_name(ent, name);
+    if(!clip)
+        return false;
 
-    ctx->active = clip;
-    ctx->mode = mode;
-    ctx->key_fps = key_fps;
-    ctx->curr_frame = 0;
-    ctx->curr_frame_start_ticks = SDL_GetTicks();
+    /* Keep playing the current clip until the new one has been read */
+    if(!a_queue_clip(ent, clip))
+        return false;
+
+    if(clip->state != CLIP_LOADED) {
+
+        ctx->pending = clip;
+        ctx->pending_mode = mode;
+        ctx->pending_key_fps = key_fps;
+        return true;
+    }
+
+    a_play_clip(ctx, clip, mode, key_fps);
+    return true;
 }
 
 void A_Update(const struct entity *ent)
 {
-    struct anim_data *priv = ent->anim_private;
-    struct anim_ctx *ctx = ent->anim_ctx;
+    a_set_uniforms_curr_frame(ent);
+    A_Tick(ent);
+}
 
+void A_SetRenderState(const struct entity *ent)
+{
     a_set_uniforms_curr_frame(ent);
+}
 
-    float frame_period_secs = 1.0f/ctx->key_fps;
+void A_Tick(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    a_start_pending(ent);
+
+    float frame_period_ms = 1000.0f/ctx->key_fps;
     uint32_t curr_ticks = SDL_GetTicks();
-    float elapsed_secs = (curr_ticks - ctx->curr_frame_start_ticks)/1000.0f;
+    float elapsed_ms = a_curr_frame_elapsed_ms(ctx, curr_ticks);
 
-    if(elapsed_secs > frame_period_secs) {
+    /* The time past the end of the frame is kept, so that the clip plays at 
+     * 'key_fps' regardless of the frame rate. Several frames are stepped over 
+     * when the game falls behind. */
+    while(elapsed_ms >= frame_period_ms) {
 
+        elapsed_ms -= frame_period_ms;
         ctx->curr_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
-        ctx->curr_frame_start_ticks = curr_ticks;
 
         if(ctx->curr_frame == 0) {
             E_Entity_Notify(EVENT_ANIM_CYCLE_FINISHED, ent->uid, NULL, ES_ENGINE);
@@ -202,8 +486,23 @@ void A_Update(const struct entity *ent)
 
             E_Entity_Notify(EVENT_ANIM_FINISHED, ent->uid, NULL, ES_ENGINE);
             A_SetActiveClip(ent, ctx->idle->name, ANIM_MODE_LOOP, ctx->key_fps);
+            return;
         }
     }
+
+    uint32_t whole_ms = (uint32_t)elapsed_ms;
+    ctx->curr_frame_start_ticks = curr_ticks - whole_ms;
+    ctx->curr_frame_carry_ms = elapsed_ms - whole_ms;
+}
+
+void A_GetCurrSamples(const struct entity *ent, int *out_curr, int *out_next, float *out_frac)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+
+    int next_frame;
+    *out_frac = a_curr_frame_fraction(ctx, &next_frame);
+    *out_curr = ctx->active->first_sample + ctx->curr_frame;
+    *out_next = ctx->active->first_sample + next_frame;
 }
 
 const struct skeleton *A_GetBindSkeleton(const struct entity *ent)
@@ -252,7 +551,10 @@ const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent)
     
         /* Update the inverse bind matrices for the current frame */
         mat4x4_t pose_mat;
-        a_make_pose_mat(ent, i, ret, &pose_mat);
+        if(sample->pose_mats)
+            pose_mat = sample->pose_mats[i];
+        else
+            a_make_pose_mat(sample->local_joint_poses, i, ret, &pose_mat);
         PFM_Mat4x4_Inverse(&pose_mat, &ret->inv_bind_poses[i]);
     }
 
@@ -273,6 +575,17 @@ void A_PrepareInvBindMatrices(const struct skeleton *skel)
     }
 }
 
+void A_PrepareBakedPalettes(const struct skeleton *skel, const struct SQT *local_poses,
+                            size_t num_samples, mat4x4_t *out)
+{
+    for(int s = 0; s < num_samples; s++) {
+
+        const struct SQT *sample_poses = local_poses + s * skel->num_joints;
+        mat4x4_t *sample_mats = out + s * skel->num_joints;
+        a_make_pose_mats(sample_poses, skel, sample_mats);
+    }
+}
+
 const struct aabb *A_GetCurrPoseAABB(const struct entity *ent)
 {
     assert(ent->flags & ENTITY_FLAG_COLLISION);
@@ -282,3 +595,84 @@ const struct aabb *A_GetCurrPoseAABB(const struct entity *ent)
     return &ctx->active->samples[ctx->curr_frame].sample_aabb;
 }
 
+const struct aabb *A_GetCurrClipAABB(const struct entity *ent)
+{
+    assert(ent->flags & ENTITY_FLAG_COLLISION);
+    struct anim_ctx *ctx = ent->anim_ctx;
+
+    return &ctx->active->clip_aabb;
+}
+
+
+bool A_PrefetchClip(const struct entity *ent, const char *name)
+{
+    struct anim_clip *clip = a_clip_for_name(ent, name);
+    if(!clip)
+        return false;
+    return a_queue_clip(ent, clip);
+}
+
+const char *A_GetIdleClip(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    return ctx->idle->name;
+}
+
+bool A_SaveCtx(const struct entity *ent, SDL_RWops *stream)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+
+    struct anim_ctx_rec rec = {
+        .mode                  = ctx->mode,
+        .key_fps               = ctx->key_fps,
+        .curr_frame            = ctx->curr_frame,
+        .curr_frame_elapsed_ms = (uint32_t)a_curr_frame_elapsed_ms(ctx, SDL_GetTicks()),
+    };
+    strcpy(rec.idle, ctx->idle->name);
+    strcpy(rec.active, ctx->active->name);
+
+    /* A clip that is still being read is saved as having just started */
+    if(ctx->pending) {
+        rec.mode = ctx->pending_mode;
+        rec.key_fps = ctx->pending_key_fps;
+        rec.curr_frame = 0;
+        rec.curr_frame_elapsed_ms = 0;
+        strcpy(rec.active, ctx->pending->name);
+    }
+
+    return (SDL_RWwrite(stream, &rec, sizeof(rec), 1) == 1);
+}
+
+size_t A_CtxSaveSize(void)
+{
+    return sizeof(struct anim_ctx_rec);
+}
+
+bool A_LoadCtx(const struct entity *ent, SDL_RWops *stream)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+
+    struct anim_ctx_rec rec;
+    if(SDL_RWread(stream, &rec, sizeof(rec), 1) != 1)
+        return false;
+    rec.idle[ANIM_NAME_LEN-1] = '\0';
+    rec.active[ANIM_NAME_LEN-1] = '\0';
+
+    struct anim_clip *idle = a_clip_for_name(ent, rec.idle);
+    struct anim_clip *active = a_clip_for_name(ent, rec.active);
+    if(!idle || !active || rec.key_fps == 0 || rec.curr_frame >= active->num_frames)
+        return false;
+
+    if(!a_load_clip(ent, idle) || !a_load_clip(ent, active))
+        return false;
+
+    ctx->idle = idle;
+    ctx->active = active;
+    ctx->mode = rec.mode;
+    ctx->key_fps = rec.key_fps;
+    ctx->curr_frame = rec.curr_frame;
+    ctx->curr_frame_start_ticks = SDL_GetTicks() - rec.curr_frame_elapsed_ms;
+    ctx->curr_frame_carry_ms = 0.0f;
+    ctx->pending = NULL;
+    return true;
+}
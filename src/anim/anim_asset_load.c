@@ -39,51 +39,72 @@
 #include "anim_ctx.h"
 
 #include "../asset_load.h"
+#include "../config.h"
+#include "../render/public/render.h"
+
+#include <SDL.h>
 
 #define __USE_POSIX
 #include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../lib/public/khash.h"
+
+#define MIN(a, b)     ((a) < (b) ? (a) : (b))
+#define MAX(a, b)     ((a) > (b) ? (a) : (b))
+
+KHASH_MAP_INIT_INT64(clip_data, struct anim_clip_data*)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
 
+/* The loaded clip samples, keyed by a hash of their contents. The lock is 
+ * needed since clips may be loaded on the asset loader threads. */
+static SDL_mutex          *s_clip_data_lock;
+static khash_t(clip_data) *s_clip_data_table;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static bool al_read_vec3(const char **curr, vec3_t *out)
+{
+    return AL_ParseFloat(curr, &out->x) && AL_ParseLiteral(curr, "/")
+        && AL_ParseFloat(curr, &out->y) && AL_ParseLiteral(curr, "/")
+        && AL_ParseFloat(curr, &out->z);
+}
+
+static bool al_read_quat(const char **curr, quat_t *out)
+{
+    return AL_ParseFloat(curr, &out->x) && AL_ParseLiteral(curr, "/")
+        && AL_ParseFloat(curr, &out->y) && AL_ParseLiteral(curr, "/")
+        && AL_ParseFloat(curr, &out->z) && AL_ParseLiteral(curr, "/")
+        && AL_ParseFloat(curr, &out->w);
+}
+
 static bool al_read_joint(SDL_RWops *stream, struct joint *out, struct SQT *out_bind)
 {
     char line[MAX_LINE_LEN];
+    const char *curr;
     int unfixed_idx;
     
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "j %d %s", &unfixed_idx, out->name))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "j")
+    || !AL_ParseInt(&curr, &unfixed_idx)
+    || !AL_ParseWord(&curr, out->name, sizeof(out->name)))
         goto fail;
     /* Convert to a 0 base index system; the root's parent_idx will be -1 */
     out->parent_idx = unfixed_idx - 1;
 
-    char *string = line;
-    char *saveptr;
-
-    /* Consume the first 3 tokens, 'j', '<parent idx>', '<name>' */
-    strtok_r(line, " \t", &saveptr);
-    strtok_r(NULL, " \t", &saveptr);
-    strtok_r(NULL, " \t", &saveptr);
-
-    string = strtok_r(NULL, " \t", &saveptr);  
-    if(!sscanf(string, "%f/%f/%f", 
-        &out_bind->scale.x, &out_bind->scale.y, &out_bind->scale.z))
-        goto fail;
-
-    string = strtok_r(NULL, " \t", &saveptr);  
-    if(!sscanf(string, "%f/%f/%f/%f", &out_bind->quat_rotation.x, &out_bind->quat_rotation.y, 
-        &out_bind->quat_rotation.z, &out_bind->quat_rotation.w))
-        goto fail;
-
-    string = strtok_r(NULL, " \t", &saveptr);  
-    if(!sscanf(string, "%f/%f/%f", 
-        &out_bind->trans.x, &out_bind->trans.y, &out_bind->trans.z))
-        goto fail;
-
-    string = strtok_r(NULL, " \t", &saveptr);  
-    if(!sscanf(string, "%f/%f/%f", &out->tip.x, &out->tip.y, &out->tip.z))
+    if(!al_read_vec3(&curr, &out_bind->scale)
+    || !al_read_quat(&curr, &out_bind->quat_rotation)
+    || !al_read_vec3(&curr, &out_bind->trans)
+    || !al_read_vec3(&curr, &out->tip))
         goto fail;
 
     return true;
@@ -92,44 +113,63 @@ fail:
     return false;
 }
 
-static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out, 
-                              const struct pfobj_hdr *header)
+static void al_set_clip_aabb(struct anim_clip *out)
+{
+    if(out->num_frames == 0)
+        return;
+
+    out->clip_aabb = out->samples[0].sample_aabb;
+    for(int f = 1; f < out->num_frames; f++) {
+
+        const struct aabb *curr = &out->samples[f].sample_aabb;
+        out->clip_aabb.x_min = MIN(out->clip_aabb.x_min, curr->x_min);
+        out->clip_aabb.x_max = MAX(out->clip_aabb.x_max, curr->x_max);
+        out->clip_aabb.y_min = MIN(out->clip_aabb.y_min, curr->y_min);
+        out->clip_aabb.y_max = MAX(out->clip_aabb.y_max, curr->y_max);
+        out->clip_aabb.z_min = MIN(out->clip_aabb.z_min, curr->z_min);
+        out->clip_aabb.z_max = MAX(out->clip_aabb.z_max, curr->z_max);
+    }
+}
+
+/* Reads the lines of a clip's samples. The joint transforms are written to 
+ * 'out_poses' and the AABBs to 'out_samples'. Either one may be NULL, in which 
+ * case their lines are skipped without being parsed. */
+static bool al_read_clip_samples(SDL_RWops *stream, unsigned num_frames, size_t num_joints,
+                                 bool has_collision, struct SQT *out_poses, 
+                                 struct anim_sample *out_samples)
 {
     char line[MAX_LINE_LEN];
+    const char *curr;
 
-    READ_LINE(stream, line, fail);
-    if(!sscanf(line, "as %s %u", out->name, &out->num_frames))
-        goto fail;
+    for(int f = 0; f < num_frames; f++) {
+        for(int j = 0; j < num_joints; j++) {
 
-    for(int f = 0; f < out->num_frames; f++) {
-        for(int j = 0; j < header->num_joints; j++) {
+            READ_LINE(stream, line, fail);
+            if(!out_poses)
+                continue;
 
             int joint_idx;  /* unused */
-            struct SQT *curr_joint_trans = &out->samples[f].local_joint_poses[j];
-        
-            READ_LINE(stream, line, fail);
-            if(!sscanf(line, "%d %f/%f/%f %f/%f/%f/%f %f/%f/%f",
-                &joint_idx, 
-                &curr_joint_trans->scale.x,
-                &curr_joint_trans->scale.y,
-                &curr_joint_trans->scale.z,
-                &curr_joint_trans->quat_rotation.x,
-                &curr_joint_trans->quat_rotation.y,
-                &curr_joint_trans->quat_rotation.z,
-                &curr_joint_trans->quat_rotation.w,
-                &curr_joint_trans->trans.x,
-                &curr_joint_trans->trans.y,
-                &curr_joint_trans->trans.z)) {
+            struct SQT *curr_joint_trans = &out_poses[f * num_joints + j];
+
+            curr = line;
+            if(!AL_ParseInt(&curr, &joint_idx)
+            || !al_read_vec3(&curr, &curr_joint_trans->scale)
+            || !al_read_quat(&curr, &curr_joint_trans->quat_rotation)
+            || !al_read_vec3(&curr, &curr_joint_trans->trans)) {
                 goto fail;
             }
-        
         }
 
-        if(!header->has_collision)
+        if(!has_collision)
             continue;
 
-        if(!AL_ParseAABB(stream, &out->samples[f].sample_aabb))
-            goto fail;
+        if(out_samples) {
+            if(!AL_ParseAABB(stream, &out_samples[f].sample_aabb))
+                goto fail;
+        }else{
+            for(int i = 0; i < 3; i++)
+                READ_LINE(stream, line, fail);
+        }
     }
 
     return true;
@@ -138,42 +178,344 @@ fail:
     return false;
 }
 
-size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
+/* Reads the clip's name and the AABBs of its' samples, noting where in the 
+ * file its' samples are so that they can be read later. The joint transforms 
+ * are only parsed if 'out_poses' is not NULL. */
+static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out, 
+                              const struct pfobj_hdr *header, struct SQT *out_poses)
+{
+    char line[MAX_LINE_LEN];
+    const char *curr;
+    int num_frames;
+
+    READ_LINE(stream, line, fail);
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "as")
+    || !AL_ParseWord(&curr, out->name, sizeof(out->name))
+    || !AL_ParseInt(&curr, &num_frames))
+        goto fail;
+
+    /* The samples have been allocated according to the header */
+    if(num_frames != out->num_frames)
+        goto fail;
+
+    out->src_offset = SDL_RWtell(stream);
+    if(!al_read_clip_samples(stream, out->num_frames, header->num_joints, 
+                             header->has_collision, out_poses, out->samples))
+        goto fail;
+    out->src_size = SDL_RWtell(stream) - out->src_offset;
+
+    if(header->has_collision)
+        al_set_clip_aabb(out);
+
+    return true;
+
+fail:
+    return false;
+}
+
+static size_t al_num_samples(const struct pfobj_hdr *header)
+{
+    size_t ret = 0;
+    for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++)
+        ret += header->frame_counts[as_idx];
+    return ret;
+}
+
+static size_t al_palette_buffsize(const struct pfobj_hdr *header)
+{
+    return al_num_samples(header) * header->num_joints * sizeof(mat4x4_t);
+}
+
+/* With interpolation, the CPU skinning path only uses the baked palettes when 
+ * the current time falls right on a keyframe, which is next to never. They are
+ * then only worth their memory as the source of the animation texture. */
+static bool al_should_bake(const struct pfobj_hdr *header)
+{
+    if(header->num_as == 0)
+        return false;
+    if(CONFIG_ANIM_INTERPOLATE && !CONFIG_ANIM_GPU_INSTANCING)
+        return false;
+    return al_palette_buffsize(header) <= CONFIG_ANIM_BAKED_PALETTE_MAX_KB * 1024;
+}
+
+/* Divides up the buffer betwen data members and sets the counts and pointers */
+static void al_init_layout(struct anim_data *ret, const struct pfobj_hdr *header)
+{
+    char *unused_base = (char*)(ret + 1);
+
+    ret->num_anims = header->num_as; 
+    ret->baked = al_should_bake(header);
+    ret->has_collision = header->has_collision;
+    ret->skel.num_joints = header->num_joints;
+
+    ret->skel.bind_sqts = (void*)unused_base;
+    unused_base += sizeof(struct SQT) * header->num_joints;
+
+    ret->skel.inv_bind_poses = (void*)unused_base;
+    unused_base += sizeof(mat4x4_t) * header->num_joints;
+
+    ret->skel.joints = (void*)unused_base;
+    unused_base += sizeof(struct joint) * header->num_joints;
+
+    ret->anims = (void*)unused_base;
+    unused_base += sizeof(struct anim_clip) * header->num_as;
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].samples = (void*)unused_base;
+        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
+    }
+
+    unsigned first_sample = 0;
+    for(int i = 0; i < header->num_as; i++) {
+
+        struct anim_clip *clip = &ret->anims[i];
+        clip->skel = &ret->skel;
+        clip->num_frames = header->frame_counts[i];
+        clip->first_sample = first_sample;
+        clip->src_offset = 0;
+        clip->src_size = 0;
+        clip->state = CLIP_UNLOADED;
+        clip->data = NULL;
+        first_sample += header->frame_counts[i];
+
+        for(int f = 0; f < clip->num_frames; f++) {
+            clip->samples[f].local_joint_poses = NULL;
+            clip->samples[f].pose_mats = NULL;
+        }
+    }
+
+    ret->num_samples = first_sample;
+}
+
+static size_t al_data_buffsize(size_t num_joints, size_t num_as, size_t num_samples)
 {
     size_t ret = 0;
 
     ret += sizeof(struct anim_data);
 
-    ret += header->num_joints * sizeof(struct SQT);
-    ret += header->num_joints * sizeof(mat4x4_t);
-    ret += header->num_joints * sizeof(struct joint);
-    ret += header->num_as     * sizeof(struct anim_clip);
-
-    /*
-     * For each frame of each animation clip, we also require:
-     *
-     *    1. a 'struct anim_sample' (for referencing this frame's SQT array)
-     *    2. num_joint number of 'struct SQT's (each joint's transform
-     *       for the current frame)
-     */
-    for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
+    ret += num_joints  * sizeof(struct SQT);
+    ret += num_joints  * sizeof(mat4x4_t);
+    ret += num_joints  * sizeof(struct joint);
+    ret += num_as      * sizeof(struct anim_clip);
+    ret += num_samples * sizeof(struct anim_sample);
+
+    return ret;
+}
 
-        ret += header->frame_counts[as_idx] * 
-               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT));
+size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
+{
+    return al_data_buffsize(header->num_joints, header->num_as, al_num_samples(header));
+}
+
+static uint64_t al_hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
     }
+    return hash;
+}
+
+static bool al_clip_data_equal(const struct anim_clip_data *data, const struct skeleton *skel,
+                               unsigned num_frames, const struct SQT *poses)
+{
+    if(data->num_joints != skel->num_joints || data->num_frames != num_frames)
+        return false;
 
+    for(int j = 0; j < skel->num_joints; j++) {
+        if(data->parent_idxs[j] != skel->joints[j].parent_idx)
+            return false;
+    }
+
+    return !memcmp(data->local_joint_poses, poses, 
+        sizeof(struct SQT) * num_frames * skel->num_joints);
+}
+
+/* Returns the shared copy of the clip's samples. If there is none yet, 'poses' 
+ * becomes the shared copy. Either way, the ownership of 'poses' is taken. */
+static struct anim_clip_data *al_share_clip_data(const struct skeleton *skel, unsigned num_frames,
+                                                 struct SQT *poses, bool baked)
+{
+    size_t num_poses = num_frames * skel->num_joints;
+
+    /* The pose matrices of a clip depend on the joint hierarchy as well */
+    uint64_t hash = 14695981039346656037ull;
+    for(int j = 0; j < skel->num_joints; j++)
+        hash = al_hash_bytes(hash, &skel->joints[j].parent_idx, sizeof(skel->joints[j].parent_idx));
+    hash = al_hash_bytes(hash, poses, sizeof(struct SQT) * num_poses);
+
+    struct anim_clip_data *ret = NULL;
+    SDL_LockMutex(s_clip_data_lock);
+
+    khiter_t k = kh_get(clip_data, s_clip_data_table, hash);
+    struct anim_clip_data *head = (k != kh_end(s_clip_data_table)) ? kh_value(s_clip_data_table, k) 
+                                                                   : NULL;
+    for(ret = head; ret; ret = ret->next) {
+        if(al_clip_data_equal(ret, skel, num_frames, poses))
+            break;
+    }
+
+    if(ret) {
+
+        free(poses);
+        poses = NULL;
+    }else{
+
+        ret = malloc(sizeof(struct anim_clip_data) + sizeof(int) * skel->num_joints);
+        if(!ret)
+            goto out;
+
+        ret->hash = hash;
+        ret->owner = skel;
+        ret->num_joints = skel->num_joints;
+        ret->num_frames = num_frames;
+        ret->parent_idxs = (void*)(ret + 1);
+        ret->local_joint_poses = poses;
+        ret->pose_mats = NULL;
+        ret->next = head;
+
+        for(int j = 0; j < skel->num_joints; j++)
+            ret->parent_idxs[j] = skel->joints[j].parent_idx;
+
+        int put_ret;
+        k = kh_put(clip_data, s_clip_data_table, hash, &put_ret);
+        if(put_ret < 0) {
+            free(ret);
+            ret = NULL;
+            goto out;
+        }
+        kh_value(s_clip_data_table, k) = ret;
+        poses = NULL;
+    }
+
+    /* The model that loaded the samples first may not have baked its' palettes.
+     * If the matrices can't be allocated, the poses are built every frame. */
+    if(baked && !ret->pose_mats) {
+
+        mat4x4_t *pose_mats = malloc(sizeof(mat4x4_t) * num_poses);
+        if(pose_mats) {
+            A_PrepareBakedPalettes(skel, ret->local_joint_poses, num_frames, pose_mats);
+            ret->pose_mats = pose_mats;
+        }
+    }
+
+out:
+    SDL_UnlockMutex(s_clip_data_lock);
+    free(poses);
     return ret;
 }
 
+static bool al_stat_source(const char *path, int64_t *out_size, int64_t *out_mtime)
+{
+    struct stat st;
+    if(stat(path, &st) < 0)
+        return false;
+
+    *out_size = st.st_size;
+    *out_mtime = st.st_mtime;
+    return true;
+}
+
+/* Points the clip's samples at the loaded joint transforms. Must be called
+ * from the main thread. */
+static void al_set_clip_data(const struct anim_data *priv, struct anim_clip *clip, 
+                             struct anim_clip_data *data)
+{
+    size_t num_joints = priv->skel.num_joints;
+    for(int f = 0; f < clip->num_frames; f++) {
+
+        clip->samples[f].local_joint_poses = data->local_joint_poses + f * num_joints;
+        clip->samples[f].pose_mats = (priv->baked && data->pose_mats) ? data->pose_mats + f * num_joints
+                                                                      : NULL;
+    }
+
+    clip->data = data;
+    clip->state = CLIP_LOADED;
+}
+
+/* Takes the ownership of 'poses' */
+static bool al_set_clip_poses(const struct anim_data *priv, struct anim_clip *clip, struct SQT *poses)
+{
+    struct anim_clip_data *data = al_share_clip_data(&priv->skel, clip->num_frames, poses, priv->baked);
+    if(!data)
+        return false;
+
+    al_set_clip_data(priv, clip, data);
+    return true;
+}
+
+static struct SQT *al_alloc_poses(const struct anim_data *priv, const struct anim_clip *clip)
+{
+    /* Zero the memory, so that the samples can be compared byte-for-byte */
+    return calloc(MAX(clip->num_frames * priv->skel.num_joints, 1), sizeof(struct SQT));
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
+bool A_AL_Init(void)
+{
+    s_clip_data_table = kh_init(clip_data);
+    if(!s_clip_data_table)
+        goto fail_table;
+
+    s_clip_data_lock = SDL_CreateMutex();
+    if(!s_clip_data_lock)
+        goto fail_lock;
+
+    return true;
+
+fail_lock:
+    kh_destroy(clip_data, s_clip_data_table);
+    s_clip_data_table = NULL;
+fail_table:
+    return false;
+}
+
+void A_AL_Shutdown(void)
+{
+    /* The shared clip samples are still referenced by the models, which
+     * are never freed, so only the lock is torn down. */
+    SDL_DestroyMutex(s_clip_data_lock);
+    s_clip_data_lock = NULL;
+}
+
 size_t A_AL_CtxBuffSize(void)
 {
     return sizeof(struct anim_ctx);
 }
 
+size_t A_AL_MemUsage(const void *priv_data)
+{
+    const struct anim_data *priv = priv_data;
+    size_t ret = al_data_buffsize(priv->skel.num_joints, priv->num_anims, priv->num_samples);
+
+    for(int i = 0; i < priv->num_anims; i++) {
+
+        const struct anim_clip_data *data = priv->anims[i].data;
+        if(!data || data->owner != &priv->skel)
+            continue;
+
+        /* Identical clips of the same model share the samples as well */
+        bool seen = false;
+        for(int j = 0; j < i && !seen; j++)
+            seen = (priv->anims[j].data == data);
+        if(seen)
+            continue;
+
+        size_t num_poses = data->num_frames * data->num_joints;
+        ret += sizeof(struct anim_clip_data) + sizeof(int) * data->num_joints;
+        ret += num_poses * sizeof(struct SQT);
+        if(data->pose_mats)
+            ret += num_poses * sizeof(mat4x4_t);
+    }
+    return ret;
+}
+
 /*
  * Animation data buff layout:
  *
@@ -191,73 +533,127 @@ size_t A_AL_CtxBuffSize(void)
  *  | struct anim_samples[num_as      |
  *  |    * num_frames]                |
  *  +---------------------------------+
- *  | struct SQT[num_as * num_joints] |
- *  |    (stored in clip-major order) |
- *  +---------------------------------+
  *
+ * The joint transforms and the baked palettes of each clip are allocated 
+ * separately when the clip is loaded (see 'struct anim_clip_data').
  */
 
-void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
+void *A_AL_PrivFromStream(const char *path, const struct pfobj_hdr *header, SDL_RWops *stream)
 {
+    if(strlen(path) >= ANIM_PATH_LEN)
+        goto fail_alloc;
+
     struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
     if(!ret)
         goto fail_alloc;
 
-    /*-----------------------------------------------------------
-     * First divide up the buffer betwen data members,
-     * set counts and pointers 
-     *-----------------------------------------------------------
+    al_init_layout(ret, header);
+    strcpy(ret->path, path);
+    ret->binary = false;
+
+    if(!al_stat_source(path, &ret->src_size, &ret->src_mtime))
+        goto fail_parse;
+
+    /*---------------------------------------------------------------
+     * Then we populate priv members with the file data 
+     *---------------------------------------------------------------
      */
+    for(int i = 0; i < header->num_joints; i++) {
 
-    char *unused_base = (char*)(ret + 1);
+        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
+            goto fail_parse;
+    }
 
-    ret->num_anims = header->num_as; 
-    ret->skel.num_joints = header->num_joints;
+    for(int i = 0; i < header->num_as; i++) {
 
-    ret->skel.bind_sqts = (void*)unused_base;
-    unused_base += sizeof(struct SQT) * header->num_joints;
+        struct anim_clip *clip = &ret->anims[i];
+        struct SQT *poses = NULL;
 
-    ret->skel.inv_bind_poses = (void*)unused_base;
-    unused_base += sizeof(mat4x4_t) * header->num_joints;
+        if(!CONFIG_ANIM_LAZY_CLIPS && !(poses = al_alloc_poses(ret, clip)))
+            goto fail_parse;
+        
+        if(!al_read_anim_clip(stream, clip, header, poses)) {
+            free(poses);
+            goto fail_parse;
+        }
 
-    ret->skel.joints = (void*)unused_base;
-    unused_base += sizeof(struct joint) * header->num_joints;
+        if(poses && !al_set_clip_poses(ret, clip, poses))
+            goto fail_parse;
+    }
 
-    ret->anims = (void*)unused_base;
-    unused_base += sizeof(struct anim_clip) * header->num_as;
+    A_PrepareInvBindMatrices(&ret->skel);
+    return ret;
 
-    for(int i = 0; i < header->num_as; i++) {
+fail_parse:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
 
-        ret->anims[i].samples = (void*)unused_base;
-        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
-    }
+void *A_AL_PrivFromBin(const char *path, const struct pfobj_hdr *header, const struct pfobj_bin *bin)
+{
+    if(bin->hdr->joint_size != sizeof(struct joint)
+    || bin->hdr->sqt_size != sizeof(struct SQT))
+        goto fail_layout;
 
-    for(int i = 0; i < header->num_as; i++) {
+    if(strlen(path) >= ANIM_PATH_LEN)
+        goto fail_layout;
+
+    struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
+    if(!ret)
+        goto fail_alloc;
 
-        ret->anims[i].skel = &ret->skel;
-        ret->anims[i].num_frames = header->frame_counts[i];
+    al_init_layout(ret, header);
+    strcpy(ret->path, path);
+    ret->binary = true;
 
-        for(int f = 0; f < header->frame_counts[i]; f++) {
+    if(!al_stat_source(path, &ret->src_size, &ret->src_mtime))
+        goto fail_parse;
 
-            ret->anims[i].samples[f].local_joint_poses = (void*)unused_base;
-            unused_base += sizeof(struct SQT) * header->num_joints;
-        }
-    }
+    memcpy(ret->skel.joints, bin->sections[PFOBJB_JOINTS], 
+        sizeof(struct joint) * header->num_joints);
+    memcpy(ret->skel.bind_sqts, bin->sections[PFOBJB_BIND_POSES], 
+        sizeof(struct SQT) * header->num_joints);
 
-    /*---------------------------------------------------------------
-     * Then we populate priv members with the file data 
-     *---------------------------------------------------------------
-     */
     for(int i = 0; i < header->num_joints; i++) {
-
-        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
+        if(!memchr(ret->skel.joints[i].name, '\0', sizeof(ret->skel.joints[i].name)))
             goto fail_parse;
     }
 
+    const char (*names)[PFOBJB_NAME_LEN] = bin->sections[PFOBJB_CLIP_NAMES];
+    const struct aabb *sample_aabbs = bin->sections[PFOBJB_SAMPLE_AABBS];
+    const struct SQT *samples = bin->sections[PFOBJB_SAMPLES];
+
     for(int i = 0; i < header->num_as; i++) {
-        
-        if(!al_read_anim_clip(stream, &ret->anims[i], header))
+
+        struct anim_clip *clip = &ret->anims[i];
+        if(!memchr(names[i], '\0', sizeof(clip->name)))
             goto fail_parse;
+        strcpy(clip->name, names[i]);
+
+        /* The samples of all the clips are laid out back-to-back, in clip-major order */
+        size_t num_poses = clip->num_frames * header->num_joints;
+        clip->src_offset = bin->hdr->section_offsets[PFOBJB_SAMPLES] 
+                         + clip->first_sample * header->num_joints * sizeof(struct SQT);
+        clip->src_size = num_poses * sizeof(struct SQT);
+
+        if(!CONFIG_ANIM_LAZY_CLIPS) {
+
+            struct SQT *poses = al_alloc_poses(ret, clip);
+            if(!poses)
+                goto fail_parse;
+
+            memcpy(poses, samples + clip->first_sample * header->num_joints, clip->src_size);
+            if(!al_set_clip_poses(ret, clip, poses))
+                goto fail_parse;
+        }
+
+        if(!header->has_collision)
+            continue;
+
+        for(int f = 0; f < clip->num_frames; f++)
+            clip->samples[f].sample_aabb = sample_aabbs[clip->first_sample + f];
+        al_set_clip_aabb(clip);
     }
 
     A_PrepareInvBindMatrices(&ret->skel);
@@ -266,51 +662,176 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
 fail_parse:
     free(ret);
 fail_alloc:
+fail_layout:
     return NULL;
 }
 
-void A_AL_DumpPrivate(FILE *stream, void *priv_data)
+/* Reads the clip's samples from the model file and returns the shared copy 
+ * of them. Neither the model nor the clip are modified, so this can run on
+ * a loader thread. */
+static struct anim_clip_data *al_read_clip(const struct anim_data *data, const struct anim_clip *clip)
 {
-    struct anim_data *priv = priv_data;
+    char *buff = NULL;
+    SDL_RWops *file = NULL;
+
+    /* The byte range of the clip is only valid for the file the model was loaded from */
+    int64_t src_size, src_mtime;
+    if(!al_stat_source(data->path, &src_size, &src_mtime)
+    || src_size != data->src_size || src_mtime != data->src_mtime) {
+        fprintf(stderr, "Animation clip source has changed since it was loaded: %s\n", data->path);
+        return NULL;
+    }
 
-    /* Write joints */
-    for(int i = 0; i < priv->skel.num_joints; i++) {
+    struct SQT *poses = al_alloc_poses(data, clip);
+    if(!poses)
+        goto fail;
 
-        struct joint *j = &priv->skel.joints[i];
-        struct SQT *bind = &priv->skel.bind_sqts[i];
+    file = SDL_RWFromFile(data->path, "rb");
+    if(!file)
+        goto fail;
+
+    if(SDL_RWseek(file, clip->src_offset, RW_SEEK_SET) < 0)
+        goto fail;
 
-        float roll, pitch, yaw;
-        PFM_Quat_ToEuler(&bind->quat_rotation, &roll, &pitch, &yaw);
+    if(data->binary) {
 
-        fprintf(stream, "j %d %s ", j->parent_idx + 1, j->name); 
-        fprintf(stream, "%.6f/%.6f/%.6f %.6f/%.6f/%.6f %.6f/%.6f/%.6f %.6f/%.6f/%.6f\n",
-            bind->scale.x, bind->scale.y, bind->scale.z, 
-            roll,          pitch,         yaw,
-            bind->trans.x, bind->trans.y, bind->trans.z,
-            j->tip.x,      j->tip.y,      j->tip.z);
+        if(clip->src_size != clip->num_frames * data->skel.num_joints * sizeof(struct SQT))
+            goto fail;
+        if(clip->src_size > 0 && SDL_RWread(file, poses, clip->src_size, 1) != 1)
+            goto fail;
+    }else{
+
+        buff = malloc(clip->src_size);
+        if(!buff)
+            goto fail;
+        if(SDL_RWread(file, buff, clip->src_size, 1) != 1)
+            goto fail;
+
+        SDL_RWops *stream = SDL_RWFromConstMem(buff, clip->src_size);
+        if(!stream)
+            goto fail;
+
+        bool ok = al_read_clip_samples(stream, clip->num_frames, data->skel.num_joints, 
+                                       data->has_collision, poses, NULL);
+        SDL_RWclose(stream);
+        if(!ok)
+            goto fail;
     }
 
-    /* Write animation sets */
-    for(int i = 0; i < priv->num_anims; i++) {
+    SDL_RWclose(file);
+    free(buff);
 
-        struct anim_clip *ac = &priv->anims[i];
-        fprintf(stream, "as %s %d\n", ac->name, ac->num_frames); 
+    struct anim_clip_data *ret = al_share_clip_data(&data->skel, clip->num_frames, poses, data->baked);
+    if(!ret)
+        fprintf(stderr, "Failed to load animation clip '%s' of: %s\n", clip->name, data->path);
+    return ret;
 
-        for(int f = 0; f < ac->num_frames; f++) {
-            for(int j = 0; j < ac->skel->num_joints; j++) {
+fail:
+    fprintf(stderr, "Failed to load animation clip '%s' of: %s\n", clip->name, data->path);
+    if(file)
+        SDL_RWclose(file);
+    free(buff);
+    free(poses);
+    return NULL;
+}
 
-                struct SQT *sqt = &ac->samples[f].local_joint_poses[j]; 
+bool A_LoadClip(const struct anim_data *data, struct anim_clip *clip)
+{
+    if(clip->state == CLIP_LOADED)
+        return true;
+    if(clip->state == CLIP_FAILED)
+        return false;
+
+    /* If the clip is also queued to be read on a loader thread, the samples
+     * read there will be the same shared copy and are simply dropped. */
+    struct anim_clip_data *clip_data = al_read_clip(data, clip);
+    if(!clip_data) {
+        clip->state = CLIP_FAILED;
+        return false;
+    }
 
-                float roll, pitch, yaw;
-                PFM_Quat_ToEuler(&sqt->quat_rotation, &roll, &pitch, &yaw);
+    al_set_clip_data(data, clip, clip_data);
+    return true;
+}
 
-                fprintf(stream, "\t%d %f/%f/%f %f/%f/%f %f/%f/%f\n",
-                    j + 1,
-                    sqt->scale.x, sqt->scale.y, sqt->scale.z,
-                    roll,         pitch,        yaw,
-                    sqt->trans.x, sqt->trans.y, sqt->trans.z);
-            }
-        }
-    } 
+void A_UpdateAnimTex(const struct anim_data *data, void *render_private, 
+                     const struct anim_clip *clip)
+{
+    if(!clip->data || !clip->samples[0].pose_mats || !R_GL_HasAnimTex(render_private))
+        return;
+
+    R_GL_AnimTexUpdate(render_private, data->skel.inv_bind_poses, clip->samples[0].pose_mats, 
+        data->skel.num_joints, clip->first_sample, clip->num_frames);
+}
+
+void *A_AL_ReadClip(const void *priv_data, int clip_idx)
+{
+    const struct anim_data *priv = priv_data;
+    assert(clip_idx >= 0 && clip_idx < priv->num_anims);
+    return al_read_clip(priv, &priv->anims[clip_idx]);
+}
+
+void A_AL_FinishClipLoad(void *priv_data, void *render_private, int clip_idx, void *clip_data)
+{
+    struct anim_data *priv = priv_data;
+    assert(clip_idx >= 0 && clip_idx < priv->num_anims);
+    struct anim_clip *clip = &priv->anims[clip_idx];
+
+    /* The clip may have been loaded synchronously in the meantime */
+    if(clip->state != CLIP_LOADING)
+        return;
+
+    if(!clip_data) {
+        clip->state = CLIP_FAILED;
+        return;
+    }
+
+    al_set_clip_data(priv, clip, clip_data);
+    A_UpdateAnimTex(priv, render_private, clip);
+}
+
+bool A_AL_InitAnimTex(const void *priv_data, void *render_private)
+{
+    const struct anim_data *priv = priv_data;
+    if(!priv->baked)
+        return false;
+
+    if(!R_GL_AnimTexInit(render_private, priv->skel.num_joints, priv->num_samples))
+        return false;
+
+    /* The rest of the clips are uploaded as they get loaded */
+    for(int i = 0; i < priv->num_anims; i++) {
+
+        const struct anim_clip *clip = &priv->anims[i];
+        if(!clip->data || !clip->samples[0].pose_mats)
+            continue;
+
+        R_GL_AnimTexUpdate(render_private, priv->skel.inv_bind_poses, clip->samples[0].pose_mats,
+            priv->skel.num_joints, clip->first_sample, clip->num_frames);
+    }
+    return true;
 }
 
+void A_AL_DumpMemReport(FILE *stream, const char *name, const void *priv_data)
+{
+    const struct anim_data *priv = priv_data;
+
+    unsigned num_loaded = 0;
+    size_t num_samples = 0;
+
+    for(int i = 0; i < priv->num_anims; i++) {
+
+        if(!priv->anims[i].data)
+            continue;
+        num_loaded++;
+        num_samples += priv->anims[i].num_frames;
+    }
+
+    size_t sqt_bytes = num_samples * priv->skel.num_joints * sizeof(struct SQT);
+    size_t palette_bytes = priv->baked ? num_samples * priv->skel.num_joints * sizeof(mat4x4_t) : 0;
+
+    fprintf(stream, "[ANIM] %-32s joints: %3zu clips: %2u/%2u samples: %5zu/%5zu "
+        "SQT: %8.1f kB palettes: %8.1f kB (%s)\n",
+        name, priv->skel.num_joints, num_loaded, priv->num_anims, num_samples, priv->num_samples,
+        sqt_bytes / 1024.0f, palette_bytes / 1024.0f, priv->baked ? "baked" : "not baked");
+}
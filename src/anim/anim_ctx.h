@@ -45,6 +45,15 @@ struct anim_ctx{
     unsigned                key_fps;
     int                     curr_frame;
     uint32_t                curr_frame_start_ticks;
+    /* The current frame started this many milliseconds (less than one) before
+     * 'curr_frame_start_ticks'. Frames are only whole multiples of the frame 
+     * period apart, so the fraction is carried over from one to the next. */
+    float                   curr_frame_carry_ms;
+    /* The clip that was made active while its' samples were still being 
+     * read. It starts playing once they are in memory. */
+    const struct anim_clip *pending;
+    enum anim_mode          pending_mode;
+    unsigned                pending_key_fps;
 };
 
 #endif
@@ -41,25 +41,84 @@
 #include "../collision.h"
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #define ANIM_NAME_LEN  32
+#define ANIM_PATH_LEN  512
+
+/* The joint transforms of every sample of a clip. These are shared between 
+ * all the clips with the same transforms on the same joint hierarchy, which 
+ * is the case for models that reuse a rig. They are never freed. */
+struct anim_clip_data{
+    uint64_t               hash;
+    /* The skeleton of the model that read the samples first. The memory of
+     * the samples (and of the baked palettes, even if they are added later 
+     * for another model) is charged to this model only. */
+    const struct skeleton *owner;
+    size_t                 num_joints;
+    unsigned               num_frames;
+    int                   *parent_idxs;       /* [num_joints] */
+    struct SQT            *local_joint_poses; /* [num_frames * num_joints] */
+    /* The object-space pose matrices for every sample, in the same order as
+     * 'local_joint_poses'. Only computed for the models that bake their 
+     * palettes. */
+    mat4x4_t              *pose_mats;
+    struct anim_clip_data *next;              /* with the same hash */
+};
+
+/* Whether the samples of a clip are in memory. Only accessed from the main 
+ * thread: the loader threads just read the samples and hand them over. */
+enum clip_state{
+    CLIP_UNLOADED,
+    CLIP_LOADING,  /* queued to be read on a loader thread */
+    CLIP_LOADED,
+    CLIP_FAILED,   /* the samples could not be read; they are not retried */
+};
 
 struct anim_sample{
+    /* These are NULL until the clip is loaded */
     struct SQT  *local_joint_poses;
+    /* When the palette for the clip is baked, this holds the final 
+     * object-space pose matrix of every joint for this sample. Otherwise,
+     * it is NULL and the matrices are built from 'local_joint_poses' 
+     * every frame. */
+    mat4x4_t    *pose_mats;
     struct aabb  sample_aabb;
 };
 
 struct anim_clip{
-    char                name[ANIM_NAME_LEN];
-    struct skeleton    *skel;
-    unsigned            num_frames;
-    struct anim_sample *samples;
+    char                   name[ANIM_NAME_LEN];
+    struct skeleton       *skel;
+    unsigned               num_frames;
+    /* Index of this clip's first sample among the samples of all the 
+     * clips of the model, in clip-major order. */
+    unsigned               first_sample;
+    struct anim_sample    *samples;
+    /* The union of the AABBs of all the clip's samples. */
+    struct aabb            clip_aabb;
+    /* The samples are read from this byte range of the model file the first 
+     * time that the clip is used. Until then, 'data' is NULL. */
+    size_t                 src_offset;
+    size_t                 src_size;
+    enum clip_state        state;
+    struct anim_clip_data *data;
 };
 
 struct anim_data{
     unsigned          num_anims;
+    bool              baked;
     struct skeleton   skel;
     struct anim_clip *anims;
+    size_t            num_samples;
+    /* The model file that the clips are loaded from. Its' size and 
+     * modification time when the model was loaded are kept so that a file 
+     * which has since been replaced is not read from. */
+    char              path[ANIM_PATH_LEN];
+    int64_t           src_size;
+    int64_t           src_mtime;
+    bool              binary;
+    bool              has_collision;
 };
 
 #endif
@@ -36,7 +36,15 @@
 #ifndef ANIM_PRIVATE_H
 #define ANIM_PRIVATE_H
 
+#include "../pf_math.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
 struct skeleton;
+struct SQT;
+struct anim_data;
+struct anim_clip;
 
 /* Computes the inverse bind matrix for each joint based on the 
  * joint's bind SQT. The inverse bind matrix will be used by the vertex
@@ -48,4 +56,24 @@ struct skeleton;
  */
 void A_PrepareInvBindMatrices(const struct skeleton *skel);
 
+/* Computes the object-space pose matrix of every joint for 'num_samples' 
+ * samples of local joint transforms, writing 'skel->num_joints' matrices per 
+ * sample to 'out'. Afterwards, setting the skinning uniforms for a frame 
+ * requires no matrix math at all.
+ */
+void A_PrepareBakedPalettes(const struct skeleton *skel, const struct SQT *local_poses,
+                            size_t num_samples, mat4x4_t *out);
+
+/* Reads the samples of the clip from the model file, unless they have been 
+ * loaded already. The samples are shared with any other model that has
+ * loaded the same ones. Once reading a clip fails, it is not retried.
+ */
+bool A_LoadClip(const struct anim_data *data, struct anim_clip *clip);
+
+/* Fills in the clip's samples in the model's animation texture, if the model 
+ * has one and the clip is loaded. 
+ */
+void A_UpdateAnimTex(const struct anim_data *data, void *render_private, 
+                     const struct anim_clip *clip);
+
 #endif
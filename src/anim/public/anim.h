@@ -42,7 +42,10 @@
 
 #include <SDL.h> /* for SDL_RWops */
 
+#include "../../pf_math.h"
+
 struct pfobj_hdr;
+struct pfobj_bin;
 struct entity;
 struct skeleton;
 
@@ -61,19 +64,25 @@ enum anim_mode{
  * play when no other animation clips are active.
  *
  * Note that 'key_fps' is the number of key frames to cycle through each
- * second, not the frame rendering rate.
+ * second, not the frame rendering rate. Returns false if the model has no 
+ * such clip or its' samples could not be read.
  * ---------------------------------------------------------------------------
  */
-void                   A_InitCtx(const struct entity *ent, const char *idle_clip, 
+bool                   A_InitCtx(const struct entity *ent, const char *idle_clip, 
                                  unsigned key_fps);
 
 /* ---------------------------------------------------------------------------
  * If anim_mode is 'ANIM_MODE_ONCE', the entity will fire an 'EVENT_ANIM_FINISHED'
  * event and go back to playing the 'idle' animtion once the clip has played once. 
  * Otherwise, it will keep looping the clip.
+ *
+ * If the clip's samples are not in memory yet, they are read on a loader 
+ * thread and the current clip keeps playing until they are. Returns false if 
+ * the model has no such clip or its' samples could not be read, in which case 
+ * the current clip keeps playing.
  * ---------------------------------------------------------------------------
  */
-void                   A_SetActiveClip(const struct entity *ent, const char *name, 
+bool                   A_SetActiveClip(const struct entity *ent, const char *name, 
                                        enum anim_mode mode, unsigned key_fps);
 
 /* ---------------------------------------------------------------------------
@@ -83,6 +92,33 @@ void                   A_SetActiveClip(const struct entity *ent, const char *nam
  */
 void                   A_Update(const struct entity *ent);
 
+/* ---------------------------------------------------------------------------
+ * Advances the animation context of the entity based on the current time,
+ * without touching any OpenGL state. This is to be used instead of 'A_Update'
+ * for entities which are drawn in more than one pass, or which are rendered 
+ * using their model's animation texture.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_Tick(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * Updates the OpenGL state for the current point of the active clip, without
+ * advancing the animation context. This is to be used instead of 'A_Update'
+ * when the entity is drawn in several passes of a frame, with the context 
+ * having been advanced once with 'A_Tick' beforehand.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_SetRenderState(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * Returns the indices of the current and next samples of the active clip among
+ * all the baked samples of the entity's model (see 'A_AL_InitAnimTex'),
+ * as well as the fraction of the way from the current to the next sample.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_GetCurrSamples(const struct entity *ent, int *out_curr, 
+                                        int *out_next, float *out_frac);
+
 /* ---------------------------------------------------------------------------
  * Simple utility to get a reference to the skeleton structure in its' default
  * bind pose. The skeleton structure shoould not be modified or freed.
@@ -108,11 +144,65 @@ const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent);
  */
 const struct aabb     *A_GetCurrPoseAABB(const struct entity *ent);
 
+/* ---------------------------------------------------------------------------
+ * Returns a pointer to an AABB enclosing every sample of the active clip. 
+ * Unlike the AABB of the current sample, this only changes when a different
+ * clip is made active. This should only be called for entities with the 
+ * COLLISION flag set.
+ * ---------------------------------------------------------------------------
+ */
+const struct aabb     *A_GetCurrClipAABB(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * Clips are read from the model file the first time that they are played. 
+ * This queues the named clip to be read on a loader thread ahead of time, so 
+ * that it can start right away when it is played. Returns false if the model 
+ * has no such clip or it could not be read before.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_PrefetchClip(const struct entity *ent, const char *name);
+
+/* ---------------------------------------------------------------------------
+ * Returns the name of the clip that plays when no other clip is active.
+ * ---------------------------------------------------------------------------
+ */
+const char            *A_GetIdleClip(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * Writes the animation context of the entity (the idle and active clips and 
+ * how far into the active clip playback is) to the stream.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_SaveCtx(const struct entity *ent, SDL_RWops *stream);
+
+/* ---------------------------------------------------------------------------
+ * Returns the number of bytes that 'A_SaveCtx' writes. It is the same for 
+ * every entity.
+ * ---------------------------------------------------------------------------
+ */
+size_t                 A_CtxSaveSize(void);
+
+/* ---------------------------------------------------------------------------
+ * Restores an animation context written by 'A_SaveCtx'. This may be used in 
+ * place of 'A_InitCtx'. Playback resumes from the saved position. Returns 
+ * false if the entity's model does not have the saved clips.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_LoadCtx(const struct entity *ent, SDL_RWops *stream);
+
 
 /*###########################################################################*/
 /* ANIM ASSET LOADING                                                        */
 /*###########################################################################*/
 
+/* ---------------------------------------------------------------------------
+ * Sets up the table of clip samples that are shared between models. Must be
+ * called before any model is loaded.
+ * ---------------------------------------------------------------------------
+ */
+bool   A_AL_Init(void);
+void   A_AL_Shutdown(void);
+
 /* ---------------------------------------------------------------------------
  * Returns the size (in bytes) that is required to store private animation 
  * context for a single entity.
@@ -120,17 +210,71 @@ const struct aabb     *A_GetCurrPoseAABB(const struct entity *ent);
  */
 size_t A_AL_CtxBuffSize(void);
 
+/* ---------------------------------------------------------------------------
+ * Returns the number of bytes taken up by the private animation data of a 
+ * model: the skeleton and the joint transforms and baked palettes of the 
+ * clips that have been loaded so far. Samples that are shared with other 
+ * models are only counted for the model that read them first, so that the 
+ * usage of all the models can be summed.
+ * ---------------------------------------------------------------------------
+ */
+size_t A_AL_MemUsage(const void *priv_data);
+
 /* ---------------------------------------------------------------------------
  * Consumes lines of the stream and uses them to populate the private data, 
- * which is then returned in a malloc'd buffer.
+ * which is then returned in a malloc'd buffer. Only the skeleton and the 
+ * bounding boxes of the clips are kept: the joint transforms of each clip are
+ * read again from 'path' when the clip is first used (unless 
+ * CONFIG_ANIM_LAZY_CLIPS is off).
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromStream(const char *path, const struct pfobj_hdr *header, 
+                           SDL_RWops *stream);
+
+/* ---------------------------------------------------------------------------
+ * The same as 'A_AL_PrivFromStream', but copies the joints from the sections 
+ * of a binary PFOBJ file, which is at 'path'. Returns NULL if the file was 
+ * written for a different joint or SQT layout.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromBin(const char *path, const struct pfobj_hdr *header, 
+                        const struct pfobj_bin *bin);
+
+/* ---------------------------------------------------------------------------
+ * Reads the samples of the model's clip at 'clip_idx' from the model file. 
+ * The model is not modified, so this may be called from a loader thread. 
+ * Returns the samples to be passed to 'A_AL_FinishClipLoad', or NULL if they 
+ * could not be read.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_ReadClip(const void *priv_data, int clip_idx);
+
+/* ---------------------------------------------------------------------------
+ * Hands the samples returned by 'A_AL_ReadClip' (which may be NULL) over to 
+ * the clip and fills them in in the model's animation texture. Must be 
+ * called from the main thread.
+ * ---------------------------------------------------------------------------
+ */
+void   A_AL_FinishClipLoad(void *priv_data, void *render_private, int clip_idx, 
+                           void *clip_data);
+
+/* ---------------------------------------------------------------------------
+ * If the model's pose palettes are baked, creates the model's animation 
+ * texture, with room for every sample of every clip (in clip-major order), 
+ * and fills in the samples of the clips loaded so far. The rest are filled 
+ * in as the clips get loaded. Returns false if the palettes are not baked or 
+ * the texture could not be created.
  * ---------------------------------------------------------------------------
  */
-void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream);
+bool   A_AL_InitAnimTex(const void *priv_data, void *render_private);
 
 /* ---------------------------------------------------------------------------
- * Dumps private animation data in PF Object format.
+ * Writes a one-line summary of the memory taken up by the model's animation 
+ * data: the number of clips loaded so far, the size of their local joint 
+ * transforms and the size of their baked pose palettes (allocated only when 
+ * the model's palettes are baked).
  * ---------------------------------------------------------------------------
  */
-void   A_AL_DumpPrivate(FILE *stream, void *priv_data);
+void   A_AL_DumpMemReport(FILE *stream, const char *name, const void *priv_data);
 
 #endif
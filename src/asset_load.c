@@ -35,14 +35,18 @@
 
 #include "asset_load.h"
 #include "entity.h"
+#include "config.h"
 
 #include "render/public/render.h"
 #include "anim/public/anim.h"
 #include "map/public/map.h"
+#include "anim/public/skeleton.h"
+#include "render/vertex.h"
 #ifndef __USE_POSIX
     #define __USE_POSIX /* strtok_r */
 #endif
 #include "lib/public/khash.h"
+#include "lib/public/strintern.h"
 
 #include <SDL.h>
 
@@ -51,87 +55,149 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h> 
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
+#define MAX_LOAD_WORKERS 8
+#define INIT_NUM_RES     64
+#define MIN(a, b)        ((a) < (b) ? (a) : (b))
 
 struct shared_resource{
-    char         key[64];
     uint32_t     ent_flags;
     void        *render_private;
     void        *anim_private;
     struct aabb  aabb;
+    struct asset_stats stats;
+};
+
+enum load_job_state{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+};
+
+/* A model that is being loaded in the background. The file is read and parsed 
+ * into CPU-side data by a worker thread. Afterwards, the main thread creates the 
+ * GL state for it and adds it to the shared resources. */
+struct load_job{
+    char                 key[64];
+    char                 base_path[512];
+    enum load_job_state  state;
+    struct pfobj_hdr     header;
+    void                *render_parsed;
+    void                *anim_private;
+    struct aabb          aabb;
+    bool                 binary;
+    float                parse_ms;
+    struct load_job     *next_queued;
+};
+
+/* The samples of an animation clip of a loaded model, which are being read in 
+ * the background (see 'A_AL_ReadClip'). Clip jobs are only picked up when 
+ * there are no models waiting to be loaded. */
+struct clip_job{
+    void                *anim_private;
+    void                *render_private;
+    int                  clip_idx;
+    enum load_job_state  state;
+    void                *clip_data;
+    struct clip_job     *next_queued;
+    struct clip_job     *next_pending;
 };
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-KHASH_MAP_INIT_STR(entity_res, struct shared_resource)
-khash_t(entity_res) *s_name_resource_table;
+/* The shared resources are indexed by the handle of their' PFOBJ name */
+static strintern_t            *s_res_names;
+static struct shared_resource *s_resources;
+static size_t                  s_resources_cap;
+
+/* The jobs that have not been finalized yet, keyed by the PFOBJ name. This is 
+ * only accessed from the main thread. */
+KHASH_MAP_INIT_STR(load_job, struct load_job*)
+static khash_t(load_job) *s_name_job_table;
+
+/* The clip jobs that have not been finalized yet. This is only accessed from 
+ * the main thread. */
+static struct clip_job   *s_pending_clips = NULL;
+
+/* The queues and the job states are protected by 's_job_lock' */
+static struct load_job   *s_queue_head = NULL;
+static struct load_job   *s_queue_tail = NULL;
+static struct clip_job   *s_clip_queue_head = NULL;
+static struct clip_job   *s_clip_queue_tail = NULL;
+static SDL_mutex         *s_job_lock;
+static SDL_cond          *s_job_queued;
+static SDL_cond          *s_job_done;
+static bool               s_workers_quit = false;
+static SDL_Thread        *s_workers[MAX_LOAD_WORKERS];
+static int                s_num_workers = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-/* A copy of the key string is stored in the 'struct shared_resource' itself. Make the key 
- * (string pointer) be a pointer to that buffer in order to avoid allocating/storing the key 
- * strings separately. All keys must be patched in case rehashing took place. */
-static void kh_update_str_keys(khash_t(entity_res) *table)
-{
-    for(khiter_t k = kh_begin(table); k != kh_end(table); k++) {
-        if(!kh_exist(table, k)) continue;
-        kh_key(table, k) = kh_value(table, k).key;
-    }
-}
-
 static bool al_parse_pfobj_header(SDL_RWops *stream, struct pfobj_hdr *out)
 {
     char line[MAX_LINE_LEN];
+    const char *curr;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "version %f", &out->version))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "version") || !AL_ParseFloat(&curr, &out->version))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_verts %d", &out->num_verts))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_verts") || !AL_ParseInt(&curr, (int*)&out->num_verts))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_joints %d", &out->num_joints))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_joints") || !AL_ParseInt(&curr, (int*)&out->num_joints))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_materials %d", &out->num_materials))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_materials") || !AL_ParseInt(&curr, (int*)&out->num_materials))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_as %d", &out->num_as))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_as") || !AL_ParseInt(&curr, (int*)&out->num_as))
         goto fail;
 
     if(out->num_as > MAX_ANIM_SETS)
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!(strstr(line, "frame_counts")))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "frame_counts"))
         goto fail;
 
-    char *string = line;
-    char *saveptr;
-
-    /* Consume the first token, the property name 'frame_counts' */
-    string = strtok_r(line, " \t", &saveptr);
     for(int i = 0; i < out->num_as; i++) {
 
-        string = strtok_r(NULL, " \t", &saveptr);
-        if(!string)
-            goto fail;
-
-        if(!sscanf(string, "%d", &out->frame_counts[i]))
+        if(!AL_ParseInt(&curr, (int*)&out->frame_counts[i]))
             goto fail;
     }
 
     int tmp;
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "has_collision %d", &tmp))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "has_collision") || !AL_ParseInt(&curr, &tmp))
         goto fail;
     out->has_collision = tmp;
 
@@ -141,20 +207,531 @@ fail:
     return false;
 }
 
+static const char *al_skip_space(const char *str)
+{
+    while(*str && isspace(*str))
+        str++;
+    return str;
+}
+
+static int al_mem_close(SDL_RWops *context)
+{
+    free(context->hidden.mem.base);
+    SDL_FreeRW(context);
+    return 0;
+}
+
+static bool al_map_file(const char *path, void **out, size_t *out_size)
+{
+#if defined(_WIN32)
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *ret = malloc(size);
+    if(!ret || size <= 0 || fread(ret, 1, size, file) != size) {
+        free(ret);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *ret = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(ret == MAP_FAILED)
+        return false;
+#endif
+    *out = ret;
+    *out_size = size;
+    return true;
+}
+
+static void al_unmap_file(void *buff, size_t size)
+{
+#if defined(_WIN32)
+    free(buff);
+#else
+    munmap(buff, size);
+#endif
+}
+
+static float al_elapsed_ms(uint64_t start)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+/* Sets 'out' to the size of 'count' elements, failing when they could not 
+ * possibly fit in a file of 'size' bytes. */
+static bool al_section_size(uint64_t count, uint64_t elem_size, size_t size, uint64_t *out)
+{
+    if(elem_size > 0 && count > size / elem_size)
+        return false;
+    *out = count * elem_size;
+    return true;
+}
+
+/* Checks that the header is sane and that all the sections are within the 
+ * file, and sets up the section pointers. */
+static bool al_pfobjb_open(const void *buff, size_t size, struct pfobj_bin *out)
+{
+    const struct pfobjb_hdr *hdr = buff;
+
+    if(size < sizeof(struct pfobjb_hdr))
+        return false;
+    if(hdr->magic != PFOBJB_MAGIC || hdr->version != PFOBJB_VERSION)
+        return false;
+    if(hdr->num_as > MAX_ANIM_SETS)
+        return false;
+
+    /* The sections are the engine's structures as-is. A file written for 
+     * different ones is rejected before any sizes are derived from it. */
+    if(hdr->vertex_size != sizeof(struct vertex)
+    || hdr->joint_size != sizeof(struct joint)
+    || hdr->sqt_size != sizeof(struct SQT))
+        return false;
+
+    uint64_t num_frames = 0;
+    for(int i = 0; i < hdr->num_as; i++)
+        num_frames += hdr->frame_counts[i];
+
+    /* Every count is bounded by the file size as the sizes are computed, so 
+     * none of the products can overflow. */
+    uint64_t section_sizes[PFOBJB_NUM_SECTIONS] = {0};
+    if(!al_section_size(hdr->num_verts, sizeof(struct vertex), size, &section_sizes[PFOBJB_VERTS])
+    || !al_section_size(hdr->num_materials, sizeof(struct pfobjb_material), size, &section_sizes[PFOBJB_MATERIALS])
+    || !al_section_size(hdr->num_joints, sizeof(struct joint), size, &section_sizes[PFOBJB_JOINTS])
+    || !al_section_size(hdr->num_joints, sizeof(struct SQT), size, &section_sizes[PFOBJB_BIND_POSES])
+    || !al_section_size(hdr->num_as, PFOBJB_NAME_LEN, size, &section_sizes[PFOBJB_CLIP_NAMES])
+    || !al_section_size(num_frames, section_sizes[PFOBJB_BIND_POSES], size, &section_sizes[PFOBJB_SAMPLES]))
+        return false;
+
+    if(hdr->has_collision) {
+        if(!al_section_size(num_frames, sizeof(struct aabb), size, &section_sizes[PFOBJB_SAMPLE_AABBS]))
+            return false;
+        section_sizes[PFOBJB_AABB] = sizeof(struct aabb);
+    }
+
+    for(int i = 0; i < PFOBJB_NUM_SECTIONS; i++) {
+
+        uint32_t off = hdr->section_offsets[i];
+        if(off % PFOBJB_ALIGN || off < sizeof(struct pfobjb_hdr))
+            return false;
+        if(off + section_sizes[i] > size)
+            return false;
+        out->sections[i] = (const char*)buff + off;
+    }
+
+    out->hdr = hdr;
+    return true;
+}
+
+/* Checks that the binary companion of an ASCII asset file exists. A binary 
+ * that is older than the ASCII file was converted from a previous version of 
+ * the asset and is not used. */
+static bool al_bin_up_to_date(const char *bin_path, const char *src_path)
+{
+    struct stat bin_st, src_st;
+    if(stat(bin_path, &bin_st) != 0)
+        return false;
+
+    if(stat(src_path, &src_st) == 0 && src_st.st_mtime > bin_st.st_mtime) {
+        fprintf(stderr, "Ignoring out-of-date binary file: %s\n", bin_path);
+        return false;
+    }
+    return true;
+}
+
+/* Loads the binary companion of the model file, if there is an up-to-date one */
+static bool al_job_parse_bin(struct load_job *job, const char *pfobj_path)
+{
+    char bin_path[sizeof(job->base_path) + sizeof(job->key) + 2];
+    strcpy(bin_path, pfobj_path);
+    strcat(bin_path, "b");
+
+    if(!al_bin_up_to_date(bin_path, pfobj_path))
+        return false;
+
+    void *buff;
+    size_t size;
+    if(!al_map_file(bin_path, &buff, &size))
+        return false;
+
+    struct pfobj_bin bin;
+    if(!al_pfobjb_open(buff, size, &bin))
+        goto fail;
+
+    job->header = (struct pfobj_hdr){
+        .version       = bin.hdr->pfobj_version,
+        .num_verts     = bin.hdr->num_verts,
+        .num_joints    = bin.hdr->num_joints,
+        .num_materials = bin.hdr->num_materials,
+        .num_as        = bin.hdr->num_as,
+        .has_collision = bin.hdr->has_collision,
+    };
+    memcpy(job->header.frame_counts, bin.hdr->frame_counts, sizeof(job->header.frame_counts));
+
+    if(!job->header.has_collision)
+        goto fail;
+
+    job->render_parsed = R_AL_ParsePrivFromBin(job->base_path, &job->header, &bin);
+    if(!job->render_parsed)
+        goto fail;
+
+    job->anim_private = A_AL_PrivFromBin(bin_path, &job->header, &bin);
+    if(!job->anim_private)
+        goto fail_anim;
+
+    job->aabb = *(const struct aabb*)bin.sections[PFOBJB_AABB];
+
+    al_unmap_file(buff, size);
+    return true;
+
+fail_anim:
+    R_AL_FreeParsed(job->render_parsed);
+    job->render_parsed = NULL;
+fail:
+    fprintf(stderr, "Invalid binary model: %s\n", bin_path);
+    al_unmap_file(buff, size);
+    return false;
+}
+
+/* Reads and parses the model file. This does not touch any GL or global 
+ * state, so it can run on a worker thread. */
+static bool al_job_parse(struct load_job *job)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    char pfobj_path[sizeof(job->base_path) + sizeof(job->key) + 1];
+    strcpy(pfobj_path, job->base_path);
+    strcat(pfobj_path, "/");
+    strcat(pfobj_path, job->key);
+
+    if(al_job_parse_bin(job, pfobj_path)) {
+        job->binary = true;
+        job->parse_ms = al_elapsed_ms(start);
+        return true;
+    }
+
+    SDL_RWops *stream = AL_OpenFile(pfobj_path);
+    if(!stream)
+        goto fail_stream; 
+
+    if(!al_parse_pfobj_header(stream, &job->header))
+        goto fail_parse;
+
+    job->render_parsed = R_AL_ParsePrivFromStream(job->base_path, &job->header, stream);
+    if(!job->render_parsed)
+        goto fail_parse;
+
+    job->anim_private = A_AL_PrivFromStream(pfobj_path, &job->header, stream);
+    if(!job->anim_private)
+        goto fail_anim;
+
+    if(!job->header.has_collision) {
+        fprintf(stderr, "Imported entities required to have bounding boxes.\n");
+        goto fail_aabb;
+    }
+
+    if(!AL_ParseAABB(stream, &job->aabb))
+        goto fail_aabb;
+
+    SDL_RWclose(stream);
+    job->binary = false;
+    job->parse_ms = al_elapsed_ms(start);
+    return true;
+
+fail_aabb:
+    free(job->anim_private);
+    job->anim_private = NULL;
+fail_anim:
+    R_AL_FreeParsed(job->render_parsed);
+    job->render_parsed = NULL;
+fail_parse:
+    SDL_RWclose(stream);
+fail_stream:
+    return false;
+}
+
+static void al_job_free(struct load_job *job)
+{
+    if(job->render_parsed)
+        R_AL_FreeParsed(job->render_parsed);
+    free(job->anim_private);
+    free(job);
+}
+
+static int al_worker(void *arg)
+{
+    SDL_LockMutex(s_job_lock);
+    while(true) {
+
+        while(!s_queue_head && !s_clip_queue_head && !s_workers_quit)
+            SDL_CondWait(s_job_queued, s_job_lock);
+        if(s_workers_quit)
+            break;
+
+        if(!s_queue_head) {
+
+            struct clip_job *clip_job = s_clip_queue_head;
+            s_clip_queue_head = clip_job->next_queued;
+            if(!s_clip_queue_head)
+                s_clip_queue_tail = NULL;
+
+            clip_job->state = JOB_RUNNING;
+            SDL_UnlockMutex(s_job_lock);
+
+            void *clip_data = A_AL_ReadClip(clip_job->anim_private, clip_job->clip_idx);
+
+            SDL_LockMutex(s_job_lock);
+            clip_job->clip_data = clip_data;
+            clip_job->state = clip_data ? JOB_DONE : JOB_FAILED;
+            continue;
+        }
+
+        struct load_job *job = s_queue_head;
+        s_queue_head = job->next_queued;
+        if(!s_queue_head)
+            s_queue_tail = NULL;
+
+        job->state = JOB_RUNNING;
+        SDL_UnlockMutex(s_job_lock);
+
+        bool ok = al_job_parse(job);
+
+        SDL_LockMutex(s_job_lock);
+        job->state = ok ? JOB_DONE : JOB_FAILED;
+        SDL_CondBroadcast(s_job_done);
+    }
+    SDL_UnlockMutex(s_job_lock);
+    return 0;
+}
+
+static void al_queue_remove(struct load_job *job)
+{
+    struct load_job **curr = &s_queue_head, *prev = NULL;
+    while(*curr && *curr != job) {
+        prev = *curr;
+        curr = &(*curr)->next_queued;
+    }
+
+    assert(*curr == job);
+    *curr = job->next_queued;
+    if(s_queue_tail == job)
+        s_queue_tail = prev;
+}
+
+static struct load_job *al_job_new(const char *base_path, const char *pfobj_name)
+{
+    struct load_job *ret = malloc(sizeof(struct load_job));
+    if(!ret)
+        return NULL;
+
+    if(strlen(pfobj_name) >= sizeof(ret->key) 
+    || strlen(base_path) >= sizeof(ret->base_path)) {
+        free(ret);
+        return NULL;
+    }
+
+    strcpy(ret->key, pfobj_name);
+    strcpy(ret->base_path, base_path);
+    ret->render_parsed = NULL;
+    ret->anim_private = NULL;
+    ret->binary = false;
+    ret->parse_ms = 0.0f;
+    ret->next_queued = NULL;
+    return ret;
+}
+
+static const struct shared_resource *al_resource_for_name(const char *pfobj_name)
+{
+    int handle = strintern_get(s_res_names, pfobj_name);
+    if(handle < 0)
+        return NULL;
+    return &s_resources[handle];
+}
+
+/* If there is no memory to add the resource, it is simply not shared and 
+ * the model will be loaded again for the next entity using it. */
+static void al_add_resource(const char *pfobj_name, const struct shared_resource *res)
+{
+    assert(strintern_get(s_res_names, pfobj_name) < 0);
+    size_t num_res = strintern_get_size(s_res_names);
+
+    if(num_res == s_resources_cap) {
+
+        struct shared_resource *resources = realloc(s_resources, 
+            sizeof(struct shared_resource) * s_resources_cap * 2);
+        if(!resources)
+            return;
+        s_resources = resources;
+        s_resources_cap *= 2;
+    }
+
+    int handle = strintern_put(s_res_names, pfobj_name);
+    if(handle < 0)
+        return;
+    assert(handle == num_res);
+    s_resources[handle] = *res;
+}
+
+static void al_init_stats(const struct load_job *job, const struct shared_resource *res, 
+                          float upload_ms, struct asset_stats *out)
+{
+    strcpy(out->name, job->key);
+    out->binary = job->binary;
+    out->parse_ms = job->parse_ms;
+    out->upload_ms = upload_ms;
+    out->num_verts = job->header.num_verts;
+    out->num_joints = job->header.num_joints;
+    out->num_materials = job->header.num_materials;
+    out->num_clips = job->header.num_as;
+
+    out->num_samples = 0;
+    for(int i = 0; i < job->header.num_as; i++)
+        out->num_samples += job->header.frame_counts[i];
+
+    R_AL_GetMemUsage(res->render_private, &out->buff_bytes, &out->arr_bytes, &out->tex_bytes);
+    out->anim_bytes = A_AL_MemUsage(res->anim_private);
+}
+
+static float al_stats_load_ms(const struct asset_stats *stats)
+{
+    return stats->parse_ms + stats->upload_ms;
+}
+
+static int al_compare_stats(const void *a, const void *b)
+{
+    float load_a = al_stats_load_ms(a);
+    float load_b = al_stats_load_ms(b);
+    return (load_a < load_b) - (load_a > load_b);
+}
+
+/* Creates the GL state for a parsed model and adds it to the shared resources.
+ * The job is freed. Must be called from the main thread. */
+static bool al_job_finalize(struct load_job *job, struct shared_resource *out)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    khiter_t k = kh_get(load_job, s_name_job_table, job->key);
+    if(k != kh_end(s_name_job_table) && kh_value(s_name_job_table, k) == job)
+        kh_del(load_job, s_name_job_table, k);
+
+    if(job->state != JOB_DONE)
+        goto fail;
+
+    struct shared_resource res;
+    res.ent_flags = ENTITY_FLAG_COLLISION;
+    res.aabb = job->aabb;
+    res.anim_private = job->anim_private;
+
+    res.render_private = R_AL_PrivFromParsed(job->render_parsed);
+    job->render_parsed = NULL;
+    if(!res.render_private)
+        goto fail;
+
+#if CONFIG_ANIM_MEM_REPORT
+    if(job->header.num_as > 0)
+        A_AL_DumpMemReport(stdout, job->key, res.anim_private);
+#endif
+
+#if CONFIG_ANIM_GPU_INSTANCING
+    /* Failing to create the animation texture is not fatal - the model 
+     * will just be drawn one entity at a time. */
+    if(job->header.num_as > 0)
+        A_AL_InitAnimTex(res.anim_private, res.render_private);
+#endif
+
+    /* Entities with no animation sets are considered static. */
+    if(job->header.num_as > 0) {
+        res.ent_flags |= ENTITY_FLAG_ANIMATED;
+    }
+
+    al_init_stats(job, &res, al_elapsed_ms(start), &res.stats);
+
+    job->anim_private = NULL;
+    al_add_resource(job->key, &res);
+    al_job_free(job);
+
+    *out = res;
+    return true;
+
+fail:
+    fprintf(stderr, "Failed to load model: %s/%s\n", job->base_path, job->key);
+    al_job_free(job);
+    return false;
+}
+
+/* Gets the model from the job loading it, waiting for it if necessary. If no 
+ * worker has picked up the job yet, it is parsed right away on this thread. */
+static bool al_load_model(const char *base_path, const char *pfobj_name, struct shared_resource *out)
+{
+    struct load_job *job;
+
+    khiter_t k = kh_get(load_job, s_name_job_table, pfobj_name);
+    if(k == kh_end(s_name_job_table)) {
+
+        job = al_job_new(base_path, pfobj_name);
+        if(!job)
+            return false;
+        job->state = al_job_parse(job) ? JOB_DONE : JOB_FAILED;
+        return al_job_finalize(job, out);
+    }
+
+    job = kh_value(s_name_job_table, k);
+    SDL_LockMutex(s_job_lock);
+
+    if(job->state == JOB_QUEUED) {
+
+        al_queue_remove(job);
+        job->state = JOB_RUNNING;
+        SDL_UnlockMutex(s_job_lock);
+
+        bool ok = al_job_parse(job);
+
+        SDL_LockMutex(s_job_lock);
+        job->state = ok ? JOB_DONE : JOB_FAILED;
+    }
+
+    while(job->state == JOB_RUNNING)
+        SDL_CondWait(s_job_done, s_job_lock);
+    SDL_UnlockMutex(s_job_lock);
+
+    return al_job_finalize(job, out);
+}
+
 static bool al_parse_pfmap_header(SDL_RWops *stream, struct pfmap_hdr *out)
 {
     char line[MAX_LINE_LEN];
 
+    const char *curr;
+
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "version %f", &out->version))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "version") || !AL_ParseFloat(&curr, &out->version))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_rows %d", &out->num_rows))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_rows") || !AL_ParseInt(&curr, (int*)&out->num_rows))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, "num_cols %d", &out->num_cols))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_cols") || !AL_ParseInt(&curr, (int*)&out->num_cols))
         goto fail;
 
     return true;
@@ -163,13 +740,14 @@ fail:
     return false;
 }
 
-static struct map *al_map_from_stream(const char *base_path, SDL_RWops *stream)
+static struct map *al_map_from_stream(const char *base_path, SDL_RWops *stream, uint64_t hash)
 {
     struct map *ret;
     struct pfmap_hdr header;
 
     if(!al_parse_pfmap_header(stream, &header))
         goto fail_parse;
+    header.hash = hash;
 
     ret = malloc(M_AL_BuffSizeFromHeader(&header));
     if(!ret)
@@ -187,6 +765,109 @@ fail_parse:
     return NULL;
 }
 
+/* Returns a 64-bit FNV-1a hash of the contents of the file, or 0 if it 
+ * cannot be read */
+static uint64_t al_file_hash(const char *path)
+{
+    void *buff;
+    size_t size;
+    if(!al_map_file(path, &buff, &size))
+        return 0;
+
+    const unsigned char *bytes = buff;
+    uint64_t ret = 14695981039346656037ull;
+    for(size_t i = 0; i < size; i++) {
+        ret ^= bytes[i];
+        ret *= 1099511628211ull;
+    }
+
+    al_unmap_file(buff, size);
+    return ret;
+}
+
+/* Checks that the header is sane and that the chunk table and all the chunks 
+ * are within the file. */
+static bool al_pfmapb_open(const void *buff, size_t size, struct pfmap_bin *out)
+{
+    const struct pfmapb_hdr *hdr = buff;
+
+    if(size < sizeof(struct pfmapb_hdr))
+        return false;
+    if(hdr->magic != PFMAPB_MAGIC || hdr->version != PFMAPB_VERSION)
+        return false;
+
+    uint64_t num_chunks = (uint64_t)hdr->num_rows * hdr->num_cols;
+    uint64_t table_end = sizeof(struct pfmapb_hdr) + num_chunks * sizeof(uint32_t);
+    if(num_chunks == 0 || table_end > size)
+        return false;
+
+    /* The materials start at the next 4-byte boundary after the tiles */
+    uint64_t tiles_size = (uint64_t)hdr->chunk_width * hdr->chunk_height * sizeof(struct pfmapb_tile);
+    uint64_t mats_offset = (tiles_size + 3) & ~(uint64_t)3;
+    uint64_t chunk_size = mats_offset + (uint64_t)hdr->mats_per_chunk * sizeof(struct pfobjb_material);
+
+    const uint32_t *offsets = (const uint32_t*)(hdr + 1);
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(offsets[i] % 4 || offsets[i] < table_end)
+            return false;
+        if(offsets[i] + chunk_size > size)
+            return false;
+    }
+
+    out->hdr = hdr;
+    out->chunk_offsets = offsets;
+    out->base = buff;
+    out->mats_offset = mats_offset;
+    return true;
+}
+
+/* Loads the binary companion of the map file, if there is an up-to-date one.
+ * The tiles and materials are copied out, so the file is not kept open. */
+static struct map *al_map_from_bin(const char *base_path, const char *pfmap_path, uint64_t hash)
+{
+    char bin_path[strlen(pfmap_path) + 2];
+    strcpy(bin_path, pfmap_path);
+    strcat(bin_path, "b");
+
+    if(!al_bin_up_to_date(bin_path, pfmap_path))
+        return NULL;
+
+    void *buff;
+    size_t size;
+    if(!al_map_file(bin_path, &buff, &size))
+        return NULL;
+
+    struct pfmap_bin bin;
+    if(!al_pfmapb_open(buff, size, &bin))
+        goto fail_open;
+
+    struct pfmap_hdr header = {
+        .version  = bin.hdr->pfmap_version,
+        .num_rows = bin.hdr->num_rows,
+        .num_cols = bin.hdr->num_cols,
+        .hash     = hash,
+    };
+
+    struct map *ret = malloc(M_AL_BuffSizeFromHeader(&header));
+    if(!ret)
+        goto fail_alloc;
+
+    if(!M_AL_InitMapFromBin(&header, base_path, &bin, ret))
+        goto fail_init;
+
+    al_unmap_file(buff, size);
+    return ret;
+
+fail_init:
+    free(ret);
+fail_alloc:
+fail_open:
+    fprintf(stderr, "Invalid binary map: %s\n", bin_path);
+    al_unmap_file(buff, size);
+    return NULL;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -194,7 +875,6 @@ fail_parse:
 struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, const char *name)
 {
     struct shared_resource res;
-    SDL_RWops *stream;
 
     size_t alloc_size = sizeof(struct entity) + A_AL_CtxBuffSize();
     struct entity *ret = malloc(alloc_size);
@@ -209,6 +889,7 @@ struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name,
     ret->max_speed = 0.0f;
     ret->faction_id = 0; 
     ret->anim_ctx = (void*)(ret + 1);
+    ret->bounds.aabb = NULL;
 
     if(strlen(name) >= sizeof(ret->name))
         return NULL;
@@ -224,74 +905,127 @@ struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name,
 
     assert(strlen(base_path) < sizeof(ret->basedir));
     strcpy(ret->basedir, base_path);
-    strcpy(res.key, pfobj_name);
 
-    khiter_t k = kh_get(entity_res, s_name_resource_table, pfobj_name);
-    if(k != kh_end(s_name_resource_table)) {
+    const struct shared_resource *shared = al_resource_for_name(pfobj_name);
+    if(shared) {
 
-        res = kh_value(s_name_resource_table, k);
+        res = *shared;
     }else{
 
-        struct pfobj_hdr header;
+        if(!al_load_model(base_path, pfobj_name, &res))
+            goto fail_load;
+    }
 
-        char pfobj_path[128];
-        assert( strlen(base_path) + strlen(pfobj_name) + 1 < sizeof(pfobj_path) );
-        strcpy(pfobj_path, base_path);
-        strcat(pfobj_path, "/");
-        strcat(pfobj_path, pfobj_name);
+    ret->flags |= res.ent_flags;
+    ret->render_private = res.render_private;
+    ret->anim_private = res.anim_private;
+    ret->identity_aabb = res.aabb;
+    ret->uid = Entity_NewUID();
+    return ret;
 
-        stream = SDL_RWFromFile(pfobj_path, "r");
-        if(!stream)
-            goto fail_stream; 
+fail_load:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+bool AL_PrefetchPFObj(const char *base_path, const char *pfobj_name)
+{
+    if(al_resource_for_name(pfobj_name))
+        return true;
+    if(kh_get(load_job, s_name_job_table, pfobj_name) != kh_end(s_name_job_table))
+        return true;
+
+    struct load_job *job = al_job_new(base_path, pfobj_name);
+    if(!job)
+        return false;
+
+    int put_ret;
+    khiter_t k = kh_put(load_job, s_name_job_table, job->key, &put_ret);
+    if(put_ret == -1) {
+        free(job);
+        return false;
+    }
+    kh_value(s_name_job_table, k) = job;
 
-        if(!al_parse_pfobj_header(stream, &header))
-            goto fail_parse;
+    SDL_LockMutex(s_job_lock);
 
-        res.ent_flags = 0;
-        res.render_private = R_AL_PrivFromStream(base_path, &header, stream);
-        if(!res.render_private)
-            goto fail_parse;
+    job->state = JOB_QUEUED;
+    if(s_queue_tail)
+        s_queue_tail->next_queued = job;
+    else
+        s_queue_head = job;
+    s_queue_tail = job;
 
-        res.anim_private = A_AL_PrivFromStream(&header, stream);
-        if(!res.anim_private)
-            goto fail_parse;
+    SDL_CondSignal(s_job_queued);
+    SDL_UnlockMutex(s_job_lock);
+    return true;
+}
 
-        /* Entities with no animation sets are considered static. */
-        if(header.num_as > 0) {
-            res.ent_flags |= ENTITY_FLAG_ANIMATED;
-        }
+void AL_ServiceLoadQueue(void)
+{
+    for(khiter_t k = kh_begin(s_name_job_table); k != kh_end(s_name_job_table); k++) {
 
-        if(!header.has_collision) {
-            fprintf(stderr, "Imported entities required to have bounding boxes.\n");
-            goto fail_parse;
-        }
+        if(!kh_exist(s_name_job_table, k))
+            continue;
 
-        res.ent_flags |= ENTITY_FLAG_COLLISION;
-        if(!AL_ParseAABB(stream, &res.aabb))
-            goto fail_parse;
+        struct load_job *job = kh_value(s_name_job_table, k);
 
-        SDL_RWclose(stream);
+        SDL_LockMutex(s_job_lock);
+        bool finished = (job->state == JOB_DONE || job->state == JOB_FAILED);
+        SDL_UnlockMutex(s_job_lock);
 
-        int put_ret;
-        k = kh_put(entity_res, s_name_resource_table, pfobj_name, &put_ret);
-        assert(put_ret != -1 && put_ret != 0);
-        kh_value(s_name_resource_table, k) = res;
-        kh_update_str_keys(s_name_resource_table);
+        struct shared_resource res;
+        if(finished)
+            al_job_finalize(job, &res);
     }
 
-    ret->flags |= res.ent_flags;
-    ret->render_private = res.render_private;
-    ret->anim_private = res.anim_private;
-    ret->identity_aabb = res.aabb;
-    ret->uid = Entity_NewUID();
-    return ret;
+    struct clip_job **curr = &s_pending_clips;
+    while(*curr) {
 
-fail_parse:
-    SDL_RWclose(stream);
-fail_stream:
-    free(ret);
-fail_alloc:
-    return NULL;
+        struct clip_job *job = *curr;
+
+        SDL_LockMutex(s_job_lock);
+        bool finished = (job->state == JOB_DONE || job->state == JOB_FAILED);
+        SDL_UnlockMutex(s_job_lock);
+
+        if(!finished) {
+            curr = &job->next_pending;
+            continue;
+        }
+
+        A_AL_FinishClipLoad(job->anim_private, job->render_private, job->clip_idx, job->clip_data);
+        *curr = job->next_pending;
+        free(job);
+    }
+}
+
+bool AL_QueueClipLoad(void *anim_private, void *render_private, int clip_idx)
+{
+    struct clip_job *job = malloc(sizeof(struct clip_job));
+    if(!job)
+        return false;
+
+    job->anim_private = anim_private;
+    job->render_private = render_private;
+    job->clip_idx = clip_idx;
+    job->clip_data = NULL;
+    job->next_queued = NULL;
+    job->next_pending = s_pending_clips;
+    s_pending_clips = job;
+
+    SDL_LockMutex(s_job_lock);
+
+    job->state = JOB_QUEUED;
+    if(s_clip_queue_tail)
+        s_clip_queue_tail->next_queued = job;
+    else
+        s_clip_queue_head = job;
+    s_clip_queue_tail = job;
+
+    SDL_CondSignal(s_job_queued);
+    SDL_UnlockMutex(s_job_lock);
+    return true;
 }
 
 void AL_EntityFree(struct entity *entity)
@@ -299,6 +1033,68 @@ void AL_EntityFree(struct entity *entity)
     free(entity);
 }
 
+size_t AL_NumLoadedModels(void)
+{
+    return strintern_get_size(s_res_names);
+}
+
+size_t AL_GetAssetStats(struct asset_stats *out, size_t maxout)
+{
+    size_t num_res = strintern_get_size(s_res_names);
+    struct asset_stats *sorted = malloc(sizeof(struct asset_stats) * num_res);
+    if(!sorted)
+        return 0;
+
+    for(int i = 0; i < num_res; i++) {
+
+        /* Animation clips are loaded as they get played */
+        sorted[i] = s_resources[i].stats;
+        if(s_resources[i].anim_private)
+            sorted[i].anim_bytes = A_AL_MemUsage(s_resources[i].anim_private);
+    }
+    qsort(sorted, num_res, sizeof(struct asset_stats), al_compare_stats);
+
+    size_t ret = MIN(num_res, maxout);
+    memcpy(out, sorted, sizeof(struct asset_stats) * ret);
+    free(sorted);
+    return ret;
+}
+
+void AL_DumpAssetStats(FILE *stream)
+{
+    size_t num_res = strintern_get_size(s_res_names);
+    struct asset_stats *stats = malloc(sizeof(struct asset_stats) * num_res);
+    if(!stats)
+        return;
+    num_res = AL_GetAssetStats(stats, num_res);
+
+    struct asset_stats total = {0};
+    for(int i = 0; i < num_res; i++) {
+
+        const struct asset_stats *curr = &stats[i];
+        fprintf(stream, "[ASSET] %-32s %-5s parse: %7.2f ms upload: %7.2f ms "
+            "verts: %6u joints: %3u clips: %2u samples: %5u "
+            "buffers: %8.1f kB arrays: %8.1f kB textures: %8.1f kB anim: %8.1f kB\n",
+            curr->name, curr->binary ? "bin" : "ascii", curr->parse_ms, curr->upload_ms,
+            curr->num_verts, curr->num_joints, curr->num_clips, curr->num_samples,
+            curr->buff_bytes / 1024.0f, curr->arr_bytes / 1024.0f, curr->tex_bytes / 1024.0f, 
+            curr->anim_bytes / 1024.0f);
+
+        total.parse_ms += curr->parse_ms;
+        total.upload_ms += curr->upload_ms;
+        total.buff_bytes += curr->buff_bytes;
+        total.arr_bytes += curr->arr_bytes;
+        total.tex_bytes += curr->tex_bytes;
+        total.anim_bytes += curr->anim_bytes;
+    }
+
+    fprintf(stream, "[ASSET] %zu models, parse: %.2f ms upload: %.2f ms "
+        "buffers: %.1f kB arrays: %.1f kB textures: %.1f kB anim: %.1f kB\n",
+        num_res, total.parse_ms, total.upload_ms, total.buff_bytes / 1024.0f, 
+        total.arr_bytes / 1024.0f, total.tex_bytes / 1024.0f, total.anim_bytes / 1024.0f);
+    free(stats);
+}
+
 struct map *AL_MapFromPFMap(const char *base_path, const char *pfmap_name)
 {
     struct map *ret;
@@ -310,8 +1106,17 @@ struct map *AL_MapFromPFMap(const char *base_path, const char *pfmap_name)
     strcat(pfmap_path, "/");
     strcat(pfmap_path, pfmap_name);
 
-    stream = SDL_RWFromFile(pfmap_path, "r");
-    ret = al_map_from_stream(base_path, stream);
+    uint64_t hash = CONFIG_MAP_CACHE ? al_file_hash(pfmap_path) : 0;
+
+    ret = al_map_from_bin(base_path, pfmap_path, hash);
+    if(ret)
+        return ret;
+
+    stream = AL_OpenFile(pfmap_path);
+    if(!stream)
+        goto fail_open;
+
+    ret = al_map_from_stream(base_path, stream, hash);
     if(!ret)
         goto fail_parse;
 
@@ -330,7 +1135,7 @@ struct map *AL_MapFromPFMapString(const char *str)
     SDL_RWops *stream;
 
     stream = SDL_RWFromConstMem(str, strlen(str));
-    ret = al_map_from_stream(NULL, stream);
+    ret = al_map_from_stream(NULL, stream, 0);
     if(!ret)
         goto fail_parse;
 
@@ -351,38 +1156,223 @@ void AL_MapFree(struct map *map)
 
 bool AL_ReadLine(SDL_RWops *stream, char *outbuff)
 {
-    bool done = false;
-    int idx = 0;
-    do {
-         
-        if(!SDL_RWread(stream, outbuff + idx, 1, 1))
-            return false; 
+    size_t len;
+
+    /* Memory streams (such as the ones returned by 'AL_OpenFile') are scanned 
+     * in place, without going through 'SDL_RWread'. */
+    if(stream->type == SDL_RWOPS_MEMORY || stream->type == SDL_RWOPS_MEMORY_RO) {
+
+        Uint8 *here = stream->hidden.mem.here;
+        size_t left = stream->hidden.mem.stop - here;
+
+        const Uint8 *newline = memchr(here, '\n', MIN(left, MAX_LINE_LEN - 1));
+        if(!newline)
+            return false;
+
+        len = newline - here + 1;
+        memcpy(outbuff, here, len);
+        stream->hidden.mem.here += len;
+
+    }else{
+
+        Sint64 start = SDL_RWtell(stream);
+        size_t nread = SDL_RWread(stream, outbuff, 1, MAX_LINE_LEN - 1);
+
+        const char *newline = memchr(outbuff, '\n', nread);
+        if(!newline)
+            return false;
+
+        len = newline - outbuff + 1;
+        if(SDL_RWseek(stream, start + len, RW_SEEK_SET) < 0)
+            return false;
+    }
+
+    /* Lines are always returned with a '\n' ending */
+    if(len > 1 && outbuff[len - 2] == '\r') {
+        outbuff[len - 2] = '\n';
+        len--;
+    }
+    outbuff[len] = '\0';
+    return true;
+}
+
+SDL_RWops *AL_OpenFile(const char *path)
+{
+    SDL_RWops *file = SDL_RWFromFile(path, "rb");
+    if(!file)
+        goto fail_open;
+
+    Sint64 size = SDL_RWsize(file);
+    if(size <= 0)
+        goto fail_size;
+
+    void *buff = malloc(size);
+    if(!buff)
+        goto fail_size;
+
+    if(SDL_RWread(file, buff, size, 1) != 1)
+        goto fail_read;
+
+    SDL_RWops *ret = SDL_RWFromConstMem(buff, size);
+    if(!ret)
+        goto fail_read;
+
+    ret->close = al_mem_close;
+    SDL_RWclose(file);
+    return ret;
+
+fail_read:
+    free(buff);
+fail_size:
+    SDL_RWclose(file);
+fail_open:
+    return NULL;
+}
+
+bool AL_ParseInt(const char **str, int *out)
+{
+    const char *curr = al_skip_space(*str);
+
+    bool neg = (*curr == '-');
+    if(*curr == '-' || *curr == '+')
+        curr++;
+
+    if(!isdigit(*curr))
+        return false;
+
+    long long val = 0;
+    while(isdigit(*curr)) {
+        val = val * 10 + (*curr++ - '0');
+        if(val > (long long)INT_MAX + 1)
+            return false;
+    }
+
+    val = neg ? -val : val;
+    if(val > INT_MAX)
+        return false;
+
+    *out = (int)val;
+    *str = curr;
+    return true;
+}
+
+bool AL_ParseFloat(const char **str, float *out)
+{
+    static const double s_pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *start = al_skip_space(*str);
+    const char *curr = start;
+
+    bool neg = (*curr == '-');
+    if(*curr == '-' || *curr == '+')
+        curr++;
+
+    /* Accumulate up to 15 significant digits, which a double holds exactly. 
+     * Scaling that by an exactly representable power of 10 gives a correctly 
+     * rounded double. Anything outside of this is handed off to 'strtod'. */
+    uint64_t mantissa = 0;
+    int num_digits = 0, exp = 0;
+    bool any = false;
+
+    for(; isdigit(*curr); curr++, any = true) {
+        if(mantissa == 0 && *curr == '0')
+            continue;
+        if(num_digits++ == 15)
+            goto slow;
+        mantissa = mantissa * 10 + (*curr - '0');
+    }
 
-        if(outbuff[idx] == '\n') {
-            outbuff[++idx] = '\0';
-            return true;
+    if(*curr == '.') {
+        for(curr++; isdigit(*curr); curr++, any = true) {
+            exp--;
+            if(mantissa == 0 && *curr == '0')
+                continue;
+            if(num_digits++ == 15)
+                goto slow;
+            mantissa = mantissa * 10 + (*curr - '0');
         }
-        
-        idx++; 
-    }while(idx < MAX_LINE_LEN);
+    }
 
-    return false;
+    if(!any || *curr == 'e' || *curr == 'E' || exp < -22)
+        goto slow;
+
+    double fast = (double)mantissa / s_pow10[-exp];
+    *out = (float)(neg ? -fast : fast);
+    *str = curr;
+    return true;
+
+slow:;
+    char *end;
+    double val = strtod(start, &end);
+    if(end == start)
+        return false;
+
+    *out = (float)val;
+    *str = end;
+    return true;
+}
+
+bool AL_ParseLiteral(const char **str, const char *literal)
+{
+    const char *curr = al_skip_space(*str);
+    size_t len = strlen(literal);
+
+    if(strncmp(curr, literal, len))
+        return false;
+
+    *str = curr + len;
+    return true;
+}
+
+bool AL_ParseWord(const char **str, char *out, size_t maxlen)
+{
+    const char *curr = al_skip_space(*str);
+    size_t len = 0;
+
+    while(curr[len] && !isspace(curr[len]))
+        len++;
+
+    if(len == 0 || len >= maxlen)
+        return false;
+
+    memcpy(out, curr, len);
+    out[len] = '\0';
+    *str = curr + len;
+    return true;
+}
+
+bool AL_AtLineEnd(const char *str)
+{
+    return (*al_skip_space(str) == '\0');
 }
 
 bool AL_ParseAABB(SDL_RWops *stream, struct aabb *out)
 {
     char line[MAX_LINE_LEN];
+    const char *curr;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " x_bounds %f %f", &out->x_min, &out->x_max))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "x_bounds") 
+    || !AL_ParseFloat(&curr, &out->x_min) 
+    || !AL_ParseFloat(&curr, &out->x_max))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " y_bounds %f %f", &out->y_min, &out->y_max))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "y_bounds") 
+    || !AL_ParseFloat(&curr, &out->y_min) 
+    || !AL_ParseFloat(&curr, &out->y_max))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " z_bounds %f %f", &out->z_min, &out->z_max))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "z_bounds") 
+    || !AL_ParseFloat(&curr, &out->z_min) 
+    || !AL_ParseFloat(&curr, &out->z_max))
         goto fail;
 
     return true;
@@ -393,12 +1383,108 @@ fail:
 
 bool AL_Init(void)
 {
-    s_name_resource_table = kh_init(entity_res);
-    return (s_name_resource_table != NULL);
+    s_res_names = strintern_init(INIT_NUM_RES);
+    if(!s_res_names)
+        goto fail_res_names;
+
+    s_resources = malloc(sizeof(struct shared_resource) * INIT_NUM_RES);
+    if(!s_resources)
+        goto fail_res_table;
+    s_resources_cap = INIT_NUM_RES;
+
+    s_name_job_table = kh_init(load_job);
+    if(!s_name_job_table)
+        goto fail_job_table;
+
+    if(!A_AL_Init())
+        goto fail_anim;
+
+    s_job_lock = SDL_CreateMutex();
+    if(!s_job_lock)
+        goto fail_lock;
+
+    s_job_queued = SDL_CreateCond();
+    if(!s_job_queued)
+        goto fail_cond_queued;
+
+    s_job_done = SDL_CreateCond();
+    if(!s_job_done)
+        goto fail_cond_done;
+
+    /* Leave one core for the main thread, but always have at least one worker */
+    int num_workers = SDL_GetCPUCount() - 1;
+    num_workers = num_workers < 1 ? 1 
+                : num_workers > MAX_LOAD_WORKERS ? MAX_LOAD_WORKERS 
+                : num_workers;
+
+    s_workers_quit = false;
+    for(int i = 0; i < num_workers; i++) {
+
+        s_workers[s_num_workers] = SDL_CreateThread(al_worker, "asset_load", NULL);
+        if(s_workers[s_num_workers])
+            s_num_workers++;
+    }
+
+    if(s_num_workers == 0)
+        goto fail_workers;
+
+    return true;
+
+fail_workers:
+    SDL_DestroyCond(s_job_done);
+fail_cond_done:
+    SDL_DestroyCond(s_job_queued);
+fail_cond_queued:
+    SDL_DestroyMutex(s_job_lock);
+fail_lock:
+    A_AL_Shutdown();
+fail_anim:
+    kh_destroy(load_job, s_name_job_table);
+fail_job_table:
+    free(s_resources);
+fail_res_table:
+    strintern_free(s_res_names);
+fail_res_names:
+    return false;
 }
 
 void AL_Shutdown(void)
 {
-    kh_destroy(entity_res, s_name_resource_table);
+#if CONFIG_ASSET_STATS_REPORT
+    AL_DumpAssetStats(stdout);
+#endif
+
+    SDL_LockMutex(s_job_lock);
+    s_workers_quit = true;
+    SDL_CondBroadcast(s_job_queued);
+    SDL_UnlockMutex(s_job_lock);
+
+    for(int i = 0; i < s_num_workers; i++)
+        SDL_WaitThread(s_workers[i], NULL);
+    s_num_workers = 0;
+
+    /* Any jobs that have not been finalized are discarded */
+    for(khiter_t k = kh_begin(s_name_job_table); k != kh_end(s_name_job_table); k++) {
+        if(!kh_exist(s_name_job_table, k)) continue;
+        al_job_free(kh_value(s_name_job_table, k));
+    }
+    s_queue_head = s_queue_tail = NULL;
+
+    /* The samples of the clips are shared and never freed, so only the 
+     * jobs themselves are discarded */
+    while(s_pending_clips) {
+        struct clip_job *next = s_pending_clips->next_pending;
+        free(s_pending_clips);
+        s_pending_clips = next;
+    }
+    s_clip_queue_head = s_clip_queue_tail = NULL;
+
+    SDL_DestroyCond(s_job_done);
+    SDL_DestroyCond(s_job_queued);
+    SDL_DestroyMutex(s_job_lock);
+    A_AL_Shutdown();
+    kh_destroy(load_job, s_name_job_table);
+    free(s_resources);
+    strintern_free(s_res_names);
 }
 
@@ -38,6 +38,8 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
@@ -70,10 +72,123 @@ struct pfobj_hdr{
     bool     has_collision;
 };
 
+/* Binary PFOBJ ('.pfobjb'). The sections hold the model data laid out exactly 
+ * as the engine's in-memory structures, so loading it is just a matter of 
+ * locating the sections. See 'docs/pfobj.txt' for the full description. */
+
+#define PFOBJB_MAGIC    0x424f4650 /* 'PFOB' */
+#define PFOBJB_VERSION  1
+#define PFOBJB_NAME_LEN 32
+#define PFOBJB_ALIGN    16 /* of every section offset */
+
+enum pfobjb_section{
+    PFOBJB_VERTS,        /* struct vertex[num_verts]                      */
+    PFOBJB_MATERIALS,    /* struct pfobjb_material[num_materials]         */
+    PFOBJB_JOINTS,       /* struct joint[num_joints]                      */
+    PFOBJB_BIND_POSES,   /* struct SQT[num_joints]                        */
+    PFOBJB_CLIP_NAMES,   /* char[num_as][PFOBJB_NAME_LEN]                 */
+    PFOBJB_SAMPLES,      /* struct SQT[sum(frame_counts) * num_joints]    */
+    PFOBJB_SAMPLE_AABBS, /* struct aabb[sum(frame_counts)]                */
+    PFOBJB_AABB,         /* struct aabb                                   */
+    PFOBJB_NUM_SECTIONS
+};
+
+struct pfobjb_hdr{
+    uint32_t magic;
+    uint32_t version;
+    float    pfobj_version;
+    uint32_t num_verts;
+    uint32_t num_joints;
+    uint32_t num_materials;
+    uint32_t num_as;
+    uint32_t frame_counts[MAX_ANIM_SETS];
+    uint32_t has_collision;
+    /* The sizes of the structures the file was written for */
+    uint32_t vertex_size;
+    uint32_t joint_size;
+    uint32_t sqt_size;
+    uint32_t section_offsets[PFOBJB_NUM_SECTIONS];
+};
+
+struct pfobjb_material{
+    float    ambient_intensity;
+    float    diffuse_clr[3];
+    float    specular_clr[3];
+    char     texname[PFOBJB_NAME_LEN];
+};
+
+/* A loaded binary PFOBJ file */
+struct pfobj_bin{
+    const struct pfobjb_hdr *hdr;
+    const void              *sections[PFOBJB_NUM_SECTIONS];
+};
+
 struct pfmap_hdr{
     float    version;
     unsigned num_rows;
     unsigned num_cols;
+    /* Hash of the contents of the map file, identifying the data derived from
+     * it in the map cache. 0 if the map does not come from a file. */
+    uint64_t hash;
+};
+
+/* Binary PFMAP ('.pfmapb'). The header is followed by a table with the file 
+ * offset of every chunk, in row-major order, so that each chunk can be read 
+ * on its' own. A chunk holds its' tiles followed by its' materials. See 
+ * 'scripts/editor/pfmapb.py' for the full description. */
+
+#define PFMAPB_MAGIC    0x424d4650 /* 'PFMB' */
+#define PFMAPB_VERSION  1
+
+struct pfmapb_hdr{
+    uint32_t magic;
+    uint32_t version;
+    float    pfmap_version;
+    uint32_t num_rows;
+    uint32_t num_cols;
+    /* The chunk dimensions the file was written for */
+    uint32_t chunk_width;
+    uint32_t chunk_height;
+    uint32_t mats_per_chunk;
+};
+
+struct pfmapb_tile{
+    uint8_t  type;
+    uint8_t  pathable;
+    int8_t   base_height;
+    int8_t   ramp_height;
+    uint8_t  top_mat_idx;
+    uint8_t  sides_mat_idx;
+};
+
+/* A loaded binary PFMAP file */
+struct pfmap_bin{
+    const struct pfmapb_hdr *hdr;
+    const uint32_t          *chunk_offsets;
+    const char              *base;
+    /* Offset of the materials from the start of a chunk */
+    size_t                   mats_offset;
+};
+
+
+/* The load times and memory use of a model, recorded when it is loaded */
+struct asset_stats{
+    char     name[64];
+    bool     binary;        /* loaded from the binary PFOBJ file */
+    float    parse_ms;      /* reading and parsing the file, usually on a loader thread */
+    float    upload_ms;     /* loading the textures and creating the GL state */
+    unsigned num_verts;     /* as stored in the file, before indexing */
+    unsigned num_joints;
+    unsigned num_materials;
+    unsigned num_clips;
+    unsigned num_samples;
+    size_t   buff_bytes;    /* vertex and index buffers and the animation texture */
+    size_t   arr_bytes;     /* array texture of the materials, except when shared with a 
+                             * model that loaded it first */
+    size_t   tex_bytes;     /* source textures of the array, except for ones shared with 
+                             * a model that loaded them first */
+    size_t   anim_bytes;    /* skeleton and the clips loaded so far, except for clips shared 
+                             * with a model that loaded them first */
 };
 
 
@@ -83,11 +198,41 @@ void           AL_Shutdown(void);
 struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, const char *name);
 void           AL_EntityFree(struct entity *entity);
 
+/* Queue the model to be read and parsed on a background thread so that a later 
+ * 'AL_EntityFromPFObj' call for it does not stall. Loaded models are uploaded 
+ * to the GPU by 'AL_ServiceLoadQueue', which is to be called once per frame. */
+bool           AL_PrefetchPFObj(const char *base_path, const char *pfobj_name);
+void           AL_ServiceLoadQueue(void);
+
+/* Queue the samples of an animation clip of a loaded model to be read on a 
+ * background thread. 'AL_ServiceLoadQueue' hands them over to the model with 
+ * 'A_AL_FinishClipLoad' once they are read. */
+bool           AL_QueueClipLoad(void *anim_private, void *render_private, int clip_idx);
+
 struct map    *AL_MapFromPFMap(const char *base_path, const char *pfmap_name);
 struct map    *AL_MapFromPFMapString(const char *str);
 void           AL_MapFree(struct map *map);
 
+/* 'AL_GetAssetStats' copies the stats of at most 'maxout' of the loaded models, 
+ * the slowest to load first, and returns the number copied. 'AL_DumpAssetStats'
+ * writes a line for every loaded model followed by the totals. */
+size_t         AL_NumLoadedModels(void);
+size_t         AL_GetAssetStats(struct asset_stats *out, size_t maxout);
+void           AL_DumpAssetStats(FILE *stream);
+
+/* Reads the whole file into memory and returns a stream over it, which 
+ * 'AL_ReadLine' reads from without any per-byte calls. */
+SDL_RWops     *AL_OpenFile(const char *path);
 bool           AL_ReadLine(SDL_RWops *stream, char *outbuff);
 bool           AL_ParseAABB(SDL_RWops *stream, struct aabb *out);
 
+/* Tokenizers for parsing the lines of the ASCII asset formats without going 
+ * through 'sscanf'. Leading whitespace is skipped and, on success, '*str' is 
+ * advanced past the parsed token. */
+bool           AL_ParseInt(const char **str, int *out);
+bool           AL_ParseFloat(const char **str, float *out);
+bool           AL_ParseLiteral(const char **str, const char *literal);
+bool           AL_ParseWord(const char **str, char *out, size_t maxlen);
+bool           AL_AtLineEnd(const char *str);
+
 #endif
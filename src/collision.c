@@ -342,6 +342,56 @@ void C_MakeFrustum(vec3_t pos, vec3_t up, vec3_t front,
     PFM_Vec3_Cross(&p_to_near_bot_edge, &cam_right, &out->bot.normal);
 }
 
+void C_MakeOrthoFrustum(vec3_t pos, vec3_t up, vec3_t front, 
+                        float left, float right, float bot, float top, 
+                        float near_dist, float far_dist,
+                        struct frustum *out)
+{
+    vec3_t ax_right, ax_up, ax_front = front;
+    PFM_Vec3_Normal(&ax_front, &ax_front);
+    PFM_Vec3_Cross(&up, &ax_front, &ax_right);
+    PFM_Vec3_Normal(&ax_right, &ax_right);
+    /* Make sure the basis is orthonormal even if 'up' is not perpendicular to 'front' */
+    PFM_Vec3_Cross(&ax_front, &ax_right, &ax_up);
+
+    const float xs[2] = {left, right};
+    const float ys[2] = {bot, top};
+    const float zs[2] = {near_dist, far_dist};
+    vec3_t corners[8];
+
+    /* Bit 0 of the index selects the x extent, bit 1 the y extent and bit 2 the z extent */
+    for(int i = 0; i < 8; i++) {
+
+        vec3_t tmp;
+        corners[i] = pos;
+        PFM_Vec3_Scale(&ax_right, xs[(i >> 0) & 1], &tmp);
+        PFM_Vec3_Add(&corners[i], &tmp, &corners[i]);
+        PFM_Vec3_Scale(&ax_up, ys[(i >> 1) & 1], &tmp);
+        PFM_Vec3_Add(&corners[i], &tmp, &corners[i]);
+        PFM_Vec3_Scale(&ax_front, zs[(i >> 2) & 1], &tmp);
+        PFM_Vec3_Add(&corners[i], &tmp, &corners[i]);
+    }
+
+    /* Keep the same naming as 'C_MakeFrustum', where 'left' is along -right */
+    out->nbl = corners[0]; out->nbr = corners[1];
+    out->ntl = corners[2]; out->ntr = corners[3];
+    out->fbl = corners[4]; out->fbr = corners[5];
+    out->ftl = corners[6]; out->ftr = corners[7];
+
+    /* All plane normals point towards the inside of the volume */
+    vec3_t neg_right, neg_up, neg_front;
+    PFM_Vec3_Scale(&ax_right, -1.0f, &neg_right);
+    PFM_Vec3_Scale(&ax_up,    -1.0f, &neg_up);
+    PFM_Vec3_Scale(&ax_front, -1.0f, &neg_front);
+
+    out->near  = (struct plane){out->nbl, ax_front};
+    out->far   = (struct plane){out->ftr, neg_front};
+    out->left  = (struct plane){out->nbl, ax_right};
+    out->right = (struct plane){out->ftr, neg_right};
+    out->bot   = (struct plane){out->nbl, ax_up};
+    out->top   = (struct plane){out->ftr, neg_up};
+}
+
 bool C_RayIntersectsAABB(vec3_t ray_origin, vec3_t ray_dir, struct aabb aabb, float *out_t)
 {
      float t1 = (aabb.x_min - ray_origin.x) / ray_dir.x;
@@ -456,6 +506,25 @@ enum volume_intersec_type C_FrustrumPointIntersectionFast(const struct frustum *
     return VOLUME_INTERSEC_INSIDE;
 }
 
+enum volume_intersec_type C_FrustumSphereIntersectionFast(const struct frustum *frustum, 
+                                                          vec3_t center, float radius)
+{
+    const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
+                                    &frustum->right, &frustum->near, &frustum->far};
+    enum volume_intersec_type ret = VOLUME_INTERSEC_INSIDE;
+
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+
+        float dist = plane_point_signed_distance(planes[i], center);
+        if(dist < -radius)
+            return VOLUME_INTERSEC_OUTSIDE;
+        else if(dist < radius)
+            ret = VOLUME_INTERSEC_INTERSECTION;
+    }
+
+    return ret;
+}
+
 /* Based on the algorithm outlined here:
  * http://cgvr.informatik.uni-bremen.de/teaching/cg_literatur/lighthouse3d_view_frustum_culling/index.html
  */
@@ -463,6 +532,7 @@ enum volume_intersec_type C_FrustumAABBIntersectionFast(const struct frustum *fr
 {
     const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
                                     &frustum->right, &frustum->near, &frustum->far};
+    enum volume_intersec_type ret = VOLUME_INTERSEC_INSIDE;
 
     const vec3_t corners[8] = {
         (vec3_t){aabb->x_min, aabb->y_min, aabb->z_min},
@@ -492,17 +562,19 @@ enum volume_intersec_type C_FrustumAABBIntersectionFast(const struct frustum *fr
         /* All corners are outside */
         if(corners_in == 0)
             return VOLUME_INTERSEC_OUTSIDE;
+        /* Keep going - the box may still be fully outside one of the other planes */
         else if(corners_out > 0)
-            return VOLUME_INTERSEC_INTERSECTION;
+            ret = VOLUME_INTERSEC_INTERSECTION;
     }
 
-    return VOLUME_INTERSEC_INSIDE;
+    return ret;
 }
 
 enum volume_intersec_type C_FrustumOBBIntersectionFast(const struct frustum *frustum, const struct obb *obb)
 {
     const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
                                     &frustum->right, &frustum->near, &frustum->far};
+    enum volume_intersec_type ret = VOLUME_INTERSEC_INSIDE;
 
     for(int i = 0; i < ARR_SIZE(planes); i++) {
 
@@ -521,11 +593,12 @@ enum volume_intersec_type C_FrustumOBBIntersectionFast(const struct frustum *fru
         /* All corners are outside */
         if(corners_in == 0)
             return VOLUME_INTERSEC_OUTSIDE;
+        /* Keep going - the box may still be fully outside one of the other planes */
         else if(corners_out > 0)
-            return VOLUME_INTERSEC_INTERSECTION;
+            ret = VOLUME_INTERSEC_INTERSECTION;
     }
 
-    return VOLUME_INTERSEC_INSIDE;
+    return ret;
 }
 
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb)
@@ -78,6 +78,13 @@ void C_MakeFrustum(vec3_t pos, vec3_t up, vec3_t front,
                    GLfloat near_dist, GLfloat far_dist,
                    struct frustum *out);
 
+/* Builds the box-shaped volume of an orthographic projection. The extents are given 
+ * along the 'right' (up x front), 'up' and 'front' axes, relative to 'pos'. */
+void C_MakeOrthoFrustum(vec3_t pos, vec3_t up, vec3_t front, 
+                        float left, float right, float bot, float top, 
+                        float near_dist, float far_dist,
+                        struct frustum *out);
+
 bool C_RayIntersectsAABB(vec3_t ray_origin, vec3_t ray_dir, struct aabb aabb, float *out_t);
 bool C_RayIntersectsOBB (vec3_t ray_origin, vec3_t ray_dir, struct obb obb,   float *out_t);
 bool C_RayIntersectsTriMesh(vec3_t ray_origin, vec3_t ray_dir, vec3_t *tribuff, size_t n, float *out_t);
@@ -87,6 +94,7 @@ bool C_RayIntersectsPlane(vec3_t ray_origin, vec3_t ray_dir, struct plane plane,
  * sometimes give false positives. Howvever, this is still suitable for view frustum culling 
  * in some cases. */
 enum volume_intersec_type C_FrustumPointIntersectionFast(const struct frustum *frustum, vec3_t point);
+enum volume_intersec_type C_FrustumSphereIntersectionFast(const struct frustum *frustum, vec3_t center, float radius);
 enum volume_intersec_type C_FrustumAABBIntersectionFast (const struct frustum *frustum, const struct aabb *aabb);
 enum volume_intersec_type C_FrustumOBBIntersectionFast  (const struct frustum *frustum, const struct obb *obb);
 
@@ -52,23 +52,93 @@ enum pf_window_flags{
 #define CONFIG_RES_X                1920
 #define CONFIG_RES_Y                1080
 #define CONFIG_BAKED_TILE_TEX_RES   128
+/* Pre-baked chunks further than this from the camera are drawn with a coarser
+ * mesh where flat regions are merged. Close up, the long and thin triangles of 
+ * the merged regions cost more to rasterize than the extra vertices of the 
+ * full mesh. */
+#define CONFIG_TERRAIN_LOD_DIST     256
 #define CONFIG_WINDOWFLAGS          PF_WINDOWFLAGS_BORDERLESS_WINDOWED
 #define CONFIG_VSYNC                false
+/* Render to an offscreen EGL context instead of a window, for running on 
+ * machines with no display (such as build servers using llvmpipe). This is
+ * set by building with 'make HEADLESS=1', which also links against EGL and 
+ * builds GLEW for EGL. */
+#ifndef CONFIG_HEADLESS
+#define CONFIG_HEADLESS             false
+#endif
+/* Store the material textures of models and map chunks S3TC-compressed (DXT1, 
+ * or DXT5 for images with an alpha channel) both in the on-disk cache and in 
+ * video memory. UI images loaded with 'R_Texture_Load' are left uncompressed. 
+ * On drivers without S3TC support, the cached textures are decompressed at 
+ * load time. */
+#define CONFIG_TEXTURE_COMPRESS     true
 #define CONFIG_LOADING_SCREEN       "assets/loading_screens/battle_of_kulikovo.png"
+/* Print the load times and memory use of every loaded model at exit, the 
+ * slowest to load first. The same stats are available to scripts through 
+ * 'pf.asset_stats()'. */
+#define CONFIG_ASSET_STATS_REPORT   false
+/* Save the linked shader programs in the driver's binary format under 
+ * CONFIG_SHADER_CACHE_DIR in the base directory and load them from there at 
+ * startup. A program is compiled from source again whenever its' sources or 
+ * the driver change. */
+#define CONFIG_SHADER_CACHE         true
+#define CONFIG_SHADER_CACHE_DIR     "shader_cache"
+/* Only load the tiles of the map up front, and build and upload the meshes 
+ * of the chunks after the game has started, nearest to the camera first. 
+ * This allows large maps to start playing much sooner, at the cost of the 
+ * chunks far away from the camera popping in during the first seconds. At 
+ * most CONFIG_MAP_STREAM_CHUNKS_PER_FRAME chunks are uploaded every frame. */
+#define CONFIG_MAP_STREAM_CHUNKS    false
+#define CONFIG_MAP_STREAM_CHUNKS_PER_FRAME 4
+/* Save the data derived from a map file at load time (the navigation cost 
+ * fields and portals, the baked chunk textures and the minimap) to a 
+ * directory named after a hash of the map file, under CONFIG_MAP_CACHE_DIR 
+ * in the base directory. Later loads of the same map read it from there. 
+ * The baked textures are DXT1 compressed when CONFIG_TEXTURE_COMPRESS is 
+ * set, taking up 8 MB per chunk at the default CONFIG_BAKED_TILE_TEX_RES, 
+ * and 48 MB per chunk otherwise. Only the directories of the 
+ * CONFIG_MAP_CACHE_MAX_MAPS most recently loaded map files are kept. */
+#define CONFIG_MAP_CACHE            false
+#define CONFIG_MAP_CACHE_DIR        "cache"
+#define CONFIG_MAP_CACHE_MAX_MAPS   2
+
+/* The object-space pose matrices of every joint for every keyframe of an
+ * animated model are precomputed at load time, as long as the resulting 
+ * palettes for the model take up no more than this many kilobytes. Models
+ * over the budget have their poses evaluated from the keyframe SQTs at 
+ * render time. Set to 0 to disable baking entirely. With interpolation on,
+ * the palettes are only baked to fill the GPU instancing textures.
+ */
+#define CONFIG_ANIM_BAKED_PALETTE_MAX_KB  8192
+/* Blend joint transforms between adjacent keyframes instead of stepping 
+ * from one keyframe to the next. This allows animations to be exported at
+ * lower key rates without looking choppy. */
+#define CONFIG_ANIM_INTERPOLATE     true
+/* Print the animation memory usage of every model as it is loaded. */
+#define CONFIG_ANIM_MEM_REPORT      false
+/* Upload the baked joint palettes of animated models to a texture and draw
+ * all visible instances of the same model with a single instanced draw call, 
+ * with the skinning matrices fetched on the GPU. Models without baked 
+ * palettes are always drawn one entity at a time. */
+#define CONFIG_ANIM_GPU_INSTANCING  true
+/* Only read the joint transforms of an animation clip from the model file
+ * the first time that the clip is played, instead of when the model is 
+ * loaded. Clips with identical transforms on the same joint hierarchy are 
+ * kept in memory once, no matter how many models they belong to. */
+#define CONFIG_ANIM_LAZY_CLIPS      true
 
 #define CONFIG_SHADOWS              true
 #define CONFIG_SHADOW_MAP_RES       2048
-/* Determines the draw distance from the light source when creating the
- * shadow map. Note that a higher drawdistance leads to more peterpanning.
+/* Shadows are only drawn on surfaces up to this distance from the camera. A
+ * smaller distance gives sharper shadows for the same shadow map resolution,
+ * since the shadow map is split into cascades over this distance. The value 
+ * of 768 covers the whole view of the standard RTS camera.
  */
-#define CONFIG_SHADOW_DRAWDIST      512
-/* This is the half-width of the light source's frustum, in OpenGL coordinates.
- * A value is 128 is enough for all visible shadows to be rendered when 
- * viewing the scene from the standard RTS camera. When looking around with
- * an FPS camera, objects at the edges of the camera may not be properly
- * shadowed. However, increasing the FOV results in lower-quality shadows
- * for the same shadow map resolution. 
+#define CONFIG_SHADOW_MAX_DIST      768
+/* Controls how the shadow cascades are distributed over the distance from the 
+ * camera. 0.0 splits it into equal parts, while 1.0 gives the near cascades 
+ * a much smaller (more detailed) part than the far ones. 
  */
-#define CONFIG_SHADOW_FOV           128
+#define CONFIG_SHADOW_SPLIT_LAMBDA  0.5
 
 #endif
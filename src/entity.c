@@ -37,37 +37,15 @@
 #include "anim/public/anim.h"
 
 #include <assert.h>
+#include <string.h>
 
 /*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
+/* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out)
-{
-    mat4x4_t trans, scale, rot, tmp;
-
-    PFM_Mat4x4_MakeTrans(ent->pos.x, ent->pos.y, ent->pos.z, &trans);
-    PFM_Mat4x4_MakeScale(ent->scale.x, ent->scale.y, ent->scale.z, &scale);
-    PFM_Mat4x4_RotFromQuat(&ent->rotation, &rot);
-
-    PFM_Mat4x4_Mult4x4(&scale, &rot, &tmp);
-    PFM_Mat4x4_Mult4x4(&trans, &tmp, out);
-}
-
-uint32_t Entity_NewUID(void)
-{
-    static uint32_t uid = 0;
-    return uid++;
-}
-
-void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
+static void entity_obb_from_aabb(const struct entity *ent, const struct aabb *aabb, 
+                                 struct obb *out)
 {
-    const struct aabb *aabb;
-    if(ent->flags & ENTITY_FLAG_ANIMATED)
-        aabb = A_GetCurrPoseAABB(ent);
-    else
-        aabb = &ent->identity_aabb;
-
     vec4_t identity_verts_homo[8] = {
         {aabb->x_min, aabb->y_min, aabb->z_min, 1.0f},
         {aabb->x_min, aabb->y_min, aabb->z_max, 1.0f},
@@ -120,3 +98,59 @@ void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
     PFM_Vec3_Normal(&axis2, &out->axes[2]);
 }
 
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out)
+{
+    mat4x4_t trans, scale, rot, tmp;
+
+    PFM_Mat4x4_MakeTrans(ent->pos.x, ent->pos.y, ent->pos.z, &trans);
+    PFM_Mat4x4_MakeScale(ent->scale.x, ent->scale.y, ent->scale.z, &scale);
+    PFM_Mat4x4_RotFromQuat(&ent->rotation, &rot);
+
+    PFM_Mat4x4_Mult4x4(&scale, &rot, &tmp);
+    PFM_Mat4x4_Mult4x4(&trans, &tmp, out);
+}
+
+uint32_t Entity_NewUID(void)
+{
+    static uint32_t uid = 0;
+    return uid++;
+}
+
+void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
+{
+    const struct aabb *aabb;
+    if(ent->flags & ENTITY_FLAG_ANIMATED)
+        aabb = A_GetCurrPoseAABB(ent);
+    else
+        aabb = &ent->identity_aabb;
+
+    entity_obb_from_aabb(ent, aabb, out);
+}
+
+const struct obb *Entity_CullingOBB(struct entity *ent)
+{
+    const struct aabb *aabb;
+    if(ent->flags & ENTITY_FLAG_ANIMATED)
+        aabb = A_GetCurrClipAABB(ent);
+    else
+        aabb = &ent->identity_aabb;
+
+    if(ent->bounds.aabb == aabb
+    && 0 == memcmp(&ent->bounds.pos, &ent->pos, sizeof(vec3_t))
+    && 0 == memcmp(&ent->bounds.scale, &ent->scale, sizeof(vec3_t))
+    && 0 == memcmp(&ent->bounds.rotation, &ent->rotation, sizeof(quat_t))) {
+        return &ent->bounds.obb;
+    }
+
+    entity_obb_from_aabb(ent, aabb, &ent->bounds.obb);
+    ent->bounds.aabb = aabb;
+    ent->bounds.pos = ent->pos;
+    ent->bounds.scale = ent->scale;
+    ent->bounds.rotation = ent->rotation;
+
+    return &ent->bounds.obb;
+}
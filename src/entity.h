@@ -65,6 +65,18 @@ struct entity{
     float        selection_radius; /* The radius of the selection circle in OpenGL coordinates */
     float        max_speed;        /* The base movement speed in units of OpenGL coords / second */
     int          faction_id;       /* The faction to which this entity belongs to. */
+    /* World-space bounds used for culling. For animated entities, these 
+     * enclose all samples of the active clip, so that they only need to be 
+     * rebuilt when the transform or the active clip changes. The remaining
+     * members are the inputs that 'obb' was last built from. A NULL 'aabb' 
+     * means the cache is not yet valid. */
+    struct{
+    struct obb         obb;
+    const struct aabb *aabb;
+    vec3_t             pos;
+    vec3_t             scale;
+    quat_t             rotation;
+    }bounds;
     /* The following struct ('combat attributes') holds attributes 
      * which are only valid for entities for which 'ENTITY_FLAG_COMBATABLE' 
      * is set. */
@@ -78,5 +90,8 @@ struct entity{
 void     Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out);
 uint32_t Entity_NewUID(void);
 void     Entity_CurrentOBB(const struct entity *ent, struct obb *out);
+/* Returns cached world-space bounds which are conservative for all frames of
+ * the active animation clip. Suitable for visibility culling. */
+const struct obb *Entity_CullingOBB(struct entity *ent);
 
 #endif
@@ -87,6 +87,15 @@ struct combatstate{
 
 KHASH_MAP_INIT_INT(state, struct combatstate)
 
+/* The record written by 'G_Combat_SaveState'. The target is referred 
+ * to by its' UID. */
+struct combatstate_rec{
+    uint32_t           uid;
+    uint32_t           has_target;
+    uint32_t           target_uid;
+    struct combatstate cs;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -474,3 +483,70 @@ void G_Combat_StopAttack(const struct entity *ent)
     }
 }
 
+bool G_Combat_SaveState(SDL_RWops *stream)
+{
+    uint32_t num_states = kh_size(s_entity_state_table);
+    if(SDL_RWwrite(stream, &num_states, sizeof(num_states), 1) != 1)
+        return false;
+
+    uint32_t key;
+    struct combatstate curr;
+    kh_foreach(s_entity_state_table, key, curr, {
+
+        struct combatstate_rec rec = {
+            .uid        = key,
+            .has_target = (curr.target != NULL),
+            .target_uid = curr.target ? curr.target->uid : 0,
+            .cs         = curr,
+        };
+        rec.cs.target = NULL;
+
+        if(SDL_RWwrite(stream, &rec, sizeof(rec), 1) != 1)
+            return false;
+    });
+    return true;
+}
+
+size_t G_Combat_StateRecSize(void)
+{
+    return sizeof(struct combatstate_rec);
+}
+
+bool G_Combat_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map)
+{
+    uint32_t num_states;
+    if(SDL_RWread(stream, &num_states, sizeof(num_states), 1) != 1)
+        return false;
+
+    for(int i = 0; i < num_states; i++) {
+
+        struct combatstate_rec rec;
+        if(SDL_RWread(stream, &rec, sizeof(rec), 1) != 1)
+            return false;
+
+        khiter_t k = kh_get(entity, uid_map, rec.uid);
+        if(k == kh_end(uid_map))
+            continue;
+
+        const struct entity *ent = kh_value(uid_map, k);
+        struct combatstate *cs = combatstate_get(ent);
+        if(!cs)
+            continue;
+
+        *cs = rec.cs;
+        if(rec.has_target && (k = kh_get(entity, uid_map, rec.target_uid)) != kh_end(uid_map))
+            cs->target = kh_value(uid_map, k);
+
+        /* The target was not restored - look for a new one */
+        if(!cs->target && cs->state != STATE_NOT_IN_COMBAT) {
+
+            if(cs->state == STATE_CAN_ATTACK || cs->state == STATE_ATTACK_ANIM_PLAYING)
+                E_Entity_Notify(EVENT_ATTACK_END, ent->uid, NULL, ES_ENGINE);
+            cs->state = STATE_NOT_IN_COMBAT;
+        }
+
+        if(cs->state == STATE_ATTACK_ANIM_PLAYING)
+            E_Entity_Register(EVENT_ANIM_CYCLE_FINISHED, ent->uid, on_attack_anim_finish, (void*)ent);
+    }
+    return true;
+}
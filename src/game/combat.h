@@ -37,7 +37,9 @@
 #define COMBAT_H
 
 #include "public/game.h"
+
 #include <stdbool.h>
+#include <SDL.h>
 
 struct entity;
 
@@ -50,5 +52,13 @@ void G_Combat_RemoveEntity(const struct entity *ent);
 void G_Combat_StopAttack(const struct entity *ent);
 void G_Combat_ClearSavedMoveCmd(const struct entity *ent);
 
+/* Writes the combat state of all combatable entities to the stream */
+bool G_Combat_SaveState(SDL_RWops *stream);
+/* Restores state written by 'G_Combat_SaveState' to the entities that 
+ * the saved UIDs map to. The entities must already have been added. */
+bool G_Combat_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map);
+/* The size of the per-entity records written by 'G_Combat_SaveState' */
+size_t G_Combat_StateRecSize(void);
+
 #endif
 
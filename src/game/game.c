@@ -52,6 +52,9 @@
 #include "../collision.h"
 
 #include <assert.h> 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 #define CAM_HEIGHT          175.0f
@@ -139,40 +142,172 @@ static void g_init_map(void)
     M_InitMinimap(s_gs.map, DEFAULT_MINIMAP_POS);
     G_Move_Init(s_gs.map);
     G_Combat_Init();
+    R_GL_InvalidateStaticShadows();
 }
 
-static void g_shadow_pass(void)
+static int g_compare_render_private(const void *a, const void *b)
 {
-    R_GL_DepthPassBegin();
+    uintptr_t pa = (uintptr_t)(*(const struct entity**)a)->render_private;
+    uintptr_t pb = (uintptr_t)(*(const struct entity**)b)->render_private;
+    return (pa > pb) - (pa < pb);
+}
 
-    if(s_gs.map) {
-        M_RenderVisibleMap(s_gs.map, ACTIVE_CAM, RENDER_PASS_DEPTH);
+/* Animated entities whose model has an animation texture are not drawn right
+ * away, but are set aside to be drawn together with all other instances of 
+ * the same model in 'g_flush_instanced'. */
+static bool g_defer_instanced(struct entity *ent)
+{
+#if CONFIG_ANIM_GPU_INSTANCING
+    if(!(ent->flags & ENTITY_FLAG_ANIMATED))
+        return false;
+    if(!R_GL_HasAnimTex(ent->render_private))
+        return false;
+
+    kv_push(struct entity*, s_gs.inst_ents, ent);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void g_flush_instanced(enum render_pass pass)
+{
+    if(kv_size(s_gs.inst_ents) == 0)
+        return;
+
+    qsort(s_gs.inst_ents.a, kv_size(s_gs.inst_ents), sizeof(struct entity*), g_compare_render_private);
+
+    size_t begin = 0;
+    while(begin < kv_size(s_gs.inst_ents)) {
+
+        const void *render_private = kv_A(s_gs.inst_ents, begin)->render_private;
+        kv_reset(s_gs.inst_data);
+
+        size_t end = begin;
+        for(; end < kv_size(s_gs.inst_ents); end++) {
+
+            struct entity *curr = kv_A(s_gs.inst_ents, end);
+            if(curr->render_private != render_private)
+                break;
+
+            struct render_anim_inst inst;
+            int curr_sample, next_sample;
+            Entity_ModelMatrix(curr, &inst.model);
+            A_GetCurrSamples(curr, &curr_sample, &next_sample, &inst.frac);
+            inst.curr_sample = curr_sample;
+            inst.next_sample = next_sample;
+
+            kv_push(struct render_anim_inst, s_gs.inst_data, inst);
+        }
+
+        if(pass == RENDER_PASS_DEPTH)
+            R_GL_RenderDepthMapAnimInstanced(render_private, s_gs.inst_data.a, kv_size(s_gs.inst_data));
+        else
+            R_GL_DrawAnimInstanced(render_private, s_gs.inst_data.a, kv_size(s_gs.inst_data));
+
+        begin = end;
     }
 
-    struct frustum frust;
-    R_GL_GetLightFrustum(&frust);
+    kv_reset(s_gs.inst_ents);
+}
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
+static bool g_static_caster(const struct entity *ent)
+{
+    return (ent->flags & ENTITY_FLAG_STATIC) && !(ent->flags & ENTITY_FLAG_ANIMATED);
+}
 
-        if(!(curr->flags & ENTITY_FLAG_COLLISION))
+static void g_render_casters(const pentity_kvec_t *casters, const struct frustum *volume)
+{
+    for(int i = 0; i < kv_size(*casters); i++) {
+
+        struct entity *curr = kv_A(*casters, i);
+        const struct obb *obb = Entity_CullingOBB(curr);
+
+        if(C_FrustumOBBIntersectionFast(volume, obb) == VOLUME_INTERSEC_OUTSIDE)
             continue;
-    
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb);
 
-        if(!(C_FrustumOBBIntersectionFast(&frust, &obb) != VOLUME_INTERSEC_OUTSIDE))
+        if(g_defer_instanced(curr))
             continue;
 
         if(curr->flags & ENTITY_FLAG_ANIMATED)
-            A_Update(curr);
+            A_SetRenderState(curr);
 
         mat4x4_t model;
         Entity_ModelMatrix(curr, &model);
 
         R_GL_RenderDepthMap(curr->render_private, &model);
+    }
+
+    g_flush_instanced(RENDER_PASS_DEPTH);
+}
+
+/* An entity may be drawn in several cascades of the shadow pass as well as in 
+ * the regular pass. Its' animation is advanced once up front, and the passes 
+ * only read the animation state. */
+static void g_tick_anims(void)
+{
+    uint32_t key;
+    struct entity *curr;
+    kh_foreach(s_gs.active, key, curr, {
+
+        if(curr->flags & ENTITY_FLAG_ANIMATED)
+            A_Tick(curr);
     });
+}
+
+static void g_shadow_pass(void)
+{
+    R_GL_DepthPassBegin();
+
+    struct frustum frust;
+    R_GL_GetLightFrustum(&frust);
+
+    /* Gather the moving casters which can affect the visible part of the scene */
+    kv_reset(s_gs.dynamic_casters);
+
+    uint32_t key;
+    struct entity *curr;
+    kh_foreach(s_gs.active, key, curr, {
+
+        if(!(curr->flags & ENTITY_FLAG_COLLISION) || g_static_caster(curr))
+            continue;
+    
+        const struct obb *obb = Entity_CullingOBB(curr);
+        if(C_FrustumOBBIntersectionFast(&frust, obb) == VOLUME_INTERSEC_OUTSIDE)
+            continue;
+
+        kv_push(struct entity*, s_gs.dynamic_casters, curr);
+    });
+
+    /* The static casters are only gathered when some cascade must redraw them, 
+     * which should be rare. */
+    kv_reset(s_gs.static_casters);
+    bool have_static = false;
+
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+
+        struct frustum volume;
+
+        if(R_GL_DepthPassBeginCascade(i, SHADOW_CASTERS_STATIC, &volume)) {
+
+            if(!have_static) {
+                kh_foreach(s_gs.active, key, curr, {
+                    if((curr->flags & ENTITY_FLAG_COLLISION) && g_static_caster(curr))
+                        kv_push(struct entity*, s_gs.static_casters, curr);
+                });
+                have_static = true;
+            }
+
+            if(s_gs.map) {
+                M_RenderChunksInFrustum(s_gs.map, &volume, RENDER_PASS_DEPTH);
+            }
+            g_render_casters((const pentity_kvec_t*)&s_gs.static_casters, &volume);
+        }
+
+        if(R_GL_DepthPassBeginCascade(i, SHADOW_CASTERS_DYNAMIC, &volume)) {
+            g_render_casters((const pentity_kvec_t*)&s_gs.dynamic_casters, &volume);
+        }
+    }
 
     R_GL_DepthPassEnd();
 }
@@ -187,14 +322,19 @@ static void g_draw_pass(void)
     
         struct entity *curr = kv_A(s_gs.visible, i);
 
+        if(g_defer_instanced(curr))
+            continue;
+
         if(curr->flags & ENTITY_FLAG_ANIMATED)
-            A_Update(curr);
+            A_SetRenderState(curr);
 
         mat4x4_t model;
         Entity_ModelMatrix(curr, &model);
 
         R_GL_Draw(curr->render_private, &model);
     }
+
+    g_flush_instanced(RENDER_PASS_REGULAR);
 }
 
 /*****************************************************************************/
@@ -205,6 +345,10 @@ bool G_Init(void)
 {
     kv_init(s_gs.visible);
     kv_init(s_gs.visible_obbs);
+    kv_init(s_gs.inst_ents);
+    kv_init(s_gs.inst_data);
+    kv_init(s_gs.static_casters);
+    kv_init(s_gs.dynamic_casters);
 
     s_gs.active = kh_init(entity);
     if(!s_gs.active)
@@ -341,6 +485,10 @@ void G_Shutdown(void)
     kh_destroy(entity, s_gs.dynamic);
     kv_destroy(s_gs.visible);
     kv_destroy(s_gs.visible_obbs);
+    kv_destroy(s_gs.inst_ents);
+    kv_destroy(s_gs.inst_data);
+    kv_destroy(s_gs.static_casters);
+    kv_destroy(s_gs.dynamic_casters);
 }
 
 void G_Update(void)
@@ -357,21 +505,40 @@ void G_Update(void)
     struct entity *curr;
     kh_foreach(s_gs.active, key, curr, {
 
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb);
-
-        if(C_FrustumOBBIntersectionFast(&frust, &obb) != VOLUME_INTERSEC_OUTSIDE) {
+        const struct obb *culling_obb = Entity_CullingOBB(curr);
+        if(C_FrustumOBBIntersectionFast(&frust, culling_obb) != VOLUME_INTERSEC_OUTSIDE)
             kv_push(struct entity *, s_gs.visible, curr);
-            kv_push(struct obb, s_gs.visible_obbs, obb);
-        }
     });
 
+    /* The selection code needs bounds which are tight around the current pose. 
+     * These are only built for the (much smaller) set of visible entities. */
+    for(int i = 0; i < kv_size(s_gs.visible); i++) {
+
+        struct obb obb;
+        Entity_CurrentOBB(kv_A(s_gs.visible, i), &obb);
+        kv_push(struct obb, s_gs.visible_obbs, obb);
+    }
+
     /* Next, update the set of currently selected entities. */
     G_Sel_Update(ACTIVE_CAM, (const pentity_kvec_t*)&s_gs.visible, (obb_kvec_t*)&s_gs.visible_obbs);
 }
 
 void G_Render(void)
 {
+    /* Tile edits are accumulated, and the affected regions of the baked chunk textures 
+     * and the minimap are re-rendered at most once per frame. This clobbers the view 
+     * and projection of the active camera, so they are restored afterwards. */
+    if(s_gs.map && M_UpdateDirtyChunks(s_gs.map))
+        Camera_TickFinishPerspective(ACTIVE_CAM);
+
+    /* The same goes for the chunks that have been streamed in since the last frame */
+    if(s_gs.map && M_AL_StreamChunks(s_gs.map, ACTIVE_CAM)) {
+        R_GL_InvalidateStaticShadows();
+        Camera_TickFinishPerspective(ACTIVE_CAM);
+    }
+
+    g_tick_anims();
+
 #if CONFIG_SHADOWS
     g_shadow_pass();
 #endif
@@ -408,8 +575,10 @@ bool G_AddEntity(struct entity *ent)
     if(ent->flags & ENTITY_FLAG_COMBATABLE)
         G_Combat_AddEntity(ent, COMBAT_STANCE_AGGRESSIVE);
 
-    if(ent->flags & ENTITY_FLAG_STATIC)
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        R_GL_InvalidateStaticShadows();
         return true;
+    }
 
     k = kh_put(entity, s_gs.dynamic, ent->uid, &ret);
     assert(ret != -1 && ret != 0);
@@ -431,6 +600,8 @@ bool G_RemoveEntity(struct entity *ent)
         k = kh_get(entity, s_gs.dynamic, ent->uid);
         assert(k != kh_end(s_gs.dynamic));
         kh_del(entity, s_gs.dynamic, k);
+    }else{
+        R_GL_InvalidateStaticShadows();
     }
 
     G_Combat_RemoveEntity(ent);
@@ -438,6 +609,15 @@ bool G_RemoveEntity(struct entity *ent)
     return true;
 }
 
+void G_GetActiveEntities(pentity_kvec_t *out)
+{
+    uint32_t key;
+    struct entity *curr;
+    kh_foreach(s_gs.active, key, curr, {
+        kv_push(struct entity*, *out, curr);
+    });
+}
+
 void G_StopEntity(const struct entity *ent)
 {
     G_Combat_StopAttack(ent);
@@ -596,6 +776,21 @@ vec3_t G_ActiveCamDir(void)
     return ret;
 }
 
+void G_ActiveCamFrustum(struct frustum *out)
+{
+    Camera_MakeFrustum(ACTIVE_CAM, out);
+}
+
+void G_SetActiveCamPos(vec3_t pos)
+{
+    Camera_SetPos(ACTIVE_CAM, pos);
+}
+
+void G_SetActiveCamOrientation(float pitch, float yaw)
+{
+    Camera_SetPitchAndYaw(ACTIVE_CAM, pitch, yaw);
+}
+
 bool G_UpdateChunkMats(int chunk_r, int chunk_c, const char *mats_string)
 {
     return M_AL_UpdateChunkMats(s_gs.map, chunk_r, chunk_c, mats_string);
@@ -603,9 +798,79 @@ bool G_UpdateChunkMats(int chunk_r, int chunk_c, const char *mats_string)
 
 bool G_UpdateTile(const struct tile_desc *desc, const struct tile *tile)
 {
+    R_GL_InvalidateStaticShadows();
     return M_AL_UpdateTile(s_gs.map, desc, tile);
 }
 
+void G_StaticEntityMoved(const struct entity *ent)
+{
+    khiter_t k = kh_get(entity, s_gs.active, ent->uid);
+    if(k == kh_end(s_gs.active))
+        return;
+
+    R_GL_InvalidateStaticShadows();
+}
+
+bool G_SaveState(SDL_RWops *stream)
+{
+    if(!s_gs.map)
+        return false;
+
+    uint32_t num_factions = s_gs.num_factions;
+    if(SDL_RWwrite(stream, &num_factions, sizeof(num_factions), 1) != 1)
+        return false;
+    if(SDL_RWwrite(stream, s_gs.factions, sizeof(struct faction), num_factions) != num_factions)
+        return false;
+
+    for(int i = 0; i < num_factions; i++) {
+        if(SDL_RWwrite(stream, s_gs.diplomacy_table[i], sizeof(enum diplomacy_state), num_factions) != num_factions)
+            return false;
+    }
+
+    return G_Move_SaveState(stream)
+        && G_Combat_SaveState(stream);
+}
+
+void G_SaveStateSizes(uint32_t *out_faction, uint32_t *out_move_rec, uint32_t *out_combat_rec)
+{
+    *out_faction = sizeof(struct faction);
+    *out_move_rec = G_Move_StateRecSize();
+    *out_combat_rec = G_Combat_StateRecSize();
+}
+
+bool G_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map)
+{
+    if(!s_gs.map)
+        return false;
+
+    uint32_t num_factions;
+    if(SDL_RWread(stream, &num_factions, sizeof(num_factions), 1) != 1)
+        return false;
+    if(num_factions > MAX_FACTIONS)
+        return false;
+
+    struct faction factions[MAX_FACTIONS];
+    enum diplomacy_state diplomacy_table[MAX_FACTIONS][MAX_FACTIONS];
+
+    if(SDL_RWread(stream, factions, sizeof(struct faction), num_factions) != num_factions)
+        return false;
+    for(int i = 0; i < num_factions; i++) {
+        if(SDL_RWread(stream, diplomacy_table[i], sizeof(enum diplomacy_state), num_factions) != num_factions)
+            return false;
+    }
+
+    s_gs.num_factions = num_factions;
+    for(int i = 0; i < num_factions; i++) {
+
+        s_gs.factions[i] = factions[i];
+        s_gs.factions[i].name[MAX_FAC_NAME_LEN-1] = '\0';
+        memcpy(s_gs.diplomacy_table[i], diplomacy_table[i], sizeof(enum diplomacy_state) * num_factions);
+    }
+
+    return G_Move_LoadState(stream, uid_map)
+        && G_Combat_LoadState(stream, uid_map);
+}
+
 const khash_t(entity) *G_GetDynamicEntsSet(void)
 {
     return s_gs.dynamic;
@@ -39,6 +39,7 @@
 #include "public/game.h"
 #include "../lib/public/kvec.h"
 #include "faction.h"
+#include "../render/public/render.h"
 
 #define NUM_CAMERAS  2
 
@@ -61,6 +62,19 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     kvec_t(struct obb)      visible_obbs;
+    /*-------------------------------------------------------------------------
+     * Scratch buffers for batching animated entities which share a model into
+     * a single instanced draw call. Only valid during a render pass.
+     *-------------------------------------------------------------------------
+     */
+    kvec_t(struct entity*)  inst_ents;
+    kvec_t(struct render_anim_inst) inst_data;
+    /*-------------------------------------------------------------------------
+     * Scratch buffers for the shadow casters of the current depth pass.
+     *-------------------------------------------------------------------------
+     */
+    kvec_t(struct entity*)  static_casters;
+    kvec_t(struct entity*)  dynamic_casters;
     /*-------------------------------------------------------------------------
      * Up-to-date set of all non-static entities. (Subset of 'active' set). 
      * Used for collision avoidance force computations.
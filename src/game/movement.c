@@ -85,6 +85,18 @@ struct movestate{
 
 KHASH_MAP_INIT_INT(state, struct movestate)
 
+/* The records written by 'G_Move_SaveState'. Each flock record is 
+ * followed by the UIDs of its' members. */
+struct movestate_rec{
+    uint32_t         uid;
+    struct movestate ms;
+};
+
+struct flock_rec{
+    vec2_t           target_xz;
+    uint32_t         num_ents;
+};
+
 struct flock{
     khash_t(entity) *ents;
     vec2_t           target_xz; 
@@ -425,10 +437,13 @@ static void move_marker_add(vec3_t pos, bool attack)
 
     ent->pos = pos;
     ent->scale = (vec3_t){2.0f, 2.0f, 2.0f};
-    E_Entity_Register(EVENT_ANIM_FINISHED, ent->uid, on_marker_anim_finish, ent);
 
-    A_InitCtx(ent, "Converge", 48);
+    if(!A_InitCtx(ent, "Converge", 48)) {
+        AL_EntityFree(ent);
+        return;
+    }
     A_SetActiveClip(ent, "Converge", ANIM_MODE_ONCE, 48);
+    E_Entity_Register(EVENT_ANIM_FINISHED, ent->uid, on_marker_anim_finish, ent);
 
     kv_push(struct entity*, s_move_markers, ent);
 }
@@ -916,6 +931,68 @@ static void on_30hz_tick(void *user, void *event)
     }
 }
 
+/* Re-creates a saved flock, requesting a path to its' target the same way 
+ * as 'make_flock_from_selection'. Unlike it, this leaves the movement state
+ * of the entities untouched, except for those for which no path could be 
+ * found, which are stopped. */
+static bool flock_restore(const pentity_kvec_t *ents, vec2_t target_xz)
+{
+    struct flock new_flock = (struct flock) {
+        .ents = kh_init(entity),
+        .target_xz = target_xz,
+    };
+
+    if(!new_flock.ents)
+        return false;
+
+    struct tile_desc pathed_ents_descs[kv_size(*ents)];
+    size_t num_pathed_ents = 0;
+
+    for(int i = 0; i < kv_size(*ents); i++) {
+
+        const struct entity *curr_ent = kv_A(*ents, i);
+        struct movestate *ms = movestate_get(curr_ent);
+        assert(ms);
+
+        struct tile_desc curr_desc;
+        M_DescForPoint2D(s_map, (vec2_t){curr_ent->pos.x, curr_ent->pos.z}, &curr_desc);
+
+        if(same_chunk_as_any_in_set(curr_desc, pathed_ents_descs, num_pathed_ents)
+        || M_NavRequestPath(s_map, (vec2_t){curr_ent->pos.x, curr_ent->pos.z}, target_xz, &new_flock.dest_id)) {
+
+            pathed_ents_descs[num_pathed_ents++] = curr_desc;
+            flock_add(&new_flock, curr_ent);
+
+        }else{
+
+            if(ms->state != STATE_ARRIVED) 
+                entity_finish_moving(curr_ent);
+            *ms = (struct movestate) {
+                .state = STATE_ARRIVED,
+                .velocity = (vec2_t){0.0f}
+            };
+        }
+    }
+
+    if(kh_size(new_flock.ents) == 0) {
+        kh_destroy(entity, new_flock.ents);
+        return true;
+    }
+
+    struct flock *merge_flock = flock_for_dest(new_flock.dest_id);
+    if(merge_flock) {
+
+        uint32_t key;
+        struct entity *curr;
+        kh_foreach(new_flock.ents, key, curr, { flock_add(merge_flock, curr); });
+        kh_destroy(entity, new_flock.ents);
+
+    }else{
+        kv_push(struct flock, s_flocks, new_flock);
+    }
+    return true;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1025,3 +1102,110 @@ void G_Move_SetAttackOnLeftClick(void)
     Cursor_SetRTSPointer(CURSOR_TARGET);
 }
 
+bool G_Move_SaveState(SDL_RWops *stream)
+{
+    uint32_t num_states = kh_size(s_entity_state_table);
+    if(SDL_RWwrite(stream, &num_states, sizeof(num_states), 1) != 1)
+        return false;
+
+    uint32_t key;
+    struct movestate curr;
+    kh_foreach(s_entity_state_table, key, curr, {
+
+        struct movestate_rec rec = {.uid = key, .ms = curr};
+        if(SDL_RWwrite(stream, &rec, sizeof(rec), 1) != 1)
+            return false;
+    });
+
+    uint32_t num_flocks = kv_size(s_flocks);
+    if(SDL_RWwrite(stream, &num_flocks, sizeof(num_flocks), 1) != 1)
+        return false;
+
+    for(int i = 0; i < kv_size(s_flocks); i++) {
+
+        const struct flock *curr_flock = &kv_A(s_flocks, i);
+        struct flock_rec rec = {
+            .target_xz = curr_flock->target_xz,
+            .num_ents = kh_size(curr_flock->ents),
+        };
+        if(SDL_RWwrite(stream, &rec, sizeof(rec), 1) != 1)
+            return false;
+
+        for(khiter_t k = kh_begin(curr_flock->ents); k != kh_end(curr_flock->ents); k++) {
+
+            if(!kh_exist(curr_flock->ents, k))
+                continue;
+            uint32_t uid = kh_key(curr_flock->ents, k);
+            if(SDL_RWwrite(stream, &uid, sizeof(uid), 1) != 1)
+                return false;
+        }
+    }
+    return true;
+}
+
+size_t G_Move_StateRecSize(void)
+{
+    return sizeof(struct movestate_rec);
+}
+
+bool G_Move_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map)
+{
+    uint32_t num_states;
+    if(SDL_RWread(stream, &num_states, sizeof(num_states), 1) != 1)
+        return false;
+
+    for(int i = 0; i < num_states; i++) {
+
+        struct movestate_rec rec;
+        if(SDL_RWread(stream, &rec, sizeof(rec), 1) != 1)
+            return false;
+
+        khiter_t k = kh_get(entity, uid_map, rec.uid);
+        if(k == kh_end(uid_map))
+            continue;
+
+        const struct entity *ent = kh_value(uid_map, k);
+        struct movestate *ms = movestate_get(ent);
+        if(ms)
+            *ms = rec.ms;
+        else
+            movestate_set(ent, &rec.ms);
+    }
+
+    uint32_t num_flocks;
+    if(SDL_RWread(stream, &num_flocks, sizeof(num_flocks), 1) != 1)
+        return false;
+
+    pentity_kvec_t ents;
+    kv_init(ents);
+
+    for(int i = 0; i < num_flocks; i++) {
+
+        struct flock_rec rec;
+        if(SDL_RWread(stream, &rec, sizeof(rec), 1) != 1)
+            goto fail;
+
+        kv_reset(ents);
+        for(int j = 0; j < rec.num_ents; j++) {
+
+            uint32_t uid;
+            if(SDL_RWread(stream, &uid, sizeof(uid), 1) != 1)
+                goto fail;
+
+            khiter_t k = kh_get(entity, uid_map, uid);
+            if(k == kh_end(uid_map) || !movestate_get(kh_value(uid_map, k)))
+                continue;
+            kv_push(struct entity*, ents, kh_value(uid_map, k));
+        }
+
+        if(kv_size(ents) > 0 && !flock_restore(&ents, rec.target_xz))
+            goto fail;
+    }
+
+    kv_destroy(ents);
+    return true;
+
+fail:
+    kv_destroy(ents);
+    return false;
+}
@@ -37,7 +37,10 @@
 #define MOVEMENT_H
 
 #include "../pf_math.h"
+#include "public/game.h"
+
 #include <stdbool.h>
+#include <SDL.h>
 
 struct map;
 struct entity;
@@ -51,6 +54,15 @@ void G_Move_Stop(const struct entity *ent);
 bool G_Move_GetDest(const struct entity *ent, vec2_t *out_xz);
 void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz);
 
+/* Writes the movement state of all entities and their flocks to the stream */
+bool G_Move_SaveState(SDL_RWops *stream);
+/* Restores state written by 'G_Move_SaveState'. 'uid_map' maps the saved 
+ * UIDs to the entities to restore the state to. Saved entities which are
+ * missing from 'uid_map' are skipped. */
+bool G_Move_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map);
+/* The size of the per-entity records written by 'G_Move_SaveState' */
+size_t G_Move_StateRecSize(void);
+
 
 #endif
 
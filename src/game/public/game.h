@@ -52,6 +52,7 @@ struct map;
 struct tile_desc;
 struct tile;
 struct faction;
+struct frustum;
 
 enum cam_mode{
     CAM_MODE_FPS,
@@ -89,6 +90,10 @@ void   G_MakeStaticObjsImpassable(void);
 bool   G_AddEntity(struct entity *ent);
 bool   G_RemoveEntity(struct entity *ent);
 void   G_StopEntity(const struct entity *ent);
+/* Appends all the entities currently taking part in the simulation to 'out' */
+void   G_GetActiveEntities(pentity_kvec_t *out);
+/* Must be called after the position, scale or rotation of a static entity is changed */
+void   G_StaticEntityMoved(const struct entity *ent);
 
 bool   G_AddFaction(const char *name, vec3_t color);
 bool   G_RemoveFaction(int faction_id);
@@ -101,11 +106,24 @@ bool   G_ActivateCamera(int idx, enum cam_mode mode);
 void   G_MoveActiveCamera(vec2_t xz_ground_pos);
 vec3_t G_ActiveCamPos(void);
 vec3_t G_ActiveCamDir(void);
+void   G_ActiveCamFrustum(struct frustum *out);
+void   G_SetActiveCamPos(vec3_t pos);
+void   G_SetActiveCamOrientation(float pitch, float yaw);
 
 bool   G_UpdateMinimapChunk(int chunk_r, int chunk_c);
 bool   G_UpdateChunkMats(int chunk_r, int chunk_c, const char *mats_string);
 bool   G_UpdateTile(const struct tile_desc *desc, const struct tile *tile);
 
+/* Writes the factions, their diplomatic relations and the movement and combat 
+ * state of the active entities to the stream. A map must be loaded. */
+bool   G_SaveState(SDL_RWops *stream);
+/* Restores the state written by 'G_SaveState'. 'uid_map' maps the UIDs of the
+ * saved entities to the (already active) entities taking their place. */
+bool   G_LoadState(SDL_RWops *stream, const khash_t(entity) *uid_map);
+/* The sizes of the structures that 'G_SaveState' writes as they are. State 
+ * saved with different sizes cannot be restored. */
+void   G_SaveStateSizes(uint32_t *out_faction, uint32_t *out_move_rec, uint32_t *out_combat_rec);
+
 
 /*###########################################################################*/
 /* GAME SELECTION                                                            */
@@ -0,0 +1,170 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "headless.h"
+#include "config.h"
+
+#if CONFIG_HEADLESS
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static EGLDisplay s_display = EGL_NO_DISPLAY;
+static EGLSurface s_surface = EGL_NO_SURFACE;
+static EGLContext s_context = EGL_NO_CONTEXT;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static EGLDisplay headless_get_display(void)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = 
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if(get_platform_display) {
+        EGLDisplay ret = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if(ret != EGL_NO_DISPLAY)
+            return ret;
+    }
+
+    /* Fall back to whatever the EGL implementation gives us by default */
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Headless_Init(int width, int height)
+{
+    s_display = headless_get_display();
+    if(s_display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "Headless: Failed to get EGL display.\n");
+        goto fail_display;
+    }
+
+    EGLint major, minor;
+    if(!eglInitialize(s_display, &major, &minor)) {
+        fprintf(stderr, "Headless: Failed to initialize EGL: 0x%x\n", eglGetError());
+        goto fail_display;
+    }
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE,    EGL_OPENGL_BIT,
+        EGL_RED_SIZE,           8,
+        EGL_GREEN_SIZE,         8,
+        EGL_BLUE_SIZE,          8,
+        EGL_ALPHA_SIZE,         8,
+        EGL_DEPTH_SIZE,         24,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint num_configs;
+    if(!eglChooseConfig(s_display, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+        fprintf(stderr, "Headless: No suitable EGL framebuffer configuration.\n");
+        goto fail_config;
+    }
+
+    const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH,  width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+
+    s_surface = eglCreatePbufferSurface(s_display, config, pbuffer_attribs);
+    if(s_surface == EGL_NO_SURFACE) {
+        fprintf(stderr, "Headless: Failed to create pbuffer surface: 0x%x\n", eglGetError());
+        goto fail_config;
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+        goto fail_context;
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION,          3,
+        EGL_CONTEXT_MINOR_VERSION,          3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,    EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    s_context = eglCreateContext(s_display, config, EGL_NO_CONTEXT, context_attribs);
+    if(s_context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Headless: Failed to create OpenGL 3.3 context: 0x%x\n", eglGetError());
+        goto fail_context;
+    }
+
+    if(!eglMakeCurrent(s_display, s_surface, s_surface, s_context)) {
+        fprintf(stderr, "Headless: Failed to make context current: 0x%x\n", eglGetError());
+        goto fail_current;
+    }
+
+    return true;
+
+fail_current:
+    eglDestroyContext(s_display, s_context);
+fail_context:
+    eglDestroySurface(s_display, s_surface);
+fail_config:
+    eglTerminate(s_display);
+fail_display:
+    return false;
+}
+
+void Headless_Shutdown(void)
+{
+    eglMakeCurrent(s_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(s_display, s_context);
+    eglDestroySurface(s_display, s_surface);
+    eglTerminate(s_display);
+}
+
+void Headless_SwapBuffers(void)
+{
+    /* Pbuffers are single-buffered, so this only flushes the pending commands. */
+    eglSwapBuffers(s_display, s_surface);
+}
+
+#endif
+
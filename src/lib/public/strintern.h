@@ -0,0 +1,57 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2017-2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef STRINTERN_H
+#define STRINTERN_H
+
+#include <stddef.h>
+
+/* Maps strings to small integer handles. Handles are handed out in insertion 
+ * order starting from 0, so that they can be used to index arrays that run 
+ * parallel to the table. The interned copies of the strings are never moved 
+ * and stay valid until the table is freed. */
+typedef struct strintern strintern_t;
+
+strintern_t *strintern_init(int init_capacity);
+void         strintern_free(strintern_t *si);
+/* Returns the handle for the string, adding it to the table if it is not already 
+ * there, or -1 if memory could not be allocated. */
+int          strintern_put(strintern_t *si, const char *str);
+/* Returns the handle for the string or -1 if it was never added. */
+int          strintern_get(const strintern_t *si, const char *str);
+const char  *strintern_str(const strintern_t *si, int handle);
+size_t       strintern_get_size(const strintern_t *si);
+
+#endif
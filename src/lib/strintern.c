@@ -0,0 +1,180 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2017-2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "./public/strintern.h"
+#include "./public/khash.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define CHUNK_SIZE (4096 - sizeof(struct chunk))
+
+/* The strings are packed into chunks which are never reallocated, so the keys 
+ * of the hash table can point straight into them. */
+struct chunk {
+    struct chunk *next;
+    size_t        used;
+    size_t        size;
+    char          mem[];
+};
+
+KHASH_MAP_INIT_STR(handle, int)
+
+struct strintern {
+    khash_t(handle) *table;
+    const char     **strs;
+    int              size;
+    int              capacity;
+    struct chunk    *chunks;
+};
+
+static const char *strintern_copy(strintern_t *si, const char *str)
+{
+    size_t len = strlen(str) + 1;
+
+    if(!si->chunks || si->chunks->size - si->chunks->used < len) {
+
+        size_t size = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+        struct chunk *new = malloc(sizeof(struct chunk) + size);
+        if(!new)
+            return NULL;
+
+        new->next = si->chunks;
+        new->used = 0;
+        new->size = size;
+        si->chunks = new;
+    }
+
+    char *ret = si->chunks->mem + si->chunks->used;
+    memcpy(ret, str, len);
+    si->chunks->used += len;
+    return ret;
+}
+
+strintern_t *strintern_init(int init_capacity)
+{
+    strintern_t *ret = malloc(sizeof(strintern_t));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->table = kh_init(handle);
+    if(!ret->table)
+        goto fail_table;
+
+    if(init_capacity < 1)
+        init_capacity = 1;
+    if(kh_resize(handle, ret->table, init_capacity) < 0)
+        goto fail_strs;
+
+    ret->strs = malloc(sizeof(const char*) * init_capacity);
+    if(!ret->strs)
+        goto fail_strs;
+
+    ret->size = 0;
+    ret->capacity = init_capacity;
+    ret->chunks = NULL;
+    return ret;
+
+fail_strs:
+    kh_destroy(handle, ret->table);
+fail_table:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+void strintern_free(strintern_t *si)
+{
+    struct chunk *curr = si->chunks;
+    while(curr) {
+        struct chunk *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+
+    kh_destroy(handle, si->table);
+    free(si->strs);
+    free(si);
+}
+
+int strintern_put(strintern_t *si, const char *str)
+{
+    khiter_t k = kh_get(handle, si->table, str);
+    if(k != kh_end(si->table))
+        return kh_value(si->table, k);
+
+    if(si->size == si->capacity) {
+
+        const char **strs = realloc(si->strs, sizeof(const char*) * si->capacity * 2);
+        if(!strs)
+            return -1;
+        si->strs = strs;
+        si->capacity *= 2;
+    }
+
+    const char *copy = strintern_copy(si, str);
+    if(!copy)
+        return -1;
+
+    int put_ret;
+    k = kh_put(handle, si->table, copy, &put_ret);
+    if(put_ret == -1)
+        return -1; /* The copy is left unused in its' chunk */
+
+    kh_value(si->table, k) = si->size;
+    si->strs[si->size] = copy;
+    return si->size++;
+}
+
+int strintern_get(const strintern_t *si, const char *str)
+{
+    khiter_t k = kh_get(handle, si->table, str);
+    if(k == kh_end(si->table))
+        return -1;
+    return kh_value(si->table, k);
+}
+
+const char *strintern_str(const strintern_t *si, int handle)
+{
+    assert(handle >= 0 && handle < si->size);
+    return si->strs[handle];
+}
+
+size_t strintern_get_size(const strintern_t *si)
+{
+    return si->size;
+}
+
@@ -44,6 +44,7 @@
 #include "navigation/public/nav.h"
 #include "event.h"
 #include "ui.h"
+#include "headless.h"
 
 #include <GL/glew.h>
 #include <SDL.h>
@@ -62,6 +63,8 @@
 #define PF_VER_MINOR 28
 #define PF_VER_PATCH 0
 
+#define NUM_GPU_TIMERS 3
+
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
 /*****************************************************************************/
@@ -70,6 +73,17 @@
 const char                *g_basepath;
 
 unsigned                   g_last_frame_ms = 0;
+/* CPU time spent on the previous frame, not counting the buffer swap */
+float                      g_last_frame_cpu_ms = 0.0f;
+unsigned long              g_last_frame_cpu_idx = 0;
+/* GPU time spent on rendering frame 'g_last_frame_gpu_idx'. As the timer queries 
+ * are read back without stalling, this lags behind the CPU time by at least 
+ * (NUM_GPU_TIMERS - 1) frames, and by more when a result is not ready in time. */
+float                      g_last_frame_gpu_ms = 0.0f;
+unsigned long              g_last_frame_gpu_idx = 0;
+/* When non-empty, the next rendered frame is written to this path as a PPM 
+ * image, after which the path is cleared. */
+char                       g_frame_dump_path[256] = {0};
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -83,6 +97,9 @@ static kvec_t(SDL_Event)   s_prev_tick_events;
 
 static struct nk_context  *s_nk_ctx;
 
+static GLuint              s_gpu_timers[NUM_GPU_TIMERS];
+static unsigned long       s_frame_idx = 0;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -146,7 +163,11 @@ static void gl_set_globals(void)
 
 static void render(void)
 {
+#if !CONFIG_HEADLESS
     SDL_GL_MakeCurrent(s_window, s_context); 
+#endif
+
+    glBeginQuery(GL_TIME_ELAPSED, s_gpu_timers[s_frame_idx % NUM_GPU_TIMERS]);
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -157,7 +178,38 @@ static void render(void)
     G_Render();
     UI_Render();
 
+    glEndQuery(GL_TIME_ELAPSED);
+
+    /* The oldest query is the one that will be re-used next frame. By now, it 
+     * should be complete so that reading it back doesn't stall the pipeline. */
+    GLuint oldest = s_gpu_timers[(s_frame_idx + 1) % NUM_GPU_TIMERS];
+    if(s_frame_idx + 1 >= NUM_GPU_TIMERS) {
+
+        GLint available = 0;
+        glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available) {
+            GLuint64 elapsed_ns;
+            glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed_ns);
+            g_last_frame_gpu_ms = elapsed_ns / 1000000.0f;
+            g_last_frame_gpu_idx = s_frame_idx + 1 - NUM_GPU_TIMERS;
+        }
+    }
+    g_last_frame_cpu_idx = s_frame_idx;
+    s_frame_idx++;
+}
+
+static void present(void)
+{
+    if(g_frame_dump_path[0]) {
+        R_GL_DumpFBColor_PPM(g_frame_dump_path, CONFIG_RES_X, CONFIG_RES_Y);
+        g_frame_dump_path[0] = '\0';
+    }
+
+#if CONFIG_HEADLESS
+    Headless_SwapBuffers();
+#else
     SDL_GL_SwapWindow(s_window);
+#endif
 }
 
 /* Fills the framebuffer with the loading screen using SDL's software renderer. 
@@ -217,11 +269,31 @@ static bool engine_init(char **argv)
     if(!kv_resize(SDL_Event, s_prev_tick_events, 256))
         return false;
 
+#if CONFIG_HEADLESS
+    /* We still create an SDL window as the input and UI code expects one, 
+     * but it is never shown or rendered to. */
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+#endif
+
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0) {
         fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
         goto fail_sdl;
     }
 
+#if CONFIG_HEADLESS
+    s_window = SDL_CreateWindow(
+        "Permafrost Engine",
+        SDL_WINDOWPOS_UNDEFINED, 
+        SDL_WINDOWPOS_UNDEFINED,
+        CONFIG_RES_X, 
+        CONFIG_RES_Y, 
+        SDL_WINDOW_HIDDEN);
+
+    if(!Headless_Init(CONFIG_RES_X, CONFIG_RES_Y)) {
+        fprintf(stderr, "Failed to create headless rendering context\n");
+        goto fail_headless;
+    }
+#else
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
@@ -246,6 +318,7 @@ static bool engine_init(char **argv)
 
     s_context = SDL_GL_CreateContext(s_window); 
     SDL_GL_SetSwapInterval(CONFIG_VSYNC ? 1 : 0); 
+#endif
 
     glewExperimental = GL_TRUE;
     if(glewInit() != GLEW_OK) {
@@ -260,19 +333,23 @@ static bool engine_init(char **argv)
 
     glViewport(0, 0, CONFIG_RES_X, CONFIG_RES_Y);
     glProvokingVertex(GL_FIRST_VERTEX_CONVENTION); 
+    glGenQueries(NUM_GPU_TIMERS, s_gpu_timers);
 
-    stbi_set_flip_vertically_on_load(true);
+    R_Texture_SetFlipOnLoad(true);
 
     if(!AL_Init()) {
         fprintf(stderr, "Failed to initialize asset-loading module.\n");
         goto fail_al;
     }
 
+#if !CONFIG_HEADLESS
+    /* There is no mouse cursor to speak of when running headless */
     if(!Cursor_InitAll(argv[1])) {
         fprintf(stderr, "Failed to initialize cursor module\n");
         goto fail_cursor;
     }
     Cursor_SetActive(CURSOR_POINTER);
+#endif
 
     if(!R_Init(argv[1])) {
         fprintf(stderr, "Failed to iniaialize rendering subsystem\n");
@@ -321,7 +398,13 @@ fail_render:
 fail_cursor:
 fail_al:
 fail_glew:
+#if CONFIG_HEADLESS
+    Headless_Shutdown();
+    /* Headless_Init releases its own EGL objects when it fails */
+fail_headless:
+#else
     SDL_GL_DeleteContext(s_context);
+#endif
     SDL_DestroyWindow(s_window);
     SDL_Quit();
 fail_sdl:
@@ -345,8 +428,13 @@ static void engine_shutdown(void)
     E_Shutdown();
 
     kv_destroy(s_prev_tick_events);
+    glDeleteQueries(NUM_GPU_TIMERS, s_gpu_timers);
 
+#if CONFIG_HEADLESS
+    Headless_Shutdown();
+#else
     SDL_GL_DeleteContext(s_context);
+#endif
     SDL_DestroyWindow(s_window); 
     SDL_Quit();
 }
@@ -398,11 +486,18 @@ int main(int argc, char **argv)
     uint32_t last_ts = SDL_GetTicks();
     while(!s_quit) {
 
+        uint64_t frame_start = SDL_GetPerformanceCounter();
+
         process_sdl_events();
         E_ServiceQueue();
+        AL_ServiceLoadQueue();
         G_Update();
         render();
 
+        g_last_frame_cpu_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0f 
+                            / SDL_GetPerformanceFrequency();
+        present();
+
         uint32_t curr_time = SDL_GetTicks();
         g_last_frame_ms = curr_time - last_ts;
         last_ts = curr_time;
@@ -40,42 +40,372 @@
 #include "pfchunk.h"
 #include "../camera.h"
 #include "../collision.h"
+#include "../config.h"
 
 #include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#endif
 
 #include <SDL.h>
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
 #define MAX(a, b)           ((a) > (b) ? (a) : (b))
 
+#ifndef PATH_MAX
+#define PATH_MAX            4096
+#endif
+
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void m_aabb_for_chunk(const struct map *map, struct chunkpos p, struct aabb *out)
+static void m_make_dir(const char *path)
+{
+    /* Fails harmlessly when the directory exists already */
+#if defined(_WIN32)
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+/* The cache holds plain files only */
+static bool m_remove_dir(const char *path)
+{
+    DIR *dir = opendir(path);
+    if(!dir)
+        return false;
+
+    struct dirent *entry;
+    while((entry = readdir(dir))) {
+
+        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        char file[PATH_MAX];
+        int len = snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        if(len >= 0 && len < sizeof(file))
+            remove(file);
+    }
+    closedir(dir);
+    return (rmdir(path) == 0);
+}
+
+/* Cache entries are the directories named after the 16 hex digit map hash */
+static bool m_is_cache_entry(const char *name)
+{
+    return (strlen(name) == 16 && strspn(name, "0123456789abcdef") == 16);
+}
+
+static float m_dist_to_aabb(vec3_t pos, const struct aabb *aabb)
+{
+    float dx = MAX(MAX(aabb->x_min - pos.x, 0.0f), pos.x - aabb->x_max);
+    float dy = MAX(MAX(aabb->y_min - pos.y, 0.0f), pos.y - aabb->y_max);
+    float dz = MAX(MAX(aabb->z_min - pos.z, 0.0f), pos.z - aabb->z_max);
+
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+/* Picks the render context to draw the chunk with. The coarse mesh of a pre-baked chunk 
+ * has exactly the same surface as the full mesh, so it is always used for the depth 
+ * pass. For the regular pass, it is used when the chunk is far enough from the viewer. 
+ * When there is no viewer position ('view_pos' is NULL), the full mesh is used. Returns
+ * NULL for chunks which have not been streamed in yet. */
+static void *m_chunk_rprivate(const struct pfchunk *chunk, const struct aabb *chunk_aabb,
+                              const vec3_t *view_pos, enum render_pass pass)
+{
+    if(!chunk->render_private_tiles)
+        return NULL;
+
+    if(chunk->mode == CHUNK_RENDER_MODE_REALTIME_BLEND)
+        return chunk->render_private_tiles;
+
+    if(!chunk->render_private_lod)
+        return chunk->render_private_prebaked;
+
+    if(pass == RENDER_PASS_DEPTH)
+        return chunk->render_private_lod;
+
+    if(view_pos && m_dist_to_aabb(*view_pos, chunk_aabb) > CONFIG_TERRAIN_LOD_DIST)
+        return chunk->render_private_lod;
+
+    return chunk->render_private_prebaked;
+}
+
+/* The top of the bounds is the highest corner of any of the chunk's tiles */
+static void m_chunk_local_aabb(const struct pfchunk *chunk, int r, int c, struct aabb *out)
 {
-    size_t chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
-    size_t chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
-    size_t chunk_max_height = MAX_HEIGHT_LEVEL * Y_COORDS_PER_TILE;
+    float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
+    float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
 
-    ssize_t x_offset = -(p.c * chunk_x_dim);
-    ssize_t z_offset =  (p.r * chunk_z_dim);
+    int max_height = 0;
+    for(int i = 0; i < TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT; i++) {
 
-    out->x_max = map->pos.x + x_offset;
-    out->x_min = out->x_max - chunk_x_dim;
+        const struct tile *tile = &chunk->tiles[i];
+        max_height = MAX(max_height, MAX(MAX(M_Tile_NWHeight(tile), M_Tile_NEHeight(tile)), 
+                                         MAX(M_Tile_SWHeight(tile), M_Tile_SEHeight(tile))));
+    }
 
-    out->z_min = map->pos.z + z_offset;
-    out->z_max = out->z_min + chunk_z_dim;
+    out->x_max = -(c * chunk_x_dim);
+    out->x_min = -((c + 1) * chunk_x_dim);
+
+    out->z_min = r * chunk_z_dim;
+    out->z_max = (r + 1) * chunk_z_dim;
+
+    /* The bottom faces of the tiles are one tile's height below the ground */
+    out->y_min = -Y_COORDS_PER_TILE;
+    out->y_max = max_height * Y_COORDS_PER_TILE;
+}
+
+static void m_aabb_union(const struct aabb *a, const struct aabb *b, struct aabb *out)
+{
+    out->x_min = MIN(a->x_min, b->x_min);
+    out->x_max = MAX(a->x_max, b->x_max);
+    out->y_min = MIN(a->y_min, b->y_min);
+    out->y_max = MAX(a->y_max, b->y_max);
+    out->z_min = MIN(a->z_min, b->z_min);
+    out->z_max = MAX(a->z_max, b->z_max);
+}
+
+static bool m_qnode_leaf(const struct map_qnode *node)
+{
+    return (node->r_end - node->r_begin == 1) && (node->c_end - node->c_begin == 1);
+}
+
+/* Sets the bounds of the node from the bounds of its' chunk (for leaves) or the
+ * bounds of its' children. */
+static void m_qnode_fit(struct map *map, int idx)
+{
+    struct map_qnode *node = &map->quadtree[idx];
+
+    if(m_qnode_leaf(node)) {
+        node->local_aabb = map->chunks[node->r_begin * map->width + node->c_begin].local_aabb;
+    }else{
+
+        bool first = true;
+        for(int i = 0; i < 4; i++) {
+
+            if(node->children[i] < 0)
+                continue;
+
+            const struct aabb *child = &map->quadtree[node->children[i]].local_aabb;
+            if(first)
+                node->local_aabb = *child;
+            else
+                m_aabb_union(&node->local_aabb, child, &node->local_aabb);
+            first = false;
+        }
+    }
+
+    const struct aabb *aabb = &node->local_aabb;
+    node->local_center = (vec3_t){
+        (aabb->x_min + aabb->x_max) / 2.0f,
+        (aabb->y_min + aabb->y_max) / 2.0f,
+        (aabb->z_min + aabb->z_max) / 2.0f,
+    };
+    vec3_t half_diag = (vec3_t){
+        (aabb->x_max - aabb->x_min) / 2.0f,
+        (aabb->y_max - aabb->y_min) / 2.0f,
+        (aabb->z_max - aabb->z_min) / 2.0f,
+    };
+    node->radius = PFM_Vec3_Len(&half_diag);
+}
+
+/* Refits the nodes on the path from 'idx' down to the leaf of the chunk */
+static void m_qtree_refit(struct map *map, int idx, int r, int c)
+{
+    const struct map_qnode *node = &map->quadtree[idx];
+    if(r < node->r_begin || r >= node->r_end || c < node->c_begin || c >= node->c_end)
+        return;
+
+    for(int i = 0; i < 4; i++) {
+
+        if(node->children[i] < 0)
+            continue;
+        m_qtree_refit(map, node->children[i], r, c);
+    }
+    m_qnode_fit(map, idx);
+}
+
+static void m_translate_aabb(const struct aabb *in, vec3_t delta, struct aabb *out)
+{
+    out->x_min = in->x_min + delta.x;
+    out->x_max = in->x_max + delta.x;
+    out->y_min = in->y_min + delta.y;
+    out->y_max = in->y_max + delta.y;
+    out->z_min = in->z_min + delta.z;
+    out->z_max = in->z_max + delta.z;
+}
+
+/* Recursively splits the chunk range in half along both axes, until every node holds 
+ * a single chunk. Returns the index of the created node. */
+static int m_qtree_build(struct map *map, int *inout_next, 
+                         int r_begin, int r_end, int c_begin, int c_end)
+{
+    assert(r_end > r_begin && c_end > c_begin);
+
+    int idx = (*inout_next)++;
+    struct map_qnode *node = &map->quadtree[idx];
+
+    node->r_begin = r_begin;
+    node->r_end = r_end;
+    node->c_begin = c_begin;
+    node->c_end = c_end;
+
+    for(int i = 0; i < 4; i++)
+        node->children[i] = -1;
+
+    if(m_qnode_leaf(node)) {
+
+        struct pfchunk *chunk = &map->chunks[r_begin * map->width + c_begin];
+        m_chunk_local_aabb(chunk, r_begin, c_begin, &chunk->local_aabb);
+        m_qnode_fit(map, idx);
+        return idx;
+    }
+
+    int r_mid = (r_end - r_begin > 1) ? (r_begin + r_end) / 2 : r_end;
+    int c_mid = (c_end - c_begin > 1) ? (c_begin + c_end) / 2 : c_end;
+
+    const int ranges[4][4] = {
+        {r_begin, r_mid, c_begin, c_mid},
+        {r_begin, r_mid, c_mid,   c_end},
+        {r_mid,   r_end, c_begin, c_mid},
+        {r_mid,   r_end, c_mid,   c_end},
+    };
+
+    for(int i = 0; i < 4; i++) {
+
+        if(ranges[i][1] == ranges[i][0] || ranges[i][3] == ranges[i][2])
+            continue;
+
+        int child = m_qtree_build(map, inout_next, 
+            ranges[i][0], ranges[i][1], ranges[i][2], ranges[i][3]);
+        /* 'node' may not be used after the recursive call modifies the array */
+        map->quadtree[idx].children[i] = child;
+    }
+
+    m_qnode_fit(map, idx);
+    return idx;
+}
+
+/* Appends the positions of all the chunks under the node that intersect the frustum to 
+ * 'out'. The bounding sphere and the fast AABB test are used to reject or accept whole 
+ * subtrees. Only the chunks whose ancestors all straddle the frustum boundary get the 
+ * precise (and much more costly) frustum intersection test. Due to the nature of the 
+ * map (perfect grid), the fast and greedy test alone would yield too many false 
+ * positives for individual chunks. As each chunk mesh has a high vertex count, this is 
+ * undesirable. */
+static void m_qtree_visible(const struct map *map, const struct frustum *frustum, 
+                            int idx, bool inside, struct chunkpos *out, size_t *inout_count)
+{
+    const struct map_qnode *node = &map->quadtree[idx];
+    bool leaf = m_qnode_leaf(node);
+
+    if(!inside) {
+
+        struct aabb aabb;
+        m_translate_aabb(&node->local_aabb, map->pos, &aabb);
+
+        if(leaf) {
+
+            if(!C_FrustumAABBIntersectionExact(frustum, &aabb))
+                return;
+        }else{
+
+            vec3_t center;
+            PFM_Vec3_Add((vec3_t*)&node->local_center, (vec3_t*)&map->pos, &center);
+
+            enum volume_intersec_type type = C_FrustumSphereIntersectionFast(frustum, center, node->radius);
+            if(type == VOLUME_INTERSEC_INTERSECTION)
+                type = C_FrustumAABBIntersectionFast(frustum, &aabb);
+
+            if(type == VOLUME_INTERSEC_OUTSIDE)
+                return;
+            inside = (type == VOLUME_INTERSEC_INSIDE);
+        }
+    }
+
+    if(leaf) {
+        out[(*inout_count)++] = (struct chunkpos){node->r_begin, node->c_begin};
+        return;
+    }
+
+    for(int i = 0; i < 4; i++) {
+
+        if(node->children[i] < 0)
+            continue;
+        m_qtree_visible(map, frustum, node->children[i], inside, out, inout_count);
+    }
+}
+
+static size_t m_visible_chunks(const struct map *map, const struct frustum *frustum, 
+                               struct chunkpos *out)
+{
+    size_t ret = 0;
+    assert(map->quadtree);
+    m_qtree_visible(map, frustum, 0, false, out, &ret);
+    return ret;
+}
+
+static void m_render_chunks(const struct map *map, const struct frustum *frustum, 
+                            const vec3_t *view_pos, enum render_pass pass)
+{
+    struct chunkpos visible[map->width * map->height];
+    size_t num_visible = m_visible_chunks(map, frustum, visible);
+
+    for(int i = 0; i < num_visible; i++) {
+
+        struct chunkpos p = visible[i];
+        const struct pfchunk *chunk = &map->chunks[p.r * map->width + p.c];
+
+        struct aabb chunk_aabb;
+        m_translate_aabb(&chunk->local_aabb, map->pos, &chunk_aabb);
+
+        mat4x4_t chunk_model;
+        void *render_private = m_chunk_rprivate(chunk, &chunk_aabb, view_pos, pass);
+        if(!render_private)
+            continue;
+
+        M_ModelMatrixForChunk(map, p, &chunk_model);
+        switch(pass) {
+        case RENDER_PASS_DEPTH: 
+            R_GL_RenderDepthMap(render_private, &chunk_model);
+            break;
+        case RENDER_PASS_REGULAR:
+            R_GL_Draw(render_private, &chunk_model);
+            break;
+        default: assert(0);
+        }
+    }
+}
+
+static void m_chunk_model_and_center(const struct map *map, int chunk_r, int chunk_c,
+                                     mat4x4_t *out_model, vec3_t *out_center)
+{
+    ssize_t x_offset = -(chunk_c * TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE);
+    ssize_t z_offset =  (chunk_r * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
+    vec3_t chunk_pos = (vec3_t) {map->pos.x + x_offset, map->pos.y, map->pos.z + z_offset};
 
-    out->y_min = 0.0f;
-    out->y_max = chunk_max_height;
+    PFM_Mat4x4_MakeTrans(chunk_pos.x, chunk_pos.y, chunk_pos.z, out_model);
 
-    assert(out->x_max >= out->x_min);
-    assert(out->y_max >= out->y_min);
-    assert(out->z_max >= out->z_min);
+    *out_center = (vec3_t) {
+        chunk_pos.x - (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE)/2.0f,
+        chunk_pos.y,
+        chunk_pos.z + (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE)/2.0f
+    };
 }
 
 /*****************************************************************************/
@@ -91,16 +421,51 @@ void M_ModelMatrixForChunk(const struct map *map, struct chunkpos p, mat4x4_t *o
     PFM_Mat4x4_MakeTrans(chunk_pos.x, chunk_pos.y, chunk_pos.z, out);
 }
 
+bool M_BuildQuadtree(struct map *map)
+{
+    size_t num_chunks = map->width * map->height;
+    assert(num_chunks > 0);
+
+    /* Every inner node has at least 2 children, so there are fewer inner nodes 
+     * than there are leaves (chunks). */
+    map->quadtree = malloc(2 * num_chunks * sizeof(struct map_qnode));
+    if(!map->quadtree)
+        return false;
+
+    int num_nodes = 0;
+    m_qtree_build(map, &num_nodes, 0, map->height, 0, map->width);
+    assert(num_nodes < 2 * num_chunks);
+
+    return true;
+}
+
+void M_FreeQuadtree(struct map *map)
+{
+    free(map->quadtree);
+    map->quadtree = NULL;
+}
+
+void M_UpdateChunkBounds(struct map *map, int chunk_r, int chunk_c)
+{
+    struct pfchunk *chunk = &map->chunks[chunk_r * map->width + chunk_c];
+    m_chunk_local_aabb(chunk, chunk_r, chunk_c, &chunk->local_aabb);
+    m_qtree_refit(map, 0, chunk_r, chunk_c);
+}
+
 void M_RenderEntireMap(const struct map *map, enum render_pass pass)
 {
     for(int r = 0; r < map->height; r++) {
         for(int c = 0; c < map->width; c++) {
         
-            mat4x4_t chunk_model;
             const struct pfchunk *chunk = &map->chunks[r * map->width + c];
-            void *render_private = 
-                (chunk->mode == CHUNK_RENDER_MODE_REALTIME_BLEND) ? chunk->render_private_tiles
-                                                                  : chunk->render_private_prebaked;
+
+            struct aabb chunk_aabb;
+            m_translate_aabb(&chunk->local_aabb, map->pos, &chunk_aabb);
+
+            mat4x4_t chunk_model;
+            void *render_private = m_chunk_rprivate(chunk, &chunk_aabb, NULL, pass);
+            if(!render_private)
+                continue;
 
             M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
             switch(pass) {
@@ -121,38 +486,14 @@ void M_RenderVisibleMap(const struct map *map, const struct camera *cam, enum re
     struct frustum frustum;
     Camera_MakeFrustum(cam, &frustum);
 
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
-
-            struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-            /* Due to the nature of the the map (perfect grid), the fast and greedy frustrum 
-             * intersection test will yield too many false positives. As each chunk mesh has 
-             * a high vertex count, this is undesirable. It is absolutely worth it to do the 
-             * precise frustrum intersection test. With it, the map rendering performance
-             * scales great for large maps. */
-            if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-                continue;
-
-            mat4x4_t chunk_model;
-            const struct pfchunk *chunk = &map->chunks[r * map->width + c];
-            void *render_private = 
-                (chunk->mode == CHUNK_RENDER_MODE_REALTIME_BLEND) ? chunk->render_private_tiles
-                                                                  : chunk->render_private_prebaked;
+    vec3_t view_pos = Camera_GetPos(cam);
+    m_render_chunks(map, &frustum, &view_pos, pass);
+}
 
-            M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
-            switch(pass) {
-            case RENDER_PASS_DEPTH: 
-                R_GL_RenderDepthMap(render_private, &chunk_model);
-                break;
-            case RENDER_PASS_REGULAR:
-                R_GL_Draw(render_private, &chunk_model);
-                break;
-            default: assert(0);
-            }
-        }
-    }
+void M_RenderChunksInFrustum(const struct map *map, const struct frustum *frustum, 
+                             enum render_pass pass)
+{
+    m_render_chunks(map, frustum, NULL, pass);
 }
 
 void M_RenderVisiblePathableLayer(const struct map *map, const struct camera *cam)
@@ -160,19 +501,15 @@ void M_RenderVisiblePathableLayer(const struct map *map, const struct camera *ca
     struct frustum frustum;
     Camera_MakeFrustum(cam, &frustum);
 
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
+    struct chunkpos visible[map->width * map->height];
+    size_t num_visible = m_visible_chunks(map, &frustum, visible);
 
-            struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    for(int i = 0; i < num_visible; i++) {
 
-            if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-                continue;
-
-            mat4x4_t chunk_model;
-            M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
-            N_RenderPathableChunk(map->nav_private, &chunk_model, map, r, c); 
-        }
+        struct chunkpos p = visible[i];
+        mat4x4_t chunk_model;
+        M_ModelMatrixForChunk(map, p, &chunk_model);
+        N_RenderPathableChunk(map->nav_private, &chunk_model, map, p.r, p.c); 
     }
 }
 
@@ -218,26 +555,75 @@ void M_SetChunkRenderMode(struct map *map, int chunk_r, int chunk_c, enum chunk_
     struct pfchunk *chunk = &map->chunks[chunk_r * map->width + chunk_c];
     chunk->mode = mode;
 
-    if(mode == CHUNK_RENDER_MODE_PREBAKED) {
-        
-        ssize_t x_offset = -(chunk_c * TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE);
-        ssize_t z_offset =  (chunk_r * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
-        vec3_t chunk_pos = (vec3_t) {map->pos.x + x_offset, map->pos.y, map->pos.z + z_offset};
+    /* Chunks that are still being streamed in get baked once they are set up */
+    if(mode == CHUNK_RENDER_MODE_PREBAKED && chunk->render_private_tiles) {
 
         mat4x4_t chunk_model;
-        PFM_Mat4x4_MakeTrans(chunk_pos.x, chunk_pos.y, chunk_pos.z, &chunk_model);
+        vec3_t chunk_center;
+        m_chunk_model_and_center(map, chunk_r, chunk_c, &chunk_model, &chunk_center);
 
-        vec3_t chunk_center = (vec3_t) {
-            chunk_pos.x - (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE)/2.0f,
-            chunk_pos.y,
-            chunk_pos.z + (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE)/2.0f
-        };
+        char name[64], path[512];
+        snprintf(name, sizeof(name), "chunk.%d.%d", chunk_r, chunk_c);
+        bool cached = !chunk->edited && M_CachePath(map, name, path, sizeof(path));
+
+        /* The chunk may have been baked before */
+        R_GL_TileFreeBaked(chunk->render_private_prebaked, chunk->render_private_lod, chunk_r, chunk_c);
+        chunk->render_private_lod = NULL;
 
         chunk->render_private_prebaked = R_GL_TileBakeChunk(chunk->render_private_tiles, chunk_center, &chunk_model,
-            TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->tiles, chunk_r, chunk_c);
+            TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->tiles, chunk_r, chunk_c, cached ? path : NULL);
+
+        if(chunk->render_private_prebaked) {
+            chunk->render_private_lod = R_GL_TileBakeChunkLOD(chunk->render_private_prebaked, 
+                TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->tiles);
+        }
     }
 }
 
+bool M_UpdateDirtyChunks(struct map *map)
+{
+    bool ret = false;
+
+    for(int r = 0; r < map->height; r++) {
+        for(int c = 0; c < map->width; c++) {
+
+            struct pfchunk *chunk = &map->chunks[r * map->width + c];
+            if(!chunk->dirty || !chunk->render_private_tiles)
+                continue;
+
+            if(chunk->mode == CHUNK_RENDER_MODE_PREBAKED && chunk->render_private_prebaked) {
+
+                mat4x4_t chunk_model;
+                vec3_t chunk_center;
+                m_chunk_model_and_center(map, r, c, &chunk_model, &chunk_center);
+
+                bool rebaked = R_GL_TileRebakeRegion(chunk->render_private_prebaked, chunk->render_private_lod, 
+                    chunk->render_private_tiles, chunk_center, &chunk_model, 
+                    TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->tiles,
+                    chunk->dirty_r_min, chunk->dirty_c_min, chunk->dirty_r_max, chunk->dirty_c_max);
+
+                /* The baked chunk may be partially updated at this point. Baking it 
+                 * from scratch brings it in line with the tiles again. */
+                if(!rebaked) {
+                    fprintf(stderr, "Failed to re-bake the edited region of map chunk (%d, %d), "
+                        "baking the whole chunk\n", r, c);
+                    M_SetChunkRenderMode(map, r, c, CHUNK_RENDER_MODE_PREBAKED);
+                }
+
+                if(!chunk->render_private_prebaked)
+                    fprintf(stderr, "Failed to bake map chunk (%d, %d)\n", r, c);
+            }
+
+            M_UpdateMinimapRegion(map, r, c, 
+                chunk->dirty_r_min, chunk->dirty_c_min, chunk->dirty_r_max, chunk->dirty_c_max);
+
+            chunk->dirty = false;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
 void M_SetMapRenderMode(struct map *map, enum chunk_render_mode mode)
 {
     assert(map);
@@ -335,7 +721,104 @@ void M_NavCutoutStaticObject(const struct map *map, const struct obb *obb)
 
 void M_NavUpdatePortals(const struct map *map)
 {
+    /* The portals only depend on the cost field, which is the same every time 
+     * the same scene is loaded on top of the map */
+    char name[64], path[512];
+    snprintf(name, sizeof(name), "nav.%016llx", (unsigned long long)N_CostFieldHash(map->nav_private));
+    bool cached = M_CachePath(map, name, path, sizeof(path));
+
+    if(cached && N_LoadPortalsFromFile(map->nav_private, path))
+        return;
+
     N_UpdatePortals(map->nav_private);
+    if(cached)
+        N_SaveToFile(map->nav_private, path);
+}
+
+bool M_CachePath(const struct map *map, const char *name, char *out, size_t size)
+{
+    extern const char *g_basepath;
+
+    if(!map->cache_key)
+        return false;
+
+    int len = snprintf(out, size, "%s/%s", g_basepath, CONFIG_MAP_CACHE_DIR);
+    if(len < 0 || len >= size)
+        return false;
+    m_make_dir(out);
+
+    len = snprintf(out, size, "%s/%s/%016llx", g_basepath, CONFIG_MAP_CACHE_DIR, 
+        (unsigned long long)map->cache_key);
+    if(len < 0 || len >= size)
+        return false;
+    m_make_dir(out);
+
+    int name_len = snprintf(out + len, size - len, "/%s", name);
+    return (name_len >= 0 && name_len < size - len);
+}
+
+void M_CacheEvict(const struct map *map)
+{
+    extern const char *g_basepath;
+
+    char root[PATH_MAX], path[PATH_MAX];
+    if(!M_CachePath(map, "", path, sizeof(path)))
+        return;
+
+    /* The entry's modification time is the last time the map was loaded */
+    utime(path, NULL);
+
+    int len = snprintf(root, sizeof(root), "%s/%s", g_basepath, CONFIG_MAP_CACHE_DIR);
+    if(len < 0 || len >= sizeof(root))
+        return;
+
+    char curr[17];
+    snprintf(curr, sizeof(curr), "%016llx", (unsigned long long)map->cache_key);
+
+    for(;;) {
+
+        DIR *dir = opendir(root);
+        if(!dir)
+            return;
+
+        int num_entries = 0;
+        char oldest[17] = {0};
+        time_t oldest_time = 0;
+
+        struct dirent *entry;
+        while((entry = readdir(dir))) {
+
+            if(!m_is_cache_entry(entry->d_name))
+                continue;
+
+            /* Entries whose paths don't fit are skipped rather than truncated */
+            struct stat st;
+            int path_len = snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+            if(path_len < 0 || path_len >= sizeof(path))
+                continue;
+            if(stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+                continue;
+
+            num_entries++;
+            if(!strcmp(entry->d_name, curr))
+                continue;
+
+            if(!oldest[0] || st.st_mtime < oldest_time) {
+                strcpy(oldest, entry->d_name);
+                oldest_time = st.st_mtime;
+            }
+        }
+        closedir(dir);
+
+        if(num_entries <= CONFIG_MAP_CACHE_MAX_MAPS || !oldest[0])
+            return;
+
+        int path_len = snprintf(path, sizeof(path), "%s/%s", root, oldest);
+        if(path_len < 0 || path_len >= sizeof(path))
+            return;
+        if(!m_remove_dir(path))
+            return;
+    }
 }
 
 bool M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
@@ -353,7 +836,7 @@ void M_NavRenderVisiblePathFlowField(const struct map *map, const struct camera
         for(int c = 0; c < map->width; c++) {
 
             struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+            m_translate_aabb(&map->chunks[r * map->width + c].local_aabb, map->pos, &chunk_aabb);
 
             if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
                 continue;
@@ -39,14 +39,48 @@
 #include "../render/public/render.h"
 #include "../navigation/public/nav.h"
 #include "map_private.h"
+#include "../camera.h"
+#include "../config.h"
+
+#include <SDL.h>
 
 #include <stdlib.h>
 #include <assert.h>
-#ifndef __USE_POSIX
-    #define __USE_POSIX /* strtok_r */
-#endif
 #include <string.h>
 
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+enum chunk_state{
+    CHUNK_QUEUED,
+    CHUNK_BUILDING,
+    CHUNK_BUILT,
+    CHUNK_LOADED,
+    /* Building or uploading the mesh failed. The chunk is not drawn. */
+    CHUNK_FAILED,
+};
+
+/* The chunk meshes are built by a single background thread. It is not worth 
+ * taking workers away from the model loading for, as the GL uploads on the 
+ * main thread are what limits the rate at which the chunks come in. */
+struct chunk_stream{
+    SDL_Thread      *thread;
+    SDL_mutex       *lock;
+    SDL_cond        *built;
+    bool             quit;
+    struct map      *map;
+    /* The chunk under the camera. The chunks nearest to it go first. */
+    int              focus_r, focus_c;
+    size_t           num_queued;
+    size_t           num_unloaded;
+    bool             has_basedir;
+    char             basedir[512];
+    struct{
+        enum chunk_state state;
+        void            *mesh;
+    }slots[];
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -78,23 +112,20 @@ static bool m_al_read_row(SDL_RWops *stream, struct tile *out)
 
     READ_LINE(stream, line, fail); 
 
-    char *string = line;
-    char *saveptr;
-    /* String points to the first token - the first tile of this row */
-    string = strtok_r(line, " \t\n", &saveptr);
-
+    const char *curr = line;
     for(int i = 0; i < TILES_PER_CHUNK_WIDTH; i++) {
 
-        if(!string)
+        /* A tile is 6 characters. Longer tokens fail to parse. */
+        char tile[8];
+        if(!AL_ParseWord(&curr, tile, sizeof(tile)))
             goto fail;
 
-        if(!m_al_parse_tile(string, out + i))
+        if(!m_al_parse_tile(tile, out + i))
             goto fail;
-        string = strtok_r(NULL, " \t\n", &saveptr);
     }
 
     /* That should have been it for this line */
-    if(string != NULL)
+    if(!AL_AtLineEnd(curr))
         goto fail;
 
     return true;
@@ -117,57 +148,399 @@ fail:
     return false;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
- 
-bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
-                            SDL_RWops *stream, void *outmap)
+static void *m_al_chunk_rbuff(const struct map *map, int idx)
 {
-    struct map *map = outmap;
-    char line[MAX_LINE_LEN];
+    size_t num_chunks = map->width * map->height;
+    size_t renderbuff_sz = R_AL_PrivBuffSizeForChunk(
+                           TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, MATERIALS_PER_CHUNK);
+
+    return (char*)(map->chunks + num_chunks) + idx * renderbuff_sz;
+}
 
+static void m_al_init_map(const struct pfmap_hdr *header, struct map *map)
+{
     map->width = header->num_cols;
     map->height = header->num_rows;
     map->pos = (vec3_t) {0.0f, 0.0f, 0.0f};
+    map->quadtree = NULL;
+    map->stream = NULL;
+    map->cache_key = CONFIG_MAP_CACHE ? header->hash : 0;
+    map->minimap_cached = false;
 
-    size_t num_chunks = header->num_rows * header->num_cols;
-
-    char *unused_base = (char*)(map + 1);
-    unused_base += num_chunks * sizeof(struct pfchunk);
-
-    for(int i = 0; i < num_chunks; i++) {
+    for(int i = 0; i < map->width * map->height; i++) {
 
-        map->chunks[i].render_private_tiles = (void*)unused_base;
+        /* Only set once the chunk's mesh has been uploaded */
+        map->chunks[i].render_private_tiles = NULL;
         map->chunks[i].render_private_prebaked = NULL;
+        map->chunks[i].render_private_lod = NULL;
+        map->chunks[i].dirty = false;
+        map->chunks[i].edited = false;
         map->chunks[i].mode = CHUNK_RENDER_MODE_REALTIME_BLEND;
+    }
+}
 
-        if(!m_al_read_pfchunk(stream, map->chunks + i))
-            return false;
+/* Returns the index of the chunk in the given state which is nearest to the 
+ * focus, or -1 if there are none. Must be called with the lock held. */
+static int m_al_stream_nearest(const struct chunk_stream *cs, enum chunk_state state)
+{
+    const struct map *map = cs->map;
+    int ret = -1, best = 0;
+
+    for(int r = 0; r < map->height; r++) {
+        for(int c = 0; c < map->width; c++) {
 
-        size_t renderbuff_sz = R_AL_PrivBuffSizeForChunk(
-                               TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, MATERIALS_PER_CHUNK);
-        unused_base += renderbuff_sz;
+            int idx = r * map->width + c;
+            if(cs->slots[idx].state != state)
+                continue;
 
-        if(!R_AL_InitPrivFromTilesAndMats(stream, MATERIALS_PER_CHUNK, 
-                                          map->chunks[i].tiles, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT,
-                                          map->chunks[i].render_private_tiles, basedir)) {
-            return false;
+            int dist = MAX(abs(r - cs->focus_r), abs(c - cs->focus_c));
+            if(ret < 0 || dist < best) {
+                ret = idx;
+                best = dist;
+            }
         }
     }
+    return ret;
+}
+
+static int m_al_stream_worker(void *arg)
+{
+    struct chunk_stream *cs = arg;
+
+    SDL_LockMutex(cs->lock);
+    while(!cs->quit && cs->num_queued > 0) {
+
+        int idx = m_al_stream_nearest(cs, CHUNK_QUEUED);
+        assert(idx >= 0);
+        cs->slots[idx].state = CHUNK_BUILDING;
+        cs->num_queued--;
+        SDL_UnlockMutex(cs->lock);
+
+        void *mesh = R_AL_ChunkMeshFromTiles(cs->map->chunks[idx].tiles, 
+                                             TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT);
+
+        SDL_LockMutex(cs->lock);
+        cs->slots[idx].mesh = mesh;
+        cs->slots[idx].state = CHUNK_BUILT;
+        SDL_CondBroadcast(cs->built);
+    }
+    SDL_UnlockMutex(cs->lock);
+    return 0;
+}
+
+static bool m_al_stream_start(struct map *map, const char *basedir)
+{
+    size_t num_chunks = map->width * map->height;
+    struct chunk_stream *cs = malloc(sizeof(struct chunk_stream) + num_chunks * sizeof(cs->slots[0]));
+    if(!cs)
+        goto fail_alloc;
+
+    cs->lock = SDL_CreateMutex();
+    if(!cs->lock)
+        goto fail_lock;
+
+    cs->built = SDL_CreateCond();
+    if(!cs->built)
+        goto fail_cond;
+
+    cs->quit = false;
+    cs->map = map;
+    cs->focus_r = map->height / 2;
+    cs->focus_c = map->width / 2;
+    cs->num_queued = num_chunks;
+    cs->num_unloaded = num_chunks;
+
+    cs->has_basedir = (basedir != NULL);
+    if(basedir) {
+        assert(strlen(basedir) < sizeof(cs->basedir));
+        strcpy(cs->basedir, basedir);
+    }
+
+    for(int i = 0; i < num_chunks; i++) {
+        cs->slots[i].state = CHUNK_QUEUED;
+        cs->slots[i].mesh = NULL;
+    }
+
+    cs->thread = SDL_CreateThread(m_al_stream_worker, "chunk_stream", cs);
+    if(!cs->thread)
+        goto fail_thread;
+
+    map->stream = cs;
+    return true;
+
+fail_thread:
+    SDL_DestroyCond(cs->built);
+fail_cond:
+    SDL_DestroyMutex(cs->lock);
+fail_lock:
+    free(cs);
+fail_alloc:
+    return false;
+}
+
+static void m_al_stream_free(struct map *map)
+{
+    struct chunk_stream *cs = map->stream;
+
+    SDL_LockMutex(cs->lock);
+    cs->quit = true;
+    SDL_UnlockMutex(cs->lock);
+    SDL_WaitThread(cs->thread, NULL);
+
+    /* Meshes which have been built but never uploaded */
+    for(int i = 0; i < map->width * map->height; i++) {
+        if(cs->slots[i].mesh)
+            R_AL_FreeChunkMesh(cs->slots[i].mesh);
+    }
+
+    SDL_DestroyCond(cs->built);
+    SDL_DestroyMutex(cs->lock);
+    free(cs);
+    map->stream = NULL;
+}
+
+/* Uploads a chunk which has been built. Chunks which were switched to the 
+ * pre-baked render mode before they came in are baked now. */
+static bool m_al_stream_finish(struct map *map, int idx)
+{
+    struct chunk_stream *cs = map->stream;
+    int r = idx / map->width, c = idx % map->width;
+
+    SDL_LockMutex(cs->lock);
+    assert(cs->slots[idx].state == CHUNK_BUILT);
+    void *mesh = cs->slots[idx].mesh;
+    cs->slots[idx].mesh = NULL;
+    SDL_UnlockMutex(cs->lock);
+
+    struct pfchunk *chunk = &map->chunks[idx];
+    void *rbuff = m_al_chunk_rbuff(map, idx);
+
+    bool ok = mesh && R_AL_InitChunkFromMesh(rbuff, mesh, cs->has_basedir ? cs->basedir : NULL);
+    if(!ok) {
+        fprintf(stderr, "Failed to %s the mesh of map chunk (%d, %d)\n", 
+            mesh ? "upload" : "build", r, c);
+    }
 
+    SDL_LockMutex(cs->lock);
+    cs->slots[idx].state = ok ? CHUNK_LOADED : CHUNK_FAILED;
+    cs->num_unloaded--;
+    SDL_UnlockMutex(cs->lock);
+
+    if(!ok)
+        return false;
+
+    chunk->render_private_tiles = rbuff;
+    if(chunk->mode == CHUNK_RENDER_MODE_PREBAKED)
+        M_SetChunkRenderMode(map, r, c, chunk->mode);
+    if(!map->minimap_cached)
+        M_UpdateMinimapChunk(map, r, c);
+    return true;
+}
+
+/* Makes sure the chunk has been set up, building it right away if the worker 
+ * has not gotten to it yet. */
+static bool m_al_stream_load_now(struct map *map, int idx)
+{
+    struct chunk_stream *cs = map->stream;
+    if(!cs)
+        return true;
+
+    SDL_LockMutex(cs->lock);
+    if(cs->slots[idx].state == CHUNK_LOADED || cs->slots[idx].state == CHUNK_FAILED) {
+        bool ret = (cs->slots[idx].state == CHUNK_LOADED);
+        SDL_UnlockMutex(cs->lock);
+        return ret;
+    }
+
+    if(cs->slots[idx].state == CHUNK_QUEUED) {
+
+        cs->slots[idx].state = CHUNK_BUILDING;
+        cs->num_queued--;
+        SDL_UnlockMutex(cs->lock);
+
+        void *mesh = R_AL_ChunkMeshFromTiles(map->chunks[idx].tiles, 
+                                             TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT);
+
+        SDL_LockMutex(cs->lock);
+        cs->slots[idx].mesh = mesh;
+        cs->slots[idx].state = CHUNK_BUILT;
+    }
+
+    while(cs->slots[idx].state == CHUNK_BUILDING)
+        SDL_CondWait(cs->built, cs->lock);
+    SDL_UnlockMutex(cs->lock);
+
+    return m_al_stream_finish(map, idx);
+}
+
+/* Sets up the chunks once all their tiles and materials have been read */
+static bool m_al_finish_map(struct map *map, const char *basedir)
+{
     const struct tile *chunk_tiles[map->width * map->height];
     for(int r = 0; r < map->height; r++) {
         for(int c = 0; c < map->width; c++) {
             chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
         }
     }
-    map->nav_private = N_BuildForMapData(map->width, map->height, 
-        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles);
-    if(!map->nav_private)
-        return false;
+    M_CacheEvict(map);
 
+    char nav_path[512];
+    bool nav_cached = M_CachePath(map, "nav", nav_path, sizeof(nav_path));
+
+    map->nav_private = nav_cached ? N_LoadFromFile(nav_path, map->width, map->height) : NULL;
+    if(!map->nav_private) {
+
+        map->nav_private = N_BuildForMapData(map->width, map->height, 
+            TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles);
+        if(!map->nav_private)
+            goto fail_nav;
+        if(nav_cached)
+            N_SaveToFile(map->nav_private, nav_path);
+    }
+
+    if(!M_BuildQuadtree(map))
+        goto fail_quadtree;
+
+    if(CONFIG_MAP_STREAM_CHUNKS) {
+
+        if(!m_al_stream_start(map, basedir))
+            goto fail_chunks;
+        return true;
+    }
+
+    for(int i = 0; i < map->width * map->height; i++) {
+
+        void *mesh = R_AL_ChunkMeshFromTiles(map->chunks[i].tiles, 
+                                             TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT);
+        if(!mesh)
+            goto fail_chunks;
+
+        void *rbuff = m_al_chunk_rbuff(map, i);
+        if(!R_AL_InitChunkFromMesh(rbuff, mesh, basedir))
+            goto fail_chunks;
+        map->chunks[i].render_private_tiles = rbuff;
+    }
     return true;
+
+fail_chunks:
+    M_FreeQuadtree(map);
+fail_quadtree:
+    N_FreePrivate(map->nav_private);
+fail_nav:
+    return false;
+}
+
+static void m_al_mark_dirty(struct pfchunk *chunk, int r_min, int r_max, int c_min, int c_max)
+{
+    if(!chunk->dirty) {
+        chunk->dirty = true;
+        chunk->dirty_r_min = r_min;
+        chunk->dirty_r_max = r_max;
+        chunk->dirty_c_min = c_min;
+        chunk->dirty_c_max = c_max;
+    }else{
+        chunk->dirty_r_min = MIN(chunk->dirty_r_min, r_min);
+        chunk->dirty_r_max = MAX(chunk->dirty_r_max, r_max);
+        chunk->dirty_c_min = MIN(chunk->dirty_c_min, c_min);
+        chunk->dirty_c_max = MAX(chunk->dirty_c_max, c_max);
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+ 
+bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
+                            SDL_RWops *stream, void *outmap)
+{
+    struct map *map = outmap;
+    m_al_init_map(header, map);
+
+    for(int i = 0; i < map->width * map->height; i++) {
+
+        if(!m_al_read_pfchunk(stream, map->chunks + i))
+            return false;
+
+        if(!R_AL_ChunkMatsFromStream(stream, MATERIALS_PER_CHUNK, m_al_chunk_rbuff(map, i)))
+            return false;
+    }
+
+    return m_al_finish_map(map, basedir);
+}
+
+bool M_AL_InitMapFromBin(const struct pfmap_hdr *header, const char *basedir,
+                         const struct pfmap_bin *bin, void *outmap)
+{
+    struct map *map = outmap;
+
+    if(bin->hdr->chunk_width != TILES_PER_CHUNK_WIDTH
+    || bin->hdr->chunk_height != TILES_PER_CHUNK_HEIGHT
+    || bin->hdr->mats_per_chunk != MATERIALS_PER_CHUNK)
+        return false;
+
+    m_al_init_map(header, map);
+
+    for(int i = 0; i < map->width * map->height; i++) {
+
+        const char *chunk = bin->base + bin->chunk_offsets[i];
+        const struct pfmapb_tile *tiles = (const struct pfmapb_tile*)chunk;
+
+        for(int j = 0; j < TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT; j++) {
+
+            map->chunks[i].tiles[j] = (struct tile){
+                .type          = (enum tiletype) tiles[j].type,
+                .pathable      = (bool)          tiles[j].pathable,
+                .base_height   = (int)           tiles[j].base_height,
+                .ramp_height   = (int)           tiles[j].ramp_height,
+                .top_mat_idx   = (int)           tiles[j].top_mat_idx,
+                .sides_mat_idx = (int)           tiles[j].sides_mat_idx,
+            };
+        }
+
+        const struct pfobjb_material *mats = (const void*)(chunk + bin->mats_offset);
+        if(!R_AL_ChunkMatsFromBin(mats, MATERIALS_PER_CHUNK, m_al_chunk_rbuff(map, i)))
+            return false;
+    }
+
+    return m_al_finish_map(map, basedir);
+}
+
+bool M_AL_StreamChunks(struct map *map, const struct camera *cam)
+{
+    struct chunk_stream *cs = map->stream;
+    if(!cs)
+        return false;
+
+    vec3_t cam_pos = Camera_GetPos(cam);
+    struct tile_desc focus;
+    if(M_DescForPoint2D(map, M_ClampedMapCoordinate(map, (vec2_t){cam_pos.x, cam_pos.z}), &focus)) {
+
+        SDL_LockMutex(cs->lock);
+        cs->focus_r = focus.chunk_r;
+        cs->focus_c = focus.chunk_c;
+        SDL_UnlockMutex(cs->lock);
+    }
+
+    /* Only this thread takes chunks out of the 'built' state */
+    int num_loaded = 0;
+    while(num_loaded < CONFIG_MAP_STREAM_CHUNKS_PER_FRAME) {
+
+        SDL_LockMutex(cs->lock);
+        int idx = m_al_stream_nearest(cs, CHUNK_BUILT);
+        SDL_UnlockMutex(cs->lock);
+
+        if(idx < 0)
+            break;
+        m_al_stream_finish(map, idx);
+        num_loaded++;
+    }
+
+    if(cs->num_unloaded == 0) {
+        m_al_stream_free(map);
+        if(!map->minimap_cached)
+            M_SaveMinimapToCache(map);
+    }
+    return (num_loaded > 0);
 }
 
 size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header)
@@ -179,10 +552,14 @@ size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header)
                                      TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, MATERIALS_PER_CHUNK));
 }
 
-bool M_AL_UpdateChunkMats(const struct map *map, int chunk_r, int chunk_c, const char *mats_string)
+bool M_AL_UpdateChunkMats(struct map *map, int chunk_r, int chunk_c, const char *mats_string)
 {
     SDL_RWops *stream;
-    const struct pfchunk *chunk = &map->chunks[chunk_r * map->width + chunk_c];
+    struct pfchunk *chunk = &map->chunks[chunk_r * map->width + chunk_c];
+
+    if(!m_al_stream_load_now(map, chunk_r * map->width + chunk_c))
+        return false;
+    chunk->edited = true;
 
     stream = SDL_RWFromConstMem(mats_string, strlen(mats_string));
     bool result = R_AL_UpdateMats(stream, MATERIALS_PER_CHUNK, chunk->render_private_tiles);
@@ -195,10 +572,42 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
     if(desc->chunk_r >= map->height || desc->chunk_c >= map->width)
         return false;
 
+    /* The chunk has to be set up before its' tiles can change under the worker */
+    if(!m_al_stream_load_now(map, desc->chunk_r * map->width + desc->chunk_c))
+        return false;
+
     struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
     chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c] = *tile;
+    chunk->edited = true;
     R_GL_TileUpdate(chunk->render_private_tiles, desc->tile_r, desc->tile_c, 
         TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->tiles);
+    M_UpdateChunkBounds(map, desc->chunk_r, desc->chunk_c);
+
+    /* The blending and the visible side faces of the adjacent tiles are affected too. 
+     * When the tile is on the chunk's edge, some of them are in the neighbouring 
+     * chunks. */
+    for(int dr = -1; dr <= 1; dr++) {
+        for(int dc = -1; dc <= 1; dc++) {
+
+            int chunk_r = desc->chunk_r + dr, chunk_c = desc->chunk_c + dc;
+            if(chunk_r < 0 || chunk_r >= map->height || chunk_c < 0 || chunk_c >= map->width)
+                continue;
+
+            /* The adjacent tiles in the coordinates of the neighbouring chunk */
+            int r_min = desc->tile_r - 1 - dr * TILES_PER_CHUNK_HEIGHT;
+            int r_max = desc->tile_r + 1 - dr * TILES_PER_CHUNK_HEIGHT;
+            int c_min = desc->tile_c - 1 - dc * TILES_PER_CHUNK_WIDTH;
+            int c_max = desc->tile_c + 1 - dc * TILES_PER_CHUNK_WIDTH;
+
+            r_min = MAX(r_min, 0), r_max = MIN(r_max, TILES_PER_CHUNK_HEIGHT - 1);
+            c_min = MAX(c_min, 0), c_max = MIN(c_max, TILES_PER_CHUNK_WIDTH - 1);
+            if(r_min > r_max || c_min > c_max)
+                continue;
+
+            m_al_mark_dirty(&map->chunks[chunk_r * map->width + chunk_c], 
+                r_min, r_max, c_min, c_max);
+        }
+    }
 
     return true;
 }
@@ -235,9 +644,21 @@ void M_AL_DumpMap(FILE *stream, const struct map *map)
 
 void M_AL_FreePrivate(struct map *map)
 {
-    //TODO: Clean up OpenGL buffers
     //TODO: Clean up extra allocations by map
+    if(map->stream)
+        m_al_stream_free(map);
+
+    for(int r = 0; r < map->height; r++) {
+        for(int c = 0; c < map->width; c++) {
+
+            struct pfchunk *chunk = &map->chunks[r * map->width + c];
+            R_GL_TileFreeBaked(chunk->render_private_prebaked, chunk->render_private_lod, r, c);
+            if(chunk->render_private_tiles)
+                R_AL_ReleasePrivate(chunk->render_private_tiles);
+        }
+    }
     assert(map->nav_private);
     N_FreePrivate(map->nav_private);
+    M_FreeQuadtree(map);
 }
 
@@ -38,6 +38,26 @@
 
 #include "pfchunk.h"
 #include "../pf_math.h"
+#include "../collision.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A node of the static quadtree over the map chunks, used for hierarchical 
+ * visibility culling. The node covers the chunks in rows [r_begin, r_end) and 
+ * columns [c_begin, c_end). The bounds are relative to the map position, so 
+ * the tree stays valid when the map is moved. */
+struct map_qnode{
+    int r_begin, r_end;
+    int c_begin, c_end;
+    struct aabb local_aabb;
+    vec3_t local_center;
+    float radius;
+    /* Indices of the non-empty children in the node array, -1 if absent. 
+     * A node without children holds a single chunk. */
+    int children[4];
+};
 
 struct map{
     /* ------------------------------------------------------------------------
@@ -60,6 +80,30 @@ struct map{
      * ------------------------------------------------------------------------
      */
     void *nav_private;
+    /* ------------------------------------------------------------------------
+     * Quadtree over the chunk bounds, built at load time. The root is the 
+     * first node.
+     * ------------------------------------------------------------------------
+     */
+    struct map_qnode *quadtree;
+    /* ------------------------------------------------------------------------
+     * State of the background setup of the chunks (CONFIG_MAP_STREAM_CHUNKS).
+     * NULL when there are no more chunks left to set up. 
+     * ------------------------------------------------------------------------
+     */
+    struct chunk_stream *stream;
+    /* ------------------------------------------------------------------------
+     * Hash of the map file, naming the directory that the data derived from 
+     * it is cached in (CONFIG_MAP_CACHE). 0 when the map is not cached.
+     * ------------------------------------------------------------------------
+     */
+    uint64_t cache_key;
+    /* ------------------------------------------------------------------------
+     * Set when the minimap texture was read from the cache, in which case the
+     * chunks are not drawn into it as they are set up.
+     * ------------------------------------------------------------------------
+     */
+    bool minimap_cached;
     /* ------------------------------------------------------------------------
      * The map chunks stored in row-major order. In total, there must be 
      * (width * height) number of chunks.
@@ -73,5 +117,24 @@ struct chunkpos{
 };
 
 void M_ModelMatrixForChunk(const struct map *map, struct chunkpos p, mat4x4_t *out);
+bool M_BuildQuadtree(struct map *map);
+void M_FreeQuadtree(struct map *map);
+/* Recompute the bounds of the chunk from its' tiles and update the quadtree
+ * nodes above it. To be called after the chunk's tiles have been changed. */
+void M_UpdateChunkBounds(struct map *map, int chunk_r, int chunk_c);
+/* Update the region of the minimap covering the tiles of the chunk in rows 
+ * [r_min, r_max] and columns [c_min, c_max]. */
+bool M_UpdateMinimapRegion(const struct map *map, int chunk_r, int chunk_c, 
+                           int r_min, int c_min, int r_max, int c_max);
+/* Save the minimap to the cache, if every chunk is set up and none have been
+ * edited since the map was loaded. */
+void M_SaveMinimapToCache(const struct map *map);
+/* Writes the path of the file 'name' in the cache directory of the map to 
+ * 'out', creating the directory if needed. Returns false if the map is not 
+ * cached. */
+bool M_CachePath(const struct map *map, const char *name, char *out, size_t size);
+/* Marks the map's cache directory as the most recently used one and removes 
+ * the least recently used directories over CONFIG_MAP_CACHE_MAX_MAPS. */
+void M_CacheEvict(const struct map *map);
 
 #endif
@@ -170,9 +170,15 @@ bool M_InitMinimap(struct map *map, vec2_t center_pos)
     };
     vec3_t map_center = (vec3_t){ map->pos.x - map_size.raw[0]/2.0f, map->pos.y, map->pos.z + map_size.raw[1]/2.0f };
 
-    bool ret = R_GL_MinimapBake(chunk_rprivates, chunk_model_mats, 
+    char path[512];
+    map->minimap_cached = M_CachePath(map, "minimap", path, sizeof(path)) && R_GL_MinimapLoad(path);
+
+    bool ret = map->minimap_cached || R_GL_MinimapBake(chunk_rprivates, chunk_model_mats, 
         map->width, map->height, map_center, map_size);
 
+    if(ret && !map->minimap_cached)
+        M_SaveMinimapToCache(map);
+
     if(ret) {
         E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mouseclick, map);
         E_Global_Register(SDL_MOUSEMOTION,     on_mousemove,  map);
@@ -180,7 +186,29 @@ bool M_InitMinimap(struct map *map, vec2_t center_pos)
     return ret;
 }
 
+void M_SaveMinimapToCache(const struct map *map)
+{
+    if(map->stream)
+        return;
+
+    for(int i = 0; i < map->width * map->height; i++) {
+        if(map->chunks[i].edited || !map->chunks[i].render_private_tiles)
+            return;
+    }
+
+    char path[512];
+    if(M_CachePath(map, "minimap", path, sizeof(path)))
+        R_GL_MinimapSave(path);
+}
+
 bool M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c)
+{
+    return M_UpdateMinimapRegion(map, chunk_r, chunk_c, 
+        0, 0, TILES_PER_CHUNK_HEIGHT - 1, TILES_PER_CHUNK_WIDTH - 1);
+}
+
+bool M_UpdateMinimapRegion(const struct map *map, int chunk_r, int chunk_c, 
+                           int r_min, int c_min, int r_max, int c_max)
 {
     vec2_t map_size = (vec2_t) {
         map->width * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
@@ -190,8 +218,19 @@ bool M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c)
     mat4x4_t model;
     M_ModelMatrixForChunk(map, (struct chunkpos){chunk_r, chunk_c}, &model);
 
-    return R_GL_MinimapUpdateChunk(map, map->chunks[chunk_r * map->width + chunk_c].render_private_tiles, &model,
-        map_center, map_size);
+    struct box dirty = (struct box){
+        map->pos.x - chunk_c * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE - c_min * X_COORDS_PER_TILE,
+        map->pos.z + chunk_r * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE + r_min * Z_COORDS_PER_TILE,
+        (c_max - c_min + 1) * X_COORDS_PER_TILE,
+        (r_max - r_min + 1) * Z_COORDS_PER_TILE
+    };
+
+    const struct pfchunk *chunk = &map->chunks[chunk_r * map->width + chunk_c];
+    if(!chunk->render_private_tiles)
+        return true;
+
+    return R_GL_MinimapUpdateChunk(map, chunk->render_private_tiles, &model,
+        map_center, map_size, &dirty);
 }
 
 void M_FreeMinimap(struct map *map)
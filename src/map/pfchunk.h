@@ -39,6 +39,7 @@
 #include "public/tile.h"
 #include "public/map.h"
 #include "../pf_math.h"
+#include "../collision.h"
 
 #include <stdbool.h>
 
@@ -50,16 +51,41 @@ struct pfchunk{
      * and everything the rendering subsystem needs to render this PFChunk.
      * 
      * There are two rendering contexts. The one that is used to render the 
-     * chunk depends on the 'mode' attribute.
+     * chunk depends on the 'mode' attribute. Pre-baked chunks additionally 
+     * have a coarser mesh, used when the chunk is far from the camera and 
+     * for the shadow depth pass.
      * ------------------------------------------------------------------------
      */
     void           *render_private_tiles;
     void           *render_private_prebaked;
+    void           *render_private_lod;
+    /* ------------------------------------------------------------------------
+     * The rectangle of tiles (inclusive bounds) that have been edited since 
+     * the baked top face texture and the minimap were last updated. Only 
+     * meaningful when 'dirty' is set.
+     * ------------------------------------------------------------------------
+     */
+    bool            dirty;
+    int             dirty_r_min, dirty_r_max;
+    int             dirty_c_min, dirty_c_max;
+    /* ------------------------------------------------------------------------
+     * Set once the tiles or materials have been changed since the map was 
+     * loaded. The chunk then no longer matches the data in the map cache.
+     * ------------------------------------------------------------------------
+     */
+    bool            edited;
     /* ------------------------------------------------------------------------
      * Worldspace position of the top left corner. 
      * ------------------------------------------------------------------------
      */
     vec3_t          position;
+    /* ------------------------------------------------------------------------
+     * Bounds of the chunk's terrain, relative to the map position. These are
+     * set when the map's quadtree is built and kept up to date as tiles are 
+     * edited.
+     * ------------------------------------------------------------------------
+     */
+    struct aabb     local_aabb;
     /* ------------------------------------------------------------------------
      * Each tiles' attributes, stored in row-major order.
      * ------------------------------------------------------------------------
@@ -51,11 +51,13 @@
 
 struct pfchunk;
 struct pfmap_hdr;
+struct pfmap_bin;
 struct map;
 struct camera;
 struct tile;
 struct tile_desc;
 struct obb;
+struct frustum;
 enum render_pass;
 
 enum chunk_render_mode{
@@ -93,6 +95,14 @@ void   M_RenderEntireMap    (const struct map *map, enum render_pass pass);
 void   M_RenderVisibleMap   (const struct map *map, const struct camera *cam,
                              enum render_pass pass);
 
+/* ------------------------------------------------------------------------
+ * Same as 'M_RenderVisibleMap' but renders the chunks intersecting an 
+ * arbitrary volume, such as the light volume used for the shadow pass.
+ * ------------------------------------------------------------------------
+ */
+void   M_RenderChunksInFrustum(const struct map *map, const struct frustum *frustum, 
+                               enum render_pass pass);
+
 /* ------------------------------------------------------------------------
  * Render a layer over the visible map surface showing which regions are 
  * pathable and which are not.
@@ -151,6 +161,15 @@ bool   M_Raycast_IntersecCoordinate(vec3_t *out);
 void   M_SetChunkRenderMode(struct map *map, int chunk_r, int chunk_c, 
                             enum chunk_render_mode mode);
 
+/* ------------------------------------------------------------------------
+ * Re-renders the regions of the pre-baked chunk textures and the minimap 
+ * covering the tiles edited since the last call. Edits are accumulated 
+ * into a single rectangle per chunk. Returns true if anything was drawn, 
+ * in which case the current view and projection matrices are clobbered.
+ * ------------------------------------------------------------------------
+ */
+bool   M_UpdateDirtyChunks(struct map *map);
+
 /* ------------------------------------------------------------------------
  * Sets the render mode for every chunk in the map.
  * ------------------------------------------------------------------------
@@ -303,6 +322,26 @@ bool   M_MouseOverMinimap(const struct map *map);
 bool   M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
                               SDL_RWops *stream, void *outmap);
 
+/* ------------------------------------------------------------------------
+ * The same as 'M_AL_InitMapFromStream', but reads the chunks from a binary
+ * PFMAP file. The file data is not referenced after this returns.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_InitMapFromBin(const struct pfmap_hdr *header, const char *basedir,
+                           const struct pfmap_bin *bin, void *outmap);
+
+/* ------------------------------------------------------------------------
+ * With CONFIG_MAP_STREAM_CHUNKS, the chunk meshes are built on a background 
+ * thread after the map is loaded, starting with the chunks nearest to the 
+ * camera, and a chunk is not drawn until it has been set up. This sets up 
+ * the chunks which have been built since the last call and is to be called
+ * once per frame. Returns true if any chunks were set up, in which case the 
+ * view and projection of the camera have been overwritten by the rendering 
+ * of their minimap regions.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_StreamChunks(struct map *map, const struct camera *cam);
+
 /* ------------------------------------------------------------------------
  * Returns the size, in bytes, needed to store the private map data
  * based on the header contents.
@@ -327,7 +366,7 @@ void   M_AL_FreePrivate(struct map *map);
  * section string.
  * ------------------------------------------------------------------------
  */
-bool   M_AL_UpdateChunkMats(const struct map *map, int chunk_r, int chunk_c, 
+bool   M_AL_UpdateChunkMats(struct map *map, int chunk_r, int chunk_c, 
                             const char *mats_string);
 
 bool   M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, 
@@ -46,6 +46,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <assert.h>
 #include <string.h>
 
@@ -60,6 +61,9 @@
 #define EPSILON                  (1.0f / 1024)
 #define MAX_TILES_PER_LINE       (128)
 
+#define NAV_FILE_MAGIC           0x564e4650 /* 'PFNV' */
+#define NAV_FILE_VERSION         1
+
 struct row_desc{
     int chunk_r;
     int tile_r;
@@ -105,6 +109,36 @@ enum edge_type{
     EDGE_TOP   = (1 << 3),
 };
 
+/* Layout of the files written by 'N_SaveToFile'. The header is followed by a 
+ * record for every chunk, in row-major order. Each chunk record is followed 
+ * by its' portals and each portal by its' edges. Portals are referred to by 
+ * their chunk and portal indices. All records are multiples of 4 bytes. */
+struct nav_file_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t field_res_r, field_res_c;
+    uint32_t max_portals;
+    uint32_t reserved;
+};
+
+struct nav_file_chunk{
+    uint8_t  cost_base[FIELD_RES_R][FIELD_RES_C];
+    uint32_t num_portals;
+};
+
+struct nav_file_portal{
+    int32_t  endpoints[2][2];
+    uint32_t connected_chunk;
+    uint32_t connected_portal;
+    uint32_t num_neighbours;
+};
+
+struct nav_file_edge{
+    uint32_t portal;
+    float    cost;
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -128,6 +162,14 @@ static void n_set_cost_for_tile(struct nav_chunk *chunk,
     assert(FIELD_RES_R / chunk_h == 2);
     assert(FIELD_RES_C / chunk_w == 2);
 
+    /* The tables must outlive the switch statement, which compound literals 
+     * declared inside of it do not */
+    static const int open_map[2][2]  = {{0,0}, {0,0}};
+    static const int sw_ne_map[2][2] = {{0,0}, {1,0}};
+    static const int se_nw_map[2][2] = {{0,0}, {0,1}};
+    static const int nw_se_map[2][2] = {{1,0}, {0,0}};
+    static const int ne_sw_map[2][2] = {{0,1}, {0,0}};
+
     const int (*tile_path_map)[2];
 
     switch(tile->type) {
@@ -136,34 +178,19 @@ static void n_set_cost_for_tile(struct nav_chunk *chunk,
     case TILETYPE_RAMP_NS:
     case TILETYPE_RAMP_EW:
     case TILETYPE_RAMP_WE:
-        tile_path_map = (int[2][2]){
-            {0,0}, 
-            {0,0}
-        };  break;
+        tile_path_map = open_map;  break;
     case TILETYPE_CORNER_CONCAVE_SW:
     case TILETYPE_CORNER_CONVEX_NE:
-        tile_path_map = (int[2][2]){
-            {0,0}, 
-            {1,0}
-        };  break;
+        tile_path_map = sw_ne_map; break;
     case TILETYPE_CORNER_CONCAVE_SE:
     case TILETYPE_CORNER_CONVEX_NW:
-        tile_path_map = (int[2][2]){
-            {0,0}, 
-            {0,1}
-        };  break;
+        tile_path_map = se_nw_map; break;
     case TILETYPE_CORNER_CONCAVE_NW:
     case TILETYPE_CORNER_CONVEX_SE:
-        tile_path_map = (int[2][2]){
-            {1,0}, 
-            {0,0}
-        };  break;
+        tile_path_map = nw_se_map; break;
     case TILETYPE_CORNER_CONCAVE_NE:
     case TILETYPE_CORNER_CONVEX_SW:
-        tile_path_map = (int[2][2]){
-            {0,1}, 
-            {0,0}
-        };  break;
+        tile_path_map = ne_sw_map; break;
     default: assert(0);
     }
 
@@ -188,29 +215,19 @@ static void n_set_cost_edge(struct nav_chunk *chunk,
     assert(FIELD_RES_R / chunk_h == 2);
     assert(FIELD_RES_C / chunk_w == 2);
 
+    static const int bot_map[2][2]   = {{1,1}, {0,0}};
+    static const int top_map[2][2]   = {{0,0}, {1,1}};
+    static const int left_map[2][2]  = {{0,1}, {0,1}};
+    static const int right_map[2][2] = {{1,0}, {1,0}};
+
     const int (*tile_path_map)[2];
 
     switch(edge){
-    case EDGE_BOT:
-        tile_path_map = (int[2][2]){
-            {1,1}, 
-            {0,0}
-        };  break;
-    case EDGE_TOP:
-        tile_path_map = (int[2][2]){
-            {0,0}, 
-            {1,1}
-        };  break;
-    case EDGE_LEFT:
-        tile_path_map = (int[2][2]){
-            {0,1}, 
-            {0,1}
-        };  break;
-    case EDGE_RIGHT:
-        tile_path_map = (int[2][2]){
-            {1,0}, 
-            {1,0}
-        };  break;
+    case EDGE_BOT:   tile_path_map = bot_map;   break;
+    case EDGE_TOP:   tile_path_map = top_map;   break;
+    case EDGE_LEFT:  tile_path_map = left_map;  break;
+    case EDGE_RIGHT: tile_path_map = right_map; break;
+    default: assert(0);
     }
 
     size_t r_base = tile_r * 2;
@@ -499,6 +516,143 @@ static void n_render_portals(const struct nav_chunk *chunk, mat4x4_t *chunk_mode
     R_GL_DrawMapOverlayQuads(corners_buff, colors_buff, num_tiles, chunk_model, map);
 }
 
+static bool n_read_file(const char *path, void **out, size_t *out_size)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *ret = malloc(size);
+    if(!ret || size <= 0 || fread(ret, 1, size, file) != size) {
+        free(ret);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    *out = ret;
+    *out_size = size;
+    return true;
+}
+
+/* Returns the end of the chunk record (including its' portals and edges) 
+ * starting at 'cursor', or NULL if it is malformed. */
+static const char *n_file_chunk_end(const char *cursor, const char *end)
+{
+    if(end - cursor < sizeof(struct nav_file_chunk))
+        return NULL;
+
+    const struct nav_file_chunk *chunk = (const void*)cursor;
+    if(chunk->num_portals > MAX_PORTALS_PER_CHUNK)
+        return NULL;
+    cursor += sizeof(struct nav_file_chunk);
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        if(end - cursor < sizeof(struct nav_file_portal))
+            return NULL;
+
+        const struct nav_file_portal *port = (const void*)cursor;
+        if(port->num_neighbours > MAX_PORTALS_PER_CHUNK-1)
+            return NULL;
+
+        for(int j = 0; j < 2; j++) {
+            if(port->endpoints[j][0] < 0 || port->endpoints[j][0] >= FIELD_RES_R
+            || port->endpoints[j][1] < 0 || port->endpoints[j][1] >= FIELD_RES_C)
+                return NULL;
+        }
+        cursor += sizeof(struct nav_file_portal);
+
+        if((end - cursor) / sizeof(struct nav_file_edge) < port->num_neighbours)
+            return NULL;
+
+        const struct nav_file_edge *edges = (const void*)cursor;
+        for(int j = 0; j < port->num_neighbours; j++) {
+            if(edges[j].portal >= chunk->num_portals)
+                return NULL;
+        }
+        cursor += port->num_neighbours * sizeof(struct nav_file_edge);
+    }
+    return cursor;
+}
+
+/* Checks that the file is well-formed and holds data for a map of the 
+ * given size. Sets 'out_chunks' to the start of every chunk record. */
+static bool n_file_index(const void *buff, size_t size, size_t w, size_t h, 
+                         const struct nav_file_chunk **out_chunks)
+{
+    const struct nav_file_hdr *hdr = buff;
+    const char *end = (const char*)buff + size;
+
+    if(size < sizeof(struct nav_file_hdr))
+        return false;
+    if(hdr->magic != NAV_FILE_MAGIC || hdr->version != NAV_FILE_VERSION)
+        return false;
+    if(hdr->width != w || hdr->height != h)
+        return false;
+    if(hdr->field_res_r != FIELD_RES_R || hdr->field_res_c != FIELD_RES_C
+    || hdr->max_portals != MAX_PORTALS_PER_CHUNK)
+        return false;
+
+    const char *cursor = (const char*)(hdr + 1);
+    for(int i = 0; i < w * h; i++) {
+
+        out_chunks[i] = (const void*)cursor;
+        cursor = n_file_chunk_end(cursor, end);
+        if(!cursor)
+            return false;
+    }
+    if(cursor != end)
+        return false;
+
+    /* The portals on the other side can only be checked once all the 
+     * chunks have been found */
+    for(int i = 0; i < w * h; i++) {
+
+        const char *port_cursor = (const char*)(out_chunks[i] + 1);
+        for(int j = 0; j < out_chunks[i]->num_portals; j++) {
+
+            const struct nav_file_portal *port = (const void*)port_cursor;
+            if(port->connected_chunk >= w * h
+            || port->connected_portal >= out_chunks[port->connected_chunk]->num_portals)
+                return false;
+            port_cursor += sizeof(struct nav_file_portal) + port->num_neighbours * sizeof(struct nav_file_edge);
+        }
+    }
+    return true;
+}
+
+static void n_file_load_portals(struct nav_private *priv, int chunk_idx, 
+                                const struct nav_file_chunk *record)
+{
+    struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    struct coord chunk_coord = (struct coord){chunk_idx / priv->width, chunk_idx % priv->width};
+    const char *cursor = (const char*)(record + 1);
+
+    chunk->num_portals = record->num_portals;
+    for(int i = 0; i < record->num_portals; i++) {
+
+        const struct nav_file_portal *in = (const void*)cursor;
+        const struct nav_file_edge *edges = (const void*)(in + 1);
+        struct portal *out = &chunk->portals[i];
+
+        out->chunk = chunk_coord;
+        out->endpoints[0] = (struct coord){in->endpoints[0][0], in->endpoints[0][1]};
+        out->endpoints[1] = (struct coord){in->endpoints[1][0], in->endpoints[1][1]};
+        out->connected = &priv->chunks[in->connected_chunk].portals[in->connected_portal];
+        out->num_neighbours = in->num_neighbours;
+
+        for(int j = 0; j < in->num_neighbours; j++) {
+            out->edges[j] = (struct edge){&chunk->portals[edges[j].portal], edges[j].cost};
+        }
+        cursor += sizeof(struct nav_file_portal) + in->num_neighbours * sizeof(struct nav_file_edge);
+    }
+}
+
 static dest_id_t n_dest_id(struct tile_desc dst_desc)
 {
     return (((uint32_t)dst_desc.chunk_r & 0xff) << 24)
@@ -1063,3 +1217,157 @@ bool N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
     return chunk->cost_base[tile.tile_r][tile.tile_c] != COST_IMPASSABLE;
 }
 
+
+bool N_SaveToFile(const void *nav_private, const char *path)
+{
+    const struct nav_private *priv = nav_private;
+
+    /* Written to the side and renamed over the old file, so that a crash or a 
+     * full disk never leaves a truncated file at 'path' */
+    char tmp_path[strlen(path) + sizeof(".tmp")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if(!file)
+        return false;
+
+    struct nav_file_hdr hdr = {
+        .magic       = NAV_FILE_MAGIC,
+        .version     = NAV_FILE_VERSION,
+        .width       = priv->width,
+        .height      = priv->height,
+        .field_res_r = FIELD_RES_R,
+        .field_res_c = FIELD_RES_C,
+        .max_portals = MAX_PORTALS_PER_CHUNK,
+    };
+    bool ok = (fwrite(&hdr, sizeof(hdr), 1, file) == 1);
+
+    for(int i = 0; ok && i < priv->width * priv->height; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        struct nav_file_chunk chunk_rec;
+        memcpy(chunk_rec.cost_base, chunk->cost_base, sizeof(chunk_rec.cost_base));
+        chunk_rec.num_portals = chunk->num_portals;
+        ok = ok && (fwrite(&chunk_rec, sizeof(chunk_rec), 1, file) == 1);
+
+        for(int j = 0; ok && j < chunk->num_portals; j++) {
+
+            const struct portal *port = &chunk->portals[j];
+            const struct nav_chunk *other = &priv->chunks[IDX(port->connected->chunk.r, priv->width, port->connected->chunk.c)];
+
+            struct nav_file_portal port_rec = {
+                .endpoints = {
+                    {port->endpoints[0].r, port->endpoints[0].c},
+                    {port->endpoints[1].r, port->endpoints[1].c},
+                },
+                .connected_chunk  = IDX(port->connected->chunk.r, priv->width, port->connected->chunk.c),
+                .connected_portal = port->connected - other->portals,
+                .num_neighbours   = port->num_neighbours,
+            };
+            ok = ok && (fwrite(&port_rec, sizeof(port_rec), 1, file) == 1);
+
+            for(int k = 0; ok && k < port->num_neighbours; k++) {
+
+                struct nav_file_edge edge_rec = {
+                    .portal = port->edges[k].neighbour - chunk->portals,
+                    .cost   = port->edges[k].cost,
+                };
+                ok = ok && (fwrite(&edge_rec, sizeof(edge_rec), 1, file) == 1);
+            }
+        }
+    }
+
+    ok = (fclose(file) == 0) && ok;
+
+#if defined(_WIN32)
+    /* rename does not replace an existing file on Windows */
+    if(ok)
+        remove(path);
+#endif
+    if(!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+void *N_LoadFromFile(const char *path, size_t w, size_t h)
+{
+    const struct nav_file_chunk *chunks[w * h];
+    void *buff;
+    size_t size;
+    if(!n_read_file(path, &buff, &size))
+        goto fail_read;
+
+    if(!n_file_index(buff, size, w, h, chunks))
+        goto fail_index;
+
+    struct nav_private *ret = malloc(sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk)));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->width = w;
+    ret->height = h;
+
+    for(int i = 0; i < w * h; i++) {
+        memcpy(ret->chunks[i].cost_base, chunks[i]->cost_base, sizeof(ret->chunks[i].cost_base));
+        n_file_load_portals(ret, i, chunks[i]);
+    }
+
+    free(buff);
+    return ret;
+
+fail_alloc:
+fail_index:
+    free(buff);
+fail_read:
+    return NULL;
+}
+
+bool N_LoadPortalsFromFile(void *nav_private, const char *path)
+{
+    struct nav_private *priv = nav_private;
+
+    const struct nav_file_chunk *chunks[priv->width * priv->height];
+    void *buff;
+    size_t size;
+    if(!n_read_file(path, &buff, &size))
+        goto fail_read;
+
+    if(!n_file_index(buff, size, priv->width, priv->height, chunks))
+        goto fail_match;
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        if(memcmp(priv->chunks[i].cost_base, chunks[i]->cost_base, sizeof(chunks[i]->cost_base)))
+            goto fail_match;
+    }
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        n_file_load_portals(priv, i, chunks[i]);
+    }
+
+    free(buff);
+    return true;
+
+fail_match:
+    free(buff);
+fail_read:
+    return false;
+}
+
+uint64_t N_CostFieldHash(const void *nav_private)
+{
+    const struct nav_private *priv = nav_private;
+
+    /* 64-bit FNV-1a */
+    uint64_t ret = 14695981039346656037ull;
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        const uint8_t *bytes = &priv->chunks[i].cost_base[0][0];
+        for(int j = 0; j < FIELD_RES_R * FIELD_RES_C; j++) {
+            ret ^= bytes[j];
+            ret *= 1099511628211ull;
+        }
+    }
+    return ret;
+}
@@ -80,6 +80,36 @@ void     *N_BuildForMapData(size_t w, size_t h,
  */
 void      N_FreePrivate(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Write the cost field and the portal graph to a file, so that they can be
+ * restored without being built again.
+ * ------------------------------------------------------------------------
+ */
+bool      N_SaveToFile(const void *nav_private, const char *path);
+
+/* ------------------------------------------------------------------------
+ * Return a new navigation context read from a file written by 
+ * 'N_SaveToFile'. Returns NULL if the file is missing, malformed, or not 
+ * for a map of 'w' by 'h' chunks.
+ * ------------------------------------------------------------------------
+ */
+void     *N_LoadFromFile(const char *path, size_t w, size_t h);
+
+/* ------------------------------------------------------------------------
+ * The same as 'N_UpdatePortals', but the portals and the links between 
+ * them are read from a file written by 'N_SaveToFile'. Fails, leaving the
+ * context untouched, if the cost field in the file is not identical.
+ * ------------------------------------------------------------------------
+ */
+bool      N_LoadPortalsFromFile(void *nav_private, const char *path);
+
+/* ------------------------------------------------------------------------
+ * Returns a hash of the cost field, which is all that the portals are 
+ * derived from.
+ * ------------------------------------------------------------------------
+ */
+uint64_t  N_CostFieldHash(const void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Draw a translucent overlay over the map chunk, showing the pathable and 
  * non-pathable regions. 'chunk_x_dim' and 'chunk_z_dim' are the chunk
@@ -50,6 +50,17 @@
 #define GL_U_INV_BIND_MATS  "anim_inv_bind_mats"
 #define GL_U_CURR_POSE_MATS "anim_curr_pose_mats"
 
+/* Baked skinning transforms of all samples, for instanced animated models */
+#define GL_U_ANIM_PALETTE   "anim_palette"
+
+/* Material texture arrays, one per texture size, and the array and layer 
+ * holding the texture of each material */
+#define GL_U_MATERIAL_ARRS  "material_arrs"
+#define GL_U_MATERIAL_SLOTS "material_slots"
+
+/* Top face texture of pre-baked terrain chunks */
+#define GL_U_BAKED_TEX      "baked_tex"
+
 /* 8 texture slots that get set by render subsystem for each entity */
 #define GL_U_TEXTURE0       "texture0"
 #define GL_U_TEXTURE1       "texture1"
@@ -78,6 +89,8 @@
 
 /* Used for depth map rendering and testing */
 #define GL_U_LS_TRANS       "light_space_transform"
+#define GL_U_LS_TRANSFORMS  "light_space_transforms"
+#define GL_U_CASCADE_MASK   "cascade_mask"
 #define GL_U_SHADOW_MAP     "shadow_map"
 
 #endif
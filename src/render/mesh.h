@@ -40,10 +40,22 @@
 
 struct vertex;
 
+enum vertex_layout{
+    VERTEX_LAYOUT_FULL,    /* struct vertex */
+    VERTEX_LAYOUT_STATIC,  /* struct vertex_static */
+    VERTEX_LAYOUT_SKINNED, /* struct vertex_skinned */
+};
+
 struct mesh{
+    enum vertex_layout layout;
     unsigned       num_verts;
     GLuint         VBO;
     GLuint         VAO;
+    /* Only set for indexed meshes. Otherwise, 'IBO' is 0 and the vertices 
+     * are drawn in order. */
+    GLuint         IBO;
+    unsigned       num_indices;
+    GLenum         index_type;
 };
 
 #endif
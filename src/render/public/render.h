@@ -45,6 +45,8 @@
 #include <SDL.h> /* for SDL_RWops */
 
 struct pfobj_hdr;
+struct pfobj_bin;
+struct pfobjb_material;
 struct entity;
 struct skeleton;
 struct tile;
@@ -52,12 +54,33 @@ struct tile_desc;
 struct map;
 struct camera;
 struct frustum;
+struct box;
 
 enum render_pass{
     RENDER_PASS_DEPTH,
     RENDER_PASS_REGULAR
 };
 
+/* The shadow map is split into this many cascades, each covering a further 
+ * part of the view. This must match the shadowed shaders. */
+#define NUM_SHADOW_CASCADES (3)
+
+enum shadow_casters{
+    /* Terrain and non-animated static entities. Their depth is cached between 
+     * frames and only redrawn when a cascade moves or is invalidated. */
+    SHADOW_CASTERS_STATIC,
+    /* Everything else. Drawn on top of the cached depth every frame. */
+    SHADOW_CASTERS_DYNAMIC
+};
+
+/* Per-instance data for drawing animated models using their animation texture */
+struct render_anim_inst{
+    mat4x4_t model;
+    GLfloat  curr_sample; /* Index of the current sample among all the model's samples */
+    GLfloat  next_sample; /* Index of the sample that the current one is blended into */
+    GLfloat  frac;        /* Fraction of the way from the current to the next sample */
+};
+
 /* Each face is made of 2 independent triangles. The top face is an exception, and is made up of 4 
  * triangles. This is to give each triangle a vertex which lies at the center of the tile in the XZ
  * dimensions.
@@ -84,15 +107,20 @@ bool   R_Init(const char *base_path);
 
 /* ---------------------------------------------------------------------------
  * Load the specified image file, create an OpenGL texture, and return the handle.
+ * These textures are meant for the UI and are never compressed, unlike the 
+ * material textures of models and map chunks, since the DXT block artifacts 
+ * are plainly visible on text and icons drawn at 1:1 scale.
  * ---------------------------------------------------------------------------
  */
 bool R_Texture_Load(const char *basedir, const char *name, GLuint *out);
 
 /* ---------------------------------------------------------------------------
- * Free a previously loaded texture.
+ * Free a previously loaded texture. Returns false, leaving the texture loaded,
+ * if it is packed into the material array texture of a mesh which is still 
+ * in use.
  * ---------------------------------------------------------------------------
  */
-void R_Texture_Free(const char *name);
+bool R_Texture_Free(const char *name);
 
 /* ---------------------------------------------------------------------------
  * Get the OpenGL handle of a previously loaded texture.
@@ -100,6 +128,14 @@ void R_Texture_Free(const char *name);
  */
 bool R_Texture_GetForName(const char *name, GLuint *out);
 
+/* ---------------------------------------------------------------------------
+ * Set whether subsequently loaded textures are flipped vertically. This must be
+ * used instead of 'stbi_set_flip_vertically_on_load', as textures that are 
+ * loaded from the cache don't pass through stb_image.
+ * ---------------------------------------------------------------------------
+ */
+void R_Texture_SetFlipOnLoad(bool flip);
+
 /*###########################################################################*/
 /* RENDER OPENGL                                                             */
 /*###########################################################################*/
@@ -111,6 +147,45 @@ bool R_Texture_GetForName(const char *name, GLuint *out);
  */
 void   R_GL_Draw(const void *render_private, mat4x4_t *model);
 
+/* ---------------------------------------------------------------------------
+ * Creates a floating-point texture for the skinning transforms of every sample 
+ * of every animation clip of the model, so that any number of instances of 
+ * the model, each at a different point of an animation, can be drawn with 
+ * a single call to 'R_GL_DrawAnimInstanced'. The texture is created empty.
+ * Returns false if the texture could not be created, in which case the model 
+ * can still be drawn with 'R_GL_Draw'.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_AnimTexInit(void *render_private, size_t num_joints, size_t num_samples);
+
+/* ---------------------------------------------------------------------------
+ * Bakes the skinning matrices of 'num_samples' consecutive samples, starting 
+ * at 'first_sample', into the model's animation texture. 'palettes' holds 
+ * 'num_joints' pose matrices for each of the samples. The matrices are stored
+ * as rotation, translation and scale so that the shader can nlerp between 
+ * two samples. Only the samples that have been written may be drawn.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_AnimTexUpdate(void *render_private, const mat4x4_t *inv_bind_poses, 
+                          const mat4x4_t *palettes, size_t num_joints, 
+                          size_t first_sample, size_t num_samples);
+
+/* ---------------------------------------------------------------------------
+ * Returns true if the model has an animation texture, meaning it can be 
+ * drawn using 'R_GL_DrawAnimInstanced'.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_HasAnimTex(const void *render_private);
+
+/* ---------------------------------------------------------------------------
+ * Draws 'count' instances of an animated model in a single draw call. The 
+ * skinning transforms are sampled from the model's animation texture and 
+ * blended between the current and next sample of every instance. 
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawAnimInstanced(const void *render_private, const struct render_anim_inst *insts,
+                              size_t count);
+
 /* ---------------------------------------------------------------------------
  * Sets the view matrix for all relevant shader programs. 
  * ---------------------------------------------------------------------------
@@ -253,7 +328,7 @@ void   R_GL_SetScreenspaceDrawMode(void);
  * Draws a colored outline around the tile specified by the descriptor.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivate, mat4x4_t *model, 
+void   R_GL_TileDrawSelected(const struct tile_desc *in, const struct tile *tiles, mat4x4_t *model, 
                              int tiles_per_chunk_x, int tiles_per_chunk_z);
 
 /* ---------------------------------------------------------------------------
@@ -263,12 +338,13 @@ void   R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rpriv
  * it will be a multiple of 3.
  * ---------------------------------------------------------------------------
  */
-int    R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate, 
+int    R_GL_TileGetTriMesh(const struct tile_desc *in, const struct tile *tiles, 
                            mat4x4_t *model, int tiles_per_chunk_x, vec3_t out[]);
 
 /* ---------------------------------------------------------------------------
  * Update a specific tile with new attributes and buffer the new vertex data.
- * Will also update surrounding tiles with new adjacency data.
+ * Will also update surrounding tiles with new adjacency data. Since tiles can
+ * be merged with their neighbours, the mesh of the entire chunk is rebuilt.
  * ---------------------------------------------------------------------------
  */
 void   R_GL_TileUpdate(void *chunk_rprivate, int r, int c, int tiles_width, int tiles_height, 
@@ -278,11 +354,44 @@ void   R_GL_TileUpdate(void *chunk_rprivate, int r, int c, int tiles_width, int
  * Returns a new render context with a mesh that can be rendered much faster
  * than the original chunk mesh. It will use a single large texture for the 
  * top surface and have all non-visible tile faces removed.
+ * If 'cache_path' is not NULL, the top surface texture is read from it when
+ * it was rendered under the same lighting, and written to it otherwise.
  * ---------------------------------------------------------------------------
  */
 void  *R_GL_TileBakeChunk(const void *chunk_rprivate_tiles, vec3_t chunk_center, mat4x4_t *model,
                           int tiles_per_chunk_x, int tiles_per_chunk_z, const struct tile *tiles,
-                          int chunk_r, int chunk_c);
+                          int chunk_r, int chunk_c, const char *cache_path);
+
+/* ---------------------------------------------------------------------------
+ * Returns a new render context for drawing a pre-baked chunk from a distance.
+ * Flat regions of the top surface are merged into larger polygons, but all 
+ * tile corners along the chunk and region borders are kept, so that it can be
+ * drawn next to chunks using either mesh without cracks. Shares the materials
+ * of the pre-baked render context.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_GL_TileBakeChunkLOD(const void *chunk_rprivate_baked, int tiles_per_chunk_x, 
+                             int tiles_per_chunk_z, const struct tile *tiles);
+
+/* ---------------------------------------------------------------------------
+ * Frees the render contexts returned by 'R_GL_TileBakeChunk' and 
+ * 'R_GL_TileBakeChunkLOD' (either may be NULL), along with the top face
+ * texture of the chunk.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_TileFreeBaked(void *chunk_rprivate_baked, void *chunk_rprivate_lod, int chunk_r, int chunk_c);
+
+/* ---------------------------------------------------------------------------
+ * Re-renders the tiles in rows [r_min, r_max] and columns [c_min, c_max] 
+ * (inclusive) into the existing top face texture of a pre-baked chunk, using
+ * scissored draws. The baked and coarse ('chunk_rprivate_lod', may be NULL) 
+ * meshes and their materials are rebuilt from the current tiles.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_TileRebakeRegion(void *chunk_rprivate_baked, void *chunk_rprivate_lod, 
+                             const void *chunk_rprivate_tiles, vec3_t chunk_center, mat4x4_t *model,
+                             int tiles_per_chunk_x, int tiles_per_chunk_z, const struct tile *tiles,
+                             int r_min, int c_min, int r_max, int c_max);
 
 
 /*###########################################################################*/
@@ -299,12 +408,27 @@ bool  R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
                        vec3_t map_center, vec2_t map_size);
 
 /* ---------------------------------------------------------------------------
- * Update a chunk-sized region of the minimap texture with up-to-date mesh 
- * data.
+ * The same as 'R_GL_MinimapBake', but the texture is read from a file 
+ * written by 'R_GL_MinimapSave'. Fails if the file is missing or the minimap
+ * in it was rendered under different lighting.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_MinimapLoad(const char *path);
+
+/* ---------------------------------------------------------------------------
+ * Write the current minimap texture to a file.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_MinimapSave(const char *path);
+
+/* ---------------------------------------------------------------------------
+ * Update the region of the minimap texture covered by the worldspace box 
+ * 'dirty' with up-to-date mesh data of the chunk. Only the texels inside the
+ * box are written.
  * ---------------------------------------------------------------------------
  */
 bool  R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4_t *chunk_model, 
-                              vec3_t map_center, vec2_t map_size);
+                              vec3_t map_center, vec2_t map_size, const struct box *dirty);
 
 /* ---------------------------------------------------------------------------
  * Render the minimap centered at the specified screenscape coordinate.
@@ -326,13 +450,31 @@ void  R_GL_MinimapFree(void);
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Set up the rendering context for the depth pass. This _must_ be called
- * before any calls to 'R_GL_RenderDepthMap'. Afterwards, there _must_ be 
- * a matching call to 'R_GL_DepthPassEnd'.
+ * Set up the rendering context for the depth pass and place the shadow 
+ * cascades for the current view. This _must_ be called before any calls to 
+ * 'R_GL_DepthPassBeginCascade'. Afterwards, there _must_ be a matching call
+ * to 'R_GL_DepthPassEnd'.
  * ---------------------------------------------------------------------------
  */
 void R_GL_DepthPassBegin(void);
 
+/* ---------------------------------------------------------------------------
+ * Direct the following 'R_GL_RenderDepthMap' calls to the cascade with the
+ * specified index. The static casters of a cascade must be submitted before 
+ * its dynamic ones. Returns false when there is nothing to draw for the 
+ * 'casters' of this cascade this frame. Otherwise, all casters of this kind 
+ * which intersect 'out_volume' must be drawn.
+ * ---------------------------------------------------------------------------
+ */
+bool R_GL_DepthPassBeginCascade(int idx, enum shadow_casters casters, struct frustum *out_volume);
+
+/* ---------------------------------------------------------------------------
+ * Force the static casters to be redrawn on the next depth pass. This must
+ * be called whenever the terrain or a static entity changes.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_InvalidateStaticShadows(void);
+
 /* ---------------------------------------------------------------------------
  * Set up the rendering context for normal rendering. This _must_ be called
  * after all calls to 'R_GL_RenderDepthMap' complete.
@@ -348,8 +490,18 @@ void R_GL_DepthPassEnd(void);
 void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model);
 
 /* ---------------------------------------------------------------------------
- * Return the frustum of the light source used for rendering the shadow map.
- * An up-to-date frustum is generated during 'R_GL_DepthPassBegin'
+ * The instanced equivalent of 'R_GL_RenderDepthMap' for animated models that 
+ * have an animation texture.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_RenderDepthMapAnimInstanced(const void *render_private, 
+                                      const struct render_anim_inst *insts, size_t count);
+
+/* ---------------------------------------------------------------------------
+ * Return the volume holding all the shadow casters which can affect the visible
+ * part of the scene. It is the box, in light space, around the shadowed part 
+ * of the active camera's view, extended towards the light. An up-to-date 
+ * volume is generated during 'R_GL_DepthPassBegin'.
  * ---------------------------------------------------------------------------
  */
 void R_GL_GetLightFrustum(struct frustum *out);
@@ -365,12 +517,54 @@ void R_GL_GetLightFrustum(struct frustum *out);
  */
 void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * The same as 'R_AL_PrivFromStream', split into two steps. The first one only
+ * parses the model into CPU-side buffers and is safe to call from any thread. 
+ * The second one creates the GL state for the parsed model and must be called 
+ * from the main thread. It takes ownership of the parsed data, which can also 
+ * be discarded with 'R_AL_FreeParsed'.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_ParsePrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
+
+/* ---------------------------------------------------------------------------
+ * The same as 'R_AL_ParsePrivFromStream', but reads the vertices and materials 
+ * from the sections of a binary PFOBJ file. The file data is not referenced
+ * after this returns. Returns NULL if the file was written for a different
+ * vertex layout.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_ParsePrivFromBin(const char *base_path, const struct pfobj_hdr *header, 
+                             const struct pfobj_bin *bin);
+void  *R_AL_PrivFromParsed(void *parsed);
+void   R_AL_FreeParsed(void *parsed);
+
 /* ---------------------------------------------------------------------------
  * Dumps private render data in PF Object format.
  * ---------------------------------------------------------------------------
  */
 void   R_AL_DumpPrivate(FILE *stream, void *priv_data);
 
+/* ---------------------------------------------------------------------------
+ * Gives the memory (in bytes) used by the model. 'out_buff_bytes' gets the 
+ * size of the vertex and index buffers and of the animation texture, 
+ * 'out_arr_bytes' the size of the array texture the materials are drawn from
+ * and 'out_tex_bytes' the size of the source textures it was packed from. 
+ * Textures shared with other models are only counted the first time that
+ * one of the models sharing them is passed in, so the results for different 
+ * models can be summed.
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_GetMemUsage(const void *priv_data, size_t *out_buff_bytes, 
+                        size_t *out_arr_bytes, size_t *out_tex_bytes);
+
+/* ---------------------------------------------------------------------------
+ * Deletes the GL objects owned by a render private buffer. The buffer itself
+ * is not freed, as it may be a part of a larger allocation.
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_ReleasePrivate(void *priv_data);
+
 /* ---------------------------------------------------------------------------
  * Gives size (in bytes) of buffer size required for the render private 
  * buffer for a renderable PFChunk.
@@ -391,6 +585,25 @@ bool   R_AL_InitPrivFromTilesAndMats(SDL_RWops *mats_stream, size_t num_mats,
                                      const struct tile *tiles, size_t width, size_t height,
                                      void *priv_buff, const char *basedir);
 
+/* ---------------------------------------------------------------------------
+ * The same as 'R_AL_InitPrivFromTilesAndMats', split into steps so that the 
+ * chunks of a map can be set up some time after the map is loaded: 
+ *
+ * 1. Set the materials in the private render buff, from a PFMAP material 
+ *    section stream or from the material records of a binary PFMAP chunk. 
+ *    This does not touch any GL state.
+ * 2. Build the chunk mesh on the CPU. This is safe to call from any thread.
+ * 3. Load the textures and upload the mesh, on the main thread. This takes 
+ *    ownership of the mesh, which can also be discarded with 
+ *    'R_AL_FreeChunkMesh'.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_AL_ChunkMatsFromStream(SDL_RWops *mats_stream, size_t num_mats, void *priv_buff);
+bool   R_AL_ChunkMatsFromBin(const struct pfobjb_material *mats, size_t num_mats, void *priv_buff);
+void  *R_AL_ChunkMeshFromTiles(const struct tile *tiles, size_t width, size_t height);
+bool   R_AL_InitChunkFromMesh(void *priv_buff, void *mesh, const char *basedir);
+void   R_AL_FreeChunkMesh(void *mesh);
+
 /* ---------------------------------------------------------------------------
  * Update material data for a particular renderable object, parsed from a 
  * PFMAP material section stream.
@@ -47,7 +47,12 @@ bool R_Init(const char *base_path)
     if(!R_Shader_InitAll(base_path))
         return false;
 
-    R_Texture_Init();
+    if(!R_GL_InitProgs())
+        return false;
+
+    if(!R_Texture_Init())
+        return false;
+
     R_GL_InitShadows();
 
     return true; 
@@ -38,6 +38,7 @@
 #include "vertex.h"
 #include "material.h"
 #include "render_gl.h"
+#include "texture.h"
 #include "gl_assert.h"
 
 #include "../asset_load.h"
@@ -45,64 +46,99 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
 #define __USE_POSIX
 #include <string.h>
 
-#define STREVAL(a) STR(a)
-#define STR(a) #a
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
-
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+
+/* The render data of a model, parsed into CPU-side buffers. Parsing does not 
+ * touch any GL state, so it can be done off the main thread. All the GL objects
+ * are created from this on the main thread afterwards. */
+struct render_parsed{
+    struct render_private *priv;
+    const char            *shader;
+    void                  *verts;   /* deduplicated, in the mesh's compact layout */
+    void                  *indices;
+    char                   base_path[512];
+};
+
+/* The terrain mesh of a map chunk, built on the CPU */
+struct chunk_mesh{
+    struct vertex *verts;
+    size_t         num_verts;
+    GLushort      *indices;
+    size_t         num_indices;
+};
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool al_read_vertex(SDL_RWops *stream, struct vertex *out)
+static bool al_read_vertex(SDL_RWops *stream, bool animated, struct vertex *out)
 {
     char line[MAX_LINE_LEN];
+    const char *curr;
 
     READ_LINE(stream, line, fail); 
-    if(!sscanf(line, "v %f %f %f", &out->pos.x, &out->pos.y, &out->pos.z))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "v")
+    || !AL_ParseFloat(&curr, &out->pos.x)
+    || !AL_ParseFloat(&curr, &out->pos.y)
+    || !AL_ParseFloat(&curr, &out->pos.z))
         goto fail;
 
     READ_LINE(stream, line, fail); 
-    if(!sscanf(line, "vt %f %f", &out->uv.x, &out->uv.y))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "vt")
+    || !AL_ParseFloat(&curr, &out->uv.x)
+    || !AL_ParseFloat(&curr, &out->uv.y))
         goto fail;
 
     READ_LINE(stream, line, fail); 
-    if(!sscanf(line, "vn %f %f %f", &out->normal.x, &out->normal.y, &out->normal.z))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "vn")
+    || !AL_ParseFloat(&curr, &out->normal.x)
+    || !AL_ParseFloat(&curr, &out->normal.y)
+    || !AL_ParseFloat(&curr, &out->normal.z))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!strstr(line, "vw"))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "vw"))
         goto fail;
 
-    char *string = line;
-    char *saveptr;
-    int i;
-
     /* Write 0.0 weights by default */
     memset(out->weights, 0, sizeof(out->weights));
     memset(out->joint_indices, 0, sizeof(out->joint_indices));
 
-    /* Consume the first token, the attribute name 'vw' */
-    string = strtok_r(line, " \t", &saveptr);
+    /* Up to 6 'joint/weight' pairs follow the attribute name. The list is 
+     * empty for models with no joints. */
+    int i;
     for(i = 0; i < 6; i++) {
 
-        string = strtok_r(NULL, " \t", &saveptr);
-        if(!string)
+        if(AL_AtLineEnd(curr))
             break;
 
-        if(!sscanf(string, "%d/%f", &out->joint_indices[i], &out->weights[i]))
+        if(!AL_ParseInt(&curr, &out->joint_indices[i])
+        || !AL_ParseLiteral(&curr, "/")
+        || !AL_ParseFloat(&curr, &out->weights[i]))
             goto fail;
     }
 
-    if(i == 0)
+    if(animated && i == 0)
         goto fail;
 
     READ_LINE(stream, line, fail); 
-    if(!sscanf(line, "vm %d", &out->material_idx))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "vm") || !AL_ParseInt(&curr, &out->material_idx))
         goto fail;
 
     return true;
@@ -111,7 +147,7 @@ fail:
     return false;
 }
 
-static bool al_read_material(SDL_RWops *stream, const char *basedir, struct material *out, bool *out_null)
+static bool al_read_material(SDL_RWops *stream, struct material *out, bool *out_null)
 {
     char line[MAX_LINE_LEN];
 
@@ -126,25 +162,32 @@ static bool al_read_material(SDL_RWops *stream, const char *basedir, struct mate
         return true;
     }
 
-    READ_LINE(stream, line, fail);
-    if(!sscanf(line, " ambient %f", &out->ambient_intensity))
-        goto fail;
+    const char *curr;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " diffuse %f %f %f", &out->diffuse_clr.x, &out->diffuse_clr.y, &out->diffuse_clr.z))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "ambient") || !AL_ParseFloat(&curr, &out->ambient_intensity))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " specular %f %f %f", &out->specular_clr.x, &out->specular_clr.y, &out->specular_clr.z))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "diffuse")
+    || !AL_ParseFloat(&curr, &out->diffuse_clr.x)
+    || !AL_ParseFloat(&curr, &out->diffuse_clr.y)
+    || !AL_ParseFloat(&curr, &out->diffuse_clr.z))
         goto fail;
 
     READ_LINE(stream, line, fail);
-    if(!sscanf(line, " texture %" STREVAL(sizeof(out->texname)) "s",  out->texname))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "specular")
+    || !AL_ParseFloat(&curr, &out->specular_clr.x)
+    || !AL_ParseFloat(&curr, &out->specular_clr.y)
+    || !AL_ParseFloat(&curr, &out->specular_clr.z))
         goto fail;
-    out->texname[sizeof(out->texname)-1] = '\0';
 
-    if(!R_Texture_GetForName(out->texname, &out->texture.id)
-    && !R_Texture_Load(basedir, out->texname, &out->texture.id))
+    READ_LINE(stream, line, fail);
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "texture") || !AL_ParseWord(&curr, out->texname, sizeof(out->texname)))
         goto fail;
 
     *out_null = false;
@@ -154,13 +197,288 @@ fail:
     return false;
 }
 
-void al_patch_vbuff_adjacency_info(GLuint VBO, const struct tile *tiles, size_t width, size_t height)
+/* The textures of all the materials are loaded together, so that the images 
+ * can be decoded in parallel. */
+static bool al_load_textures(struct material *mats, size_t num_mats, const char *basedir)
 {
-    for(int r = 0; r < height; r++) {
-        for(int c = 0; c < width; c++) {
-            R_GL_TilePatchVertsBlend(VBO, tiles, width, height, r, c);
+    if(num_mats == 0)
+        return true;
+
+    const char *names[num_mats];
+    GLuint ids[num_mats];
+    size_t num_names = 0;
+
+    for(int i = 0; i < num_mats; i++) {
+        if(mats[i].texname[0])
+            names[num_names++] = mats[i].texname;
+    }
+
+    if(!R_Texture_LoadAll(basedir, num_names, names, ids))
+        return false;
+
+    for(int i = 0, j = 0; i < num_mats; i++) {
+        if(mats[i].texname[0])
+            mats[i].texture.id = ids[j++];
+    }
+    return true;
+}
+
+static GLhalf al_float_to_half(float f)
+{
+    union{ float f; uint32_t u; }in = {f};
+
+    uint32_t sign = (in.u >> 16) & 0x8000;
+    int32_t  exp  = (int32_t)((in.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = in.u & 0x7fffff;
+
+    /* Values too small to be represented as normalized halfs get flushed 
+     * to zero and values too large (as well as NaNs) become infinities. */
+    if(exp <= 0)
+        return sign;
+    if(exp >= 31)
+        return sign | 0x7c00;
+
+    /* Round to nearest. A carry out of the mantissa correctly bumps the exponent. */
+    uint32_t ret = sign | (exp << 10) | (mant >> 13);
+    if(mant & 0x1000)
+        ret++;
+    return ret;
+}
+
+static float al_half_to_float(GLhalf h)
+{
+    union{ uint32_t u; float f; }out;
+
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+
+    if(exp == 0)
+        out.u = sign;
+    else if(exp == 31)
+        out.u = sign | 0x7f800000 | (mant << 13);
+    else
+        out.u = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    return out.f;
+}
+
+static GLuint al_pack_normal(vec3_t n)
+{
+    GLint x = lroundf(MAX(-1.0f, MIN(1.0f, n.x)) * 511.0f);
+    GLint y = lroundf(MAX(-1.0f, MIN(1.0f, n.y)) * 511.0f);
+    GLint z = lroundf(MAX(-1.0f, MIN(1.0f, n.z)) * 511.0f);
+
+    /* GL_INT_2_10_10_10_REV: x in the low bits, w (unused) in the top 2 bits */
+    return (x & 0x3ff) | ((y & 0x3ff) << 10) | ((z & 0x3ff) << 20);
+}
+
+static vec3_t al_unpack_normal(GLuint packed)
+{
+    float comps[3];
+    for(int i = 0; i < 3; i++) {
+
+        GLint c = (packed >> (i * 10)) & 0x3ff;
+        if(c & 0x200)
+            c -= 0x400;
+        comps[i] = MAX(c / 511.0f, -1.0f);
+    }
+    return (vec3_t){comps[0], comps[1], comps[2]};
+}
+
+static bool al_compact_vertex(const struct vertex *in, enum vertex_layout layout, void *out)
+{
+    struct vertex_static *vs = out;
+
+    if(in->material_idx < 0 || in->material_idx > UCHAR_MAX)
+        return false;
+
+    vs->pos = in->pos;
+    vs->uv[0] = al_float_to_half(in->uv.x);
+    vs->uv[1] = al_float_to_half(in->uv.y);
+    vs->normal = al_pack_normal(in->normal);
+    vs->material_idx = in->material_idx;
+
+    if(layout != VERTEX_LAYOUT_SKINNED)
+        return true;
+
+    struct vertex_skinned *vsk = out;
+
+    /* The weights get normalized by the shader, so we are free to rescale 
+     * them here to make the most out of the 8 bits of precision. */
+    float tot_weight = 0.0f;
+    for(int i = 0; i < 6; i++)
+        tot_weight += in->weights[i];
+
+    for(int i = 0; i < 6; i++) {
+
+        if(in->joint_indices[i] < 0 || in->joint_indices[i] > UCHAR_MAX)
+            return false;
+
+        float weight = (tot_weight > 0.0f) ? in->weights[i] / tot_weight : 0.0f;
+        vsk->joint_indices[i] = in->joint_indices[i];
+        vsk->weights[i] = lroundf(MAX(0.0f, MIN(1.0f, weight)) * 255.0f);
+    }
+    return true;
+}
+
+static void al_expand_vertex(const void *in, enum vertex_layout layout, struct vertex *out)
+{
+    const struct vertex_static *vs = in;
+
+    memset(out, 0, sizeof(*out));
+    out->pos = vs->pos;
+    out->uv = (vec2_t){al_half_to_float(vs->uv[0]), al_half_to_float(vs->uv[1])};
+    out->normal = al_unpack_normal(vs->normal);
+    out->material_idx = vs->material_idx;
+
+    if(layout != VERTEX_LAYOUT_SKINNED)
+        return;
+
+    const struct vertex_skinned *vsk = in;
+    for(int i = 0; i < 6; i++) {
+        out->joint_indices[i] = vsk->joint_indices[i];
+        out->weights[i] = vsk->weights[i] / 255.0f;
+    }
+}
+
+static uint32_t al_hash_bytes(const void *data, size_t size)
+{
+    /* 32-bit FNV-1a */
+    const unsigned char *bytes = data;
+    uint32_t ret = 2166136261u;
+    for(size_t i = 0; i < size; i++) {
+        ret ^= bytes[i];
+        ret *= 16777619u;
+    }
+    return ret;
+}
+
+/* Merge identical vertices. The unique vertices are written to 'out_unique' 
+ * in the order of their first appearance, and 'out_indices' gets the index 
+ * of the unique vertex for every input vertex. */
+static bool al_dedup_verts(const void *verts, size_t vert_sz, size_t num_verts,
+                           void *out_unique, GLuint *out_indices, size_t *out_num_unique)
+{
+    size_t cap = 1;
+    while(cap < num_verts * 2)
+        cap *= 2;
+
+    /* Slots hold (unique index + 1), with 0 marking an empty slot */
+    GLuint *table = calloc(cap, sizeof(GLuint));
+    if(!table)
+        return false;
+
+    size_t num_unique = 0;
+    for(size_t i = 0; i < num_verts; i++) {
+
+        const char *curr = (const char*)verts + i * vert_sz;
+        size_t slot = al_hash_bytes(curr, vert_sz) & (cap - 1);
+
+        while(table[slot]) {
+
+            const char *cand = (const char*)out_unique + (table[slot] - 1) * vert_sz;
+            if(0 == memcmp(cand, curr, vert_sz))
+                break;
+            slot = (slot + 1) & (cap - 1);
         }
+
+        if(!table[slot]) {
+            memcpy((char*)out_unique + num_unique * vert_sz, curr, vert_sz);
+            table[slot] = ++num_unique;
+        }
+        out_indices[i] = table[slot] - 1;
+    }
+
+    free(table);
+    *out_num_unique = num_unique;
+    return true;
+}
+
+/* Converts the parsed vertices to the compact layout and builds the index buffer. 
+ * The mesh fields of 'priv' are set, but no GL state is created. */
+static bool al_build_indexed_mesh(struct render_private *priv, const struct vertex *vbuff, 
+                                  size_t num_verts, bool skinned, void **out_verts, void **out_indices)
+{
+    enum vertex_layout layout = skinned ? VERTEX_LAYOUT_SKINNED : VERTEX_LAYOUT_STATIC;
+    size_t vert_sz = skinned ? sizeof(struct vertex_skinned) : sizeof(struct vertex_static);
+
+    /* Zero-initialize so that padding bytes compare equal during deduplication */
+    void *compact = calloc(num_verts, vert_sz);
+    if(!compact)
+        goto fail_alloc_compact;
+
+    void *unique = malloc(num_verts * vert_sz);
+    if(!unique)
+        goto fail_alloc_unique;
+
+    GLuint *indices = malloc(num_verts * sizeof(GLuint));
+    if(!indices)
+        goto fail_alloc_indices;
+
+    for(size_t i = 0; i < num_verts; i++) {
+        if(!al_compact_vertex(&vbuff[i], layout, (char*)compact + i * vert_sz))
+            goto fail_convert;
+    }
+
+    size_t num_unique;
+    if(!al_dedup_verts(compact, vert_sz, num_verts, unique, indices, &num_unique))
+        goto fail_convert;
+
+    priv->mesh.layout = layout;
+    priv->mesh.num_verts = num_unique;
+    priv->mesh.num_indices = num_verts;
+
+    if(num_unique <= USHRT_MAX + 1) {
+
+        GLushort *short_indices = malloc(num_verts * sizeof(GLushort));
+        if(!short_indices)
+            goto fail_convert;
+
+        for(size_t i = 0; i < num_verts; i++)
+            short_indices[i] = indices[i];
+
+        priv->mesh.index_type = GL_UNSIGNED_SHORT;
+        free(indices);
+        *out_indices = short_indices;
+    }else{
+
+        priv->mesh.index_type = GL_UNSIGNED_INT;
+        *out_indices = indices;
     }
+
+    free(compact);
+    *out_verts = unique;
+    return true;
+
+fail_convert:
+    free(indices);
+fail_alloc_indices:
+    free(unique);
+fail_alloc_unique:
+    free(compact);
+fail_alloc_compact:
+    return false;
+}
+
+/* Builds the mesh buffers for the parsed vertices. 'vbuff' is not kept. */
+static bool al_init_parsed(struct render_parsed *out, struct render_private *priv, 
+                           const struct pfobj_hdr *header, const char *base_path,
+                           const struct vertex *vbuff)
+{
+#if CONFIG_SHADOWS
+    out->shader = (header->num_as > 0) ? "mesh.animated.textured-phong-shadowed" : "mesh.static.textured-phong-shadowed";
+#else
+    out->shader = (header->num_as > 0) ? "mesh.animated.textured-phong" : "mesh.static.textured-phong";
+#endif
+    if(!al_build_indexed_mesh(priv, vbuff, header->num_verts, header->num_as > 0, 
+                              &out->verts, &out->indices))
+        return false;
+
+    assert(strlen(base_path) < sizeof(out->base_path));
+    strcpy(out->base_path, base_path);
+    out->priv = priv;
+
+    return true;
 }
 
 size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
@@ -189,8 +507,12 @@ size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
  *
  */
 
-void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+void *R_AL_ParsePrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
 {
+    struct render_parsed *ret = malloc(sizeof(struct render_parsed));
+    if(!ret)
+        goto fail_alloc_ret;
+
     struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
     if(!priv)
         goto fail_alloc_priv;
@@ -200,12 +522,11 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
     if(!vbuff)
         goto fail_alloc_vbuff;
 
-    priv->mesh.num_verts = header->num_verts;
     priv->num_materials = header->num_materials;
     priv->materials = (void*)(priv + 1);
 
     for(int i = 0; i < header->num_verts; i++) {
-        if(!al_read_vertex(stream, &vbuff[i]))
+        if(!al_read_vertex(stream, header->num_joints > 0, &vbuff[i]))
             goto fail_parse;
     }
 
@@ -213,45 +534,141 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
 
         bool null;
         priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        if(!al_read_material(stream, base_path, &priv->materials[i], &null)) 
+        if(!al_read_material(stream, &priv->materials[i], &null)) 
             goto fail_parse;
         assert(!null);
     }
 
-#if CONFIG_SHADOWS
-    R_GL_Init(priv, (header->num_as > 0) ? "mesh.animated.textured-phong-shadowed" : "mesh.static.textured-phong-shadowed", vbuff);
-#else
-    R_GL_Init(priv, (header->num_as > 0) ? "mesh.animated.textured-phong" : "mesh.static.textured-phong", vbuff);
-#endif
+    if(!al_init_parsed(ret, priv, header, base_path, vbuff))
+        goto fail_parse;
+
     free(vbuff);
-    GL_ASSERT_OK();
-    return priv;
+    return ret;
 
 fail_parse:
     free(vbuff);
 fail_alloc_vbuff:
     free(priv);
 fail_alloc_priv:
+    free(ret);
+fail_alloc_ret:
     return NULL;
 }
 
+void *R_AL_ParsePrivFromBin(const char *base_path, const struct pfobj_hdr *header, 
+                            const struct pfobj_bin *bin)
+{
+    if(bin->hdr->vertex_size != sizeof(struct vertex))
+        goto fail_layout;
+
+    struct render_parsed *ret = malloc(sizeof(struct render_parsed));
+    if(!ret)
+        goto fail_alloc_ret;
+
+    struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
+    if(!priv)
+        goto fail_alloc_priv;
+
+    priv->num_materials = header->num_materials;
+    priv->materials = (void*)(priv + 1);
+
+    const struct pfobjb_material *mats = bin->sections[PFOBJB_MATERIALS];
+    for(int i = 0; i < header->num_materials; i++) {
+
+        struct material *mat = &priv->materials[i];
+        mat->texture.tunit = GL_TEXTURE0 + i;
+        mat->ambient_intensity = mats[i].ambient_intensity;
+        memcpy(mat->diffuse_clr.raw, mats[i].diffuse_clr, sizeof(mat->diffuse_clr.raw));
+        memcpy(mat->specular_clr.raw, mats[i].specular_clr, sizeof(mat->specular_clr.raw));
+
+        if(!memchr(mats[i].texname, '\0', sizeof(mats[i].texname)))
+            goto fail_parse;
+        strcpy(mat->texname, mats[i].texname);
+    }
+
+    /* The vertices are used straight from the file */
+    if(!al_init_parsed(ret, priv, header, base_path, bin->sections[PFOBJB_VERTS]))
+        goto fail_parse;
+
+    return ret;
+
+fail_parse:
+    free(priv);
+fail_alloc_priv:
+    free(ret);
+fail_alloc_ret:
+fail_layout:
+    return NULL;
+}
+
+void *R_AL_PrivFromParsed(void *parsed)
+{
+    struct render_parsed *rp = parsed;
+    struct render_private *priv = rp->priv;
+
+    if(!al_load_textures(priv->materials, priv->num_materials, rp->base_path))
+        goto fail;
+
+    R_GL_InitIndexed(priv, rp->shader, rp->verts, rp->indices);
+
+    if(!R_GL_InitMaterialArr(priv, 0))
+        goto fail;
+
+    rp->priv = NULL;
+    R_AL_FreeParsed(rp);
+    GL_ASSERT_OK();
+    return priv;
+
+fail:
+    R_AL_FreeParsed(rp);
+    return NULL;
+}
+
+void R_AL_FreeParsed(void *parsed)
+{
+    struct render_parsed *rp = parsed;
+
+    free(rp->priv);
+    free(rp->verts);
+    free(rp->indices);
+    free(rp);
+}
+
+void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+{
+    void *parsed = R_AL_ParsePrivFromStream(base_path, header, stream);
+    if(!parsed)
+        return NULL;
+    return R_AL_PrivFromParsed(parsed);
+}
+
 void R_AL_DumpPrivate(FILE *stream, void *priv_data)
 {
     struct render_private *priv = priv_data;
-    struct vertex *vbuff = glMapNamedBuffer(priv->mesh.VBO, GL_READ_ONLY);
-    assert(vbuff);
+    assert(priv->mesh.layout != VERTEX_LAYOUT_FULL && priv->mesh.IBO);
 
-    /* Write verticies */
-    for(int i = 0; i < priv->mesh.num_verts; i++) {
+    size_t vert_sz = (priv->mesh.layout == VERTEX_LAYOUT_SKINNED) ? sizeof(struct vertex_skinned)
+                                                                  : sizeof(struct vertex_static);
+    const char *vbuff = glMapNamedBuffer(priv->mesh.VBO, GL_READ_ONLY);
+    const void *ibuff = glMapNamedBuffer(priv->mesh.IBO, GL_READ_ONLY);
+    assert(vbuff && ibuff);
 
-        struct vertex *v = &vbuff[i];
+    /* Write verticies - the PFOBJ format has no notion of indices, so the 
+     * shared vertices get written out once for every use. */
+    for(int i = 0; i < priv->mesh.num_indices; i++) {
+
+        GLuint idx = (priv->mesh.index_type == GL_UNSIGNED_SHORT) ? ((const GLushort*)ibuff)[i]
+                                                                  : ((const GLuint*)ibuff)[i];
+        struct vertex vert;
+        struct vertex *v = &vert;
+        al_expand_vertex(vbuff + idx * vert_sz, priv->mesh.layout, v);
 
         fprintf(stream, "v %.6f %.6f %.6f\n", v->pos.x, v->pos.y, v->pos.z); 
         fprintf(stream, "vt %.6f %.6f \n", v->uv.x, v->uv.y); 
         fprintf(stream, "vn %.6f %.6f %.6f\n", v->normal.x, v->normal.y, v->normal.z);
 
         fprintf(stream, "vw ");
-        for(int j = 0; j < 4; j++) {
+        for(int j = 0; j < 6; j++) {
 
             if(v->weights[j]) {
                 fprintf(stream, "%d/%.6f ", v->joint_indices[j], v->weights[j]);
@@ -262,6 +679,7 @@ void R_AL_DumpPrivate(FILE *stream, void *priv_data)
         fprintf(stream, "vm %d\n", v->material_idx); 
     }
 
+    glUnmapNamedBuffer(priv->mesh.IBO);
     glUnmapNamedBuffer(priv->mesh.VBO);
 
     /* Write materials */
@@ -283,6 +701,45 @@ void R_AL_DumpPrivate(FILE *stream, void *priv_data)
     }
 }
 
+static size_t al_buffer_bytes(GLuint buffer)
+{
+    if(!buffer)
+        return 0;
+
+    /* Use a binding point that is not part of any VAO's state */
+    GLint size;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return size;
+}
+
+void R_AL_GetMemUsage(const void *priv_data, size_t *out_buff_bytes, 
+                      size_t *out_arr_bytes, size_t *out_tex_bytes)
+{
+    const struct render_private *priv = priv_data;
+
+    *out_buff_bytes = al_buffer_bytes(priv->mesh.VBO) + al_buffer_bytes(priv->mesh.IBO);
+    if(priv->anim_tex)
+        *out_buff_bytes += R_Texture_GPUBytes(GL_TEXTURE_2D, priv->anim_tex);
+
+    *out_arr_bytes = 0;
+    for(int i = 0; i < priv->num_material_arrs; i++)
+        *out_arr_bytes += R_Texture_ChargeBytes(GL_TEXTURE_2D_ARRAY, priv->material_arrs[i]);
+
+    *out_tex_bytes = 0;
+    for(int i = 0; i < priv->num_materials; i++) {
+        if(priv->materials[i].texture.id)
+            *out_tex_bytes += R_Texture_ChargeBytes(GL_TEXTURE_2D, priv->materials[i].texture.id);
+    }
+    GL_ASSERT_OK();
+}
+
+void R_AL_ReleasePrivate(void *priv_data)
+{
+    R_GL_Free(priv_data);
+}
+
 size_t R_AL_PrivBuffSizeForChunk(size_t tiles_width, size_t tiles_height, size_t num_mats)
 {
     size_t ret = 0;
@@ -297,56 +754,110 @@ bool R_AL_InitPrivFromTilesAndMats(SDL_RWops *mats_stream, size_t num_mats,
                                   const struct tile *tiles, size_t width, size_t height, 
                                   void *priv_buff, const char *basedir)
 {
-    size_t num_verts = VERTS_PER_TILE * (width * height);
+    if(!R_AL_ChunkMatsFromStream(mats_stream, num_mats, priv_buff))
+        return false;
+
+    void *mesh = R_AL_ChunkMeshFromTiles(tiles, width, height);
+    if(!mesh)
+        return false;
+
+    return R_AL_InitChunkFromMesh(priv_buff, mesh, basedir);
+}
 
+bool R_AL_ChunkMatsFromStream(SDL_RWops *mats_stream, size_t num_mats, void *priv_buff)
+{
     struct render_private *priv = priv_buff;
     char *unused_base = (char*)priv_buff + sizeof(struct render_private);
-    size_t vbuff_sz = num_verts * sizeof(struct vertex);
-
-    struct vertex *vbuff = malloc(vbuff_sz);
-    if(!vbuff)
-        goto fail_alloc;
 
-    priv->mesh.num_verts = num_verts;
     priv->materials = (void*)unused_base;
     priv->num_materials = num_mats;
 
-    for(int r = 0; r < height; r++) {
-        for(int c = 0; c < width; c++) {
-
-            const struct tile *curr = &tiles[r * width + c];
-            struct vertex *vert_base = &vbuff[ (r * width + c) * VERTS_PER_TILE ];
-
-            R_GL_TileGetVertices(curr, vert_base, r, c);
-        }
-    }
-
-    size_t num_null = 0;
     for(int i = 0; i < num_mats; i++) {
 
         bool null;
         priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        if(!al_read_material(mats_stream, basedir, &priv->materials[i], &null)) 
-            goto fail_parse;
+        if(!al_read_material(mats_stream, &priv->materials[i], &null)) 
+            return false;
         if(null) {
             priv->materials[i].texture.id = 0;
             priv->materials[i].texname[0] = '\0';
         }
     }
+    return true;
+}
+
+bool R_AL_ChunkMatsFromBin(const struct pfobjb_material *mats, size_t num_mats, void *priv_buff)
+{
+    struct render_private *priv = priv_buff;
+    char *unused_base = (char*)priv_buff + sizeof(struct render_private);
 
-    R_GL_Init(priv, "terrain", vbuff);
-    al_patch_vbuff_adjacency_info(priv->mesh.VBO, tiles, width, height);
+    priv->materials = (void*)unused_base;
+    priv->num_materials = num_mats;
 
-    free(vbuff);
+    /* Unused material slots are written with an empty texture name */
+    for(int i = 0; i < num_mats; i++) {
+
+        struct material *mat = &priv->materials[i];
+        if(!memchr(mats[i].texname, '\0', sizeof(mats[i].texname)))
+            return false;
+
+        mat->texture.tunit = GL_TEXTURE0 + i;
+        mat->texture.id = 0;
+        mat->ambient_intensity = mats[i].ambient_intensity;
+        memcpy(mat->diffuse_clr.raw, mats[i].diffuse_clr, sizeof(mat->diffuse_clr.raw));
+        memcpy(mat->specular_clr.raw, mats[i].specular_clr, sizeof(mat->specular_clr.raw));
+        strcpy(mat->texname, mats[i].texname);
+    }
+    return true;
+}
+
+void *R_AL_ChunkMeshFromTiles(const struct tile *tiles, size_t width, size_t height)
+{
+    struct chunk_mesh *ret = malloc(sizeof(struct chunk_mesh));
+    if(!ret)
+        return NULL;
+
+    if(!R_GL_TileMeshData(tiles, width, height, &ret->verts, &ret->num_verts, 
+                          &ret->indices, &ret->num_indices)) {
+        free(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+bool R_AL_InitChunkFromMesh(void *priv_buff, void *mesh, const char *basedir)
+{
+    struct render_private *priv = priv_buff;
+    struct chunk_mesh *cm = mesh;
+
+    if(!al_load_textures(priv->materials, priv->num_materials, basedir))
+        goto fail;
+
+    R_GL_TileInitMesh(priv, cm->verts, cm->num_verts, cm->indices, cm->num_indices);
+
+    if(!R_GL_InitMaterialArr(priv, 0))
+        goto fail_arr;
+
+    R_AL_FreeChunkMesh(cm);
     GL_ASSERT_OK();
     return true;
 
-fail_parse:
-    free(vbuff);
-fail_alloc:
+fail_arr:
+    R_GL_Free(priv);
+fail:
+    R_AL_FreeChunkMesh(cm);
     return false;
 }
 
+void R_AL_FreeChunkMesh(void *mesh)
+{
+    struct chunk_mesh *cm = mesh;
+
+    free(cm->verts);
+    free(cm->indices);
+    free(cm);
+}
+
 bool R_AL_UpdateMats(SDL_RWops *mats_stream, size_t num_mats, void *priv_buff)
 {
     struct render_private *priv = priv_buff;
@@ -356,7 +867,7 @@ bool R_AL_UpdateMats(SDL_RWops *mats_stream, size_t num_mats, void *priv_buff)
 
         bool null;
         priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        if(!al_read_material(mats_stream, g_basepath, &priv->materials[i], &null)) 
+        if(!al_read_material(mats_stream, &priv->materials[i], &null)) 
             return false;
         if(null) {
             priv->materials[i].texture.id = 0;
@@ -364,7 +875,10 @@ bool R_AL_UpdateMats(SDL_RWops *mats_stream, size_t num_mats, void *priv_buff)
         }
     }
 
+    if(!al_load_textures(priv->materials, num_mats, g_basepath))
+        return false;
+
     priv->num_materials = 8;
-    return true;
+    return R_GL_InitMaterialArr(priv, 0);
 }
 
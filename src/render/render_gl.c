@@ -65,6 +65,68 @@
 /*****************************************************************************/
 
 static vec3_t s_light_pos = (vec3_t){0.0f, 0.0f, 0.0f};
+static vec3_t s_ambient_color = (vec3_t){0.0f, 0.0f, 0.0f};
+static vec3_t s_light_color = (vec3_t){0.0f, 0.0f, 0.0f};
+
+static struct render_progs s_progs;
+
+/* The programs that each of the global uniforms is set for. They are 
+ * resolved from these names once, by 'R_GL_InitProgs'. */
+static const char *s_view_prog_names[] = {
+    "mesh.static.colored",
+    "mesh.static.colored-per-vert",
+    "mesh.static.textured",
+    "mesh.static.textured-phong",
+    "mesh.static.tile-outline",
+    "mesh.static.normals.colored",
+    "mesh.static.textured-phong-shadowed",
+    "mesh.animated.textured-phong",
+    "mesh.animated.textured-phong-shadowed",
+    "mesh.animated.normals.colored",
+    "mesh.animated-instanced.textured-phong",
+    "mesh.animated-instanced.textured-phong-shadowed",
+    "terrain",
+    "terrain-baked",
+    "terrain-baked-shadowed",
+};
+
+static const char *s_depth_prog_names[] = {
+    "mesh.static.depth",
+    "mesh.animated.depth",
+    "mesh.animated-instanced.depth",
+};
+
+static const char *s_shadowed_prog_names[] = {
+    "mesh.static.textured-phong-shadowed",
+    "mesh.animated.textured-phong-shadowed",
+    "mesh.animated-instanced.textured-phong-shadowed",
+    "terrain-baked-shadowed",
+};
+
+static const char *s_anim_prog_names[] = {
+    "mesh.animated.depth",
+    "mesh.animated.textured-phong",
+    "mesh.animated.textured-phong-shadowed",
+    "mesh.animated.normals.colored",
+};
+
+static const char *s_lit_prog_names[] = {
+    "mesh.static.textured-phong",
+    "mesh.static.textured-phong-shadowed",
+    "mesh.animated.textured-phong",
+    "mesh.animated.textured-phong-shadowed",
+    "mesh.animated-instanced.textured-phong",
+    "mesh.animated-instanced.textured-phong-shadowed",
+    "terrain",
+    "terrain-baked",
+    "terrain-baked-shadowed",
+};
+
+static GLuint s_view_progs    [ARR_SIZE(s_view_prog_names)];
+static GLuint s_depth_progs   [ARR_SIZE(s_depth_prog_names)];
+static GLuint s_shadowed_progs[ARR_SIZE(s_shadowed_prog_names)];
+static GLuint s_anim_progs    [ARR_SIZE(s_anim_prog_names)];
+static GLuint s_lit_progs     [ARR_SIZE(s_lit_prog_names)];
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -106,12 +168,42 @@ static void r_gl_set_materials(GLuint shader_prog, size_t num_mats, const struct
     }
 }
 
-static void r_gl_set_uniform_mat4x4_array(mat4x4_t *data, size_t count, 
-                                          const char *uname, const char *shader_name)
+static void r_gl_bind_textures(const struct render_private *priv, GLuint shader_prog)
 {
-    GLuint loc, shader_prog;
+    GLuint loc;
+    char locbuff[64];
+
+    /* Unused array samplers are pointed at the first array, so that every 
+     * sampler refers to a unit with an array texture bound. */
+    for(int i = 0; i < MAX_MATERIAL_ARRS; i++) {
+
+        int arr_idx = (i < priv->num_material_arrs) ? i : 0;
+
+        snprintf(locbuff, sizeof(locbuff), "%s[%d]", GL_U_MATERIAL_ARRS, i);
+        locbuff[sizeof(locbuff)-1] = '\0';
+
+        loc = glGetUniformLocation(shader_prog, locbuff);
+        glActiveTexture(MATERIAL_ARR_TUNIT + arr_idx);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, priv->material_arrs[arr_idx]);
+        glUniform1i(loc, MATERIAL_ARR_TUNIT - GL_TEXTURE0 + arr_idx);
+    }
+
+    loc = glGetUniformLocation(shader_prog, GL_U_MATERIAL_SLOTS);
+    glUniform1iv(loc, MAX_MATERIALS, priv->material_slots);
 
-    shader_prog = R_Shader_GetProgForName(shader_name);
+    if(!priv->baked_tex)
+        return;
+
+    loc = glGetUniformLocation(shader_prog, GL_U_BAKED_TEX);
+    glActiveTexture(BAKED_TEX_TUNIT);
+    glBindTexture(GL_TEXTURE_2D, priv->baked_tex);
+    glUniform1i(loc, BAKED_TEX_TUNIT - GL_TEXTURE0);
+}
+
+static void r_gl_set_uniform_mat4x4_array(mat4x4_t *data, size_t count, 
+                                          const char *uname, GLuint shader_prog)
+{
+    GLuint loc;
     glUseProgram(shader_prog);
 
     loc = glGetUniformLocation(shader_prog, uname);
@@ -119,54 +211,44 @@ static void r_gl_set_uniform_mat4x4_array(mat4x4_t *data, size_t count,
 }
 
 static void r_gl_set_uniform_vec4_array(vec4_t *data, size_t count, 
-                                        const char *uname, const char *shader_name)
+                                        const char *uname, GLuint shader_prog)
 {
-    GLuint loc, shader_prog;
-
-    shader_prog = R_Shader_GetProgForName(shader_name);
+    GLuint loc;
     glUseProgram(shader_prog);
 
     loc = glGetUniformLocation(shader_prog, uname);
     glUniform4fv(loc, count, (void*)data);
 }
 
-static void r_gl_set_mat4(const mat4x4_t *trans, const char *shader_name, const char *uname)
+static void r_gl_set_mat4(const mat4x4_t *trans, GLuint shader_prog, const char *uname)
 {
-    GLuint loc, shader_prog;
-
-    shader_prog = R_Shader_GetProgForName(shader_name);
+    GLuint loc;
     glUseProgram(shader_prog);
 
     loc = glGetUniformLocation(shader_prog, uname);
     glUniformMatrix4fv(loc, 1, GL_FALSE, trans->raw);
 }
 
-static void r_gl_set_vec3(const vec3_t *vec, const char *shader_name, const char *uname)
+static void r_gl_set_vec3(const vec3_t *vec, GLuint shader_prog, const char *uname)
 {
-    GLuint loc, shader_prog;
-
-    shader_prog = R_Shader_GetProgForName(shader_name);
+    GLuint loc;
     glUseProgram(shader_prog);
 
     loc = glGetUniformLocation(shader_prog, uname);
     glUniform3fv(loc, 1, vec->raw);
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-void R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff)
+static bool r_gl_shader_is_animated(const char *shader)
 {
-    struct mesh *mesh = &priv->mesh;
-
-    glGenVertexArrays(1, &mesh->VAO);
-    glBindVertexArray(mesh->VAO);
-
-    glGenBuffers(1, &mesh->VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * sizeof(struct vertex), vbuff, GL_STATIC_DRAW);
+    const char *prefix = "mesh.animated";
+    return (0 == strncmp(prefix, shader, strlen(prefix)));
+}
 
+/* Sets up the vertex attribute pointers of the currently bound VAO for
+ * sourcing 'struct vertex' data from the currently bound VBO. Only the 
+ * attributes used by the specified shader get enabled. */
+static void r_gl_set_vertex_attribs(const char *shader)
+{
     /* Attribute 0 - position */
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
     glEnableVertexAttribArray(0);
@@ -186,7 +268,7 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
         (void*)offsetof(struct vertex, material_idx));
     glEnableVertexAttribArray(3);
 
-    if(0 == strcmp("mesh.animated.textured-phong", shader)) {
+    if(r_gl_shader_is_animated(shader)) {
 
         /* Here, we use 2 attributes to pass in an array of size 6 since we are 
          * limited to a maximum of 4 components per attribute. */
@@ -197,7 +279,7 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
         glEnableVertexAttribArray(4);  
         glVertexAttribPointer(5, 3, GL_INT, GL_FALSE, sizeof(struct vertex),
             (void*)offsetof(struct vertex, joint_indices) + 3*sizeof(GLint));
-        glEnableVertexAttribArray(6);  
+        glEnableVertexAttribArray(5);  
 
         /* Attribute 6/7 - joint weights */
         glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
@@ -219,16 +301,354 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
             (void*)offsetof(struct vertex, adjacent_mat_indices));
         glEnableVertexAttribArray(5);
     }
+}
 
+/* Same as 'r_gl_set_vertex_attribs', but for the compact vertex layouts of
+ * model meshes. */
+static void r_gl_set_compact_vertex_attribs(enum vertex_layout layout)
+{
+    assert(layout == VERTEX_LAYOUT_STATIC || layout == VERTEX_LAYOUT_SKINNED);
+    GLsizei stride = (layout == VERTEX_LAYOUT_SKINNED) ? sizeof(struct vertex_skinned)
+                                                       : sizeof(struct vertex_static);
+
+    /* Attribute 0 - position */
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 
+        (void*)offsetof(struct vertex_static, pos));
+    glEnableVertexAttribArray(0);
+
+    /* Attribute 1 - texture coordinates */
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, 
+        (void*)offsetof(struct vertex_static, uv));
+    glEnableVertexAttribArray(1);
+
+    /* Attribute 2 - normal */
+    glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, 
+        (void*)offsetof(struct vertex_static, normal));
+    glEnableVertexAttribArray(2);
+
+    /* Attribute 3 - material index */
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, stride, 
+        (void*)offsetof(struct vertex_static, material_idx));
+    glEnableVertexAttribArray(3);
+
+    if(layout != VERTEX_LAYOUT_SKINNED)
+        return;
+
+    /* Attribute 4/5 - joint indices */
+    glVertexAttribPointer(4, 3, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+        (void*)offsetof(struct vertex_skinned, joint_indices));
+    glEnableVertexAttribArray(4);  
+    glVertexAttribPointer(5, 3, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+        (void*)offsetof(struct vertex_skinned, joint_indices) + 3*sizeof(GLubyte));
+    glEnableVertexAttribArray(5);  
+
+    /* Attribute 6/7 - joint weights */
+    glVertexAttribPointer(6, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+        (void*)offsetof(struct vertex_skinned, weights));
+    glEnableVertexAttribArray(6);  
+    glVertexAttribPointer(7, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+        (void*)offsetof(struct vertex_skinned, weights) + 3*sizeof(GLubyte));
+    glEnableVertexAttribArray(7);  
+}
+
+static void r_gl_init_progs(struct render_private *priv, const char *shader)
+{
     priv->shader_prog = R_Shader_GetProgForName(shader);
 
-    if(0 == strcmp("mesh.animated.textured-phong", shader)) {
+    if(r_gl_shader_is_animated(shader)) {
         priv->shader_prog_dp = R_Shader_GetProgForName("mesh.animated.depth");
     }else {
         priv->shader_prog_dp = R_Shader_GetProgForName("mesh.static.depth");
     }
 
+    priv->num_material_arrs = 0;
+    priv->baked_tex = 0;
+    priv->anim_tex = 0;
+    priv->inst_VAO = 0;
+    priv->inst_VBO = 0;
+
     assert(priv->shader_prog != -1 && priv->shader_prog_dp != -1);
+}
+
+static bool r_gl_resolve_progs(const char *const *names, GLuint *out, size_t count)
+{
+    for(int i = 0; i < count; i++) {
+
+        GLint prog = R_Shader_GetProgForName(names[i]);
+        if(prog <= 0)
+            return false;
+        out[i] = prog;
+    }
+    return true;
+}
+
+/* Splits an affine skinning matrix into the 3 palette texels: a rotation
+ * quaternion, a translation and a per-axis scale. Shear is not representable
+ * and is dropped. A mirroring matrix keeps its' reflection in the X scale. */
+static void r_gl_anim_decompose(const mat4x4_t *mat, vec4_t out[3])
+{
+    mat4x4_t rot;
+    PFM_Mat4x4_Identity(&rot);
+    vec3_t scale;
+
+    for(int c = 0; c < 3; c++) {
+
+        vec3_t col = (vec3_t){mat->cols[c][0], mat->cols[c][1], mat->cols[c][2]};
+        scale.raw[c] = PFM_Vec3_Len(&col);
+        for(int r = 0; r < 3; r++)
+            rot.cols[c][r] = scale.raw[c] > 0.0f ? col.raw[r] / scale.raw[c] : (c == r);
+    }
+
+    vec3_t x = (vec3_t){rot.cols[0][0], rot.cols[0][1], rot.cols[0][2]};
+    vec3_t y = (vec3_t){rot.cols[1][0], rot.cols[1][1], rot.cols[1][2]};
+    vec3_t z = (vec3_t){rot.cols[2][0], rot.cols[2][1], rot.cols[2][2]};
+    vec3_t xy;
+    PFM_Vec3_Cross(&x, &y, &xy);
+
+    if(PFM_Vec3_Dot(&xy, &z) < 0.0f) {
+        scale.x = -scale.x;
+        for(int r = 0; r < 3; r++)
+            rot.cols[0][r] = -rot.cols[0][r];
+    }
+
+    quat_t quat;
+    PFM_Quat_FromRotMat(&rot, &quat);
+    PFM_Quat_Normal(&quat, &quat);
+
+    out[0] = quat;
+    out[1] = (vec4_t){mat->cols[3][0], mat->cols[3][1], mat->cols[3][2], 0.0f};
+    out[2] = (vec4_t){scale.x, scale.y, scale.z, 0.0f};
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_InitProgs(void)
+{
+    if(!r_gl_resolve_progs(s_view_prog_names, s_view_progs, ARR_SIZE(s_view_progs))
+    || !r_gl_resolve_progs(s_depth_prog_names, s_depth_progs, ARR_SIZE(s_depth_progs))
+    || !r_gl_resolve_progs(s_shadowed_prog_names, s_shadowed_progs, ARR_SIZE(s_shadowed_progs))
+    || !r_gl_resolve_progs(s_anim_prog_names, s_anim_progs, ARR_SIZE(s_anim_progs))
+    || !r_gl_resolve_progs(s_lit_prog_names, s_lit_progs, ARR_SIZE(s_lit_progs)))
+        return false;
+
+    const struct{ const char *name; GLuint *out; }singles[] = {
+        {"mesh.static.colored",             &s_progs.colored},
+        {"mesh.static.colored-per-vert",    &s_progs.colored_per_vert},
+        {"mesh.static.textured",            &s_progs.textured},
+        {"mesh.static.tile-outline",        &s_progs.tile_outline},
+        {"mesh.static.normals.colored",     &s_progs.static_normals},
+        {"mesh.animated.normals.colored",   &s_progs.animated_normals},
+    };
+
+    for(int i = 0; i < ARR_SIZE(singles); i++) {
+        if(!r_gl_resolve_progs(&singles[i].name, singles[i].out, 1))
+            return false;
+    }
+    return true;
+}
+
+const struct render_progs *R_GL_Progs(void)
+{
+    return &s_progs;
+}
+
+void R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff)
+{
+    struct mesh *mesh = &priv->mesh;
+
+    glGenVertexArrays(1, &mesh->VAO);
+    glBindVertexArray(mesh->VAO);
+
+    glGenBuffers(1, &mesh->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * sizeof(struct vertex), vbuff, GL_STATIC_DRAW);
+
+    r_gl_set_vertex_attribs(shader);
+
+    mesh->layout = VERTEX_LAYOUT_FULL;
+    mesh->IBO = 0;
+    mesh->num_indices = 0;
+
+    r_gl_init_progs(priv, shader);
+    GL_ASSERT_OK();
+}
+
+void R_GL_InitIndexed(struct render_private *priv, const char *shader, 
+                      const void *vbuff, const void *ibuff)
+{
+    struct mesh *mesh = &priv->mesh;
+    assert(mesh->index_type == GL_UNSIGNED_SHORT || mesh->index_type == GL_UNSIGNED_INT);
+
+    size_t vert_sz = (mesh->layout == VERTEX_LAYOUT_SKINNED) ? sizeof(struct vertex_skinned)
+                   : (mesh->layout == VERTEX_LAYOUT_STATIC)  ? sizeof(struct vertex_static)
+                   : sizeof(struct vertex);
+    size_t idx_sz = (mesh->index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+    glGenVertexArrays(1, &mesh->VAO);
+    glBindVertexArray(mesh->VAO);
+
+    glGenBuffers(1, &mesh->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * vert_sz, vbuff, GL_STATIC_DRAW);
+
+    /* The element array buffer binding is part of the VAO state */
+    glGenBuffers(1, &mesh->IBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->IBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->num_indices * idx_sz, ibuff, GL_STATIC_DRAW);
+
+    if(mesh->layout == VERTEX_LAYOUT_FULL)
+        r_gl_set_vertex_attribs(shader);
+    else
+        r_gl_set_compact_vertex_attribs(mesh->layout);
+
+    r_gl_init_progs(priv, shader);
+    GL_ASSERT_OK();
+}
+
+bool R_GL_InitMaterialArr(struct render_private *priv, GLuint baked_tex)
+{
+    assert(priv->num_materials > 0);
+
+    struct{
+        int    width, height;
+        GLuint ids[MAX_MATERIALS];
+        size_t num_ids;
+    }groups[MAX_MATERIAL_ARRS];
+    size_t num_groups = 0;
+    GLint slots[MAX_MATERIALS];
+
+    /* Materials past MAX_MATERIALS can't be drawn, so their textures are not packed */
+    for(int i = 0; i < MAX_MATERIALS; i++) {
+
+        slots[i] = -1;
+        if(i >= priv->num_materials)
+            continue;
+
+        GLuint id = priv->materials[i].texture.id;
+        if(!id || id == baked_tex)
+            continue;
+
+        int width, height;
+        if(!R_Texture_Size(id, &width, &height))
+            return false;
+
+        int g = 0;
+        for(; g < num_groups; g++) {
+            if(groups[g].width == width && groups[g].height == height)
+                break;
+        }
+
+        if(g == num_groups) {
+            if(num_groups == MAX_MATERIAL_ARRS)
+                return false;
+            groups[g].width = width;
+            groups[g].height = height;
+            groups[g].num_ids = 0;
+            num_groups++;
+        }
+
+        int layer = 0;
+        for(; layer < groups[g].num_ids; layer++) {
+            if(groups[g].ids[layer] == id)
+                break;
+        }
+        if(layer == groups[g].num_ids)
+            groups[g].ids[groups[g].num_ids++] = id;
+
+        slots[i] = (g << 8) | layer;
+    }
+
+    /* The old arrays are only given back once the new ones are acquired, so that 
+     * they are reused instead of re-created when the textures did not change. */
+    GLuint arrs[MAX_MATERIAL_ARRS];
+    for(int g = 0; g < num_groups; g++) {
+
+        if(R_Texture_ArrayForIDs(groups[g].ids, groups[g].num_ids, &arrs[g]))
+            continue;
+
+        while(g-- > 0)
+            R_Texture_ArrayRelease(arrs[g]);
+        return false;
+    }
+
+    for(int i = 0; i < priv->num_material_arrs; i++)
+        R_Texture_ArrayRelease(priv->material_arrs[i]);
+
+    memcpy(priv->material_arrs, arrs, num_groups * sizeof(GLuint));
+    memcpy(priv->material_slots, slots, sizeof(slots));
+    priv->num_material_arrs = num_groups;
+    priv->baked_tex = baked_tex;
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_ShareMaterialArr(struct render_private *dst, const struct render_private *src)
+{
+    for(int i = 0; i < src->num_material_arrs; i++)
+        R_Texture_ArrayRetain(src->material_arrs[i]);
+    for(int i = 0; i < dst->num_material_arrs; i++)
+        R_Texture_ArrayRelease(dst->material_arrs[i]);
+
+    memcpy(dst->material_arrs, src->material_arrs, sizeof(src->material_arrs));
+    memcpy(dst->material_slots, src->material_slots, sizeof(src->material_slots));
+    dst->num_material_arrs = src->num_material_arrs;
+    dst->baked_tex = src->baked_tex;
+}
+
+void R_GL_Free(struct render_private *priv)
+{
+    struct mesh *mesh = &priv->mesh;
+
+    glDeleteVertexArrays(1, &mesh->VAO);
+    glDeleteBuffers(1, &mesh->VBO);
+    if(mesh->IBO)
+        glDeleteBuffers(1, &mesh->IBO);
+
+    for(int i = 0; i < priv->num_material_arrs; i++)
+        R_Texture_ArrayRelease(priv->material_arrs[i]);
+
+    if(priv->anim_tex) {
+        glDeleteTextures(1, &priv->anim_tex);
+        glDeleteVertexArrays(1, &priv->inst_VAO);
+        glDeleteBuffers(1, &priv->inst_VBO);
+    }
+
+    priv->num_material_arrs = 0;
+    priv->anim_tex = 0;
+    GL_ASSERT_OK();
+}
+
+void R_GL_MeshDraw(const struct mesh *mesh, size_t count)
+{
+    if(mesh->IBO) {
+        glDrawElementsInstanced(GL_TRIANGLES, mesh->num_indices, mesh->index_type, (void*)0, count);
+    }else {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->num_verts, count);
+    }
+}
+
+void R_GL_SetAnimInstanced(const struct render_private *priv, GLuint shader_prog,
+                           const struct render_anim_inst *insts, size_t count)
+{
+    assert(priv->anim_tex);
+    GLuint loc;
+
+    glUseProgram(shader_prog);
+
+    loc = glGetUniformLocation(shader_prog, GL_U_ANIM_PALETTE);
+    glActiveTexture(ANIM_PALETTE_TUNIT);
+    glBindTexture(GL_TEXTURE_2D, priv->anim_tex);
+    glUniform1i(loc, ANIM_PALETTE_TUNIT - GL_TEXTURE0);
+
+    /* Orphan the previous instance buffer storage so that we don't have to
+     * wait on any draws still using it. */
+    glBindBuffer(GL_ARRAY_BUFFER, priv->inst_VBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(struct render_anim_inst), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(struct render_anim_inst), insts);
+
+    glBindVertexArray(priv->inst_VAO);
     GL_ASSERT_OK();
 }
 
@@ -244,98 +664,194 @@ void R_GL_Draw(const void *render_private, mat4x4_t *model)
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     r_gl_set_materials(priv->shader_prog, priv->num_materials, priv->materials);
+    r_gl_bind_textures(priv, priv->shader_prog);
 
-    for(int i = 0; i < priv->num_materials; i++) {
-        R_Texture_GL_Activate(&priv->materials[i].texture, priv->shader_prog);
-    }
-    
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    R_GL_MeshDraw(&priv->mesh, 1);
 
     GL_ASSERT_OK();
 }
 
-void R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos)
+bool R_GL_AnimTexInit(void *render_private, size_t num_joints, size_t num_samples)
 {
-    const char *shaders[] = {
-        "mesh.static.colored",
-        "mesh.static.colored-per-vert",
-        "mesh.static.textured",
-        "mesh.static.textured-phong",
-        "mesh.static.tile-outline",
-        "mesh.static.normals.colored",
-        "mesh.animated.textured-phong",
-        "mesh.animated.normals.colored",
-        "terrain",
-        "terrain-baked",
-        "terrain-baked-shadowed",
-    };
+    struct render_private *priv = render_private;
+
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if(num_joints * 3 > max_size || num_samples > max_size)
+        return false;
+
+    /* Every row of the texture holds a single sample. A joint's transform is 
+     * stored as 3 consecutive RGBA texels: rotation, translation and scale. 
+     * The rows are filled in by 'R_GL_AnimTexUpdate' as the clips get loaded. */
+    glActiveTexture(ANIM_PALETTE_TUNIT);
+    glGenTextures(1, &priv->anim_tex);
+    glBindTexture(GL_TEXTURE_2D, priv->anim_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, num_joints * 3, num_samples, 0, 
+        GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    /* The instanced VAO sources the same vertex data as the regular one, 
+     * with the per-instance attributes coming from a separate buffer. */
+    glGenVertexArrays(1, &priv->inst_VAO);
+    glBindVertexArray(priv->inst_VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    if(priv->mesh.layout == VERTEX_LAYOUT_FULL)
+        r_gl_set_vertex_attribs("mesh.animated-instanced.textured-phong");
+    else
+        r_gl_set_compact_vertex_attribs(priv->mesh.layout);
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+    if(priv->mesh.IBO)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->mesh.IBO);
 
-        r_gl_set_mat4(view, shaders[i], GL_U_VIEW);
-        r_gl_set_vec3(pos, shaders[i], GL_U_VIEW_POS);
+    glGenBuffers(1, &priv->inst_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, priv->inst_VBO);
+
+    /* Attribute 8-11 - per-instance model matrix */
+    for(int i = 0; i < 4; i++) {
+    
+        glVertexAttribPointer(8 + i, 4, GL_FLOAT, GL_FALSE, sizeof(struct render_anim_inst),
+            (void*)(offsetof(struct render_anim_inst, model) + i * sizeof(vec4_t)));
+        glEnableVertexAttribArray(8 + i);
+        glVertexAttribDivisor(8 + i, 1);
     }
 
+    /* Attribute 12 - per-instance current sample, next sample and fraction */
+    glVertexAttribPointer(12, 3, GL_FLOAT, GL_FALSE, sizeof(struct render_anim_inst),
+        (void*)offsetof(struct render_anim_inst, curr_sample));
+    glEnableVertexAttribArray(12);
+    glVertexAttribDivisor(12, 1);
+
+#if CONFIG_SHADOWS
+    priv->shader_prog_inst = R_Shader_GetProgForName("mesh.animated-instanced.textured-phong-shadowed");
+#else
+    priv->shader_prog_inst = R_Shader_GetProgForName("mesh.animated-instanced.textured-phong");
+#endif
+    priv->shader_prog_inst_dp = R_Shader_GetProgForName("mesh.animated-instanced.depth");
+    assert(priv->shader_prog_inst != -1 && priv->shader_prog_inst_dp != -1);
+
     GL_ASSERT_OK();
+    return true;
 }
 
-void R_GL_SetProj(const mat4x4_t *proj)
+bool R_GL_AnimTexUpdate(void *render_private, const mat4x4_t *inv_bind_poses, 
+                        const mat4x4_t *palettes, size_t num_joints, 
+                        size_t first_sample, size_t num_samples)
 {
-    const char *shaders[] = {
-        "mesh.static.colored",
-        "mesh.static.colored-per-vert",
-        "mesh.static.textured",
-        "mesh.static.textured-phong",
-        "mesh.static.tile-outline",
-        "mesh.static.normals.colored",
-        "mesh.animated.textured-phong",
-        "mesh.animated.normals.colored",
-        "terrain",
-        "terrain-baked",
-        "terrain-baked-shadowed",
-    };
+    struct render_private *priv = render_private;
+    assert(priv->anim_tex);
+
+    /* We store the final skinning transforms in the texture so that the vertex 
+     * shader doesn't have to fetch the inverse bind matrices separately. They 
+     * are split into rotation, translation and scale so that the shader can 
+     * blend two samples without distorting the mesh. */
+    vec4_t *skin_xforms = malloc(num_samples * num_joints * 3 * sizeof(vec4_t));
+    if(!skin_xforms)
+        return false;
+
+    for(size_t s = 0; s < num_samples; s++) {
+        for(size_t j = 0; j < num_joints; j++) {
+
+            mat4x4_t *pose = (mat4x4_t*)&palettes[s * num_joints + j];
+            mat4x4_t *inv_bind = (mat4x4_t*)&inv_bind_poses[j];
+            mat4x4_t skin;
+            PFM_Mat4x4_Mult4x4(pose, inv_bind, &skin);
+            r_gl_anim_decompose(&skin, &skin_xforms[(s * num_joints + j) * 3]);
+        }
+    }
+
+    glActiveTexture(ANIM_PALETTE_TUNIT);
+    glBindTexture(GL_TEXTURE_2D, priv->anim_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_sample, num_joints * 3, num_samples, 
+        GL_RGBA, GL_FLOAT, skin_xforms);
+    free(skin_xforms);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+bool R_GL_HasAnimTex(const void *render_private)
+{
+    const struct render_private *priv = render_private;
+    return (priv->anim_tex > 0);
+}
+
+void R_GL_DrawAnimInstanced(const void *render_private, const struct render_anim_inst *insts, 
+                            size_t count)
+{
+    GL_ASSERT_OK();
+    const struct render_private *priv = render_private;
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++)
-        r_gl_set_mat4(proj, shaders[i], GL_U_PROJECTION);
+    R_GL_SetAnimInstanced(priv, priv->shader_prog_inst, insts, count);
+    r_gl_set_materials(priv->shader_prog_inst, priv->num_materials, priv->materials);
+    r_gl_bind_textures(priv, priv->shader_prog_inst);
+
+    R_GL_MeshDraw(&priv->mesh, count);
+    GL_ASSERT_OK();
+}
+
+void R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos)
+{
+    for(int i = 0; i < ARR_SIZE(s_view_progs); i++) {
+
+        r_gl_set_mat4(view, s_view_progs[i], GL_U_VIEW);
+        r_gl_set_vec3(pos, s_view_progs[i], GL_U_VIEW_POS);
+    }
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_SetProj(const mat4x4_t *proj)
+{
+    for(int i = 0; i < ARR_SIZE(s_view_progs); i++)
+        r_gl_set_mat4(proj, s_view_progs[i], GL_U_PROJECTION);
 
     GL_ASSERT_OK();
 }
 
 void R_GL_SetLightSpaceTrans(const mat4x4_t *trans)
 {
-    const char *shaders[] = {
-        "mesh.static.depth",
-        "mesh.animated.depth",
-        "mesh.static.textured-phong-shadowed",
-        "mesh.animated.textured-phong-shadowed",
-        "terrain-baked-shadowed",
-    };
+    for(int i = 0; i < ARR_SIZE(s_depth_progs); i++)
+        r_gl_set_mat4(trans, s_depth_progs[i], GL_U_LS_TRANS);
+
+    GL_ASSERT_OK();
+}
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++)
-        r_gl_set_mat4(trans, shaders[i], GL_U_LS_TRANS);
+void R_GL_SetLightSpaceTransforms(const mat4x4_t *trans, size_t count, unsigned active_mask)
+{
+    for(int i = 0; i < ARR_SIZE(s_shadowed_progs); i++) {
+
+        GLuint loc;
+        GLuint shader_prog = s_shadowed_progs[i];
+
+        glUseProgram(shader_prog);
+
+        loc = glGetUniformLocation(shader_prog, GL_U_LS_TRANSFORMS);
+        glUniformMatrix4fv(loc, count, GL_FALSE, trans[0].raw);
+
+        loc = glGetUniformLocation(shader_prog, GL_U_CASCADE_MASK);
+        glUniform1i(loc, active_mask);
+    }
 
     GL_ASSERT_OK();
 }
 
 void R_GL_SetShadowMap(const GLuint shadow_map_tex_id)
 {
-    const char *shaders[] = {
-        "mesh.static.textured-phong-shadowed",
-        "mesh.animated.textured-phong-shadowed",
-        "terrain-baked-shadowed",
-    };
-
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+    for(int i = 0; i < ARR_SIZE(s_shadowed_progs); i++) {
 
-        GLuint shader_prog, sampler_loc;
+        GLuint sampler_loc;
+        GLuint shader_prog = s_shadowed_progs[i];
 
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
         glUseProgram(shader_prog);
 
         sampler_loc = glGetUniformLocation(shader_prog, GL_U_SHADOW_MAP);
         glActiveTexture(SHADOW_MAP_TUNIT);
-        glBindTexture(GL_TEXTURE_2D, shadow_map_tex_id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map_tex_id);
         glUniform1i(sampler_loc, SHADOW_MAP_TUNIT - GL_TEXTURE0);
     }
 
@@ -344,17 +860,10 @@ void R_GL_SetShadowMap(const GLuint shadow_map_tex_id)
 
 void R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, size_t count)
 {
-    const char *shaders[] = {
-        "mesh.animated.depth",
-        "mesh.animated.textured-phong",
-        "mesh.animated.textured-phong-shadowed",
-        "mesh.animated.normals.colored",
-    };
-
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+    for(int i = 0; i < ARR_SIZE(s_anim_progs); i++) {
 
-        r_gl_set_uniform_mat4x4_array(inv_bind_poses, count, GL_U_INV_BIND_MATS, shaders[i]);
-        r_gl_set_uniform_mat4x4_array(curr_poses, count, GL_U_CURR_POSE_MATS, shaders[i]);
+        r_gl_set_uniform_mat4x4_array(inv_bind_poses, count, GL_U_INV_BIND_MATS, s_anim_progs[i]);
+        r_gl_set_uniform_mat4x4_array(curr_poses, count, GL_U_CURR_POSE_MATS, s_anim_progs[i]);
     }
 
     GL_ASSERT_OK();
@@ -362,73 +871,45 @@ void R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, size_t
 
 void R_GL_SetAmbientLightColor(vec3_t color)
 {
-    const char *shaders[] = {
-        "mesh.static.textured-phong",
-        "mesh.static.textured-phong-shadowed",
-        "mesh.animated.textured-phong",
-        "mesh.animated.textured-phong-shadowed",
-        "terrain",
-        "terrain-baked",
-        "terrain-baked-shadowed",
-    };
-
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+    for(int i = 0; i < ARR_SIZE(s_lit_progs); i++) {
     
-        GLuint loc, shader_prog;
+        GLuint loc;
+        GLuint shader_prog = s_lit_progs[i];
 
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
         glUseProgram(shader_prog);
 
         loc = glGetUniformLocation(shader_prog, GL_U_AMBIENT_COLOR);
         glUniform3fv(loc, 1, color.raw);
     }
 
+    s_ambient_color = color;
     GL_ASSERT_OK();
 }
 
 void R_GL_SetLightEmitColor(vec3_t color)
 {
-    const char *shaders[] = {
-        "mesh.static.textured-phong",
-        "mesh.static.textured-phong-shadowed",
-        "mesh.animated.textured-phong",
-        "mesh.animated.textured-phong-shadowed",
-        "terrain",
-        "terrain-baked",
-        "terrain-baked-shadowed",
-    };
-
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+    for(int i = 0; i < ARR_SIZE(s_lit_progs); i++) {
     
-        GLuint loc, shader_prog;
+        GLuint loc;
+        GLuint shader_prog = s_lit_progs[i];
 
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
         glUseProgram(shader_prog);
 
         loc = glGetUniformLocation(shader_prog, GL_U_LIGHT_COLOR);
         glUniform3fv(loc, 1, color.raw);
     }
 
+    s_light_color = color;
     GL_ASSERT_OK();
 }
 
 void R_GL_SetLightPos(vec3_t pos)
 {
-    const char *shaders[] = {
-        "mesh.static.textured-phong",
-        "mesh.static.textured-phong-shadowed",
-        "mesh.animated.textured-phong",
-        "mesh.animated.textured-phong-shadowed",
-        "terrain",
-        "terrain-baked",
-        "terrain-baked-shadowed",
-    };
+    for(int i = 0; i < ARR_SIZE(s_lit_progs); i++) {
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+        GLuint loc;
+        GLuint shader_prog = s_lit_progs[i];
 
-        GLuint loc, shader_prog;
-    
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
         glUseProgram(shader_prog);
 
         loc = glGetUniformLocation(shader_prog, GL_U_LIGHT_POS);
@@ -444,6 +925,20 @@ vec3_t R_GL_GetLightPos(void)
     return s_light_pos;
 }
 
+uint64_t R_GL_LightingHash(void)
+{
+    const vec3_t state[] = {s_light_pos, s_ambient_color, s_light_color};
+    const unsigned char *bytes = (const unsigned char*)state;
+
+    /* 64-bit FNV-1a */
+    uint64_t ret = 14695981039346656037ull;
+    for(int i = 0; i < sizeof(state); i++) {
+        ret ^= bytes[i];
+        ret *= 1099511628211ull;
+    }
+    return ret;
+}
+
 void R_GL_SetScreenspaceDrawMode(void)
 {
     mat4x4_t ortho;
@@ -526,7 +1021,7 @@ void R_GL_DrawSkeleton(const struct entity *ent, const struct skeleton *skel, co
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -568,7 +1063,7 @@ void R_GL_DrawOrigin(const void *render_private, mat4x4_t *model)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -633,7 +1128,7 @@ void R_GL_DrawRay(vec3_t origin, vec3_t dir, mat4x4_t *model, vec3_t color, floa
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -714,7 +1209,7 @@ void R_GL_DrawOBB(const struct entity *ent)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -766,7 +1261,7 @@ void R_GL_DrawBox2D(vec2_t screen_pos, vec2_t signed_size, vec3_t color, float w
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -797,8 +1292,7 @@ void R_GL_DrawNormals(const void *render_private, mat4x4_t *model, bool anim)
     const struct render_private *priv = render_private;
 
 
-    GLuint normals_shader = anim ? R_Shader_GetProgForName("mesh.animated.normals.colored")
-                                 : R_Shader_GetProgForName("mesh.static.normals.colored");
+    GLuint normals_shader = anim ? s_progs.animated_normals : s_progs.static_normals;
     assert(normals_shader);
     glUseProgram(normals_shader);
 
@@ -812,7 +1306,7 @@ void R_GL_DrawNormals(const void *render_private, mat4x4_t *model, bool anim)
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    R_GL_MeshDraw(&priv->mesh, 1);
 }
 
 void R_GL_DumpFBColor_PPM(const char *filename, int width, int height)
@@ -936,7 +1430,7 @@ void R_GL_DrawSelectionCircle(vec2_t xz, float radius, float width, vec3_t color
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -1055,7 +1549,7 @@ void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, size_t count,
         (void*)offsetof(struct colored_vert, color));
     glEnableVertexAttribArray(1);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored-per-vert");
+    shader_prog = s_progs.colored_per_vert;
     glUseProgram(shader_prog);
 
     glEnable(GL_BLEND);
@@ -1141,7 +1635,7 @@ void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, size_t coun
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);  
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = s_progs.colored;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
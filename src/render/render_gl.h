@@ -41,24 +41,108 @@
 #include <GL/glew.h>
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 
-#define SHADOW_MAP_TUNIT (GL_TEXTURE15)
+#define SHADOW_MAP_TUNIT    (GL_TEXTURE15)
+#define ANIM_PALETTE_TUNIT  (GL_TEXTURE14)
+#define MATERIAL_ARR_TUNIT  (GL_TEXTURE0) /* One unit for each of the MAX_MATERIAL_ARRS */
+#define BAKED_TEX_TUNIT     (GL_TEXTURE4)
+
+/* Must match the shaders */
+#define MAX_MATERIALS       (8)
+#define MAX_MATERIAL_ARRS   (4)
 
 struct render_private;
+struct mesh;
+struct render_anim_inst;
 struct vertex;
 struct tile;
 
+/* Shader programs used by the immediate-mode draw paths, resolved once 
+ * at initialization. */
+struct render_progs{
+    GLuint colored;
+    GLuint colored_per_vert;
+    GLuint textured;
+    GLuint tile_outline;
+    GLuint static_normals;
+    GLuint animated_normals;
+};
+
 /* General */
 
+/* ---------------------------------------------------------------------------
+ * Look up the handles of all shader programs which are used for setting 
+ * global uniforms and for debug drawing, so that no by-name lookups are 
+ * needed while rendering. Must be called after the shaders are loaded.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_InitProgs(void);
+const struct render_progs *R_GL_Progs(void);
+
 void   R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff);
 
+/* ---------------------------------------------------------------------------
+ * Like 'R_GL_Init', but for meshes with an index buffer. The vertices can be
+ * in any of the vertex layouts. The 'layout', 'num_verts', 'num_indices' and 
+ * 'index_type' fields of the mesh must already be set.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_InitIndexed(struct render_private *priv, const char *shader, 
+                        const void *vbuff, const void *ibuff);
+
+/* ---------------------------------------------------------------------------
+ * Pack the textures of the mesh's materials into its' material array textures.
+ * Textures are grouped by size, with one array for every distinct size, so 
+ * that none of them have to be rescaled. Fails if the textures come in more 
+ * than MAX_MATERIAL_ARRS sizes. A non-zero 'baked_tex' is left out of the 
+ * arrays and bound on its' own instead. Must be called again whenever the 
+ * materials change.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_InitMaterialArr(struct render_private *priv, GLuint baked_tex);
+
+/* ---------------------------------------------------------------------------
+ * Make 'dst' use the same material array textures and baked texture as 'src',
+ * giving back the arrays it held before. The materials of both must be the same.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_ShareMaterialArr(struct render_private *dst, const struct render_private *src);
+
+/* ---------------------------------------------------------------------------
+ * Deletes the GL objects of the mesh and gives back its' reference to the 
+ * material array texture. The material textures themselves are left loaded.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_Free(struct render_private *priv);
+
+/* ---------------------------------------------------------------------------
+ * Issue the draw call for 'count' instances of the mesh, using its' index 
+ * buffer when it has one. The VAO and shader program must already be bound.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_MeshDraw(const struct mesh *mesh, size_t count);
+
+/* ---------------------------------------------------------------------------
+ * Bind the model's animation texture to the shader program, upload the 
+ * per-instance data and bind the instanced VAO, leaving everything ready for
+ * an instanced draw call.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_SetAnimInstanced(const struct render_private *priv, GLuint shader_prog,
+                             const struct render_anim_inst *insts, size_t count);
+
 /* Shadows */
 
 void   R_GL_InitShadows(void);
 vec3_t R_GL_GetLightPos(void);
+/* Identifies the lighting that the baked textures are rendered with */
+uint64_t R_GL_LightingHash(void);
 void   R_GL_SetLightSpaceTrans(const mat4x4_t *trans);
+/* Bit i of 'active_mask' is set when cascade i is in use this frame */
+void   R_GL_SetLightSpaceTransforms(const mat4x4_t *trans, size_t count, unsigned active_mask);
 void   R_GL_SetShadowMap(const GLuint shadow_map_tex_id);
 
 /* Tiles */
@@ -69,10 +153,30 @@ void   R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t
  * Patch the vertices for a particular tile to have adjacency information
  * about the neighboring tiles, to be used for smooth blending.
  * Tiles which border tiles with different materials will get blending
- * 'turned on' by setting a vertex attribute.
+ * 'turned on' by setting a vertex attribute. 'vbuff' holds VERTS_PER_TILE
+ * vertices for every tile, as output by 'R_GL_TileGetVertices'.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_TilePatchVertsBlend(GLuint VBO, const struct tile *tiles, 
+void   R_GL_TilePatchVertsBlend(struct vertex *vbuff, const struct tile *tiles, 
                                 int width, int height, int r, int c);
 
+/* ---------------------------------------------------------------------------
+ * Builds the indexed terrain mesh for a chunk. Only the visible tile faces 
+ * are kept and regions of flat tiles with the same material and no blending 
+ * are merged. No GL calls are made, so this can run on any thread. The 
+ * returned buffers must be freed by the caller.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_TileMeshData(const struct tile *tiles, int width, int height,
+                         struct vertex **out_verts, size_t *out_num_verts,
+                         GLushort **out_indices, size_t *out_num_indices);
+
+/* ---------------------------------------------------------------------------
+ * Sets up the GL state for a chunk mesh built by 'R_GL_TileMeshData'. The 
+ * materials of 'priv' must already be set.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_TileInitMesh(struct render_private *priv, const struct vertex *verts, size_t num_verts,
+                         const GLushort *indices, size_t num_indices);
+
 #endif
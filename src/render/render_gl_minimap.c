@@ -33,6 +33,7 @@
  *
  */
 
+#include "render_gl.h"
 #include "mesh.h"
 #include "vertex.h"
 #include "texture.h"
@@ -53,6 +54,7 @@
 #include <math.h>
 #include <assert.h>
 
+#define MIN(a, b)            ((a) < (b) ? (a) : (b))
 #define MAX(a, b)            ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)          (sizeof(a)/sizeof(a[0])) 
 #define MINIMAP_RES          (1024)
@@ -156,7 +158,7 @@ void r_gl_draw_cam_frustum(const struct camera *cam, mat4x4_t *minimap_model, co
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
     glEnableVertexAttribArray(0);
 
-    GLuint shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    GLuint shader_prog = R_GL_Progs()->colored;
     glUseProgram(shader_prog);
 
     GLuint loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
@@ -185,6 +187,46 @@ void r_gl_draw_cam_frustum(const struct camera *cam, mat4x4_t *minimap_model, co
     glDeleteBuffers(1, &VBO);
 }
 
+static void r_gl_minimap_init_mesh(void)
+{
+    struct vertex map_verts[] = {
+        (struct vertex) {
+            .pos = (vec3_t) {-1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 0.0f},
+        },
+        (struct vertex) {
+            .pos = (vec3_t) {-1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 1.0f},
+        },
+        (struct vertex) {
+            .pos = (vec3_t) {1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 1.0f},
+        },
+        (struct vertex) {
+            .pos = (vec3_t) {1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 0.0f},
+        },
+    };
+
+    glGenVertexArrays(1, &s_ctx.minimap_mesh.VAO);
+    glBindVertexArray(s_ctx.minimap_mesh.VAO);
+
+    glGenBuffers(1, &s_ctx.minimap_mesh.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_ctx.minimap_mesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(map_verts) * sizeof(struct vertex), map_verts, GL_STATIC_DRAW);
+
+    /* Attribute 0 - position */
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    /* Attribute 1 - texture coordinates */
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
+        (void*)offsetof(struct vertex, uv));
+    glEnableVertexAttribArray(1);
+
+    GL_ASSERT_OK();
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -231,8 +273,12 @@ bool R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
     /* Render the map top-down view to the texture. */
     glViewport(0,0, MINIMAP_RES, MINIMAP_RES);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
     for(int r = 0; r < chunk_z; r++) {
         for(int c = 0; c < chunk_x; c++) {
+            /* Chunks which are not set up yet are drawn in when they are */
+            if(!chunk_rprivates[r * chunk_x + c])
+                continue;
             R_GL_Draw(chunk_rprivates[r * chunk_x + c], chunk_model_mats + (r * chunk_x + c)); 
         }
     }
@@ -245,51 +291,61 @@ bool R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glDeleteFramebuffers(1, &fb);
 
-    struct vertex map_verts[] = {
-        (struct vertex) {
-            .pos = (vec3_t) {-1.0f, -1.0f, 0.0f}, 
-            .uv =  (vec2_t) {0.0f, 0.0f},
-        },
-        (struct vertex) {
-            .pos = (vec3_t) {-1.0f, 1.0f, 0.0f}, 
-            .uv =  (vec2_t) {0.0f, 1.0f},
-        },
-        (struct vertex) {
-            .pos = (vec3_t) {1.0f, 1.0f, 0.0f}, 
-            .uv =  (vec2_t) {1.0f, 1.0f},
-        },
-        (struct vertex) {
-            .pos = (vec3_t) {1.0f, -1.0f, 0.0f}, 
-            .uv =  (vec2_t) {1.0f, 0.0f},
-        },
-    };
+    r_gl_minimap_init_mesh();
+    GL_ASSERT_OK();
+    return true;
 
-    glGenVertexArrays(1, &s_ctx.minimap_mesh.VAO);
-    glBindVertexArray(s_ctx.minimap_mesh.VAO);
+fail_fb:
+    return false;
+}
 
-    glGenBuffers(1, &s_ctx.minimap_mesh.VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, s_ctx.minimap_mesh.VBO);
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(map_verts) * sizeof(struct vertex), map_verts, GL_STATIC_DRAW);
+bool R_GL_MinimapLoad(const char *path)
+{
+    glGenTextures(1, &s_ctx.minimap_texture.id);
+    if(!R_Texture_LoadRendered(s_ctx.minimap_texture.id, MINIMAP_RES, MINIMAP_RES, R_GL_LightingHash(), path)) {
+        glDeleteTextures(1, &s_ctx.minimap_texture.id);
+        s_ctx.minimap_texture.id = 0;
+        return false;
+    }
 
-    /* Attribute 0 - position */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
-    glEnableVertexAttribArray(0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-    /* Attribute 1 - texture coordinates */
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, uv));
-    glEnableVertexAttribArray(1);
+    s_ctx.minimap_texture.tunit = GL_TEXTURE0;
+    R_Texture_AddExisting("__minimap__", s_ctx.minimap_texture.id);
 
-    GL_ASSERT_OK();
+    r_gl_minimap_init_mesh();
     return true;
+}
 
-fail_fb:
-    return false;
+bool R_GL_MinimapSave(const char *path)
+{
+    if(!s_ctx.minimap_texture.id)
+        return false;
+    return R_Texture_SaveRendered(s_ctx.minimap_texture.id, MINIMAP_RES, MINIMAP_RES, R_GL_LightingHash(), path);
 }
 
 bool R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4_t *chunk_model, 
-                             vec3_t map_center, vec2_t map_size)
+                             vec3_t map_center, vec2_t map_size, const struct box *dirty)
 {
+    float map_dim = MAX(map_size.raw[0], map_size.raw[1]);
+
+    /* The minimap camera looks straight down with the texture X axis along -X in 
+     * worldspace and the texture Y axis along +Z. The scissor box is padded by a 
+     * texel as the tile edges don't line up with the texel edges. */
+    float tex_x_min = ((map_center.x - dirty->x) / map_dim + 0.5f) * MINIMAP_RES;
+    float tex_x_max = ((map_center.x - (dirty->x - dirty->width)) / map_dim + 0.5f) * MINIMAP_RES;
+    float tex_y_min = ((dirty->z - map_center.z) / map_dim + 0.5f) * MINIMAP_RES;
+    float tex_y_max = ((dirty->z + dirty->height - map_center.z) / map_dim + 0.5f) * MINIMAP_RES;
+
+    GLint scissor_x = MAX(floor(tex_x_min) - 1, 0);
+    GLint scissor_y = MAX(floor(tex_y_min) - 1, 0);
+    GLint scissor_w = MIN(ceil(tex_x_max) + 1, MINIMAP_RES) - scissor_x;
+    GLint scissor_h = MIN(ceil(tex_y_max) + 1, MINIMAP_RES) - scissor_y;
+
+    if(scissor_w <= 0 || scissor_h <= 0)
+        return true;
+
     /* Create a new camera, with orthographic projection, centered 
      * over the map and facing straight down. */
     DECL_CAMERA_STACK(map_cam);
@@ -301,7 +357,6 @@ bool R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4
     Camera_SetPos((struct camera*)map_cam, map_center);
     Camera_SetPitchAndYaw((struct camera*)map_cam, -90.0f, 90.0f);
 
-    float map_dim = MAX(map_size.raw[0], map_size.raw[1]);
     vec2_t bot_left  = (vec2_t){ -(map_dim/2),  (map_dim/2) };
     vec2_t top_right = (vec2_t){  (map_dim/2), -(map_dim/2) };
     Camera_TickFinishOrthographic((struct camera*)map_cam, bot_left, top_right);
@@ -318,7 +373,12 @@ bool R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4
         goto fail_fb;
 
     glViewport(0,0, MINIMAP_RES, MINIMAP_RES);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(scissor_x, scissor_y, scissor_w, scissor_h);
+
     R_GL_Draw(chunk_rprivate, chunk_model);
+
+    glDisable(GL_SCISSOR_TEST);
     glViewport(0,0, CONFIG_RES_X, CONFIG_RES_Y);
 
     /* Re-bind the default framebuffer when we're done rendering */
@@ -356,7 +416,7 @@ void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t
     glBindVertexArray(s_ctx.minimap_mesh.VAO);
 
     /* First render a slightly larger colored quad as the border */
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
+    shader_prog = R_GL_Progs()->colored;
     glUseProgram(shader_prog);
 
     GLuint loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
@@ -374,7 +434,7 @@ void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t
     glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 
     /* Now draw the minimap texture */
-    shader_prog = R_Shader_GetProgForName("mesh.static.textured");
+    shader_prog = R_GL_Progs()->textured;
     glUseProgram(shader_prog);
 
     loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
@@ -46,95 +46,437 @@
 #include <GL/glew.h>
 
 #include <assert.h>
-
-
-#define LIGHT_POS_HEIGHT (200.0f)
+#include <string.h>
+
+
+/* Casters are assumed to be no higher than this above the surfaces they shadow */
+#define LIGHT_POS_HEIGHT        (200.0f)
+/* Only surfaces below this height get shadows drawn on them. This keeps the 
+ * cascades from being wasted on the empty space between the camera and the ground. */
+#define RECEIVER_MAX_HEIGHT     (80.0f)
+/* Each cascade covers a little more than the region it is needed for, so that
+ * the camera can move a bit before the cached static casters must be redrawn. */
+#define CASCADE_PADDING         (0.2f)
+/* The half-width of a cascade is rounded up to a multiple of this, so that small
+ * changes to the view do not change the cascade size (and invalidate the cache). */
+#define CASCADE_SIZE_QUANTUM    (8.0f)
+#define MAX_REGION_POINTS       (8 + 12 * 2)
+
+#define MIN(a, b)        ((a) < (b) ? (a) : (b))
+#define MAX(a, b)        ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)      (sizeof(a)/sizeof(a[0]))
+
+struct cascade{
+    /* Set when the static casters have been rendered to the cache for the 
+     * current placement of the cascade. */
+    bool           static_valid;
+    /* Set when some part of the visible scene falls in this cascade's slice */
+    bool           active;
+    /* The placement of the cascade, in the light's basis */
+    float          half_width;
+    float          center_x, center_y;
+    float          near_dist, far_dist;
+    mat4x4_t       light_space_trans;
+    struct frustum volume;
+};
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
+/* The final shadow maps, sampled when rendering the scene */
 static GLuint         s_depth_map_FBO;
 static GLuint         s_depth_map_tex;
+/* The depth of only the static casters, which are redrawn very rarely */
+static GLuint         s_static_map_FBO;
+static GLuint         s_static_map_tex;
+
 static bool           s_depth_pass_active = false;
 static struct frustum s_light_frustum;
+static struct cascade s_cascades[NUM_SHADOW_CASCADES];
+/* The light's basis: right, up and the direction of the light rays */
+static vec3_t         s_light_axes[3];
 
 /*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
+/* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void R_GL_InitShadows(void)
+static float r_gl_dist_along(vec3_t point, vec3_t origin, vec3_t axis)
+{
+    vec3_t rel;
+    PFM_Vec3_Sub(&point, &origin, &rel);
+    return PFM_Vec3_Dot(&rel, &axis);
+}
+
+static vec3_t r_gl_lerp(vec3_t a, vec3_t b, float t)
+{
+    return (vec3_t){a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z)};
+}
+
+/* Computes the vertices of the part of the camera frustum, between the 'begin' and 
+ * 'end' fractions of its depth, which holds surfaces that can receive shadows. This 
+ * is the slice of the frustum clipped by the ground plane and the 'RECEIVER_MAX_HEIGHT' 
+ * plane. Returns the number of vertices written to 'out'. */
+static size_t r_gl_receiver_region(const struct frustum *cam_frust, float begin, float end,
+                                   vec3_t out[MAX_REGION_POINTS])
+{
+    const vec3_t near[4] = {cam_frust->ntl, cam_frust->ntr, cam_frust->nbr, cam_frust->nbl};
+    const vec3_t far[4]  = {cam_frust->ftl, cam_frust->ftr, cam_frust->fbr, cam_frust->fbl};
+    vec3_t corners[8];
+
+    for(int i = 0; i < 4; i++) {
+        corners[i]     = r_gl_lerp(near[i], far[i], begin);
+        corners[i + 4] = r_gl_lerp(near[i], far[i], end);
+    }
+
+    const int edges[12][2] = {
+        {0, 1}, {1, 2}, {2, 3}, {3, 0},
+        {4, 5}, {5, 6}, {6, 7}, {7, 4},
+        {0, 4}, {1, 5}, {2, 6}, {3, 7},
+    };
+    const float planes_y[2] = {0.0f, RECEIVER_MAX_HEIGHT};
+    size_t ret = 0;
+
+    for(int i = 0; i < ARR_SIZE(corners); i++) {
+    
+        if(corners[i].y >= 0.0f && corners[i].y <= RECEIVER_MAX_HEIGHT)
+            out[ret++] = corners[i];
+    }
+
+    /* The remaining vertices are where the frustum edges cross the clipping planes */
+    for(int i = 0; i < ARR_SIZE(edges); i++) {
+        for(int j = 0; j < ARR_SIZE(planes_y); j++) {
+
+            vec3_t a = corners[edges[i][0]], b = corners[edges[i][1]];
+            if((a.y < planes_y[j]) == (b.y < planes_y[j]))
+                continue;
+
+            float t = (a.y - planes_y[j]) / (a.y - b.y);
+            out[ret] = r_gl_lerp(a, b, t);
+            out[ret++].y = planes_y[j];
+        }
+    }
+
+    assert(ret <= MAX_REGION_POINTS);
+    return ret;
+}
+
+/* Given the bounds of the receiving region in light space, returns the volume 
+ * holding all the casters which can shadow it. */
+static void r_gl_caster_volume(float min[3], float max[3], struct frustum *out)
+{
+    const float light_height = LIGHT_POS_HEIGHT / fabs(s_light_axes[2].y);
+    C_MakeOrthoFrustum((vec3_t){0.0f, 0.0f, 0.0f}, s_light_axes[1], s_light_axes[2], 
+        min[0], max[0], min[1], max[1], min[2] - light_height, max[2], out);
+}
+
+static void r_gl_place_cascade(struct cascade *casc, const vec3_t *points, size_t npoints,
+                               const vec3_t view_axes[3])
 {
-    glGenFramebuffers(1, &s_depth_map_FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
+    const float light_height = LIGHT_POS_HEIGHT / fabs(s_light_axes[2].y);
+    const vec3_t origin = (vec3_t){0.0f, 0.0f, 0.0f};
+
+    /* Bound the region with a sphere. Unlike a box in light space, this does not 
+     * change size as the camera turns. The sphere is centered on the middle of 
+     * the region's bounds along the 'view_axes', which turn along with the camera. */
+    float min[3] = {INFINITY, INFINITY, INFINITY}, max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for(int i = 0; i < npoints; i++) {
+        for(int j = 0; j < 3; j++) {
+
+            float proj = r_gl_dist_along(points[i], origin, view_axes[j]);
+            min[j] = MIN(min[j], proj);
+            max[j] = MAX(max[j], proj);
+        }
+    }
+
+    vec3_t center = (vec3_t){0.0f, 0.0f, 0.0f};
+    for(int j = 0; j < 3; j++) {
+
+        vec3_t delta;
+        PFM_Vec3_Scale((vec3_t*)&view_axes[j], (min[j] + max[j]) / 2.0f, &delta);
+        PFM_Vec3_Add(&center, &delta, &center);
+    }
+
+    float radius = 0.0f;
+    for(int i = 0; i < npoints; i++) {
+        vec3_t delta;
+        PFM_Vec3_Sub((vec3_t*)&points[i], &center, &delta);
+        radius = MAX(radius, PFM_Vec3_Len(&delta));
+    }
+
+    const float half_width = ceil(radius * (1.0f + CASCADE_PADDING) / CASCADE_SIZE_QUANTUM) 
+                           * CASCADE_SIZE_QUANTUM;
+    const float cx = r_gl_dist_along(center, origin, s_light_axes[0]);
+    const float cy = r_gl_dist_along(center, origin, s_light_axes[1]);
+    const float cd = r_gl_dist_along(center, origin, s_light_axes[2]);
+
+    if(casc->static_valid
+    && casc->half_width == half_width
+    && fabs(cx - casc->center_x) + radius <= half_width
+    && fabs(cy - casc->center_y) + radius <= half_width
+    && cd - radius - light_height >= casc->near_dist
+    && cd + radius <= casc->far_dist)
+        return;
+
+    /* The region is no longer covered - move the cascade. Its center is snapped 
+     * to whole texels so that the edges of the shadows don't shimmer as it moves. */
+    const float texel = (2.0f * half_width) / CONFIG_SHADOW_MAP_RES;
+    casc->static_valid = false;
+    casc->half_width = half_width;
+    casc->center_x = floor(cx / texel) * texel;
+    casc->center_y = floor(cy / texel) * texel;
+    casc->near_dist = cd - half_width - light_height;
+    casc->far_dist = cd + half_width;
+
+    mat4x4_t light_proj, light_view;
+    PFM_Mat4x4_MakeOrthographic(
+        casc->center_x - half_width, casc->center_x + half_width, 
+        casc->center_y - half_width, casc->center_y + half_width, 
+        casc->near_dist, casc->far_dist, &light_proj);
 
-    glGenTextures(1, &s_depth_map_tex);
-    glBindTexture(GL_TEXTURE_2D, s_depth_map_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, 
-                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
+    /* Since, for shadow mapping, we treat our light source as a directional light, 
+     * we only care about direction of the light rays, not the absolute position of 
+     * the light source. Thus, all cascades share a view from the origin and only 
+     * differ in the bounds of their projection. */
+    PFM_Mat4x4_MakeLookAt((vec3_t*)&origin, &s_light_axes[2], &s_light_axes[1], &light_view);
+    PFM_Mat4x4_Mult4x4(&light_proj, &light_view, &casc->light_space_trans);
+
+    C_MakeOrthoFrustum(origin, s_light_axes[1], s_light_axes[2], 
+        casc->center_x - half_width, casc->center_x + half_width, 
+        casc->center_y - half_width, casc->center_y + half_width, 
+        casc->near_dist, casc->far_dist, &casc->volume);
+}
+
+static void r_gl_update_light_axes(void)
+{
+    vec3_t light_dir = R_GL_GetLightPos();
+    PFM_Vec3_Normal(&light_dir, &light_dir);
+    PFM_Vec3_Scale(&light_dir, -1.0f, &light_dir);
+
+    vec3_t delta;
+    PFM_Vec3_Sub(&light_dir, &s_light_axes[2], &delta);
+    if(PFM_Vec3_Len(&delta) > 1e-6f) {
+        R_GL_InvalidateStaticShadows();
+    }
+
+    vec3_t right = (vec3_t){-1.0f, 0.0f, 0.0f}, up;
+    PFM_Vec3_Cross(&light_dir, &right, &up);
+    PFM_Vec3_Normal(&up, &up);
+
+    s_light_axes[2] = light_dir;
+    PFM_Vec3_Cross(&up, &light_dir, &s_light_axes[0]);
+    PFM_Vec3_Normal(&s_light_axes[0], &s_light_axes[0]);
+    PFM_Vec3_Cross(&light_dir, &s_light_axes[0], &s_light_axes[1]);
+}
+
+static void r_gl_bind_layer(GLenum target, GLuint fbo, GLuint tex, int layer)
+{
+    glBindFramebuffer(target, fbo);
+    glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, tex, 0, layer);
+}
+
+static GLuint r_gl_make_depth_array(void)
+{
+    GLuint ret;
+    glGenTextures(1, &ret);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ret);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32, 
+                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, NUM_SHADOW_CASCADES,
                  0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return ret;
+}
+
+static GLuint r_gl_make_depth_fbo(GLuint tex)
+{
+    GLuint ret;
+    glGenFramebuffers(1, &ret);
+    glBindFramebuffer(GL_FRAMEBUFFER, ret);
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, s_depth_map_tex, 0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_InitShadows(void)
+{
+    s_depth_map_tex = r_gl_make_depth_array();
+    s_depth_map_FBO = r_gl_make_depth_fbo(s_depth_map_tex);
+
+    s_static_map_tex = r_gl_make_depth_array();
+    s_static_map_FBO = r_gl_make_depth_fbo(s_static_map_tex);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);  
     GL_ASSERT_OK();
 }
 
+void R_GL_InvalidateStaticShadows(void)
+{
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+        s_cascades[i].static_valid = false;
+    }
+}
+
 void R_GL_DepthPassBegin(void)
 {
     assert(!s_depth_pass_active);
     s_depth_pass_active = true;
 
-    mat4x4_t light_proj;
-    PFM_Mat4x4_MakeOrthographic(-CONFIG_SHADOW_FOV, CONFIG_SHADOW_FOV, 
-        CONFIG_SHADOW_FOV, -CONFIG_SHADOW_FOV, 0.1f, CONFIG_SHADOW_DRAWDIST, &light_proj);
+    r_gl_update_light_axes();
+
+    /* Must be queried before the viewport is changed to that of the shadow map */
+    struct frustum cam_frust;
+    G_ActiveCamFrustum(&cam_frust);
 
     vec3_t cam_pos = G_ActiveCamPos();
-    vec3_t cam_dir = G_ActiveCamDir();
+    vec3_t cam_dir = cam_frust.near.normal;
+    const float near_dist = r_gl_dist_along(cam_frust.near.point, cam_pos, cam_dir);
+    const float far_dist = r_gl_dist_along(cam_frust.far.point, cam_pos, cam_dir);
+
+    /* Find the range of depths (from the camera) at which there are surfaces which 
+     * can receive shadows. The cascades are split up over this range only. */
+    vec3_t points[MAX_REGION_POINTS];
+    size_t npoints = r_gl_receiver_region(&cam_frust, 0.0f, 1.0f, points);
+
+    float begin = INFINITY, end = -INFINITY;
+    for(int i = 0; i < npoints; i++) {
+        float depth = r_gl_dist_along(points[i], cam_pos, cam_dir);
+        begin = MIN(begin, depth);
+        end = MAX(end, depth);
+    }
+    begin = MAX(begin, near_dist);
+    end = MIN(end, CONFIG_SHADOW_MAX_DIST);
+
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+        s_cascades[i].active = false;
+    }
+    /* Nothing gets drawn when there are no active cascades */
+    memset(&s_light_frustum, 0, sizeof(s_light_frustum));
+
+    if(end > begin) {
+
+        /* The volume of all casters that can affect the visible part of the scene */
+        float min[3] = {INFINITY, INFINITY, INFINITY}, max[3] = {-INFINITY, -INFINITY, -INFINITY};
+        npoints = r_gl_receiver_region(&cam_frust, 
+            (begin - near_dist) / (far_dist - near_dist), 
+            (end - near_dist) / (far_dist - near_dist), points);
+
+        for(int i = 0; i < npoints; i++) {
+            for(int j = 0; j < 3; j++) {
+
+                float proj = r_gl_dist_along(points[i], (vec3_t){0.0f, 0.0f, 0.0f}, s_light_axes[j]);
+                min[j] = MIN(min[j], proj);
+                max[j] = MAX(max[j], proj);
+            }
+        }
+        r_gl_caster_volume(min, max, &s_light_frustum);
+
+        /* An orthonormal basis which follows the camera's heading */
+        vec3_t view_axes[3];
+        view_axes[1] = (vec3_t){0.0f, 1.0f, 0.0f};
+        view_axes[2] = (vec3_t){cam_dir.x, 0.0f, cam_dir.z};
+        if(PFM_Vec3_Len(&view_axes[2]) < 1e-3f) {
+            /* Looking straight up or down */
+            view_axes[2] = (vec3_t){cam_frust.top.normal.x, 0.0f, cam_frust.top.normal.z};
+        }
+        PFM_Vec3_Normal(&view_axes[2], &view_axes[2]);
+        PFM_Vec3_Cross(&view_axes[1], &view_axes[2], &view_axes[0]);
+
+        /* Split the range between a logarithmic and a uniform distribution. The
+         * logarithmic one keeps the resolution of the shadows roughly constant 
+         * on screen, but gives tiny cascades close to the camera. */
+        float splits[NUM_SHADOW_CASCADES + 1];
+        for(int i = 0; i <= NUM_SHADOW_CASCADES; i++) {
+
+            float frac = ((float)i) / NUM_SHADOW_CASCADES;
+            float log_split = begin * pow(end / begin, frac);
+            float uni_split = begin + (end - begin) * frac;
+            splits[i] = CONFIG_SHADOW_SPLIT_LAMBDA * log_split + (1.0f - CONFIG_SHADOW_SPLIT_LAMBDA) * uni_split;
+        }
+
+        for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+
+            npoints = r_gl_receiver_region(&cam_frust, 
+                (splits[i]     - near_dist) / (far_dist - near_dist), 
+                (splits[i + 1] - near_dist) / (far_dist - near_dist), points);
+            if(npoints == 0)
+                continue;
+
+            s_cascades[i].active = true;
+            r_gl_place_cascade(&s_cascades[i], points, npoints, view_axes);
+        }
+    }
+
+    /* The shaders only sample the cascades which are in the mask. The others 
+     * have nothing rendered to them this frame. */
+    mat4x4_t transforms[NUM_SHADOW_CASCADES] = {0};
+    unsigned active_mask = 0;
+    for(int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+        if(!s_cascades[i].active)
+            continue;
+        transforms[i] = s_cascades[i].light_space_trans;
+        active_mask |= (1u << i);
+    }
+    R_GL_SetLightSpaceTransforms(transforms, NUM_SHADOW_CASCADES, active_mask);
 
-    float t = cam_pos.y / cam_dir.y;
-    vec3_t cam_ray_ground_isec = (vec3_t){cam_pos.x - t * cam_dir.x, 0.0f, cam_pos.z - t * cam_dir.z};
+    glViewport(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES);
+    GL_ASSERT_OK();
+}
 
-    vec3_t light_dir = R_GL_GetLightPos();
-    PFM_Vec3_Normal(&light_dir, &light_dir);
-    PFM_Vec3_Scale(&light_dir, -1.0f, &light_dir);
+bool R_GL_DepthPassBeginCascade(int idx, enum shadow_casters casters, struct frustum *out_volume)
+{
+    assert(s_depth_pass_active);
+    assert(idx >= 0 && idx < NUM_SHADOW_CASCADES);
 
-    vec3_t right = (vec3_t){-1.0f, 0.0f, 0.0f}, up;
-    PFM_Vec3_Cross(&light_dir, &right, &up);
+    struct cascade *casc = &s_cascades[idx];
 
-    t = fabs(LIGHT_POS_HEIGHT / light_dir.y);
-    vec3_t light_origin, delta;
-    PFM_Vec3_Scale(&light_dir, -t, &delta);
-    PFM_Vec3_Add(&cam_ray_ground_isec, &delta, &light_origin);
+    switch(casters) {
+    case SHADOW_CASTERS_STATIC:
 
-    vec3_t target;
-    PFM_Vec3_Add(&light_origin, &light_dir, &target);
+        if(!casc->active || casc->static_valid)
+            return false;
 
-    /* Since, for shadow mapping, we treat our light source as a directional light, 
-     * we only care about direction of the light rays, not the absolute position of 
-     * the light source. Thus, we render the shadow map from a fixed height, looking 
-     * at the position where the camera ray intersects the ground plane. */
-    mat4x4_t light_view;
-    PFM_Mat4x4_MakeLookAt(&light_origin, &target, &up, &light_view);
+        r_gl_bind_layer(GL_FRAMEBUFFER, s_static_map_FBO, s_static_map_tex, idx);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        /* The caller is now expected to draw all the static casters in the volume */
+        casc->static_valid = true;
+        break;
 
-    C_MakeFrustum(light_origin, up, light_dir, 1.0f, M_PI/4.0f, 0.1f, CONFIG_SHADOW_DRAWDIST, &s_light_frustum);
+    case SHADOW_CASTERS_DYNAMIC:
 
-    mat4x4_t light_space_trans;
-    PFM_Mat4x4_Mult4x4(&light_proj, &light_view, &light_space_trans);
-    R_GL_SetLightSpaceTrans(&light_space_trans);
+        r_gl_bind_layer(GL_DRAW_FRAMEBUFFER, s_depth_map_FBO, s_depth_map_tex, idx);
+        if(!casc->active || !casc->static_valid) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+            if(!casc->active)
+                return false;
+            break;
+        }
 
-    glViewport(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
+        /* Start off with the cached depth of the static casters */
+        r_gl_bind_layer(GL_READ_FRAMEBUFFER, s_static_map_FBO, s_static_map_tex, idx);
+        glBlitFramebuffer(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
+                          0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
+        break;
+
+    default: assert(0);
+    }
+
+    R_GL_SetLightSpaceTrans(&casc->light_space_trans);
+    *out_volume = casc->volume;
 
     GL_ASSERT_OK();
+    return true;
 }
 
 void R_GL_DepthPassEnd(void)
@@ -164,7 +506,21 @@ void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model)
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    R_GL_MeshDraw(&priv->mesh, 1);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_RenderDepthMapAnimInstanced(const void *render_private, 
+                                      const struct render_anim_inst *insts, size_t count)
+{
+    assert(s_depth_pass_active);
+    GL_ASSERT_OK();
+
+    const struct render_private *priv = render_private;
+
+    R_GL_SetAnimInstanced(priv, priv->shader_prog_inst_dp, insts, count);
+    R_GL_MeshDraw(&priv->mesh, count);
 
     GL_ASSERT_OK();
 }
@@ -173,4 +529,3 @@ void R_GL_GetLightFrustum(struct frustum *out)
 {
     *out = s_light_frustum;
 }
-
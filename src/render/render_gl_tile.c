@@ -39,6 +39,7 @@
 #include "vertex.h"
 #include "shader.h"
 #include "material.h"
+#include "texture.h"
 #include "gl_assert.h"
 #include "gl_uniforms.h"
 #include "public/render.h"
@@ -54,6 +55,7 @@
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
   
 
 #define ARR_SIZE(a)                 (sizeof(a)/sizeof(a[0]))
@@ -349,11 +351,670 @@ static int arr_indexof(int *array, size_t size, int elem)
     return -1;
 }
 
+/* Returns the number of distinct side materials used by the chunk, or -1 if there
+ * is no material slot left over for the baked top face texture. */
+static int r_gl_tile_baked_side_mats(const struct tile *tiles, int tiles_per_chunk_x, int tiles_per_chunk_z,
+                                     int *out_side_mats)
+{
+    int num_side_mats = 0;
+
+    for(int r = 0; r < tiles_per_chunk_z; r++) {
+        for(int c = 0; c < tiles_per_chunk_x; c++) {
+
+            const struct tile *curr_tile = &tiles[r * tiles_per_chunk_x + c];
+
+            if(!arr_contains(out_side_mats, num_side_mats, curr_tile->sides_mat_idx)) {
+                out_side_mats[num_side_mats++] = curr_tile->sides_mat_idx;
+
+                /* We need at least one free material slot for the baked top face texture. */
+                if(num_side_mats > (MATERIALS_PER_CHUNK-1))
+                    return -1;
+            }
+        }
+    }
+    return num_side_mats;
+}
+
+/* Writes the visible side faces of the tile to 'out' and returns the number of
+ * vertices written. */
+static int r_gl_tile_baked_sides(const struct tile *tiles, int r, int c,
+                                 const struct vertex *tile_vbuff,
+                                 int *side_mats, int num_side_mats, struct vertex *out)
+{
+    /* Order of faces for each tile in the vbuff: bot, front, back, left, right, top. */
+    bool visible[] = {
+        M_Tile_FrontFaceVisible(tiles, r, c),
+        M_Tile_BackFaceVisible (tiles, r, c),
+        M_Tile_LeftFaceVisible (tiles, r, c),
+        M_Tile_RightFaceVisible(tiles, r, c),
+    };
+    int num_verts = 0;
+
+    for(int f = 0; f < ARR_SIZE(visible); f++) {
+
+        if(!visible[f])
+            continue;
+
+        memcpy(out, tile_vbuff + (VERTS_PER_FACE * (f + 1)), sizeof(struct vertex) * VERTS_PER_FACE);
+        for(int i = 0; i < VERTS_PER_FACE; i++) {
+            out[i].material_idx = arr_indexof(side_mats, num_side_mats, out[i].material_idx);
+            assert(out[i].material_idx >= 0);
+        }
+        num_verts += VERTS_PER_FACE;
+        out += VERTS_PER_FACE;
+    }
+    return num_verts;
+}
+
+/* The top face of every baked tile samples its' own region of the single chunk-wide
+ * texture. A corner of the tile grid maps to the same UV for all tiles sharing it. */
+static vec2_t r_gl_tile_baked_uv(int grid_r, int grid_c, int tiles_per_chunk_x, int tiles_per_chunk_z)
+{
+    return (vec2_t){ grid_c * (1.0f / tiles_per_chunk_x), grid_r * (1.0f / tiles_per_chunk_z) };
+}
+
+/* Writes the 2 top face triangles of the tile to 'out'. */
+static void r_gl_tile_baked_top(const struct tile *tile, int r, int c,
+                                const struct vertex *tile_vbuff,
+                                int tiles_per_chunk_x, int tiles_per_chunk_z, int top_mat_idx,
+                                struct vertex *out)
+{
+    struct vertex sw = tile_vbuff[(VERTS_PER_FACE * 5) + 0];
+    struct vertex se = tile_vbuff[(VERTS_PER_FACE * 5) + 1];
+    struct vertex nw = tile_vbuff[(VERTS_PER_FACE * 5) + 6];
+    struct vertex ne = tile_vbuff[(VERTS_PER_FACE * 5) + 7];
+
+    sw.material_idx = top_mat_idx;
+    se.material_idx = top_mat_idx;
+    nw.material_idx = top_mat_idx;
+    ne.material_idx = top_mat_idx;
+
+    /* Patch the UV coordinates of the top face */
+    sw.uv = r_gl_tile_baked_uv(r+1, c,   tiles_per_chunk_x, tiles_per_chunk_z);
+    se.uv = r_gl_tile_baked_uv(r+1, c+1, tiles_per_chunk_x, tiles_per_chunk_z);
+    nw.uv = r_gl_tile_baked_uv(r,   c,   tiles_per_chunk_x, tiles_per_chunk_z);
+    ne.uv = r_gl_tile_baked_uv(r,   c+1, tiles_per_chunk_x, tiles_per_chunk_z);
+
+    vec3_t top_tri_normals[2];
+    bool   top_tri_left_aligned;
+    r_gl_tile_top_normals(tile, top_tri_normals, &top_tri_left_aligned);
+
+    /*
+     * CONFIG 1 (left-aligned)   CONFIG 2
+     * (nw)      (ne)            (nw)      (ne)
+     * +---------+               +---------+
+     * |       / |               | \       |
+     * |     /   |               |   \     |
+     * |   /     |               |     \   |
+     * | /       |               |       \ |
+     * +---------+               +---------+
+     * (sw)      (se)            (sw)      (se)
+     */
+
+    out[0] = sw;
+    out[1] = se;
+    out[3] = nw;
+    out[4] = ne;
+
+    if(top_tri_left_aligned) {
+        out[2] = ne;
+        out[5] = sw;
+    }else {
+        out[2] = nw;
+        out[5] = se;
+    }
+
+    for(int i = 0; i < 3; i++)
+        out[i].normal = top_tri_normals[0];
+
+    for(int i = 3; i < 6; i++)
+        out[i].normal = top_tri_normals[1];
+}
+
+/* Grows the largest rectangle of tiles with the same (non-negative) merge key, which are 
+ * not yet part of another rectangle, with (r, c) as its' top left corner. First along the
+ * row, then downwards as long as entire row spans can be added. */
+static void r_gl_tile_grow_rect(const int *keys, const bool *merged,
+                                int tiles_per_chunk_x, int tiles_per_chunk_z,
+                                int r, int c, int *out_w, int *out_h)
+{
+    const int key = keys[r * tiles_per_chunk_x + c];
+    int w = 0, h = 0;
+    assert(key >= 0);
+
+    while(c + w < tiles_per_chunk_x) {
+        int idx = r * tiles_per_chunk_x + (c + w);
+        if(merged[idx] || keys[idx] != key)
+            break;
+        w++;
+    }
+
+    for(h = 1; r + h < tiles_per_chunk_z; h++) {
+        bool row_ok = true;
+        for(int i = 0; i < w; i++) {
+            int idx = (r + h) * tiles_per_chunk_x + (c + i);
+            if(merged[idx] || keys[idx] != key) {
+                row_ok = false;
+                break;
+            }
+        }
+        if(!row_ok)
+            break;
+    }
+
+    *out_w = w;
+    *out_h = h;
+}
+
+/* Steps to the next tile corner along the perimeter of a w x h rectangle, walking 
+ * it starting at the SW corner: east along the southern edge, north along the eastern 
+ * edge, west along the northern edge and south back to the start. 'i' is the index
+ * of the current corner. */
+static void r_gl_tile_perimeter_step(int i, int w, int h, int *inout_r, int *inout_c)
+{
+    if(i < w)                 (*inout_c)++;
+    else if(i < w + h)        (*inout_r)--;
+    else if(i < 2 * w + h)    (*inout_c)--;
+    else                      (*inout_r)++;
+}
+
+/* Triangles use the first vertex as the provoking vertex, so the 'flat' attributes 
+ * (material, blend mode and adjacency information) of a vertex only matter for the 
+ * triangles where it comes first. */
+static bool r_gl_tile_smooth_attrs_equal(const struct vertex *a, const struct vertex *b)
+{
+    return VEC3_EQUAL(a->pos, b->pos)
+        && VEC3_EQUAL(a->normal, b->normal)
+        && 0 == memcmp(a->uv.raw, b->uv.raw, sizeof(a->uv.raw));
+}
+
+static bool r_gl_tile_flat_attrs_equal(const struct vertex *a, const struct vertex *b)
+{
+    return (a->material_idx == b->material_idx)
+        && (a->blend_mode == b->blend_mode)
+        && 0 == memcmp(a->adjacent_mat_indices, b->adjacent_mat_indices, sizeof(a->adjacent_mat_indices));
+}
+
+/* Appends the triangles of a single tile face to the indexed mesh. Vertices are shared 
+ * between the face's triangles when they only differ in attributes that are ignored 
+ * for all but one of the triangles using them. */
+static void r_gl_tile_append_face(const struct vertex *tris, int count, 
+                                  struct vertex *verts, size_t *inout_num_verts,
+                                  GLushort *indices, size_t *inout_num_indices)
+{
+    assert(count % 3 == 0 && count <= 4 * 3);
+
+    size_t base = *inout_num_verts;
+    bool provoking[4 * 3];
+    int num_unique = 0;
+
+    for(int i = 0; i < count; i++) {
+
+        bool curr_provoking = (i % 3 == 0);
+        int j = 0;
+
+        for(; j < num_unique; j++) {
+
+            const struct vertex *cand = &verts[base + j];
+            if(!r_gl_tile_smooth_attrs_equal(cand, &tris[i]))
+                continue;
+            if(curr_provoking && provoking[j] && !r_gl_tile_flat_attrs_equal(cand, &tris[i]))
+                continue;
+            break;
+        }
+
+        if(j == num_unique) {
+            verts[base + j] = tris[i];
+            provoking[num_unique++] = curr_provoking;
+        }else if(curr_provoking && !provoking[j]) {
+            verts[base + j] = tris[i];
+            provoking[j] = true;
+        }
+        indices[(*inout_num_indices)++] = base + j;
+    }
+    *inout_num_verts += num_unique;
+}
+
+/* Returns true if the whole top face of the tile is drawn with a single material, with 
+ * no blending with the neighbouring tiles. */
+static bool r_gl_tile_top_uniform(const struct vertex *tile_verts, int *out_mat_idx)
+{
+    const struct vertex *top = tile_verts + (5 * VERTS_PER_FACE);
+
+    for(int i = 0; i < 4; i++) {
+        const struct vertex *provoking = &top[i * 3];
+        if(provoking->blend_mode != BLEND_MODE_NOBLEND
+        || provoking->material_idx != top[0].material_idx)
+            return false;
+    }
+    *out_mat_idx = top[0].material_idx;
+    return true;
+}
+
+/* A merged rectangle is triangulated as a fan around its' center, using every
+ * tile corner along its' perimeter. This way, the rectangle shares exactly the
+ * same edge vertices as any adjacent tiles, side faces and neighbouring chunks
+ * (regardless of which mesh they are drawn with) and no T-junctions are introduced.
+ * The cost is 2 * (w + h) triangles in place of 2 * w * h. All vertices take their 
+ * attributes from 'proto', except for the UV coordinates, which are an affine 
+ * function of the tile grid position: (uv_base.x + col * uv_step.x, 
+ * uv_base.y + row * uv_step.y). Writes 2 * (w + h) + 1 vertices and 3 times as
+ * many indices as there are triangles. */
+static void r_gl_tile_append_flat_rect(const struct vertex *proto, int r, int c, int w, int h,
+                                       vec2_t uv_base, vec2_t uv_step,
+                                       struct vertex *verts, size_t *inout_num_verts,
+                                       GLushort *indices, size_t *inout_num_indices)
+{
+    const int num_perim = 2 * (w + h);
+    const size_t base = *inout_num_verts;
+
+    struct vertex center = *proto;
+    center.pos = (vec3_t) { -((c + w/2.0f) * X_COORDS_PER_TILE), proto->pos.y, (r + h/2.0f) * Z_COORDS_PER_TILE };
+    center.uv  = (vec2_t) { uv_base.x + (c + w/2.0f) * uv_step.x, uv_base.y + (r + h/2.0f) * uv_step.y };
+    verts[base] = center;
+
+    int grid_r = r + h, grid_c = c;
+    for(int i = 0; i < num_perim; i++) {
+
+        struct vertex *curr = &verts[base + 1 + i];
+        *curr = *proto;
+        curr->pos = (vec3_t) { -(grid_c * X_COORDS_PER_TILE), proto->pos.y, grid_r * Z_COORDS_PER_TILE };
+        curr->uv  = (vec2_t) { uv_base.x + grid_c * uv_step.x, uv_base.y + grid_r * uv_step.y };
+
+        indices[(*inout_num_indices)++] = base;
+        indices[(*inout_num_indices)++] = base + 1 + i;
+        indices[(*inout_num_indices)++] = base + 1 + ((i + 1) % num_perim);
+
+        r_gl_tile_perimeter_step(i, w, h, &grid_r, &grid_c);
+    }
+    assert(grid_r == r + h && grid_c == c);
+
+    *inout_num_verts += num_perim + 1;
+}
+
+/* Builds the vertices and indices of the chunk's tile mesh. Bottom faces and side 
+ * faces that are hidden by neighbouring tiles are dropped, as they can never be seen.
+ * Regions of flat tiles of the same height which are drawn with a single material 
+ * and no blending are merged. */
+static bool r_gl_tile_mesh_data(const struct tile *tiles, int width, int height,
+                                struct vertex **out_verts, size_t *out_num_verts,
+                                GLushort **out_indices, size_t *out_num_indices)
+{
+    const size_t num_tiles = width * height;
+
+    /* Each tile has at most 4 side faces and a top face with 4 triangles */
+    const size_t max_verts = num_tiles * (VERTS_PER_TILE - VERTS_PER_FACE);
+    assert(max_verts <= USHRT_MAX + 1);
+
+    struct vertex *tile_vbuff = malloc(num_tiles * VERTS_PER_TILE * sizeof(struct vertex));
+    if(!tile_vbuff)
+        goto fail_alloc_tile_vbuff;
+
+    struct vertex *verts = malloc(max_verts * sizeof(struct vertex));
+    if(!verts)
+        goto fail_alloc_verts;
+
+    GLushort *indices = malloc(max_verts * sizeof(GLushort));
+    if(!indices)
+        goto fail_alloc_indices;
+
+    int *keys = malloc(num_tiles * sizeof(int));
+    if(!keys)
+        goto fail_alloc_keys;
+
+    bool *merged = calloc(num_tiles, sizeof(bool));
+    if(!merged)
+        goto fail_alloc_merged;
+
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) {
+            R_GL_TileGetVertices(&tiles[r * width + c], tile_vbuff + (r * width + c) * VERTS_PER_TILE, r, c);
+        }
+    }
+
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) {
+            R_GL_TilePatchVertsBlend(tile_vbuff, tiles, width, height, r, c);
+        }
+    }
+
+    size_t num_verts = 0, num_indices = 0;
+
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) {
+
+            const struct vertex *tile_verts = tile_vbuff + (r * width + c) * VERTS_PER_TILE;
+            bool visible[] = {
+                M_Tile_FrontFaceVisible(tiles, r, c),
+                M_Tile_BackFaceVisible (tiles, r, c),
+                M_Tile_LeftFaceVisible (tiles, r, c),
+                M_Tile_RightFaceVisible(tiles, r, c),
+            };
+
+            /* Order of faces for each tile: bot, front, back, left, right, top. */
+            for(int f = 0; f < ARR_SIZE(visible); f++) {
+                if(!visible[f])
+                    continue;
+                r_gl_tile_append_face(tile_verts + VERTS_PER_FACE * (f + 1), VERTS_PER_FACE, 
+                    verts, &num_verts, indices, &num_indices);
+            }
+        }
+    }
+
+    for(int i = 0; i < num_tiles; i++) {
+
+        int mat_idx;
+        bool mergeable = (tiles[i].type == TILETYPE_FLAT)
+                      && r_gl_tile_top_uniform(tile_vbuff + i * VERTS_PER_TILE, &mat_idx);
+        keys[i] = mergeable ? (tiles[i].base_height * MATERIALS_PER_CHUNK + mat_idx) : -1;
+    }
+
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) {
+
+            const struct vertex *top = tile_vbuff + (r * width + c) * VERTS_PER_TILE + (5 * VERTS_PER_FACE);
+            if(merged[r * width + c])
+                continue;
+
+            int w = 1, h = 1;
+            if(keys[r * width + c] >= 0)
+                r_gl_tile_grow_rect(keys, merged, width, height, r, c, &w, &h);
+
+            /* A single tile is cheaper to draw as-is */
+            if(w * h < 2) {
+                r_gl_tile_append_face(top, 4 * 3, verts, &num_verts, indices, &num_indices);
+                continue;
+            }
+
+            /* The per-tile UV coordinates go from (0, 1) at the NW corner to (1, 0) at the 
+             * SE corner. Offsetting them by whole tiles gives the same texture lookups 
+             * with GL_REPEAT wrapping. */
+            r_gl_tile_append_flat_rect(top, r, c, w, h, (vec2_t){-c, r + h}, (vec2_t){1.0f, -1.0f},
+                verts, &num_verts, indices, &num_indices);
+            for(int i = 0; i < h; i++)
+                for(int j = 0; j < w; j++)
+                    merged[(r + i) * width + (c + j)] = true;
+        }
+    }
+    assert(num_verts <= max_verts && num_indices <= max_verts);
+
+    free(merged);
+    free(keys);
+    free(tile_vbuff);
+
+    *out_verts = verts;
+    *out_num_verts = num_verts;
+    *out_indices = indices;
+    *out_num_indices = num_indices;
+    return true;
+
+fail_alloc_merged:
+    free(keys);
+fail_alloc_keys:
+    free(indices);
+fail_alloc_indices:
+    free(verts);
+fail_alloc_verts:
+    free(tile_vbuff);
+fail_alloc_tile_vbuff:
+    return false;
+}
+
+/* Renders a top-down orthographic view of the chunk into 'tex'. Only the texels 
+ * covering the tiles in rows [r_min, r_max] and columns [c_min, c_max] are written, 
+ * so that a region of an existing texture can be re-rendered in place. */
+static bool r_gl_tile_render_top_down(const void *chunk_rprivate_tiles, GLuint tex, 
+                                      vec3_t chunk_center, mat4x4_t *model,
+                                      int tiles_per_chunk_x, int tiles_per_chunk_z,
+                                      int r_min, int c_min, int r_max, int c_max)
+{
+    assert(r_min >= 0 && r_max < tiles_per_chunk_z && r_min <= r_max);
+    assert(c_min >= 0 && c_max < tiles_per_chunk_x && c_min <= c_max);
+
+    const struct render_private *priv = chunk_rprivate_tiles;
+    glUseProgram(priv->shader_prog);
+
+    /* Create a new camera, with orthographic projection, centered 
+     * over the chunk and facing straight down. */
+    DECL_CAMERA_STACK(chunk_cam);
+    memset(&chunk_cam, 0, g_sizeof_camera);
+
+    vec3_t offset = (vec3_t){0.0f, 200.0f, 0.0f};
+    PFM_Vec3_Add(&chunk_center, &offset, &chunk_center);
+
+    Camera_SetPos((struct camera*)chunk_cam, chunk_center);
+    Camera_SetPitchAndYaw((struct camera*)chunk_cam, -90.0f, 90.0f);
+
+    vec2_t bot_left  = (vec2_t){-(X_COORDS_PER_TILE * tiles_per_chunk_x/2),  (Z_COORDS_PER_TILE * tiles_per_chunk_z/2)};
+    vec2_t top_right = (vec2_t){ (X_COORDS_PER_TILE * tiles_per_chunk_x/2), -(Z_COORDS_PER_TILE * tiles_per_chunk_z/2)};
+    Camera_TickFinishOrthographic((struct camera*)chunk_cam, bot_left, top_right);
+
+    GLint old_viewport[4];
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+
+    GLuint fb;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex, 0);
+
+    GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
+    glDrawBuffers(1, draw_buffers);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        goto fail_fb;
+
+    glViewport(0,0, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_x, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_z);
+
+    /* Tile (r, c) is sampled from the texels [c, c+1) x [r, r+1), in units of 
+     * CONFIG_BAKED_TILE_TEX_RES (see 'r_gl_tile_baked_uv') */
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(c_min * CONFIG_BAKED_TILE_TEX_RES, r_min * CONFIG_BAKED_TILE_TEX_RES, 
+        (c_max - c_min + 1) * CONFIG_BAKED_TILE_TEX_RES, (r_max - r_min + 1) * CONFIG_BAKED_TILE_TEX_RES);
+
+    R_GL_Draw(chunk_rprivate_tiles, model);
+
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+
+    /* Re-bind the default framebuffer when we're done rendering */
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fb);
+    return true;
+
+fail_fb:
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fb);
+    return false;
+}
+
+/* Identifies everything other than the tiles that the baked texture of a 
+ * chunk depends on: the lighting and the textures of the chunk's materials. */
+static uint64_t r_gl_tile_bake_state(const struct render_private *priv)
+{
+    uint64_t ret = R_GL_LightingHash();
+    for(int i = 0; i < priv->num_materials; i++)
+        ret = R_Texture_SourceHash(priv->materials[i].texname, ret);
+    return ret;
+}
+
+/* The side materials of the baked chunk are copied from the original chunk, followed 
+ * by the material holding the baked top face texture. The materials must be set after
+ * the mesh is initialized, as they are packed into its' material array texture. */
+static bool r_gl_tile_baked_set_mats(struct render_private *baked, const struct render_private *og_priv,
+                                     const int *side_mats_set, int num_side_mats, GLuint top_tex)
+{
+    int top_mat_idx = num_side_mats;
+    assert(top_mat_idx >= 0 && top_mat_idx < MATERIALS_PER_CHUNK);
+
+    for(int i = 0; i < num_side_mats; i++) {
+        baked->materials[i] = og_priv->materials[side_mats_set[i]];
+        baked->materials[i].texture.tunit = GL_TEXTURE0 + i;
+    }
+
+    baked->materials[top_mat_idx].texture.id = top_tex;
+    baked->materials[top_mat_idx].texture.tunit = GL_TEXTURE0 + top_mat_idx;
+    baked->num_materials = num_side_mats + 1;
+    return R_GL_InitMaterialArr(baked, top_tex);
+}
+
+/* Writes the baked mesh (visible side faces and top faces) of the chunk to 'out', which 
+ * must have space for (4 * VERTS_PER_FACE + 6) vertices per tile. Returns the number of 
+ * vertices written. */
+static int r_gl_tile_baked_mesh(const struct tile *tiles, int tiles_per_chunk_x, int tiles_per_chunk_z,
+                                int *side_mats_set, int num_side_mats, struct vertex *out)
+{
+    int top_mat_idx = num_side_mats;
+    int num_verts = 0;
+
+    for(int r = 0; r < tiles_per_chunk_z; r++) {
+        for(int c = 0; c < tiles_per_chunk_x; c++) {
+            
+            const struct tile *curr_tile = &tiles[r * tiles_per_chunk_x + c];
+
+            struct vertex curr_tile_vbuff[VERTS_PER_TILE];
+            R_GL_TileGetVertices(curr_tile, curr_tile_vbuff, r, c);
+
+            int num_side_verts = r_gl_tile_baked_sides(tiles, r, c, curr_tile_vbuff, 
+                side_mats_set, num_side_mats, out);
+            num_verts += num_side_verts;
+            out += num_side_verts;
+
+            r_gl_tile_baked_top(curr_tile, r, c, curr_tile_vbuff, 
+                tiles_per_chunk_x, tiles_per_chunk_z, top_mat_idx, out);
+            num_verts += 6;
+            out += 6;
+        }
+    }
+    return num_verts;
+}
+
+/* Allocates and fills a buffer with the coarse mesh of the baked chunk. The caller is 
+ * responsible for freeing '*out_vbuff'. */
+static bool r_gl_tile_lod_mesh(const struct tile *tiles, int tiles_per_chunk_x, int tiles_per_chunk_z,
+                               struct vertex **out_vbuff, int *out_num_verts)
+{
+    /* In the worst case (no flat regions large enough to be merged), we have the 
+     * same mesh as the baked chunk. */
+    size_t max_verts = tiles_per_chunk_x * tiles_per_chunk_z * (4 * VERTS_PER_FACE + 6);
+    struct vertex *vbuff = malloc(max_verts * sizeof(struct vertex));
+    if(!vbuff)
+        goto fail_alloc_vbuff;
+    struct vertex *vbuff_curr = vbuff;
+
+    bool *merged = calloc(tiles_per_chunk_x * tiles_per_chunk_z, sizeof(bool));
+    if(!merged)
+        goto fail_alloc_merged;
+
+    /* Flat tiles of the same height can be merged */
+    int *keys = malloc(tiles_per_chunk_x * tiles_per_chunk_z * sizeof(int));
+    if(!keys)
+        goto fail_alloc_keys;
+
+    for(int i = 0; i < tiles_per_chunk_x * tiles_per_chunk_z; i++)
+        keys[i] = (tiles[i].type == TILETYPE_FLAT) ? tiles[i].base_height : -1;
+
+    int side_mats_set[MATERIALS_PER_CHUNK];
+    int num_side_mats = r_gl_tile_baked_side_mats(tiles, tiles_per_chunk_x, tiles_per_chunk_z, side_mats_set);
+    if(num_side_mats < 0)
+        goto fail_side_mats_count;
+    int top_mat_idx = num_side_mats;
+
+    int num_verts = 0;
+
+    /* The side faces are kept as-is, as they are usually only a small fraction of the 
+     * chunk's vertices and merging them would introduce T-junctions along the top edges. */
+    for(int r = 0; r < tiles_per_chunk_z; r++) {
+        for(int c = 0; c < tiles_per_chunk_x; c++) {
+
+            struct vertex curr_tile_vbuff[VERTS_PER_TILE];
+            R_GL_TileGetVertices(&tiles[r * tiles_per_chunk_x + c], curr_tile_vbuff, r, c);
+
+            int num_side_verts = r_gl_tile_baked_sides(tiles, r, c, curr_tile_vbuff, 
+                side_mats_set, num_side_mats, vbuff_curr);
+            num_verts += num_side_verts;
+            vbuff_curr += num_side_verts;
+        }
+    }
+
+    for(int r = 0; r < tiles_per_chunk_z; r++) {
+        for(int c = 0; c < tiles_per_chunk_x; c++) {
+
+            const struct tile *curr_tile = &tiles[r * tiles_per_chunk_x + c];
+            if(merged[r * tiles_per_chunk_x + c])
+                continue;
+
+            int w = 1, h = 1;
+            if(keys[r * tiles_per_chunk_x + c] >= 0)
+                r_gl_tile_grow_rect(keys, merged, tiles_per_chunk_x, tiles_per_chunk_z, r, c, &w, &h);
+
+            /* Only merge when the fan has fewer triangles than the individual tiles */
+            if(w + h < w * h) {
+
+                /* The baked mesh is not indexed, so the fan is expanded into triangles */
+                struct vertex proto = (struct vertex) {
+                    .pos    = (vec3_t) { 0.0f, M_Tile_NWHeight(curr_tile) * Y_COORDS_PER_TILE, 0.0f },
+                    .normal = (vec3_t) { 0.0f, 1.0f, 0.0f },
+                    .material_idx = top_mat_idx,
+                };
+                struct vertex fan_verts[2 * (w + h) + 1];
+                GLushort fan_indices[3 * 2 * (w + h)];
+                size_t num_fan_verts = 0, num_fan_indices = 0;
+
+                r_gl_tile_append_flat_rect(&proto, r, c, w, h, (vec2_t){0.0f, 0.0f}, 
+                    (vec2_t){1.0f / tiles_per_chunk_x, 1.0f / tiles_per_chunk_z},
+                    fan_verts, &num_fan_verts, fan_indices, &num_fan_indices);
+
+                for(int i = 0; i < num_fan_indices; i++)
+                    vbuff_curr[i] = fan_verts[fan_indices[i]];
+                num_verts += num_fan_indices;
+                vbuff_curr += num_fan_indices;
+
+                for(int i = 0; i < h; i++)
+                    for(int j = 0; j < w; j++)
+                        merged[(r + i) * tiles_per_chunk_x + (c + j)] = true;
+                continue;
+            }
+
+            struct vertex curr_tile_vbuff[VERTS_PER_TILE];
+            R_GL_TileGetVertices(curr_tile, curr_tile_vbuff, r, c);
+
+            r_gl_tile_baked_top(curr_tile, r, c, curr_tile_vbuff, 
+                tiles_per_chunk_x, tiles_per_chunk_z, top_mat_idx, vbuff_curr);
+            num_verts += 6;
+            vbuff_curr += 6;
+        }
+    }
+    assert(num_verts <= max_verts);
+
+    free(keys);
+    free(merged);
+
+    *out_vbuff = vbuff;
+    *out_num_verts = num_verts;
+    return true;
+
+fail_side_mats_count:
+    free(keys);
+fail_alloc_keys:
+    free(merged);
+fail_alloc_merged:
+    free(vbuff);
+fail_alloc_vbuff:
+    return false;
+}
+
+static void r_gl_tile_upload_verts(struct render_private *priv, const struct vertex *vbuff, int num_verts)
+{
+    priv->mesh.num_verts = num_verts;
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, num_verts * sizeof(struct vertex), vbuff, GL_STATIC_DRAW);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivate, mat4x4_t *model, 
+void R_GL_TileDrawSelected(const struct tile_desc *in, const struct tile *tiles, mat4x4_t *model, 
                            int tiles_per_chunk_x, int tiles_per_chunk_z)
 {
     struct vertex vbuff[VERTS_PER_TILE];
@@ -362,14 +1023,8 @@ void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivat
     GLint shader_prog;
     GLuint loc;
 
-    const struct render_private *priv = chunk_rprivate;
-    size_t offset = (in->tile_r * tiles_per_chunk_x + in->tile_c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-
-    const struct vertex *vert_base = glMapNamedBufferRange(priv->mesh.VBO, offset, length, GL_MAP_READ_BIT);
-    assert(vert_base);
-    memcpy(vbuff, vert_base, sizeof(vbuff));
-    glUnmapNamedBuffer(priv->mesh.VBO);
+    const struct tile *tile = &tiles[in->tile_r * tiles_per_chunk_x + in->tile_c];
+    R_GL_TileGetVertices(tile, vbuff, in->tile_r, in->tile_c);
 
     /* Additionally, scale the tile selection mesh slightly around its' center. This is so that 
      * it is slightly larger than the actual tile underneath and can be rendered on top of it. */
@@ -411,7 +1066,7 @@ void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivat
         (void*)offsetof(struct vertex, normal));
     glEnableVertexAttribArray(2);
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.tile-outline");
+    shader_prog = R_GL_Progs()->tile_outline;
     glUseProgram(shader_prog);
 
     /* Set uniforms */
@@ -432,9 +1087,8 @@ cleanup:
     glDeleteBuffers(1, &VBO);
 }
 
-void R_GL_TilePatchVertsBlend(GLuint VBO, const struct tile *tiles, int width, int height, int r, int c)
+void R_GL_TilePatchVertsBlend(struct vertex *vbuff, const struct tile *tiles, int width, int height, int r, int c)
 {
-    GL_ASSERT_OK();
     const struct tile *curr_tile  = &tiles[r * width + c];
     const struct tile *top_tile   = (r > 0)          ? &tiles[(r - 1) * width + c] : NULL;
     const struct tile *bot_tile   = (r < height - 1) ? &tiles[(r + 1) * width + c] : NULL;
@@ -528,11 +1182,7 @@ void R_GL_TilePatchVertsBlend(GLuint VBO, const struct tile *tiles, int width, i
      * The next element holds the materials at the midpoints of the edges of this tile and 
      * the last one holds the materials for the middle_mask of the tile.
      */
-    size_t offset = VERTS_PER_TILE * (r * width + c) * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-
-    struct vertex *tile_verts_base = glMapNamedBufferRange(VBO, offset, length, GL_MAP_WRITE_BIT);
-    assert(tile_verts_base);
+    struct vertex *tile_verts_base = vbuff + VERTS_PER_TILE * (r * width + c);
     struct vertex *south_provoking = tile_verts_base + (5 * VERTS_PER_FACE);
     struct vertex *north_provoking = tile_verts_base + (5 * VERTS_PER_FACE) + 2*3;
     struct vertex *west_provoking  = tile_verts_base + (5 * VERTS_PER_FACE) + (top_tri_left_aligned ?  3*3 : 3*1);
@@ -571,9 +1221,6 @@ void R_GL_TilePatchVertsBlend(GLuint VBO, const struct tile *tiles, int width, i
         provoking[i]->adjacent_mat_indices[2] = adj_center_mask;
         provoking[i]->adjacent_mat_indices[3] = curr.middle_mask;
     }
-
-    glUnmapNamedBuffer(VBO);
-    GL_ASSERT_OK();
 }
 
 void R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r, size_t c)
@@ -880,15 +1527,12 @@ void R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r,
 
 }
 
-int R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate, 
+int R_GL_TileGetTriMesh(const struct tile_desc *in, const struct tile *tiles, 
                         mat4x4_t *model, int tiles_per_chunk_x, vec3_t out[])
 {
-    const struct render_private *priv = chunk_rprivate;
-
-    size_t offset = (in->tile_r * tiles_per_chunk_x + in->tile_c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-    const struct vertex *vert_base = glMapNamedBufferRange(priv->mesh.VBO, offset, length, GL_MAP_READ_BIT);
-    assert(vert_base);
+    struct vertex vert_base[VERTS_PER_TILE];
+    const struct tile *tile = &tiles[in->tile_r * tiles_per_chunk_x + in->tile_c];
+    R_GL_TileGetVertices(tile, vert_base, in->tile_r, in->tile_c);
     int i = 0;
 
     for(; i < VERTS_PER_TILE; i++) {
@@ -904,43 +1548,65 @@ int R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate,
         };
     }
 
-    glUnmapNamedBuffer(priv->mesh.VBO);
     assert(i % 3 == 0);
     return i;
 }
 
+bool R_GL_TileMeshData(const struct tile *tiles, int width, int height,
+                       struct vertex **out_verts, size_t *out_num_verts,
+                       GLushort **out_indices, size_t *out_num_indices)
+{
+    return r_gl_tile_mesh_data(tiles, width, height, out_verts, out_num_verts, 
+                               out_indices, out_num_indices);
+}
+
+void R_GL_TileInitMesh(struct render_private *priv, const struct vertex *verts, size_t num_verts,
+                       const GLushort *indices, size_t num_indices)
+{
+    priv->mesh.layout = VERTEX_LAYOUT_FULL;
+    priv->mesh.num_verts = num_verts;
+    priv->mesh.num_indices = num_indices;
+    priv->mesh.index_type = GL_UNSIGNED_SHORT;
+    R_GL_InitIndexed(priv, "terrain", verts, indices);
+}
+
 void R_GL_TileUpdate(void *chunk_rprivate, int r, int c, int tiles_width, int tiles_height, 
                      const struct tile *tiles)
 {
     struct render_private *priv = chunk_rprivate;
-    const struct tile *tile = &tiles[r * tiles_width + c];
+    assert(r >= 0 && r < tiles_height);
+    assert(c >= 0 && c < tiles_width);
 
-    size_t offset = (r * tiles_width + c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-    struct vertex *vert_base = glMapNamedBufferRange(priv->mesh.VBO, offset, length, GL_MAP_WRITE_BIT);
-    assert(vert_base);
-    
-    R_GL_TileGetVertices(tile, vert_base, r, c);
+    /* Changing a tile can change which side faces of its' neighbours are visible, 
+     * their blending and the merged regions of the chunk. The whole chunk mesh is 
+     * rebuilt, which is cheap compared to the rest of the editing. */
+    struct vertex *verts;
+    GLushort *indices;
+    size_t num_verts, num_indices;
 
-    glUnmapNamedBuffer(priv->mesh.VBO);
+    if(!r_gl_tile_mesh_data(tiles, tiles_width, tiles_height, &verts, &num_verts, &indices, &num_indices))
+        return;
 
-    for(int r_curr = r - 1; r_curr < r + 2; r_curr++){
-        for(int c_curr = c - 1; c_curr < c + 2; c_curr++) {
-        
-            if(r_curr < 0 || r_curr >= tiles_height)
-                continue;
-            if(c_curr < 0 || c_curr >= tiles_width)
-                continue;
+    priv->mesh.num_verts = num_verts;
+    priv->mesh.num_indices = num_indices;
 
-            R_GL_TilePatchVertsBlend(priv->mesh.VBO, tiles, tiles_width, tiles_height, r_curr, c_curr);
-        }
-    }
+    /* The element array buffer binding is part of the VAO state */
+    glBindVertexArray(priv->mesh.VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, num_verts * sizeof(struct vertex), verts, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->mesh.IBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(GLushort), indices, GL_STATIC_DRAW);
+
+    free(verts);
+    free(indices);
     GL_ASSERT_OK();
 }
 
 void *R_GL_TileBakeChunk(const void *chunk_rprivate_tiles, vec3_t chunk_center, mat4x4_t *model,
                          int tiles_per_chunk_x, int tiles_per_chunk_z, const struct tile *tiles,
-                         int chunk_r, int chunk_c)
+                         int chunk_r, int chunk_c, const char *cache_path)
 {
     /* Note that we already include the phong lighting information in the pre-baked chunk. This
      * means that the pre-baked terrain cannot change lighting in real-time. It is possible 
@@ -950,55 +1616,36 @@ void *R_GL_TileBakeChunk(const void *chunk_rprivate_tiles, vec3_t chunk_center,
      * entire top surface.*/
 
     const struct render_private *og_priv = chunk_rprivate_tiles;
-    glUseProgram(og_priv->shader_prog);
-
-    /* Create a new camera, with orthographic projection, centered 
-     * over the chunk and facing straight down. */
-    DECL_CAMERA_STACK(chunk_cam);
-    memset(&chunk_cam, 0, g_sizeof_camera);
-
-    vec3_t offset = (vec3_t){0.0f, 200.0f, 0.0f};
-    PFM_Vec3_Add(&chunk_center, &offset, &chunk_center);
-
-    Camera_SetPos((struct camera*)chunk_cam, chunk_center);
-    Camera_SetPitchAndYaw((struct camera*)chunk_cam, -90.0f, 90.0f);
 
-    vec2_t bot_left  = (vec2_t){-(X_COORDS_PER_TILE * tiles_per_chunk_x/2),  (Z_COORDS_PER_TILE * tiles_per_chunk_z/2)};
-    vec2_t top_right = (vec2_t){ (X_COORDS_PER_TILE * tiles_per_chunk_x/2), -(Z_COORDS_PER_TILE * tiles_per_chunk_z/2)};
-    Camera_TickFinishOrthographic((struct camera*)chunk_cam, bot_left, top_right);
-
-    /* Next, create a new framebuffer and texture that we will render our chunk 
-     * top-down view to. */
-    GLuint fb;
-    glGenFramebuffers(1, &fb);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    /* First, create a new texture that we will render our chunk top-down view to. 
+     * Rendering it is by far the slowest part, so it is skipped when there is a 
+     * copy in the cache which was rendered with the same lighting and textures. */
+    int tex_width = CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_x;
+    int tex_height = CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_z;
+    uint64_t state = cache_path ? r_gl_tile_bake_state(og_priv) : 0;
 
     GLuint rendered_tex;
     glGenTextures(1, &rendered_tex);
 
-    glBindTexture(GL_TEXTURE_2D, rendered_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_x, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_z, 
-        0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    bool cached = cache_path 
+               && R_Texture_LoadRendered(rendered_tex, tex_width, tex_height, state, cache_path);
+    if(!cached) {
+        glBindTexture(GL_TEXTURE_2D, rendered_tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, rendered_tex, 0);
-
-    GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
-    glDrawBuffers(1, draw_buffers);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        goto fail_fb;
-
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
-    glViewport(0,0, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_x, CONFIG_BAKED_TILE_TEX_RES * tiles_per_chunk_x);
+    if(!cached) {
 
-    /* Render the chunk top-down view to the texture. */
-    R_GL_Draw(chunk_rprivate_tiles, model);
+        if(!r_gl_tile_render_top_down(chunk_rprivate_tiles, rendered_tex, chunk_center, model,
+            tiles_per_chunk_x, tiles_per_chunk_z, 0, 0, tiles_per_chunk_z - 1, tiles_per_chunk_x - 1))
+            goto fail_render;
 
-    /* Re-bind the default framebuffer when we're done rendering */
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &fb);
+        if(cache_path)
+            R_Texture_SaveRendered(rendered_tex, tex_width, tex_height, state, cache_path);
+    }
 
     /* Now construct our new 'fast' render context. We have some unused memory at the 
      * end of the buffer but this is not a concern. */
@@ -1018,181 +1665,172 @@ void *R_GL_TileBakeChunk(const void *chunk_rprivate_tiles, vec3_t chunk_center,
      *  +---------------------------------+
      */
 
-    struct vertex *vbuff = malloc(og_priv->mesh.num_verts * sizeof(struct vertex));
-    if(!vbuff)
-        goto fail_alloc_vbuff;
-    struct vertex *vbuff_curr = vbuff;
-
     /* First pass over the tiles - figure out which materials we need to keep */
     int side_mats_set[MATERIALS_PER_CHUNK];
-    int num_side_mats = 0;
+    int num_side_mats = r_gl_tile_baked_side_mats(tiles, tiles_per_chunk_x, tiles_per_chunk_z, side_mats_set);
+    if(num_side_mats < 0)
+        goto fail_side_mats_count;
 
-    for(int r = 0; r < tiles_per_chunk_z; r++) {
-        for(int c = 0; c < tiles_per_chunk_x; c++) {
+    /* At most 4 side faces and 2 top face triangles per tile */
+    size_t max_verts = tiles_per_chunk_x * tiles_per_chunk_z * (4 * VERTS_PER_FACE + 6);
+    struct vertex *vbuff = malloc(max_verts * sizeof(struct vertex));
+    if(!vbuff)
+        goto fail_alloc_vbuff;
 
-            const struct tile *curr_tile = &tiles[r * tiles_per_chunk_x + c];    
+    /* Second pass over the tiles - fill the vbuff and patch UV coordinates */
+    ret->mesh.num_verts = r_gl_tile_baked_mesh(tiles, tiles_per_chunk_x, tiles_per_chunk_z, 
+        side_mats_set, num_side_mats, vbuff);
+    ret->materials = (void*)(ret + 1);
 
-            if(!arr_contains(side_mats_set, num_side_mats, curr_tile->sides_mat_idx)) {
-                side_mats_set[num_side_mats++] = curr_tile->sides_mat_idx;
+#if CONFIG_SHADOWS
+    R_GL_Init(ret, "terrain-baked-shadowed", vbuff);
+#else
+    R_GL_Init(ret, "terrain-baked", vbuff);
+#endif
+    free(vbuff);
 
-                /* We need at least one free material slot for the baked top face texture. */
-                if(num_side_mats > (MATERIALS_PER_CHUNK-1))
-                    goto fail_side_mats_count;
-            }
-        }
-    }
+    if(!r_gl_tile_baked_set_mats(ret, og_priv, side_mats_set, num_side_mats, rendered_tex))
+        goto fail_set_mats;
 
-    int top_mat_idx = num_side_mats;
-    assert(top_mat_idx >= 0 && top_mat_idx < MATERIALS_PER_CHUNK);
+    char texname[32];
+    snprintf(texname, sizeof(texname), "__baked_chunk__.%d.%d", chunk_r, chunk_c);
+    texname[sizeof(texname)-1] = '\0';
+    R_Texture_AddExisting(texname, rendered_tex);
 
-    /* Second pass over the tiles - fill the vbuff_curr and patch UV coordinates */
-    int num_verts = 0;
+    GL_ASSERT_OK();
+    return ret;
 
-    for(int r = 0; r < tiles_per_chunk_z; r++) {
-        for(int c = 0; c < tiles_per_chunk_x; c++) {
-            
-            const struct tile *curr_tile = &tiles[r * tiles_per_chunk_x + c];
+fail_set_mats:
+    glDeleteVertexArrays(1, &ret->mesh.VAO);
+    glDeleteBuffers(1, &ret->mesh.VBO);
+fail_alloc_vbuff:
+fail_side_mats_count:
+    free(ret);
+fail_alloc_ret:
+fail_render:
+    glDeleteTextures(1, &rendered_tex); 
+    return NULL;
+}
 
-            struct vertex curr_tile_vbuff[VERTS_PER_TILE];
-            R_GL_TileGetVertices(curr_tile, curr_tile_vbuff, r, c);
+void *R_GL_TileBakeChunkLOD(const void *chunk_rprivate_baked, int tiles_per_chunk_x, 
+                            int tiles_per_chunk_z, const struct tile *tiles)
+{
+    const struct render_private *baked_priv = chunk_rprivate_baked;
+
+    /* The coarse mesh is drawn with exactly the same materials (including the baked top
+     * face texture) as the baked mesh, so it is safe to share the textures. Space is 
+     * reserved for the maximum number of materials, as the set can change on a re-bake. */
+    size_t buff_sz = sizeof(struct render_private)
+                   + MATERIALS_PER_CHUNK * sizeof(struct material);
+    struct render_private *ret = malloc(buff_sz);
+    if(!ret)
+        goto fail_alloc_ret;
 
-            /* Order of faces for each tile in the vbuff_curr: bot, front, back, left, right, top.
-             * Recall that the top face has double the number of triangles and vertices. */
-
-            if(M_Tile_FrontFaceVisible(tiles, r, c)) {
-                memcpy(vbuff_curr, curr_tile_vbuff + (VERTS_PER_FACE * 1), sizeof(struct vertex) * VERTS_PER_FACE); 
-                for(int i = 0; i < VERTS_PER_FACE; i++) {
-                    vbuff_curr[i].material_idx = arr_indexof(side_mats_set, num_side_mats, vbuff_curr[i].material_idx);
-                    assert(vbuff_curr[i].material_idx >= 0);
-                }
-                num_verts += VERTS_PER_FACE; 
-                vbuff_curr += VERTS_PER_FACE;
-            }
+    ret->materials = (void*)(ret + 1);
+    ret->num_materials = baked_priv->num_materials;
+    memcpy(ret->materials, baked_priv->materials, baked_priv->num_materials * sizeof(struct material));
 
-            if(M_Tile_BackFaceVisible(tiles, r, c)) {
-                memcpy(vbuff_curr, curr_tile_vbuff + (VERTS_PER_FACE * 2), sizeof(struct vertex) * VERTS_PER_FACE); 
-                for(int i = 0; i < VERTS_PER_FACE; i++) {
-                    vbuff_curr[i].material_idx = arr_indexof(side_mats_set, num_side_mats, vbuff_curr[i].material_idx);
-                    assert(vbuff_curr[i].material_idx >= 0);
-                }
-                num_verts += VERTS_PER_FACE; 
-                vbuff_curr += VERTS_PER_FACE;
-            }
+    struct vertex *vbuff;
+    int num_verts;
+    if(!r_gl_tile_lod_mesh(tiles, tiles_per_chunk_x, tiles_per_chunk_z, &vbuff, &num_verts))
+        goto fail_mesh;
 
-            if(M_Tile_LeftFaceVisible(tiles, r, c)) {
-                memcpy(vbuff_curr, curr_tile_vbuff + (VERTS_PER_FACE * 3), sizeof(struct vertex) * VERTS_PER_FACE); 
-                for(int i = 0; i < VERTS_PER_FACE; i++) {
-                    vbuff_curr[i].material_idx = arr_indexof(side_mats_set, num_side_mats, vbuff_curr[i].material_idx);
-                    assert(vbuff_curr[i].material_idx >= 0);
-                }
-                num_verts += VERTS_PER_FACE; 
-                vbuff_curr += VERTS_PER_FACE;
-            }
+    ret->mesh.num_verts = num_verts;
+#if CONFIG_SHADOWS
+    R_GL_Init(ret, "terrain-baked-shadowed", vbuff);
+#else
+    R_GL_Init(ret, "terrain-baked", vbuff);
+#endif
+    free(vbuff);
 
-            if(M_Tile_RightFaceVisible(tiles, r, c)) {
-                memcpy(vbuff_curr, curr_tile_vbuff + (VERTS_PER_FACE * 4), sizeof(struct vertex) * VERTS_PER_FACE); 
-                for(int i = 0; i < VERTS_PER_FACE; i++) {
-                    vbuff_curr[i].material_idx = arr_indexof(side_mats_set, num_side_mats, vbuff_curr[i].material_idx);
-                    assert(vbuff_curr[i].material_idx >= 0);
-                }
-                num_verts += VERTS_PER_FACE; 
-                vbuff_curr += VERTS_PER_FACE;
-            }
+    R_GL_ShareMaterialArr(ret, baked_priv);
 
-            struct vertex sw = curr_tile_vbuff[(VERTS_PER_FACE * 5) + 0];
-            struct vertex se = curr_tile_vbuff[(VERTS_PER_FACE * 5) + 1];
-            struct vertex nw = curr_tile_vbuff[(VERTS_PER_FACE * 5) + 6];
-            struct vertex ne = curr_tile_vbuff[(VERTS_PER_FACE * 5) + 7];
-
-            /* Patch the UV coordinates of the top face */
-            float u_frac = (1.0f / tiles_per_chunk_x);
-            float v_frac = (1.0f / tiles_per_chunk_z);
-
-            sw.material_idx = top_mat_idx;
-            se.material_idx = top_mat_idx;
-            nw.material_idx = top_mat_idx;
-            ne.material_idx = top_mat_idx;
-
-            sw.uv = (vec2_t){ c    * u_frac, (r+1) * v_frac};
-            se.uv = (vec2_t){(c+1) * u_frac, (r+1) * v_frac};
-            nw.uv = (vec2_t){ c    * u_frac, r     * v_frac};
-            ne.uv = (vec2_t){(c+1) * u_frac, r     * v_frac};
-
-            vec3_t top_tri_normals[2];
-            bool   top_tri_left_aligned;
-            r_gl_tile_top_normals(curr_tile, top_tri_normals, &top_tri_left_aligned);
-
-            /*
-             * CONFIG 1 (left-aligned)   CONFIG 2
-             * (nw)      (ne)            (nw)      (ne)
-             * +---------+               +---------+
-             * |       / |               | \       |
-             * |     /   |               |   \     |
-             * |   /     |               |     \   |
-             * | /       |               |       \ |
-             * +---------+               +---------+
-             * (sw)      (se)            (sw)      (se)
-             */
-
-            vbuff_curr[0] = sw;
-            vbuff_curr[1] = se;
-            vbuff_curr[3] = nw;
-            vbuff_curr[4] = ne;
-
-            if(top_tri_left_aligned) {
-                vbuff_curr[2] = ne;
-                vbuff_curr[5] = sw;
-            }else {
-                vbuff_curr[2] = nw; 
-                vbuff_curr[5] = se;
-            }
+    GL_ASSERT_OK();
+    return ret;
 
-            for(int i = 0; i < 3; i++)
-                vbuff_curr[i].normal = top_tri_normals[0];
+fail_mesh:
+    free(ret);
+fail_alloc_ret:
+    return NULL;
+}
 
-            for(int i = 3; i < 6; i++)
-                vbuff_curr[i].normal = top_tri_normals[1];
+void R_GL_TileFreeBaked(void *chunk_rprivate_baked, void *chunk_rprivate_lod, int chunk_r, int chunk_c)
+{
+    struct render_private *baked_priv = chunk_rprivate_baked;
+    struct render_private *lod_priv = chunk_rprivate_lod;
 
-            num_verts += 6;
-            vbuff_curr += 6;
-        }
+    if(lod_priv) {
+        R_GL_Free(lod_priv);
+        free(lod_priv);
     }
 
-    ret->mesh.num_verts = num_verts;
-    ret->materials = (void*)(ret + 1);
-    ret->num_materials = num_side_mats + 1;
+    if(baked_priv) {
+        R_GL_Free(baked_priv);
+        free(baked_priv);
 
-    for(int i = 0; i < num_side_mats; i++) {
-        ret->materials[i] = og_priv->materials[side_mats_set[i]];
-        ret->materials[i].texture.tunit = GL_TEXTURE0 + i;
+        char texname[32];
+        snprintf(texname, sizeof(texname), "__baked_chunk__.%d.%d", chunk_r, chunk_c);
+        texname[sizeof(texname)-1] = '\0';
+        R_Texture_Free(texname);
     }
+}
 
-    char texname[32];
-    snprintf(texname, sizeof(texname), "__baked_chunk__.%d.%d", chunk_r, chunk_c);
-    texname[sizeof(texname)-1] = '\0';
-    R_Texture_AddExisting(texname, rendered_tex);
+bool R_GL_TileRebakeRegion(void *chunk_rprivate_baked, void *chunk_rprivate_lod, 
+                           const void *chunk_rprivate_tiles, vec3_t chunk_center, mat4x4_t *model,
+                           int tiles_per_chunk_x, int tiles_per_chunk_z, const struct tile *tiles,
+                           int r_min, int c_min, int r_max, int c_max)
+{
+    struct render_private *baked_priv = chunk_rprivate_baked;
+    struct render_private *lod_priv = chunk_rprivate_lod;
+    const struct render_private *og_priv = chunk_rprivate_tiles;
 
-    ret->materials[top_mat_idx].texture.id = rendered_tex;
-    ret->materials[top_mat_idx].texture.tunit = GL_TEXTURE0 + top_mat_idx;
+    GLuint baked_tex = baked_priv->baked_tex;
+    assert(baked_tex);
 
-    glDeleteFramebuffers(1, &fb);
-#if CONFIG_SHADOWS
-    R_GL_Init(ret, "terrain-baked-shadowed", vbuff);
-#else
-    R_GL_Init(ret, "terrain-baked", vbuff);
-#endif
+    if(!r_gl_tile_render_top_down(chunk_rprivate_tiles, baked_tex, chunk_center, model,
+        tiles_per_chunk_x, tiles_per_chunk_z, r_min, c_min, r_max, c_max))
+        goto fail_render;
+
+    /* The geometry (heights, visible side faces) and the set of side materials may have 
+     * changed as well. Building the vertices is cheap compared to rendering the top 
+     * face texture, so the meshes are rebuilt in full. */
+    int side_mats_set[MATERIALS_PER_CHUNK];
+    int num_side_mats = r_gl_tile_baked_side_mats(tiles, tiles_per_chunk_x, tiles_per_chunk_z, side_mats_set);
+    if(num_side_mats < 0)
+        goto fail_side_mats_count;
+
+    size_t max_verts = tiles_per_chunk_x * tiles_per_chunk_z * (4 * VERTS_PER_FACE + 6);
+    struct vertex *vbuff = malloc(max_verts * sizeof(struct vertex));
+    if(!vbuff)
+        goto fail_alloc_vbuff;
+
+    int num_verts = r_gl_tile_baked_mesh(tiles, tiles_per_chunk_x, tiles_per_chunk_z, 
+        side_mats_set, num_side_mats, vbuff);
+    r_gl_tile_upload_verts(baked_priv, vbuff, num_verts);
     free(vbuff);
 
+    if(!r_gl_tile_baked_set_mats(baked_priv, og_priv, side_mats_set, num_side_mats, baked_tex))
+        goto fail_set_mats;
+
+    if(lod_priv) {
+
+        if(!r_gl_tile_lod_mesh(tiles, tiles_per_chunk_x, tiles_per_chunk_z, &vbuff, &num_verts))
+            goto fail_alloc_vbuff;
+
+        r_gl_tile_upload_verts(lod_priv, vbuff, num_verts);
+        lod_priv->num_materials = baked_priv->num_materials;
+        memcpy(lod_priv->materials, baked_priv->materials, baked_priv->num_materials * sizeof(struct material));
+        free(vbuff);
+
+        R_GL_ShareMaterialArr(lod_priv, baked_priv);
+    }
+
     GL_ASSERT_OK();
-    return ret;
+    return true;
 
-fail_side_mats_count:
-    free(vbuff);
+fail_set_mats:
 fail_alloc_vbuff:
-    free(ret);
-fail_alloc_ret:
-    glDeleteTextures(1, &rendered_tex); 
-fail_fb:
-    return NULL;
+fail_side_mats_count:
+fail_render:
+    return false;
 }
-
@@ -37,6 +37,7 @@
 #define RENDER_PRIVATE_H
 
 #include "mesh.h"
+#include "render_gl.h"
 
 struct render_private{
     struct mesh      mesh;
@@ -44,6 +45,24 @@ struct render_private{
     struct material *materials;
     GLuint           shader_prog;
     GLuint           shader_prog_dp; /* for the depth pass */
+    /* The textures of all the materials, packed into an array texture for 
+     * every distinct texture size, so that the whole mesh is drawn with one 
+     * set of bindings. Material i is layer (slot & 0xff) of array (slot >> 8),
+     * or has no texture when its' slot is negative. For pre-baked terrain 
+     * chunks, the top face texture is bound separately. */
+    GLuint           material_arrs[MAX_MATERIAL_ARRS];
+    size_t           num_material_arrs;
+    GLint            material_slots[MAX_MATERIALS];
+    GLuint           baked_tex;
+    /* The following are only set for animated models that have had their 
+     * skinning matrices baked into a texture via 'R_GL_AnimTexInit'. They
+     * are used for drawing many instances of the model in a single call. 
+     */
+    GLuint           anim_tex;
+    GLuint           inst_VAO;
+    GLuint           inst_VBO;
+    GLuint           shader_prog_inst;
+    GLuint           shader_prog_inst_dp;
 };
 
 #endif
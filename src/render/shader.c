@@ -34,17 +34,30 @@
  */
 
 #include "shader.h"
+#include "../config.h"
+#include "../lib/public/strintern.h"
 
 #include <SDL.h>
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#endif
 
 #define SHADER_PATH_LEN 128
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
 
+#define PFPROG_MAGIC    0x47504650 /* 'PFPG' */
+#define PFPROG_VERSION  1
+#define PFPROG_EXT      ".pfprog"
+
 #define MAKE_PATH(buff, base, file) \
     do{                             \
         strcpy(buff, base);         \
@@ -60,6 +73,23 @@ struct shader_resource{
     const char *frag_path;
 };
 
+struct shader_stage{
+    const char *path;
+    GLint       type;
+    const char *text;
+    GLuint      id;
+};
+
+/* The header of a cached program binary. 'key' is a hash of the driver 
+ * strings and of the sources of all the program's shaders. */
+struct pfprog_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    GLenum   format;
+    uint32_t length;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -170,9 +200,33 @@ static struct shader_resource s_shaders[] = {
         .vertex_path = "shaders/vertex_skinned-shadowed.glsl",
         .geo_path    = NULL,
         .frag_path   = "shaders/fragment_textured-phong-shadowed.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated-instanced.textured-phong",
+        .vertex_path = "shaders/vertex_skinned-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment_textured-phong.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated-instanced.textured-phong-shadowed",
+        .vertex_path = "shaders/vertex_skinned-shadowed-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment_textured-phong-shadowed.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated-instanced.depth",
+        .vertex_path = "shaders/vertex_skinned-depth-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment_passthrough.glsl"
     }
 };
 
+/* The handle of each shader's name is its' index in 's_shaders' */
+static strintern_t *s_shader_names;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -212,19 +266,32 @@ const char *shader_text_load(const char *path)
     return ret;
 }
 
-static bool shader_init(const char *text, GLuint *out, GLint type)
+static bool shader_check_compiled(GLuint shader, const char *path)
 {
     char info[512];
     GLint success;
 
-    *out = glCreateShader(type);
-    glShaderSource(*out, 1, &text, NULL);
-    glCompileShader(*out);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success) {
+
+        glGetShaderInfoLog(shader, sizeof(info), NULL, info);
+        fprintf(stderr, "%s\n", info);
+        fprintf(stderr, "Could not compile shader at: %s\n", path);
+        return false;
+    }
 
-    glGetShaderiv(*out, GL_COMPILE_STATUS, &success);
+    return true;
+}
+
+static bool shader_check_linked(GLuint prog)
+{
+    char info[512];
+    GLint success;
+
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
     if(!success) {
 
-        glGetShaderInfoLog(*out, sizeof(info), NULL, info);
+        glGetProgramInfoLog(prog, sizeof(info), NULL, info);
         fprintf(stderr, "%s\n", info);
         return false;
     }
@@ -232,51 +299,162 @@ static bool shader_init(const char *text, GLuint *out, GLint type)
     return true;
 }
 
-static bool shader_load_and_init(const char *path, GLint *out, GLint type)
+/* Shader files are shared between many programs, so every one of them is 
+ * only read once and compiled once. Returns the index of the stage. */
+static int shader_stage_for_path(struct shader_stage *stages, size_t *num_stages, 
+                                 const char *base_path, const char *path, GLint type)
 {
-    const char *text = shader_text_load(path);
-    if(!text) {
-        fprintf(stderr, "Could not load shader at: %s\n", path);
-        goto fail;
+    for(int i = 0; i < *num_stages; i++) {
+        if(!strcmp(stages[i].path, path))
+            return i;
     }
-    
-    if(!shader_init(text, out, type)){
-        fprintf(stderr, "Could not compile shader at: %s\n", path);
-        goto fail;
+
+    char full_path[512];
+    MAKE_PATH(full_path, base_path, path);
+
+    const char *text = shader_text_load(full_path);
+    if(!text) {
+        fprintf(stderr, "Could not load shader at: %s\n", full_path);
+        return -1;
     }
 
-    free((char*)text);
-    return true;
+    stages[*num_stages] = (struct shader_stage){
+        .path = path,
+        .type = type,
+        .text = text,
+        .id   = 0,
+    };
+    return (*num_stages)++;
+}
 
-fail:
-    free((char*)text);
-    return false;
+static uint64_t shader_hash(uint64_t hash, const char *str)
+{
+    for(const unsigned char *curr = (const unsigned char*)str; *curr; curr++) {
+        hash ^= *curr;
+        hash *= 1099511628211ull;
+    }
+    /* Separate the strings, so that moving text from the end of one to the 
+     * start of the next gives a different hash */
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+    return hash;
 }
 
-static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader, const GLuint frag_shader, GLint *out)
+/* The binaries are only valid for the exact same driver */
+static uint64_t shader_driver_hash(void)
 {
-    char info[512];
-    GLint success;
+    uint64_t ret = 14695981039346656037ull;
+    ret = shader_hash(ret, (const char*)glGetString(GL_VENDOR));
+    ret = shader_hash(ret, (const char*)glGetString(GL_RENDERER));
+    ret = shader_hash(ret, (const char*)glGetString(GL_VERSION));
+    return ret;
+}
 
-    *out = glCreateProgram();
-    glAttachShader(*out, vertex_shader);
+static bool shader_cache_supported(void)
+{
+    if(!CONFIG_SHADER_CACHE)
+        return false;
+    if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
 
-    if(geo_shader) {
-        glAttachShader(*out, geo_shader); 
-    }
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return (num_formats > 0);
+}
 
-    glAttachShader(*out, frag_shader);
-    glLinkProgram(*out);
+static bool shader_cache_path(const char *base_path, const char *name, char *out, size_t size)
+{
+    int len = snprintf(out, size, "%s/%s", base_path, CONFIG_SHADER_CACHE_DIR);
+    if(len < 0 || len >= size)
+        return false;
 
-    glGetProgramiv(*out, GL_LINK_STATUS, &success);
-    if(!success) {
+    /* Fails harmlessly when the directory exists already */
+#if defined(_WIN32)
+    _mkdir(out);
+#else
+    mkdir(out, 0755);
+#endif
 
-        glGetProgramInfoLog(*out, sizeof(info), NULL, info);
-        fprintf(stderr, "%s\n", info);
+    int name_len = snprintf(out + len, size - len, "/%s%s", name, PFPROG_EXT);
+    return (name_len >= 0 && name_len < size - len);
+}
+
+/* Creates the program from the cached binary. Fails if there is no binary 
+ * for the key or if the driver rejects it, in which case the program has to 
+ * be compiled from source. */
+static bool shader_cache_load(const char *path, uint64_t key, GLint *out)
+{
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
         return false;
+
+    struct pfprog_hdr hdr;
+    void *binary = NULL;
+
+    if(SDL_RWread(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail;
+    if(hdr.magic != PFPROG_MAGIC || hdr.version != PFPROG_VERSION || hdr.key != key)
+        goto fail;
+
+    binary = malloc(hdr.length);
+    if(!binary)
+        goto fail;
+    if(SDL_RWread(stream, binary, hdr.length, 1) != 1)
+        goto fail;
+
+    GLuint prog = glCreateProgram();
+    glProgramBinary(prog, hdr.format, binary, hdr.length);
+
+    GLint success;
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    if(!success) {
+        glDeleteProgram(prog);
+        goto fail;
     }
 
+    free(binary);
+    SDL_RWclose(stream);
+    *out = prog;
     return true;
+
+fail:
+    free(binary);
+    SDL_RWclose(stream);
+    return false;
+}
+
+static void shader_cache_save(const char *path, uint64_t key, GLuint prog)
+{
+    GLint length = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    void *binary = malloc(length);
+    if(!binary)
+        return;
+
+    struct pfprog_hdr hdr = {
+        .magic   = PFPROG_MAGIC,
+        .version = PFPROG_VERSION,
+        .key     = key,
+    };
+    glGetProgramBinary(prog, length, &length, &hdr.format, binary);
+    hdr.length = length;
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "wb");
+    if(!stream)
+        goto out;
+
+    bool ok = (SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) == 1)
+           && (SDL_RWwrite(stream, binary, length, 1) == 1);
+    SDL_RWclose(stream);
+
+    /* Don't leave behind a truncated file */
+    if(!ok)
+        remove(path);
+out:
+    free(binary);
 }
 
 /*****************************************************************************/
@@ -285,63 +463,120 @@ static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader
 
 bool R_Shader_InitAll(const char *base_path)
 {
-    for(int i = 0; i < ARR_SIZE(s_shaders); i++){
+    s_shader_names = strintern_init(ARR_SIZE(s_shaders));
+    if(!s_shader_names)
+        return false;
 
-        struct shader_resource *res = &s_shaders[i];
-        GLuint vertex, geometry = 0, fragment;
-        char path[512];
-    
-        MAKE_PATH(path, base_path, res->vertex_path);
-        if(!shader_load_and_init(path, &vertex, GL_VERTEX_SHADER)) {
-            fprintf(stderr, "Failed to load and init vertex shader.\n");
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+        if(strintern_put(s_shader_names, s_shaders[i].name) != i)
             return false;
-        }
+    }
 
-        if(res->geo_path)
-            MAKE_PATH(path, base_path, res->geo_path);
-        if(res->geo_path && !shader_load_and_init(path, &geometry, GL_GEOMETRY_SHADER)) {
-            fprintf(stderr, "Failed to load and init geometry shader.\n");
-            return false;
+    bool ret = false;
+    bool use_cache = shader_cache_supported();
+    uint64_t driver_hash = shader_driver_hash();
+
+    struct shader_stage stages[ARR_SIZE(s_shaders) * 3];
+    size_t num_stages = 0;
+    int prog_stages[ARR_SIZE(s_shaders)][3];
+    uint64_t keys[ARR_SIZE(s_shaders)];
+    bool compiled[ARR_SIZE(s_shaders)] = {0};
+
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+
+        struct shader_resource *res = &s_shaders[i];
+        res->prog_id = 0;
+
+        prog_stages[i][0] = shader_stage_for_path(stages, &num_stages, base_path, 
+            res->vertex_path, GL_VERTEX_SHADER);
+        prog_stages[i][1] = !res->geo_path ? -1 : shader_stage_for_path(stages, &num_stages, 
+            base_path, res->geo_path, GL_GEOMETRY_SHADER);
+        prog_stages[i][2] = shader_stage_for_path(stages, &num_stages, base_path, 
+            res->frag_path, GL_FRAGMENT_SHADER);
+
+        if(prog_stages[i][0] < 0 || prog_stages[i][2] < 0 || (res->geo_path && prog_stages[i][1] < 0))
+            goto out;
+
+        keys[i] = driver_hash;
+        for(int j = 0; j < 3; j++) {
+            if(prog_stages[i][j] >= 0)
+                keys[i] = shader_hash(keys[i], stages[prog_stages[i][j]].text);
         }
-        assert(!res->geo_path || geometry > 0);
 
-        MAKE_PATH(path, base_path, res->frag_path);
-        if(!shader_load_and_init(path, &fragment, GL_FRAGMENT_SHADER)) {
-            fprintf(stderr, "Failed to load and init fragment shader.\n");
-            return false;
+        char path[512];
+        if(use_cache && shader_cache_path(base_path, res->name, path, sizeof(path)))
+            shader_cache_load(path, keys[i], &res->prog_id);
+    }
+
+    /* Issue all the compiles and links before querying any of their results. 
+     * This allows the driver to compile the shaders in parallel. */
+    if(GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xffffffff);
+
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+
+        struct shader_resource *res = &s_shaders[i];
+        if(res->prog_id)
+            continue;
+
+        res->prog_id = glCreateProgram();
+        compiled[i] = true;
+        for(int j = 0; j < 3; j++) {
+
+            if(prog_stages[i][j] < 0)
+                continue;
+
+            struct shader_stage *stage = &stages[prog_stages[i][j]];
+            if(!stage->id) {
+                stage->id = glCreateShader(stage->type);
+                glShaderSource(stage->id, 1, &stage->text, NULL);
+                glCompileShader(stage->id);
+            }
+            glAttachShader(res->prog_id, stage->id);
         }
 
-        if(!shader_make_prog(vertex, geometry, fragment, &res->prog_id)) {
+        if(use_cache)
+            glProgramParameteri(res->prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(res->prog_id);
+    }
+
+    for(int i = 0; i < num_stages; i++) {
+        if(stages[i].id && !shader_check_compiled(stages[i].id, stages[i].path))
+            goto out;
+    }
 
-            glDeleteShader(vertex);
-            if(geometry)
-                glDeleteShader(geometry);
-            glDeleteShader(fragment);
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+
+        struct shader_resource *res = &s_shaders[i];
+        if(!compiled[i])
+            continue;
+
+        if(!shader_check_linked(res->prog_id)) {
             fprintf(stderr, "Failed to make shader program %d of %d.\n",
                 i + 1, (int)ARR_SIZE(s_shaders));
-            return false;
+            goto out;
         }
 
-        glDeleteShader(vertex);
-        if(geometry)
-            glDeleteShader(geometry);
-        glDeleteShader(fragment);
+        char path[512];
+        if(use_cache && shader_cache_path(base_path, res->name, path, sizeof(path)))
+            shader_cache_save(path, keys[i], res->prog_id);
     }
+    ret = true;
 
-    return true;
+out:
+    for(int i = 0; i < num_stages; i++) {
+        if(stages[i].id)
+            glDeleteShader(stages[i].id);
+        free((char*)stages[i].text);
+    }
+    return ret;
 }
 
-
 GLint R_Shader_GetProgForName(const char *name)
 {
-    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
-
-        const struct shader_resource *curr = &s_shaders[i];
-
-        if(!strcmp(curr->name, name))
-            return curr->prog_id;
-    }
-    
-    return -1;
+    int handle = strintern_get(s_shader_names, name);
+    if(handle < 0)
+        return -1;
+    return s_shaders[handle].prog_id;
 }
     
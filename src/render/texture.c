@@ -34,25 +34,134 @@
  */
 
 #include "texture.h"
+#include "texture_dxt.h"
 #include "gl_uniforms.h"
 #include "gl_assert.h"
+#include "../config.h"
 #include "../lib/public/stb_image.h"
+#include "../lib/public/strintern.h"
+
+#include <SDL.h>
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define MAX_NUM_TEXTURE  2048
 #define MAX_TEX_NAME_LEN 64
+#define MAX_ARRAY_LAYERS 16
+#define MAX_MIP_LEVELS   16
+#define MAX_LOAD_THREADS 16
+
+#define PFTEX_MAGIC      0x58544650 /* 'PFTX' */
+#define PFTEX_VERSION    1
+#define PFTEX_EXT        ".pftex"
+#define PFTEX_RAW_EXT    ".raw"
+#define PFTEX_FLIP_EXT   ".flip"
+
+#define PFBAKE_MAGIC     0x4b424650 /* 'PFBK' */
+#define PFBAKE_VERSION   3
+
+#define MIN(a, b)        ((a) < (b) ? (a) : (b))
+#define MAX(a, b)        ((a) > (b) ? (a) : (b))
 
 
 struct texture_resource{
     char                     name[MAX_TEX_NAME_LEN];
     GLint                    texture_id;
+    /* The mapped image cache of textures loaded from files, from which array 
+     * textures are built without reading the texture back from GL. */
+    struct pftex_hdr        *cached;
+    size_t                   cached_size;
+    bool                     cached_mapped;
+    /* Set once the texture's memory has been reported by 'R_Texture_ChargeBytes' */
+    bool                     charged;
     struct texture_resource *next_free;
     struct texture_resource *prev_free;
     bool                     free;
 };
 
+/* Array textures are shared between all meshes using the same textures in 
+ * the same order, as is the case for most map chunks and model instances. 
+ * They are deleted once the last mesh using them releases them. */
+struct texture_array_resource{
+    GLuint                   layer_ids[MAX_ARRAY_LAYERS];
+    size_t                   num_layers;
+    GLuint                   array_id;
+    unsigned                 refcount;
+    bool                     charged;
+};
+
+enum pftex_format{
+    PFTEX_RGBA8 = 0,
+    PFTEX_DXT1  = 1,
+    PFTEX_DXT5  = 2,
+};
+
+/* Header of the cached copy of an image, written next to the source image the 
+ * first time it is loaded. It is followed by the full mip chain, largest level 
+ * first, so loading a cached texture is just a matter of mapping the file and 
+ * handing the levels to GL. The cache is rebuilt when the source image changes.
+ */
+struct pftex_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t flipped;
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_levels;
+    uint32_t reserved;
+    int64_t  src_mtime;
+    int64_t  src_size;
+    uint64_t level_offsets[MAX_MIP_LEVELS];
+    uint64_t level_sizes[MAX_MIP_LEVELS];
+};
+
+/* Header of a texture rendered by the engine (a baked chunk or the minimap), 
+ * saved so that it does not have to be rendered again. It is followed by the 
+ * single level as RGB texels. These are not compressed, so that a texture read
+ * back from the cache is identical to a freshly rendered one. 'compressed' is 
+ * always 0. 'state' identifies the inputs other than the geometry that the 
+ * texture was rendered with. */
+struct pfbake_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t compressed;
+    uint32_t reserved;
+    uint64_t state;
+};
+
+/* An image that is decoded on a worker thread and then uploaded by the main thread */
+struct texture_load_job{
+    const char *name;
+    char        paths[2][512];
+    void       *buff;      /* pftex_hdr, followed by the mip levels */
+    size_t      buff_size;
+    bool        mapped;
+    bool        compress;
+    bool        flip;
+    bool        ok;
+};
+
+struct texture_load_ctx{
+    struct texture_load_job *jobs;
+    size_t                   num_jobs;
+    SDL_atomic_t             next_job;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -60,21 +169,377 @@ struct texture_resource{
 static struct texture_resource  s_tex_resources[MAX_NUM_TEXTURE];
 static struct texture_resource *s_free_head = &s_tex_resources[0];
 
+/* The resident texture for every name that has been loaded, indexed by the 
+ * handle of the name. Freed textures leave a NULL entry behind. */
+static strintern_t              *s_tex_names;
+static struct texture_resource **s_tex_for_handle;
+static size_t                    s_tex_for_handle_cap;
+
+static struct texture_array_resource *s_arr_resources = NULL;
+static size_t                         s_num_arrs = 0;
+static size_t                         s_arrs_cap = 0;
+
+static bool                          s_flip_on_load = false;
+
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool r_texture_gl_init(const char *path, GLuint *out)
+static bool r_texture_use_s3tc(void)
+{
+    return CONFIG_TEXTURE_COMPRESS && GLEW_EXT_texture_compression_s3tc;
+}
+
+static int r_texture_num_levels(int width, int height)
+{
+    int ret = 1;
+    while((width > 1 || height > 1) && ret < MAX_MIP_LEVELS) {
+        width = MAX(1, width / 2);
+        height = MAX(1, height / 2);
+        ret++;
+    }
+    return ret;
+}
+
+/* Writes the next (half-sized) mip level of an RGBA image with a box filter */
+static void r_texture_downsample(const unsigned char *src, int width, int height, unsigned char *out)
+{
+    int out_width = MAX(1, width / 2);
+    int out_height = MAX(1, height / 2);
+
+    for(int r = 0; r < out_height; r++) {
+        for(int c = 0; c < out_width; c++) {
+
+            int r0 = r * 2, r1 = MIN(r * 2 + 1, height - 1);
+            int c0 = c * 2, c1 = MIN(c * 2 + 1, width - 1);
+
+            for(int i = 0; i < 4; i++) {
+                int sum = src[(r0 * width + c0) * 4 + i] + src[(r0 * width + c1) * 4 + i]
+                        + src[(r1 * width + c0) * 4 + i] + src[(r1 * width + c1) * 4 + i];
+                out[(r * out_width + c) * 4 + i] = (sum + 2) / 4;
+            }
+        }
+    }
+}
+
+static size_t r_texture_level_size(enum pftex_format format, int width, int height)
+{
+    switch(format) {
+    case PFTEX_RGBA8:   return (size_t)width * height * 4;
+    case PFTEX_DXT1:    return R_DXT_LevelSize(width, height, false);
+    case PFTEX_DXT5:    return R_DXT_LevelSize(width, height, true);
+    default: assert(0); return 0;
+    }
+}
+
+static void r_texture_encode_level(enum pftex_format format, const unsigned char *rgba, 
+                                   int width, int height, unsigned char *out)
+{
+    switch(format) {
+    case PFTEX_RGBA8:   memcpy(out, rgba, (size_t)width * height * 4); break;
+    case PFTEX_DXT1:    R_DXT_Compress(rgba, width, height, false, out); break;
+    case PFTEX_DXT5:    R_DXT_Compress(rgba, width, height, true, out); break;
+    default: assert(0);
+    }
+}
+
+static bool r_texture_map_file(const char *path, void **out, size_t *out_size)
+{
+#if defined(_WIN32)
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *ret = malloc(size);
+    if(!ret || size <= 0 || fread(ret, 1, size, file) != size) {
+        free(ret);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *ret = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(ret == MAP_FAILED)
+        return false;
+#endif
+    *out = ret;
+    *out_size = size;
+    return true;
+}
+
+static void r_texture_unmap_file(void *buff, size_t size)
+{
+#if defined(_WIN32)
+    free(buff);
+#else
+    munmap(buff, size);
+#endif
+}
+
+static void r_texture_release_image(void *buff, size_t size, bool mapped)
+{
+    if(mapped)
+        r_texture_unmap_file(buff, size);
+    else
+        free(buff);
+}
+
+static bool r_texture_cache_valid(const void *buff, size_t size, const struct stat *src_st, 
+                                  bool compress)
+{
+    const struct pftex_hdr *hdr = buff;
+
+    if(size < sizeof(struct pftex_hdr))
+        return false;
+    if(hdr->magic != PFTEX_MAGIC || hdr->version != PFTEX_VERSION)
+        return false;
+    if(hdr->src_mtime != (int64_t)src_st->st_mtime || hdr->src_size != (int64_t)src_st->st_size)
+        return false;
+    if(hdr->format != PFTEX_RGBA8 && hdr->format != PFTEX_DXT1 && hdr->format != PFTEX_DXT5)
+        return false;
+    if((hdr->format != PFTEX_RGBA8) != compress)
+        return false;
+    if(hdr->width == 0 || hdr->width > INT16_MAX || hdr->height == 0 || hdr->height > INT16_MAX)
+        return false;
+    if(hdr->num_levels == 0 || hdr->num_levels > MAX_MIP_LEVELS)
+        return false;
+
+    for(int i = 0; i < hdr->num_levels; i++) {
+
+        int width = MAX(1, hdr->width >> i);
+        int height = MAX(1, hdr->height >> i);
+
+        if(hdr->level_sizes[i] != r_texture_level_size(hdr->format, width, height))
+            return false;
+        /* Written so that a corrupt offset cannot wrap around */
+        if(hdr->level_offsets[i] < sizeof(struct pftex_hdr) || hdr->level_offsets[i] > size)
+            return false;
+        if(hdr->level_sizes[i] > size - hdr->level_offsets[i])
+            return false;
+    }
+    return true;
+}
+
+/* Decodes the source image, builds its' mip chain and writes it out to the cache */
+static bool r_texture_convert(const char *src_path, const struct stat *src_st, 
+                              const char *cache_path, struct texture_load_job *job)
 {
-    GLuint ret;
     int width, height, nr_channels;
-    unsigned char *data;
-    
-    data = stbi_load(path, &width, &height, &nr_channels, 0);
+    unsigned char *data = stbi_load(src_path, &width, &height, &nr_channels, 4);
     if(!data)
         goto fail_load;
 
+    if(nr_channels != 3 && nr_channels != 4)
+        goto fail_format;
+
+    bool alpha = false;
+    for(int i = 0; i < width * height && nr_channels == 4; i++) {
+        if(data[i * 4 + 3] != 255) {
+            alpha = true;
+            break;
+        }
+    }
+
+    enum pftex_format format = !job->compress ? PFTEX_RGBA8 
+                             : alpha          ? PFTEX_DXT5 
+                                              : PFTEX_DXT1;
+    int num_levels = r_texture_num_levels(width, height);
+
+    struct pftex_hdr hdr = {
+        .magic = PFTEX_MAGIC,
+        .version = PFTEX_VERSION,
+        .format = format,
+        .flipped = job->flip,
+        .width = width,
+        .height = height,
+        .num_levels = num_levels,
+        .src_mtime = src_st->st_mtime,
+        .src_size = src_st->st_size,
+    };
+
+    size_t size = sizeof(struct pftex_hdr);
+    for(int i = 0; i < num_levels; i++) {
+
+        hdr.level_offsets[i] = size;
+        hdr.level_sizes[i] = r_texture_level_size(format, MAX(1, width >> i), MAX(1, height >> i));
+        size += hdr.level_sizes[i];
+    }
+
+    unsigned char *buff = malloc(size);
+    if(!buff)
+        goto fail_format;
+    unsigned char *mip = malloc((size_t)MAX(1, width / 2) * MAX(1, height / 2) * 4);
+    if(!mip)
+        goto fail_mip;
+
+    memcpy(buff, &hdr, sizeof(hdr));
+    unsigned char *level = data, *next = mip;
+
+    for(int i = 0; i < num_levels; i++) {
+
+        int level_width = MAX(1, width >> i);
+        int level_height = MAX(1, height >> i);
+        r_texture_encode_level(format, level, level_width, level_height, buff + hdr.level_offsets[i]);
+
+        if(i + 1 < num_levels) {
+            r_texture_downsample(level, level_width, level_height, next);
+            unsigned char *tmp = level;
+            level = next;
+            next = tmp;
+        }
+    }
+
+    free(mip);
+    stbi_image_free(data);
+
+    job->buff = buff;
+    job->buff_size = size;
+    job->mapped = false;
+
+    /* The cache is best-effort. The asset directory may well be read-only. When 
+     * it is written, the image is kept mapped from the file instead of the heap. 
+     * A stale cache file may still be mapped by another texture, so the new one 
+     * is written to the side and renamed over it rather than truncated. */
+    char tmp_path[sizeof(job->paths[0]) + sizeof(PFTEX_FLIP_EXT PFTEX_RAW_EXT PFTEX_EXT) + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%lu.tmp", cache_path, (unsigned long)SDL_ThreadID());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if(!file)
+        return true;
+
+    bool written = (fwrite(buff, 1, size, file) == size);
+    written = (fclose(file) == 0) && written;
+#if defined(_WIN32)
+    /* rename does not replace an existing file on Windows. Cached images are 
+     * read into memory there, so the old file is not in use. */
+    remove(cache_path);
+#endif
+    if(!written || rename(tmp_path, cache_path) != 0) {
+        remove(tmp_path);
+        return true;
+    }
+
+    void *mapped;
+    size_t mapped_size;
+    if(r_texture_map_file(cache_path, &mapped, &mapped_size)) {
+
+        free(buff);
+        job->buff = mapped;
+        job->buff_size = mapped_size;
+        job->mapped = true;
+    }
+    return true;
+
+fail_mip:
+    free(buff);
+fail_format:
+    stbi_image_free(data);
+fail_load:
+    return false;
+}
+
+static bool r_texture_decode(struct texture_load_job *job)
+{
+    const char *src_path = NULL;
+    struct stat src_st;
+
+    for(int i = 0; i < 2; i++) {
+        if(job->paths[i][0] && stat(job->paths[i], &src_st) == 0) {
+            src_path = job->paths[i];
+            break;
+        }
+    }
+    if(!src_path)
+        return false;
+
+    /* Every variant of the same image (compressed or not, flipped or not) is 
+     * cached in its' own file */
+    char cache_path[sizeof(job->paths[0]) + sizeof(PFTEX_FLIP_EXT PFTEX_RAW_EXT PFTEX_EXT)];
+    strcpy(cache_path, src_path);
+    if(job->flip)
+        strcat(cache_path, PFTEX_FLIP_EXT);
+    if(!job->compress)
+        strcat(cache_path, PFTEX_RAW_EXT);
+    strcat(cache_path, PFTEX_EXT);
+
+    void *cached;
+    size_t cached_size;
+    if(r_texture_map_file(cache_path, &cached, &cached_size)) {
+
+        if(r_texture_cache_valid(cached, cached_size, &src_st, job->compress)) {
+            job->buff = cached;
+            job->buff_size = cached_size;
+            job->mapped = true;
+            return true;
+        }
+        r_texture_unmap_file(cached, cached_size);
+    }
+
+    return r_texture_convert(src_path, &src_st, cache_path, job);
+}
+
+static int r_texture_worker(void *arg)
+{
+    struct texture_load_ctx *ctx = arg;
+    int idx;
+
+    while((idx = SDL_AtomicAdd(&ctx->next_job, 1)) < ctx->num_jobs) {
+        struct texture_load_job *job = &ctx->jobs[idx];
+        job->ok = r_texture_decode(job);
+    }
+    return 0;
+}
+
+/* Decodes all the jobs, using as many threads as there are cores. The calling 
+ * thread takes part in the decoding as well. */
+static void r_texture_decode_all(struct texture_load_job *jobs, size_t num_jobs)
+{
+    struct texture_load_ctx ctx = {
+        .jobs = jobs,
+        .num_jobs = num_jobs,
+    };
+    SDL_AtomicSet(&ctx.next_job, 0);
+
+    int num_threads = MIN(SDL_GetCPUCount() - 1, (int)num_jobs - 1);
+    num_threads = MAX(0, MIN(num_threads, MAX_LOAD_THREADS));
+
+    SDL_Thread *threads[MAX_LOAD_THREADS];
+    int num_spawned = 0;
+
+    for(int i = 0; i < num_threads; i++) {
+        threads[num_spawned] = SDL_CreateThread(r_texture_worker, "texture_load", &ctx);
+        if(threads[num_spawned])
+            num_spawned++;
+    }
+
+    r_texture_worker(&ctx);
+
+    for(int i = 0; i < num_spawned; i++)
+        SDL_WaitThread(threads[i], NULL);
+}
+
+static bool r_texture_gl_init(const struct pftex_hdr *hdr, GLuint *out)
+{
+    GLuint ret;
+    unsigned char *scratch = NULL;
+
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &ret);
     glBindTexture(GL_TEXTURE_2D, ret);
@@ -83,22 +548,417 @@ static bool r_texture_gl_init(const char *path, GLuint *out)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hdr->num_levels - 1);
 
-    if(nr_channels != 3 && nr_channels != 4)
-        goto fail_format;
+    for(int i = 0; i < hdr->num_levels; i++) {
 
-    GLint format = (nr_channels == 3) ? GL_RGB :
-                                        GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+        int width = MAX(1, hdr->width >> i);
+        int height = MAX(1, hdr->height >> i);
+        const unsigned char *data = (const unsigned char*)hdr + hdr->level_offsets[i];
 
-    stbi_image_free(data);
+        if(hdr->format == PFTEX_RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            continue;
+        }
+
+        bool alpha = (hdr->format == PFTEX_DXT5);
+        if(r_texture_use_s3tc()) {
+
+            GLenum format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, width, height, 0, hdr->level_sizes[i], data);
+            continue;
+        }
+
+        if(!scratch && !(scratch = malloc((size_t)hdr->width * hdr->height * 4)))
+            goto fail_scratch;
+
+        R_DXT_Decompress(data, width, height, alpha, scratch);
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scratch);
+    }
+
+    free(scratch);
     *out = ret;
     return true;
 
-fail_format:
-    stbi_image_free(data);
-fail_load:
+fail_scratch:
+    glDeleteTextures(1, &ret);
+    return false;
+}
+
+static int r_texture_handle_put(const char *name)
+{
+    size_t num_names = strintern_get_size(s_tex_names);
+    int handle = strintern_get(s_tex_names, name);
+    if(handle >= 0)
+        return handle;
+
+    if(num_names == s_tex_for_handle_cap) {
+
+        size_t new_cap = s_tex_for_handle_cap ? s_tex_for_handle_cap * 2 : 256;
+        struct texture_resource **arr = realloc(s_tex_for_handle, sizeof(*arr) * new_cap);
+        if(!arr)
+            return -1;
+        memset(arr + s_tex_for_handle_cap, 0, sizeof(*arr) * (new_cap - s_tex_for_handle_cap));
+        s_tex_for_handle = arr;
+        s_tex_for_handle_cap = new_cap;
+    }
+    return strintern_put(s_tex_names, name);
+}
+
+static struct texture_resource *r_texture_for_name(const char *name)
+{
+    int handle = strintern_get(s_tex_names, name);
+    if(handle < 0)
+        return NULL;
+    return s_tex_for_handle[handle];
+}
+
+static struct texture_resource *r_texture_alloc_resource(const char *name, GLuint id)
+{
+    if(!s_free_head)
+        return NULL;
+
+    int handle = r_texture_handle_put(name);
+    if(handle < 0)
+        return NULL;
+
+    struct texture_resource *alloc = s_free_head;
+    alloc->free = false;
+
+    s_free_head = alloc->next_free;
+    if(s_free_head)
+        s_free_head->prev_free = NULL;
+
+    assert( strlen(name) < MAX_TEX_NAME_LEN );
+    strcpy(alloc->name, name);
+
+    alloc->texture_id = id;
+    alloc->cached = NULL;
+    alloc->charged = false;
+
+    /* If the same name is loaded again, the first texture keeps being used */
+    if(!s_tex_for_handle[handle])
+        s_tex_for_handle[handle] = alloc;
+    return alloc;
+}
+
+static void r_texture_job_paths(const char *basedir, const char *name, struct texture_load_job *job)
+{
+    if(basedir) {
+    
+        assert( strlen(basedir) + strlen(name) + 1 < sizeof(job->paths[0]) );
+
+        strcpy(job->paths[0], basedir);
+        strcat(job->paths[0], "/");
+        strcat(job->paths[0], name);
+    }else{
+        job->paths[0][0] = '\0';
+    }
+
+    extern const char *g_basepath;
+    strcpy(job->paths[1], g_basepath);
+    strcat(job->paths[1], "assets/map_textures/");
+    strcat(job->paths[1], name);
+}
+
+/* Loads all of the textures, regardless of whether textures with the same names 
+ * have been loaded before. Textures appearing multiple times in 'names' are only 
+ * loaded once. Without 'gl_storage', the textures only get a name and their' 
+ * images stay in the CPU-side cache, from which they are packed into array 
+ * textures. With 'compress', the images are stored DXT compressed when 
+ * CONFIG_TEXTURE_COMPRESS is set. */
+static bool r_texture_load(const char *basedir, size_t count, const char *names[], GLuint out[],
+                           bool gl_storage, bool compress)
+{
+    struct texture_load_job *jobs = calloc(count, sizeof(struct texture_load_job));
+    int *job_idx = malloc(count * sizeof(int));
+    GLuint *ids = malloc(count * sizeof(GLuint));
+    if(!jobs || !job_idx || !ids)
+        goto fail_alloc;
+
+    size_t num_jobs = 0;
+    for(int i = 0; i < count; i++) {
+
+        job_idx[i] = -1;
+        for(int j = 0; j < num_jobs; j++) {
+            if(!strcmp(jobs[j].name, names[i])) {
+                job_idx[i] = j;
+                break;
+            }
+        }
+        if(job_idx[i] >= 0)
+            continue;
+
+        jobs[num_jobs].name = names[i];
+        jobs[num_jobs].compress = compress && CONFIG_TEXTURE_COMPRESS;
+        jobs[num_jobs].flip = s_flip_on_load;
+        r_texture_job_paths(basedir, names[i], &jobs[num_jobs]);
+        job_idx[i] = num_jobs++;
+    }
+
+    r_texture_decode_all(jobs, num_jobs);
+
+    /* GL calls can only be made from the main thread, so the uploads happen here */
+    bool ret = true;
+
+    for(int i = 0; i < num_jobs; i++) {
+
+        struct texture_load_job *job = &jobs[i];
+        ids[i] = 0;
+
+        if(!job->ok) {
+            ret = false;
+            continue;
+        }
+
+        if(!gl_storage) {
+            glGenTextures(1, &ids[i]);
+        }else if(!r_texture_gl_init(job->buff, &ids[i])) {
+            ret = false;
+            continue;
+        }
+
+        struct texture_resource *res = r_texture_alloc_resource(job->name, ids[i]);
+        if(!res) {
+            glDeleteTextures(1, &ids[i]);
+            ids[i] = 0;
+            ret = false;
+            continue;
+        }
+
+        res->cached = job->buff;
+        res->cached_size = job->buff_size;
+        res->cached_mapped = job->mapped;
+        job->buff = NULL;
+    }
+
+    for(int i = 0; i < num_jobs; i++) {
+        if(jobs[i].buff)
+            r_texture_release_image(jobs[i].buff, jobs[i].buff_size, jobs[i].mapped);
+    }
+    for(int i = 0; i < count; i++)
+        out[i] = ids[job_idx[i]];
+
+    free(ids);
+    free(job_idx);
+    free(jobs);
+    GL_ASSERT_OK();
+    return ret;
+
+fail_alloc:
+    free(ids);
+    free(job_idx);
+    free(jobs);
+    return false;
+}
+
+static const struct pftex_hdr *r_texture_cached_for_id(GLuint id)
+{
+    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+
+        const struct texture_resource *curr = &s_tex_resources[i];
+        if(!curr->free && curr->texture_id == id)
+            return curr->cached;
+    }
+    return NULL;
+}
+
+/* Writes level 0 of a texture as RGBA. Textures that were not loaded from 
+ * images are read back from GL. */
+static void r_texture_read_layer(GLuint id, const struct pftex_hdr *hdr, unsigned char *out)
+{
+    if(hdr) {
+
+        const unsigned char *data = (const unsigned char*)hdr + hdr->level_offsets[0];
+
+        switch(hdr->format) {
+        case PFTEX_RGBA8:   memcpy(out, data, hdr->level_sizes[0]); break;
+        case PFTEX_DXT1:    R_DXT_Decompress(data, hdr->width, hdr->height, false, out); break;
+        case PFTEX_DXT5:    R_DXT_Decompress(data, hdr->width, hdr->height, true, out); break;
+        default: assert(0);
+        }
+    }else{
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, out);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+}
+
+static bool r_texture_size(GLuint id, const struct pftex_hdr *hdr, int *out_width, int *out_height)
+{
+    if(hdr) {
+        *out_width = hdr->width;
+        *out_height = hdr->height;
+        return true;
+    }
+
+    GLint width = 0, height = 0;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+    *out_width = width;
+    *out_height = height;
+    return (width > 0 && height > 0);
+}
+
+static void r_texture_array_upload_level(enum pftex_format format, int level, int layer, 
+                                         int width, int height, const void *data)
+{
+    switch(format) {
+    case PFTEX_RGBA8:
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, 
+            GL_RGBA, GL_UNSIGNED_BYTE, data);
+        break;
+    case PFTEX_DXT1:
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+            GL_COMPRESSED_RGB_S3TC_DXT1_EXT, R_DXT_LevelSize(width, height, false), data);
+        break;
+    case PFTEX_DXT5:
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+            GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, R_DXT_LevelSize(width, height, true), data);
+        break;
+    default: assert(0);
+    }
+}
+
+static bool r_texture_array_gl_init(const GLuint *ids, size_t num_ids, GLuint *out)
+{
+    const struct pftex_hdr *hdrs[num_ids];
+
+    /* All layers of an array texture have the same dimensions. Textures are 
+     * never rescaled to fit: sets of differently-sized textures are rejected 
+     * and must be split up by the caller. */
+    int width = 0, height = 0;
+    for(int i = 0; i < num_ids; i++) {
+
+        int tex_width, tex_height;
+        hdrs[i] = r_texture_cached_for_id(ids[i]);
+        if(!r_texture_size(ids[i], hdrs[i], &tex_width, &tex_height))
+            return false;
+
+        if(i == 0) {
+            width = tex_width;
+            height = tex_height;
+        }else if(tex_width != width || tex_height != height) {
+            return false;
+        }
+    }
+
+    enum pftex_format format = PFTEX_RGBA8;
+    if(r_texture_use_s3tc()) {
+
+        format = PFTEX_DXT1;
+        for(int i = 0; i < num_ids; i++) {
+            if(!hdrs[i] || hdrs[i]->format != PFTEX_DXT1)
+                format = PFTEX_DXT5;
+        }
+    }
+
+    /* Textures whose cached mip chain is not in the array's format are decoded
+     * into 'layer' and have their mip chain rebuilt, ping-ponging with 'mip'. */
+    size_t layer_size = (size_t)width * height * 4;
+    unsigned char *layer = malloc(layer_size);
+    unsigned char *mip = malloc(layer_size);
+    unsigned char *blocks = malloc(r_texture_level_size(format, width, height));
+    if(!layer || !mip || !blocks)
+        goto fail_alloc;
+
+    int num_levels = r_texture_num_levels(width, height);
+
+    GLuint ret;
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &ret);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ret);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+
+    for(int i = 0; i < num_levels; i++) {
+
+        int level_width = MAX(1, width >> i);
+        int level_height = MAX(1, height >> i);
+
+        switch(format) {
+        case PFTEX_RGBA8:
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, level_width, level_height, num_ids, 
+                0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            break;
+        case PFTEX_DXT1:
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 
+                level_width, level_height, num_ids, 0, 
+                R_DXT_LevelSize(level_width, level_height, false) * num_ids, NULL);
+            break;
+        case PFTEX_DXT5:
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 
+                level_width, level_height, num_ids, 0, 
+                R_DXT_LevelSize(level_width, level_height, true) * num_ids, NULL);
+            break;
+        default: assert(0);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(int i = 0; i < num_ids; i++) {
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ret);
+
+        /* The common case: the cached mip chain of the texture can be copied 
+         * into the layer as-is. */
+        const struct pftex_hdr *hdr = hdrs[i];
+        if(hdr && hdr->format == format && hdr->num_levels >= num_levels) {
+
+            for(int j = 0; j < num_levels; j++) {
+                r_texture_array_upload_level(format, j, i, MAX(1, width >> j), MAX(1, height >> j), 
+                    (const unsigned char*)hdr + hdr->level_offsets[j]);
+            }
+            continue;
+        }
+
+        r_texture_read_layer(ids[i], hdr, layer);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ret);
+        unsigned char *level = layer, *next = mip;
+
+        for(int j = 0; j < num_levels; j++) {
+
+            int level_width = MAX(1, width >> j);
+            int level_height = MAX(1, height >> j);
+
+            if(format == PFTEX_RGBA8) {
+                r_texture_array_upload_level(format, j, i, level_width, level_height, level);
+            }else{
+                r_texture_encode_level(format, level, level_width, level_height, blocks);
+                r_texture_array_upload_level(format, j, i, level_width, level_height, blocks);
+            }
+
+            if(j + 1 < num_levels) {
+                r_texture_downsample(level, level_width, level_height, next);
+                unsigned char *tmp = level;
+                level = next;
+                next = tmp;
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    free(blocks);
+    free(mip);
+    free(layer);
+    *out = ret;
+    return true;
+
+fail_alloc:
+    free(blocks);
+    free(mip);
+    free(layer);
     return false;
 }
 
@@ -106,8 +966,12 @@ fail_load:
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void R_Texture_Init(void)
+bool R_Texture_Init(void)
 {
+    s_tex_names = strintern_init(MAX_NUM_TEXTURE);
+    if(!s_tex_names)
+        return false;
+
     for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
 
         struct texture_resource *res = &s_tex_resources[i];
@@ -123,110 +987,361 @@ void R_Texture_Init(void)
             next->prev_free = res;
         }
     }
+    return true;
 }
 
 bool R_Texture_GetForName(const char *name, GLuint *out)
 {
-    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+    const struct texture_resource *res = r_texture_for_name(name);
+    if(!res)
+        return false;
 
-        struct texture_resource *curr = &s_tex_resources[i];
+    *out = res->texture_id;
+    return true;
+}
 
-        if(!strcmp(name, curr->name) && !curr->free) {
-            *out = curr->texture_id;
-            return true;
-        }
+uint64_t R_Texture_SourceHash(const char *name, uint64_t seed)
+{
+    const struct texture_resource *res = r_texture_for_name(name);
+    int64_t src[2] = {0, 0};
+    if(res && res->cached) {
+        src[0] = res->cached->src_mtime;
+        src[1] = res->cached->src_size;
     }
 
-    return false;
+    /* 64-bit FNV-1a, continued from 'seed' */
+    uint64_t ret = seed;
+    for(const char *c = name; *c; c++) {
+        ret ^= (unsigned char)*c;
+        ret *= 1099511628211ull;
+    }
+    const unsigned char *bytes = (const unsigned char*)src;
+    for(int i = 0; i < sizeof(src); i++) {
+        ret ^= bytes[i];
+        ret *= 1099511628211ull;
+    }
+    return ret;
 }
 
 bool R_Texture_Load(const char *basedir, const char *name, GLuint *out)
 {
-    if(!s_free_head)
+    return r_texture_load(basedir, 1, &name, out, true, false);
+}
+
+bool R_Texture_LoadAll(const char *basedir, size_t count, const char *names[], GLuint out[])
+{
+    if(count == 0)
+        return true;
+
+    const char *to_load[count];
+    GLuint loaded[count];
+    size_t num_to_load = 0;
+
+    for(int i = 0; i < count; i++) {
+        if(!R_Texture_GetForName(names[i], &out[i]))
+            to_load[num_to_load++] = names[i];
+    }
+
+    if(num_to_load == 0)
+        return true;
+    if(!r_texture_load(basedir, num_to_load, to_load, loaded, false, true))
         return false;
 
-    struct texture_resource *alloc = s_free_head;
-    alloc->free = false;
+    for(int i = 0, j = 0; i < count; i++) {
+        if(j < num_to_load && names[i] == to_load[j])
+            out[i] = loaded[j++];
+    }
+    return true;
+}
 
-    s_free_head = alloc->next_free;
-    if(s_free_head)
-        s_free_head->prev_free = NULL;
+bool R_Texture_AddExisting(const char *name, GLuint id)
+{
+    return (r_texture_alloc_resource(name, id) != NULL);
+}
 
-    assert( strlen(name) < MAX_TEX_NAME_LEN );
-    strcpy(alloc->name, name);
+static size_t r_texture_rendered_size(int width, int height)
+{
+    return (size_t)width * height * 3;
+}
 
-    char texture_path[512], texture_path_maps[512];
+bool R_Texture_SaveRendered(GLuint id, int width, int height, uint64_t state, const char *path)
+{
+    size_t size = sizeof(struct pfbake_hdr) + r_texture_rendered_size(width, height);
+    unsigned char *buff = malloc(size);
+    if(!buff)
+        return false;
 
-    if(basedir) {
-    
-        assert( strlen(basedir) + strlen(name) < sizeof(texture_path) );
+    struct pfbake_hdr hdr = {
+        .magic = PFBAKE_MAGIC,
+        .version = PFBAKE_VERSION,
+        .width = width,
+        .height = height,
+        .compressed = 0,
+        .state = state,
+    };
+    memcpy(buff, &hdr, sizeof(hdr));
 
-        strcpy(texture_path, basedir);
-        strcat(texture_path, "/");
-        strcat(texture_path, name);
-    }else{
-        texture_path[0] = '\0';
+    glBindTexture(GL_TEXTURE_2D, id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, buff + sizeof(hdr));
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    GL_ASSERT_OK();
+
+    /* Written to the side and renamed over the old file, so that a crash or a 
+     * full disk never leaves a truncated file at 'path' */
+    char tmp_path[strlen(path) + sizeof(".tmp")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if(!file) {
+        free(buff);
+        return false;
     }
 
-    extern const char *g_basepath;
-    strcpy(texture_path_maps, g_basepath);
-    strcat(texture_path_maps, "assets/map_textures/");
-    strcat(texture_path_maps, name);
+    bool ok = (fwrite(buff, 1, size, file) == size);
+    ok = (fclose(file) == 0) && ok;
+    free(buff);
 
-    GLuint ret;
-    if(!r_texture_gl_init(texture_path, &ret)
-    && !r_texture_gl_init(texture_path_maps, &ret))
-        goto fail;
+#if defined(_WIN32)
+    /* rename does not replace an existing file on Windows */
+    if(ok)
+        remove(path);
+#endif
+    if(!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
 
-    alloc->texture_id = ret;
-    *out = ret;
+bool R_Texture_LoadRendered(GLuint id, int width, int height, uint64_t state, const char *path)
+{
+    void *buff;
+    size_t size;
+    if(!r_texture_map_file(path, &buff, &size))
+        return false;
+
+    const struct pfbake_hdr *hdr = buff;
+    if(size != sizeof(struct pfbake_hdr) + r_texture_rendered_size(width, height)
+    || hdr->magic != PFBAKE_MAGIC || hdr->version != PFBAKE_VERSION || hdr->compressed
+    || hdr->width != width || hdr->height != height || hdr->state != state) {
 
+        r_texture_unmap_file(buff, size);
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, hdr + 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     GL_ASSERT_OK();
+
+    r_texture_unmap_file(buff, size);
     return true;
+}
 
-fail:
-    return false;
+void R_Texture_SetFlipOnLoad(bool flip)
+{
+    s_flip_on_load = flip;
+    stbi_set_flip_vertically_on_load(flip);
 }
 
-bool R_Texture_AddExisting(const char *name, GLuint id)
+bool R_Texture_Free(const char *name)
 {
-    if(!s_free_head)
-        return false;
+    struct texture_resource *curr = r_texture_for_name(name);
+    if(!curr)
+        return true;
 
-    struct texture_resource *alloc = s_free_head;
-    alloc->free = false;
+    /* Every array texture is still bound by some mesh. Deleting the texture 
+     * would leave that mesh with a stale copy, and the array could later be 
+     * handed out for a new texture which is given the same GL name. */
+    for(int j = 0; j < s_num_arrs; j++) {
 
-    s_free_head = alloc->next_free;
-    if(s_free_head)
-        s_free_head->prev_free = NULL;
+        const struct texture_array_resource *arr = &s_arr_resources[j];
+        for(int k = 0; k < arr->num_layers; k++) {
 
-    assert( strlen(name) < MAX_TEX_NAME_LEN );
-    strcpy(alloc->name, name);
+            if(arr->layer_ids[k] != curr->texture_id)
+                continue;
 
-    alloc->texture_id = id;
+            fprintf(stderr, "Not freeing texture '%s': it is in use by an array texture\n", name);
+            return false;
+        }
+    }
+
+    glDeleteTextures(1, &curr->texture_id);
+    if(curr->cached)
+        r_texture_release_image(curr->cached, curr->cached_size, curr->cached_mapped);
+    curr->cached = NULL;
+    curr->free = true;
+
+    struct texture_resource *tmp = s_free_head;
+    s_free_head = curr;
+    s_free_head->next_free = tmp;
+    if(tmp)
+        tmp->prev_free = s_free_head;
+
+    /* Another texture may have been loaded under the same name */
+    int handle = strintern_get(s_tex_names, name);
+    s_tex_for_handle[handle] = NULL;
+
+    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+
+        struct texture_resource *other = &s_tex_resources[i];
+        if(!other->free && !strcmp(name, other->name)) {
+            s_tex_for_handle[handle] = other;
+            break;
+        }
+    }
+    GL_ASSERT_OK();
     return true;
 }
 
-void R_Texture_Free(const char *name)
+bool R_Texture_Size(GLuint id, int *out_width, int *out_height)
 {
-    for(int i = 0; i < MAX_NUM_TEXTURE - 1; i++) {
+    return r_texture_size(id, r_texture_cached_for_id(id), out_width, out_height);
+}
 
-        struct texture_resource *curr = &s_tex_resources[i];
+bool R_Texture_ArrayForIDs(const GLuint *ids, size_t num_ids, GLuint *out)
+{
+    assert(num_ids > 0 && num_ids <= MAX_ARRAY_LAYERS);
+
+    for(int i = 0; i < s_num_arrs; i++) {
+
+        struct texture_array_resource *curr = &s_arr_resources[i];
+        if(curr->num_layers == num_ids && !memcmp(curr->layer_ids, ids, num_ids * sizeof(GLuint))) {
+            curr->refcount++;
+            *out = curr->array_id;
+            return true;
+        }
+    }
+
+    if(s_num_arrs == s_arrs_cap) {
+
+        size_t new_cap = s_arrs_cap ? s_arrs_cap * 2 : 64;
+        struct texture_array_resource *arrs = realloc(s_arr_resources, sizeof(*arrs) * new_cap);
+        if(!arrs)
+            return false;
+        s_arr_resources = arrs;
+        s_arrs_cap = new_cap;
+    }
 
-        if(!strcmp(name, curr->name) && !curr->free) {
+    GLuint ret;
+    if(!r_texture_array_gl_init(ids, num_ids, &ret))
+        return false;
+
+    struct texture_array_resource *alloc = &s_arr_resources[s_num_arrs++];
+    memcpy(alloc->layer_ids, ids, num_ids * sizeof(GLuint));
+    alloc->num_layers = num_ids;
+    alloc->array_id = ret;
+    alloc->refcount = 1;
+    alloc->charged = false;
+
+    *out = ret;
+    GL_ASSERT_OK();
+    return true;
+}
 
-            glDeleteTextures(1, &curr->texture_id);
-            curr->free = true;
+void R_Texture_ArrayRetain(GLuint array_id)
+{
+    for(int i = 0; i < s_num_arrs; i++) {
 
-            struct texture_resource *tmp = s_free_head;
-            s_free_head = curr;
-            s_free_head->next_free = tmp;
-            if(tmp)
-                tmp->prev_free = s_free_head;
+        struct texture_array_resource *curr = &s_arr_resources[i];
+        if(curr->array_id == array_id) {
+            curr->refcount++;
+            return;
+        }
+    }
+    assert(0);
+}
+
+void R_Texture_ArrayRelease(GLuint array_id)
+{
+    for(int i = 0; i < s_num_arrs; i++) {
+
+        struct texture_array_resource *curr = &s_arr_resources[i];
+        if(curr->array_id != array_id)
+            continue;
+
+        assert(curr->refcount > 0);
+        if(--curr->refcount > 0)
+            return;
+
+        glDeleteTextures(1, &curr->array_id);
+        s_arr_resources[i] = s_arr_resources[--s_num_arrs];
+        GL_ASSERT_OK();
+        return;
+    }
+    assert(0);
+}
+
+size_t R_Texture_GPUBytes(GLenum target, GLuint id)
+{
+    size_t ret = 0;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(target, id);
+
+    for(int i = 0; i < MAX_MIP_LEVELS; i++) {
+
+        GLint width, height, depth, compressed;
+        glGetTexLevelParameteriv(target, i, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, i, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(target, i, GL_TEXTURE_DEPTH, &depth);
+        glGetTexLevelParameteriv(target, i, GL_TEXTURE_COMPRESSED, &compressed);
+        if(width == 0)
             break;
+
+        if(compressed) {
+
+            GLint size;
+            glGetTexLevelParameteriv(target, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            ret += size;
+            continue;
+        }
+
+        GLint bits = 0, channel_bits;
+        const GLenum channels[] = {
+            GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, 
+            GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE
+        };
+        for(int j = 0; j < sizeof(channels)/sizeof(channels[0]); j++) {
+            glGetTexLevelParameteriv(target, i, channels[j], &channel_bits);
+            bits += channel_bits;
         }
+        ret += (size_t)width * height * depth * bits / 8;
     }
+
     GL_ASSERT_OK();
+    return ret;
+}
+
+size_t R_Texture_ChargeBytes(GLenum target, GLuint id)
+{
+    if(target == GL_TEXTURE_2D_ARRAY) {
+
+        for(int i = 0; i < s_num_arrs; i++) {
+
+            struct texture_array_resource *curr = &s_arr_resources[i];
+            if(curr->array_id != id)
+                continue;
+            if(curr->charged)
+                return 0;
+            curr->charged = true;
+            return R_Texture_GPUBytes(GL_TEXTURE_2D_ARRAY, id);
+        }
+        return 0;
+    }
+
+    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+
+        struct texture_resource *curr = &s_tex_resources[i];
+        if(curr->free || curr->texture_id != id)
+            continue;
+        if(curr->charged)
+            return 0;
+        curr->charged = true;
+        return R_Texture_GPUBytes(GL_TEXTURE_2D, id) + (curr->cached ? curr->cached_size : 0);
+    }
+    return 0;
 }
 
 void R_Texture_GL_Activate(const struct texture *text, GLuint shader_prog)
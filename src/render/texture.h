@@ -38,14 +38,52 @@
 
 #include <GL/glew.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct texture{
     GLuint id;
     GLuint tunit;
 };
 
-void R_Texture_Init(void);
+bool R_Texture_Init(void);
 bool R_Texture_AddExisting(const char *name, GLuint id);
+
+/* Loads all the textures that are not loaded already, decoding the images in 
+ * parallel. 'out' receives the texture of each name, in order. */
+bool R_Texture_LoadAll(const char *basedir, size_t count, const char *names[], GLuint out[]);
 void R_Texture_GL_Activate(const struct texture *text, GLuint shader_prog);
 
+/* Saves level 0 of an RGB texture rendered by the engine, so that it can be 
+ * restored with 'R_Texture_LoadRendered' instead of being rendered again. 
+ * Loading fails unless the size and 'state' are the same as when it was saved. */
+bool R_Texture_SaveRendered(GLuint id, int width, int height, uint64_t state, const char *path);
+bool R_Texture_LoadRendered(GLuint id, int width, int height, uint64_t state, const char *path);
+/* Folds the identity of a loaded texture - its' name and the modification 
+ * time and size of its' source image - into the hash 'seed', for building the 
+ * 'state' of textures rendered from it. */
+uint64_t R_Texture_SourceHash(const char *name, uint64_t seed);
+
+/* Returns the dimensions of level 0 of a loaded texture. */
+bool R_Texture_Size(GLuint id, int *out_width, int *out_height);
+
+/* Packs copies of the loaded textures into the layers of a GL_TEXTURE_2D_ARRAY, 
+ * in order. All the textures must have the same size, or the call fails: they 
+ * are never rescaled. Repeated calls with the same ids return the same array. 
+ * Every call (and every 'R_Texture_ArrayRetain') takes a reference to the array, 
+ * which is deleted once all of them are given back with 'R_Texture_ArrayRelease'. */
+bool R_Texture_ArrayForIDs(const GLuint *ids, size_t num_ids, GLuint *out);
+void R_Texture_ArrayRetain(GLuint array_id);
+void R_Texture_ArrayRelease(GLuint array_id);
+
+/* Returns the video memory taken up by all the mip levels of the texture, 
+ * which is bound to texture unit 0. */
+size_t R_Texture_GPUBytes(GLenum target, GLuint id);
+
+/* Returns the memory taken up by a texture or an array texture the first time 
+ * it is called for it, and 0 after that. For textures, this includes the copy
+ * of the image kept for packing into arrays. Used for charging textures shared
+ * between models to only one of them. */
+size_t R_Texture_ChargeBytes(GLenum target, GLuint id);
+
 #endif
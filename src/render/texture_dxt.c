@@ -0,0 +1,306 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2017-2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "texture_dxt.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define MIN(a, b)        ((a) < (b) ? (a) : (b))
+#define MAX(a, b)        ((a) > (b) ? (a) : (b))
+
+#define DXT1_BLOCK_SZ    8
+#define DXT5_BLOCK_SZ    16
+
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint16_t dxt_pack_565(const unsigned char *rgb)
+{
+    return ((rgb[0] * 31 + 127) / 255) << 11
+         | ((rgb[1] * 63 + 127) / 255) << 5
+         | ((rgb[2] * 31 + 127) / 255);
+}
+
+static void dxt_unpack_565(uint16_t c, unsigned char *out_rgb)
+{
+    int r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    out_rgb[0] = (r << 3) | (r >> 2);
+    out_rgb[1] = (g << 2) | (g >> 4);
+    out_rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void dxt_put16(unsigned char *out, uint16_t val)
+{
+    out[0] = val & 0xff;
+    out[1] = val >> 8;
+}
+
+static uint16_t dxt_get16(const unsigned char *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+/* Copies out the 4x4 texels of a block, repeating the edge texels for 
+ * blocks that hang over the right or bottom edge of the image. */
+static void dxt_fetch_block(const unsigned char *rgba, int width, int height, 
+                            int bx, int by, unsigned char out[16][4])
+{
+    for(int y = 0; y < 4; y++) {
+        for(int x = 0; x < 4; x++) {
+
+            int src_x = MIN(bx * 4 + x, width - 1);
+            int src_y = MIN(by * 4 + y, height - 1);
+            memcpy(out[y * 4 + x], rgba + (src_y * width + src_x) * 4, 4);
+        }
+    }
+}
+
+/* The color block of DXT5 is always decoded in the 4-color mode */
+static void dxt_color_palette(uint16_t c0, uint16_t c1, bool four_color, unsigned char out[4][4])
+{
+    dxt_unpack_565(c0, out[0]);
+    dxt_unpack_565(c1, out[1]);
+    out[0][3] = out[1][3] = 255;
+
+    if(c0 > c1 || four_color) {
+        for(int i = 0; i < 3; i++) {
+            out[2][i] = (2 * out[0][i] + out[1][i]) / 3;
+            out[3][i] = (out[0][i] + 2 * out[1][i]) / 3;
+        }
+        out[2][3] = out[3][3] = 255;
+    }else{
+        for(int i = 0; i < 3; i++) {
+            out[2][i] = (out[0][i] + out[1][i]) / 2;
+            out[3][i] = 0;
+        }
+        out[2][3] = 255;
+        out[3][3] = 0;
+    }
+}
+
+static void dxt_alpha_palette(unsigned char a0, unsigned char a1, unsigned char out[8])
+{
+    out[0] = a0;
+    out[1] = a1;
+
+    if(a0 > a1) {
+        for(int i = 1; i < 7; i++)
+            out[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }else{
+        for(int i = 1; i < 5; i++)
+            out[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        out[6] = 0;
+        out[7] = 255;
+    }
+}
+
+/* The endpoints are the corners of the block's color bounding box, inset by
+ * 1/16th of its' extent to reduce the error of the interpolated colors. The
+ * endpoints are always ordered for the 4-color mode. */
+static void dxt_compress_color(unsigned char texels[16][4], unsigned char *out)
+{
+    unsigned char min[3] = {255, 255, 255}, max[3] = {0, 0, 0};
+    for(int i = 0; i < 16; i++) {
+        for(int j = 0; j < 3; j++) {
+            min[j] = MIN(min[j], texels[i][j]);
+            max[j] = MAX(max[j], texels[i][j]);
+        }
+    }
+
+    for(int j = 0; j < 3; j++) {
+        int inset = (max[j] - min[j]) >> 4;
+        min[j] += inset;
+        max[j] -= inset;
+    }
+
+    uint16_t c0 = dxt_pack_565(max);
+    uint16_t c1 = dxt_pack_565(min);
+    uint32_t indices = 0;
+
+    if(c0 == c1) {
+        dxt_put16(out + 0, c0);
+        dxt_put16(out + 2, c1);
+        memset(out + 4, 0, 4);
+        return;
+    }
+
+    if(c0 < c1) {
+        uint16_t tmp = c0;
+        c0 = c1;
+        c1 = tmp;
+    }
+
+    unsigned char palette[4][4];
+    dxt_color_palette(c0, c1, true, palette);
+
+    for(int i = 0; i < 16; i++) {
+
+        int best = 0, best_dist = INT_MAX;
+        for(int p = 0; p < 4; p++) {
+
+            int dr = texels[i][0] - palette[p][0];
+            int dg = texels[i][1] - palette[p][1];
+            int db = texels[i][2] - palette[p][2];
+            int dist = dr*dr + dg*dg + db*db;
+            if(dist < best_dist) {
+                best_dist = dist;
+                best = p;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+    }
+
+    dxt_put16(out + 0, c0);
+    dxt_put16(out + 2, c1);
+    for(int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+/* Fully transparent texels must remain fully transparent for the alpha test 
+ * in the shaders, so the minimum alpha is always an exact endpoint. */
+static void dxt_compress_alpha(unsigned char texels[16][4], unsigned char *out)
+{
+    unsigned char a0 = 0, a1 = 255;
+    for(int i = 0; i < 16; i++) {
+        a0 = MAX(a0, texels[i][3]);
+        a1 = MIN(a1, texels[i][3]);
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    memset(out + 2, 0, 6);
+    if(a0 == a1)
+        return;
+
+    unsigned char palette[8];
+    dxt_alpha_palette(a0, a1, palette);
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 16; i++) {
+
+        int best = 0, best_dist = INT_MAX;
+        for(int p = 0; p < 8; p++) {
+
+            int dist = abs(texels[i][3] - palette[p]);
+            if(dist < best_dist) {
+                best_dist = dist;
+                best = p;
+            }
+        }
+        indices |= (uint64_t)best << (3 * i);
+    }
+
+    for(int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+static void dxt_decompress_color(const unsigned char *in, bool four_color, unsigned char texels[16][4])
+{
+    unsigned char palette[4][4];
+    dxt_color_palette(dxt_get16(in + 0), dxt_get16(in + 2), four_color, palette);
+
+    uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+    for(int i = 0; i < 16; i++)
+        memcpy(texels[i], palette[(indices >> (2 * i)) & 0x3], 4);
+}
+
+static void dxt_decompress_alpha(const unsigned char *in, unsigned char texels[16][4])
+{
+    unsigned char palette[8];
+    dxt_alpha_palette(in[0], in[1], palette);
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 6; i++)
+        indices |= (uint64_t)in[2 + i] << (8 * i);
+
+    for(int i = 0; i < 16; i++)
+        texels[i][3] = palette[(indices >> (3 * i)) & 0x7];
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+size_t R_DXT_LevelSize(int width, int height, bool alpha)
+{
+    size_t num_blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+    return num_blocks * (alpha ? DXT5_BLOCK_SZ : DXT1_BLOCK_SZ);
+}
+
+void R_DXT_Compress(const unsigned char *rgba, int width, int height, bool alpha, unsigned char *out)
+{
+    for(int by = 0; by < (height + 3) / 4; by++) {
+        for(int bx = 0; bx < (width + 3) / 4; bx++) {
+
+            unsigned char texels[16][4];
+            dxt_fetch_block(rgba, width, height, bx, by, texels);
+
+            if(alpha) {
+                dxt_compress_alpha(texels, out);
+                out += DXT5_BLOCK_SZ - DXT1_BLOCK_SZ;
+            }
+            dxt_compress_color(texels, out);
+            out += DXT1_BLOCK_SZ;
+        }
+    }
+}
+
+void R_DXT_Decompress(const unsigned char *blocks, int width, int height, bool alpha, unsigned char *out_rgba)
+{
+    for(int by = 0; by < (height + 3) / 4; by++) {
+        for(int bx = 0; bx < (width + 3) / 4; bx++) {
+
+            unsigned char texels[16][4];
+            const unsigned char *color = alpha ? blocks + (DXT5_BLOCK_SZ - DXT1_BLOCK_SZ) : blocks;
+
+            dxt_decompress_color(color, alpha, texels);
+            if(alpha)
+                dxt_decompress_alpha(blocks, texels);
+            blocks += alpha ? DXT5_BLOCK_SZ : DXT1_BLOCK_SZ;
+
+            for(int y = 0; y < 4 && by * 4 + y < height; y++) {
+                for(int x = 0; x < 4 && bx * 4 + x < width; x++) {
+                    memcpy(out_rgba + ((by * 4 + y) * width + bx * 4 + x) * 4, texels[y * 4 + x], 4);
+                }
+            }
+        }
+    }
+}
+
@@ -0,0 +1,53 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2017-2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TEXTURE_DXT_H
+#define TEXTURE_DXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Software S3TC (DXT1/DXT5) block compression. DXT1 is used for opaque 
+ * images and DXT5 for images with an alpha channel. Images whose dimensions
+ * are not multiples of 4 have their last row and column of blocks padded
+ * by repeating the edge texels. */
+
+size_t R_DXT_LevelSize(int width, int height, bool alpha);
+void   R_DXT_Compress(const unsigned char *rgba, int width, int height, bool alpha, unsigned char *out);
+/* Used when the driver does not support S3TC textures */
+void   R_DXT_Decompress(const unsigned char *blocks, int width, int height, bool alpha, unsigned char *out_rgba);
+
+#endif
+
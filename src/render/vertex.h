@@ -50,6 +50,25 @@ struct vertex{
     GLint   adjacent_mat_indices[4];
 };
 
+/* Compact layouts for the vertices of model meshes, built from 'struct vertex'
+ * at load time. Texture coordinates are stored as half floats, normals are 
+ * packed in GL_INT_2_10_10_10_REV format and joint weights are normalized 
+ * unsigned bytes. The attribute locations are the same as for 'struct vertex',
+ * so the same shaders can source either layout. */
+struct vertex_static{
+    vec3_t  pos;
+    GLhalf  uv[2];
+    GLuint  normal;
+    GLubyte material_idx;
+    GLubyte pad[3];
+};
+
+struct vertex_skinned{
+    struct vertex_static base;
+    GLubyte joint_indices[6];
+    GLubyte weights[6];
+};
+
 struct colored_vert{
     vec3_t pos;
     vec4_t color;
@@ -35,20 +35,76 @@
 
 #include "scene.h"
 #include "asset_load.h"
+#include "entity.h"
+#include "anim/public/anim.h"
 #include "script/public/script.h"
 #include "game/public/game.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL.h>
 #include <assert.h>
 
 
+#define SNAPSHOT_MAGIC   (0x53534650) /* 'PFSS' */
+#define SNAPSHOT_VERSION (2)
+
+/* Layout of the snapshot files written by 'Scene_SaveSnapshot'. The header 
+ * is followed by the script state, a record for every entity (each followed 
+ * by its' animation context, if it is animated) and the game state. The 
+ * records are the engine's structures written as they are, so their sizes 
+ * are saved too and a snapshot is rejected when any of them has changed. */
+struct snapshot_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_ents;
+    uint32_t script_state_size;
+    uint32_t ent_rec_size;
+    uint32_t anim_ctx_size;
+    uint32_t faction_size;
+    uint32_t move_rec_size;
+    uint32_t combat_rec_size;
+};
+
+struct snapshot_ent{
+    uint32_t uid;
+    char     name[32];
+    char     dir[64]; /* relative to the base path */
+    char     filename[32];
+    vec3_t   pos;
+    vec3_t   scale;
+    quat_t   rotation;
+    uint32_t flags;
+    float    selection_radius;
+    float    max_speed;
+    int32_t  faction_id;
+    int32_t  max_hp;
+    int32_t  base_dmg;
+    float    base_armour_pc;
+};
+
+struct snapshot{
+    SDL_RWops *stream;
+    uint32_t   num_ents;
+    void      *script_state;
+    size_t     script_state_size;
+};
+
+
 __KHASH_IMPL(attr, extern, kh_cstr_t, struct attr, 1, kh_str_hash_func, kh_str_hash_equal)
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static void scene_snapshot_sizes(struct snapshot_hdr *hdr)
+{
+    hdr->ent_rec_size = sizeof(struct snapshot_ent);
+    hdr->anim_ctx_size = A_CtxSaveSize();
+    G_SaveStateSizes(&hdr->faction_size, &hdr->move_rec_size, &hdr->combat_rec_size);
+}
+
 /* A copy of the key string is stored in the 'struct attr' itself. Make the key (string pointer)
  * be a pointer to that buffer in order to avoid allocating/storing the key strings separately. 
  * All keys must be patched in case rehashing took place. */
@@ -64,66 +120,60 @@ static bool scene_parse_att(SDL_RWops *stream, struct attr *out, bool anon)
 {
     char line[MAX_LINE_LEN];
     READ_LINE(stream, line, fail);
-    char *saveptr;
-    char *token;
+    const char *curr = line;
+    char type[16];
 
     if(!anon) {
-        token = strtok_r(line, " \t", &saveptr);
-
-        strncpy(out->key, token, sizeof(out->key)); 
-        out->key[sizeof(out->key)-1] = '\0';
-
-        token = strtok_r(NULL, " \t", &saveptr);
-    }else{
-        token = strtok_r(line, " \t", &saveptr);
+        if(!AL_ParseWord(&curr, out->key, sizeof(out->key)))
+            goto fail;
     }
 
-    if(!strcmp(token, "string")) {
+    if(!AL_ParseWord(&curr, type, sizeof(type)))
+        goto fail;
+
+    if(!strcmp(type, "string")) {
 
         out->type = TYPE_STRING;
-        token = strtok_r(NULL, " \t", &saveptr);
-        if(!sscanf(token, "%63s", out->val.as_string))
+        if(!AL_ParseWord(&curr, out->val.as_string, sizeof(out->val.as_string)))
             goto fail;
 
-    }else if(!strcmp(token, "quat")) {
+    }else if(!strcmp(type, "quat")) {
 
         out->type = TYPE_QUAT;
-        token = token + strlen(token) + 1;
-        if(!sscanf(token, "%f %f %f %f", 
-            &out->val.as_quat.x, &out->val.as_quat.y, &out->val.as_quat.z, &out->val.as_quat.w))
+        if(!AL_ParseFloat(&curr, &out->val.as_quat.x)
+        || !AL_ParseFloat(&curr, &out->val.as_quat.y)
+        || !AL_ParseFloat(&curr, &out->val.as_quat.z)
+        || !AL_ParseFloat(&curr, &out->val.as_quat.w))
             goto fail;
 
-    }else if(!strcmp(token, "vec3")) {
+    }else if(!strcmp(type, "vec3")) {
 
         out->type = TYPE_VEC3;
-        token = token + strlen(token) + 1;
-        if(!sscanf(token, "%f %f %f", 
-            &out->val.as_vec3.x, &out->val.as_vec3.y, &out->val.as_vec3.z))
+        if(!AL_ParseFloat(&curr, &out->val.as_vec3.x)
+        || !AL_ParseFloat(&curr, &out->val.as_vec3.y)
+        || !AL_ParseFloat(&curr, &out->val.as_vec3.z))
             goto fail;
 
-    }else if(!strcmp(token, "bool")) {
+    }else if(!strcmp(type, "bool")) {
 
         out->type = TYPE_BOOL;
-        token = strtok_r(NULL, " \t", &saveptr);
         int tmp;
-        if(!sscanf(token, "%d", &tmp))
+        if(!AL_ParseInt(&curr, &tmp))
             goto fail;
         if(tmp != 0 && tmp != 1)
             goto fail;
         out->val.as_bool = tmp;
 
-    }else if(!strcmp(token, "float")) {
+    }else if(!strcmp(type, "float")) {
 
         out->type = TYPE_FLOAT;
-        token = strtok_r(NULL, " \t", &saveptr);
-        if(!sscanf(token, "%f", &out->val.as_float))
+        if(!AL_ParseFloat(&curr, &out->val.as_float))
             goto fail;
 
-    }else if(!strcmp(token, "int")) {
+    }else if(!strcmp(type, "int")) {
 
         out->type = TYPE_INT;
-        token = strtok_r(NULL, " \t", &saveptr);
-        if(!sscanf(token, "%d", &out->val.as_int))
+        if(!AL_ParseInt(&curr, &out->val.as_int))
             goto fail;
 
     }else {
@@ -141,7 +191,7 @@ static bool scene_load_entity(SDL_RWops *stream)
     char line[MAX_LINE_LEN];
     char name[128];
     char path[256];
-    size_t num_atts;
+    int num_atts;
 
     khash_t(attr) *attr_table = kh_init(attr);
     if(!attr_table)
@@ -151,7 +201,11 @@ static bool scene_load_entity(SDL_RWops *stream)
     kv_init(constructor_args);
 
     READ_LINE(stream, line, fail_parse);
-    if(!sscanf(line, "entity %s %s %lu", name, path, &num_atts))
+    const char *curr = line;
+    if(!AL_ParseLiteral(&curr, "entity")
+    || !AL_ParseWord(&curr, name, sizeof(name))
+    || !AL_ParseWord(&curr, path, sizeof(path))
+    || !AL_ParseInt(&curr, &num_atts))
         goto fail_parse;
 
     for(int i = 0; i < num_atts; i++) {
@@ -196,6 +250,69 @@ fail_alloc:
 }
 
 
+/* Reads past the attributes of an entity, including its' constructor arguments */
+static bool scene_skip_atts(SDL_RWops *stream, int num_atts)
+{
+    for(int i = 0; i < num_atts; i++) {
+
+        struct attr attr;
+        if(!scene_parse_att(stream, &attr, false))
+            return false;
+
+        if(strcmp(attr.key, "constructor_arguments"))
+            continue;
+
+        for(int j = 0; j < attr.val.as_int; j++) {
+            struct attr const_arg;
+            if(!scene_parse_att(stream, &const_arg, true))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Queues the models of all the entities in the scene to be parsed by the asset 
+ * loading workers, so that the distinct models are parsed in parallel while the
+ * entities are being created. Creating an entity takes over the parsing of its' 
+ * model if no worker has gotten to it yet. The stream position is restored. */
+static void scene_prefetch_models(SDL_RWops *stream, int num_ents)
+{
+    extern const char *g_basepath;
+    Sint64 start = SDL_RWtell(stream);
+
+    for(int i = 0; i < num_ents; i++) {
+
+        char line[MAX_LINE_LEN];
+        char name[128];
+        char path[256];
+        int num_atts;
+
+        READ_LINE(stream, line, done);
+        const char *curr = line;
+        if(!AL_ParseLiteral(&curr, "entity")
+        || !AL_ParseWord(&curr, name, sizeof(name))
+        || !AL_ParseWord(&curr, path, sizeof(path))
+        || !AL_ParseInt(&curr, &num_atts))
+            goto done;
+
+        char *filename = strrchr(path, '/');
+        if(filename && strlen(g_basepath) + (filename - path) < 512) {
+
+            char dir[512];
+            *filename++ = '\0';
+            strcpy(dir, g_basepath);
+            strcat(dir, path);
+            AL_PrefetchPFObj(dir, filename);
+        }
+
+        if(!scene_skip_atts(stream, num_atts))
+            goto done;
+    }
+
+done:
+    SDL_RWseek(stream, start, RW_SEEK_SET);
+}
+
 static bool scene_load_faction(SDL_RWops *stream)
 {
     char line[MAX_LINE_LEN];
@@ -227,14 +344,17 @@ bool Scene_Load(const char *path)
 {
     SDL_RWops *stream;
     char line[MAX_LINE_LEN];
-    size_t num_factions, num_ents;
+    int num_factions, num_ents;
 
-    stream = SDL_RWFromFile(path, "r");
+    stream = AL_OpenFile(path);
     if(!stream)
         goto fail_stream;
 
+    const char *curr;
+
     READ_LINE(stream, line, fail_parse);
-    if(!sscanf(line, "num_factions%lu", &num_factions))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_factions") || !AL_ParseInt(&curr, &num_factions))
         goto fail_parse;
 
     for(int i = 0; i < num_factions; i++) {
@@ -243,9 +363,12 @@ bool Scene_Load(const char *path)
     }
     
     READ_LINE(stream, line, fail_parse);
-    if(!sscanf(line, "num_entities %lu", &num_ents))
+    curr = line;
+    if(!AL_ParseLiteral(&curr, "num_entities") || !AL_ParseInt(&curr, &num_ents))
         goto fail_parse;
 
+    scene_prefetch_models(stream, num_ents);
+
     for(int i = 0; i < num_ents; i++) {
         if(!scene_load_entity(stream))
             goto fail_parse;
@@ -260,3 +383,247 @@ fail_stream:
     return false;
 }
 
+bool Scene_SaveSnapshot(const char *path, struct entity *const *ents, size_t num_ents,
+                        const void *script_state, size_t script_state_size)
+{
+    extern const char *g_basepath;
+    size_t base_len = strlen(g_basepath);
+
+    /* Written to the side and renamed over the old file, so that a failed save 
+     * never destroys the previous snapshot at 'path' */
+    char tmp_path[strlen(path) + sizeof(".tmp")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        goto fail_stream;
+
+    struct snapshot_hdr hdr = {
+        .magic             = SNAPSHOT_MAGIC,
+        .version           = SNAPSHOT_VERSION,
+        .num_ents          = num_ents,
+        .script_state_size = script_state_size,
+    };
+    scene_snapshot_sizes(&hdr);
+    if(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_write;
+    if(script_state_size && SDL_RWwrite(stream, script_state, script_state_size, 1) != 1)
+        goto fail_write;
+
+    for(int i = 0; i < num_ents; i++) {
+
+        const struct entity *ent = ents[i];
+        const char *dir = ent->basedir;
+        if(!strncmp(dir, g_basepath, base_len))
+            dir += base_len;
+
+        struct snapshot_ent rec = {
+            .uid              = ent->uid,
+            .pos              = ent->pos,
+            .scale            = ent->scale,
+            .rotation         = ent->rotation,
+            .flags            = ent->flags,
+            .selection_radius = ent->selection_radius,
+            .max_speed        = ent->max_speed,
+            .faction_id       = ent->faction_id,
+            .max_hp           = ent->ca.max_hp,
+            .base_dmg         = ent->ca.base_dmg,
+            .base_armour_pc   = ent->ca.base_armour_pc,
+        };
+        if(strlen(dir) >= sizeof(rec.dir)) {
+            fprintf(stderr, "Unable to save entity '%s' to a snapshot: its' directory '%s' is too long\n",
+                ent->name, dir);
+            goto fail_write;
+        }
+        strcpy(rec.name, ent->name);
+        strcpy(rec.dir, dir);
+        strcpy(rec.filename, ent->filename);
+
+        if(SDL_RWwrite(stream, &rec, sizeof(rec), 1) != 1)
+            goto fail_write;
+        if((ent->flags & ENTITY_FLAG_ANIMATED) && !A_SaveCtx(ent, stream))
+            goto fail_write;
+    }
+
+    if(!G_SaveState(stream))
+        goto fail_write;
+
+    if(SDL_RWclose(stream) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+
+#if defined(_WIN32)
+    /* rename does not replace an existing file on Windows */
+    remove(path);
+#endif
+    if(rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+
+fail_write:
+    SDL_RWclose(stream);
+    remove(tmp_path);
+fail_stream:
+    return false;
+}
+
+struct snapshot *Scene_OpenSnapshot(const char *path)
+{
+    extern const char *g_basepath;
+
+    struct snapshot *ret = malloc(sizeof(struct snapshot));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->stream = AL_OpenFile(path);
+    if(!ret->stream)
+        goto fail_stream;
+
+    struct snapshot_hdr hdr;
+    if(SDL_RWread(ret->stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_hdr;
+    if(hdr.magic != SNAPSHOT_MAGIC || hdr.version != SNAPSHOT_VERSION)
+        goto fail_hdr;
+
+    struct snapshot_hdr expected = {0};
+    scene_snapshot_sizes(&expected);
+    if(hdr.ent_rec_size != expected.ent_rec_size
+    || hdr.anim_ctx_size != expected.anim_ctx_size
+    || hdr.faction_size != expected.faction_size
+    || hdr.move_rec_size != expected.move_rec_size
+    || hdr.combat_rec_size != expected.combat_rec_size)
+        goto fail_hdr;
+
+    ret->num_ents = hdr.num_ents;
+    ret->script_state_size = hdr.script_state_size;
+    ret->script_state = malloc(hdr.script_state_size + 1);
+    if(!ret->script_state)
+        goto fail_hdr;
+    if(hdr.script_state_size 
+    && SDL_RWread(ret->stream, ret->script_state, hdr.script_state_size, 1) != 1)
+        goto fail_state;
+
+    /* Start loading the models while the caller is unpacking the script state. 
+     * Since the animation contexts vary in size, the records are skipped by 
+     * reading them. */
+    Sint64 ents_begin = SDL_RWtell(ret->stream);
+    for(int i = 0; i < hdr.num_ents; i++) {
+
+        struct snapshot_ent rec;
+        if(SDL_RWread(ret->stream, &rec, sizeof(rec), 1) != 1)
+            goto fail_state;
+        if((rec.flags & ENTITY_FLAG_ANIMATED)
+        && SDL_RWseek(ret->stream, A_CtxSaveSize(), RW_SEEK_CUR) < 0)
+            goto fail_state;
+
+        char dir[512];
+        rec.dir[sizeof(rec.dir)-1] = '\0';
+        rec.filename[sizeof(rec.filename)-1] = '\0';
+        if(strlen(g_basepath) + strlen(rec.dir) < sizeof(dir)) {
+
+            strcpy(dir, g_basepath);
+            strcat(dir, rec.dir);
+            AL_PrefetchPFObj(dir, rec.filename);
+        }
+    }
+    SDL_RWseek(ret->stream, ents_begin, RW_SEEK_SET);
+
+    return ret;
+
+fail_state:
+    free(ret->script_state);
+fail_hdr:
+    SDL_RWclose(ret->stream);
+fail_stream:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+size_t Scene_SnapshotNumEntities(const struct snapshot *snap)
+{
+    return snap->num_ents;
+}
+
+const void *Scene_SnapshotScriptState(const struct snapshot *snap, size_t *out_size)
+{
+    *out_size = snap->script_state_size;
+    return snap->script_state;
+}
+
+bool Scene_RestoreSnapshot(const struct snapshot *snap, struct entity *const *ents)
+{
+    khash_t(entity) *uid_map = kh_init(entity);
+    if(!uid_map)
+        goto fail_alloc;
+
+    for(int i = 0; i < snap->num_ents; i++) {
+
+        struct entity *ent = ents[i];
+        struct snapshot_ent rec;
+        if(SDL_RWread(snap->stream, &rec, sizeof(rec), 1) != 1)
+            goto fail_restore;
+
+        rec.name[sizeof(rec.name)-1] = '\0';
+        rec.filename[sizeof(rec.filename)-1] = '\0';
+
+        /* The entity must have been made from the same model */
+        if(strcmp(ent->filename, rec.filename)
+        || (ent->flags & ENTITY_FLAG_ANIMATED) != (rec.flags & ENTITY_FLAG_ANIMATED))
+            goto fail_restore;
+
+        strcpy(ent->name, rec.name);
+        ent->pos              = rec.pos;
+        ent->scale            = rec.scale;
+        ent->rotation         = rec.rotation;
+        ent->flags            = rec.flags;
+        ent->selection_radius = rec.selection_radius;
+        ent->max_speed        = rec.max_speed;
+        ent->faction_id       = rec.faction_id;
+        ent->ca.max_hp         = rec.max_hp;
+        ent->ca.base_dmg       = rec.base_dmg;
+        ent->ca.base_armour_pc = rec.base_armour_pc;
+
+        if((ent->flags & ENTITY_FLAG_ANIMATED) && !A_LoadCtx(ent, snap->stream))
+            goto fail_restore;
+
+        int ret;
+        khiter_t k = kh_put(entity, uid_map, rec.uid, &ret);
+        if(ret == -1 || ret == 0)
+            goto fail_restore;
+        kh_value(uid_map, k) = ent;
+    }
+
+    /* Only once all of the records have been read back are the entities made 
+     * active. The movement and combat state is restored into the active entities, 
+     * so it is rolled back by removing them again. */
+    int num_added = 0;
+    for(; num_added < snap->num_ents; num_added++) {
+        if(!G_AddEntity(ents[num_added]))
+            goto fail_add;
+    }
+
+    if(!G_LoadState(snap->stream, uid_map))
+        goto fail_add;
+
+    kh_destroy(entity, uid_map);
+    return true;
+
+fail_add:
+    for(int i = 0; i < num_added; i++)
+        G_RemoveEntity(ents[i]);
+fail_restore:
+    kh_destroy(entity, uid_map);
+fail_alloc:
+    return false;
+}
+
+void Scene_CloseSnapshot(struct snapshot *snap)
+{
+    SDL_RWclose(snap->stream);
+    free(snap->script_state);
+    free(snap);
+}
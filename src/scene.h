@@ -68,7 +68,27 @@ struct attr{
 KHASH_DECLARE(attr, kh_cstr_t, struct attr)
 typedef kvec_t(struct attr) kvec_attr_t;
 
+struct entity;
+struct snapshot;
+
 bool Scene_Load(const char *path);
 
+/* A snapshot holds the state of the game simulation: the factions, the given 
+ * (active) entities and their movement and combat state. The state owned by 
+ * the scripts is saved alongside as an opaque blob. */
+bool Scene_SaveSnapshot(const char *path, struct entity *const *ents, size_t num_ents,
+                        const void *script_state, size_t script_state_size);
+
+/* Restoring a snapshot takes place in two steps. After opening it, the caller 
+ * creates an entity (of the same model) in place of each saved one, in order, 
+ * and then has their state restored and the entities activated by 
+ * 'Scene_RestoreSnapshot'. The map must already be loaded. When restoring 
+ * fails, none of the entities are left active. */
+struct snapshot *Scene_OpenSnapshot(const char *path);
+size_t           Scene_SnapshotNumEntities(const struct snapshot *snap);
+const void      *Scene_SnapshotScriptState(const struct snapshot *snap, size_t *out_size);
+bool             Scene_RestoreSnapshot(const struct snapshot *snap, struct entity *const *ents);
+void             Scene_CloseSnapshot(struct snapshot *snap);
+
 #endif
 
@@ -38,6 +38,7 @@
 #include "../entity.h"
 #include "../event.h"
 #include "../asset_load.h"
+#include "../scene.h"
 #include "../anim/public/anim.h"
 #include "../game/public/game.h"
 #include "../lib/public/khash.h"
@@ -90,6 +91,7 @@ static PyObject *PyEntity_hold_position(PyEntityObject *self);
 static int       PyAnimEntity_init(PyAnimEntityObject *self, PyObject *args, PyObject *kwds);
 static PyObject *PyAnimEntity_del(PyAnimEntityObject *self);
 static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args);
+static PyObject *PyAnimEntity_prefetch_anim(PyAnimEntityObject *self, PyObject *args);
 
 static int       PyCombatableEntity_init(PyCombatableEntityObject *self, PyObject *args, PyObject *kwds);
 static PyObject *PyCombatableEntity_del(PyCombatableEntityObject *self);
@@ -242,7 +244,13 @@ static PyTypeObject PyEntity_type = {
 static PyMethodDef PyAnimEntity_methods[] = {
     {"play_anim", 
     (PyCFunction)PyAnimEntity_play_anim, METH_VARARGS,
-    "Play the animation clip with the specified name." },
+    "Play the animation clip with the specified name. If the clip has not been loaded yet, it is "
+    "loaded in the background and the current clip keeps playing until it is." },
+
+    {"prefetch_anim", 
+    (PyCFunction)PyAnimEntity_prefetch_anim, METH_VARARGS,
+    "Start loading the animation clip with the specified name in the background, so that it can "
+    "start right away when it is played. Clips are otherwise loaded the first time they are played." },
 
     {"__del__", 
     (PyCFunction)PyAnimEntity_del, METH_NOARGS,
@@ -519,6 +527,9 @@ static int PyEntity_set_pos(PyEntityObject *self, PyObject *value, void *closure
         self->ent->pos.raw[i] = PyFloat_AsDouble(item);
     }
 
+    if(self->ent->flags & ENTITY_FLAG_STATIC)
+        G_StaticEntityMoved(self->ent);
+
     return 0;
 }
 
@@ -551,6 +562,9 @@ static int PyEntity_set_scale(PyEntityObject *self, PyObject *value, void *closu
         self->ent->scale.raw[i] = PyFloat_AsDouble(item);
     }
 
+    if(self->ent->flags & ENTITY_FLAG_STATIC)
+        G_StaticEntityMoved(self->ent);
+
     return 0;
 }
 
@@ -584,6 +598,9 @@ static int PyEntity_set_rotation(PyEntityObject *self, PyObject *value, void *cl
         self->ent->rotation.raw[i] = PyFloat_AsDouble(item);
     }
 
+    if(self->ent->flags & ENTITY_FLAG_STATIC)
+        G_StaticEntityMoved(self->ent);
+
     return 0;
 }
 
@@ -783,7 +800,11 @@ static int PyAnimEntity_init(PyAnimEntityObject *self, PyObject *args, PyObject
         return -1; 
     }
 
-    A_InitCtx(self->super.ent, PyString_AS_STRING(idle_clip), 24);
+    if(!A_InitCtx(self->super.ent, PyString_AS_STRING(idle_clip), 24)) {
+        PyErr_Format(PyExc_RuntimeError, "Could not load the idle clip '%s' of the entity.", 
+            PyString_AS_STRING(idle_clip));
+        return -1;
+    }
 
     /* Call the next __init__ method in the MRO. This is required for all __init__ calls in the 
      * MRO to complete in cases when this class is one of multiple base classes of another type. 
@@ -814,7 +835,25 @@ static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args
         return NULL;
     }
 
-    A_SetActiveClip(self->super.ent, clipname, ANIM_MODE_LOOP, 24);
+    if(!A_SetActiveClip(self->super.ent, clipname, ANIM_MODE_LOOP, 24)) {
+        PyErr_Format(PyExc_RuntimeError, "Could not play animation clip: %s", clipname);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyAnimEntity_prefetch_anim(PyAnimEntityObject *self, PyObject *args)
+{
+    const char *clipname;
+    if(!PyArg_ParseTuple(args, "s", &clipname)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    if(!A_PrefetchClip(self->super.ent, clipname)) {
+        PyErr_Format(PyExc_RuntimeError, "Could not load animation clip: %s", clipname);
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
@@ -1038,6 +1077,197 @@ static PyObject *s_new_custom_class(const char *name, const kvec_attr_t *constru
     return ret;
 }
 
+/* The arguments that the entity's class gets called with to re-create it when
+ * a snapshot is loaded. Classes can provide their own by defining the 
+ * '__getinitargs__' method. Otherwise, the same positional arguments as for 
+ * pf.Entity are used, along with any keyword arguments required by the 
+ * built-in types. */
+static PyObject *s_snapshot_ctor(PyEntityObject *obj)
+{
+    struct entity *ent = obj->ent;
+    PyObject *args, *kwargs;
+
+    if(PyObject_HasAttrString((PyObject*)obj, "__getinitargs__")) {
+
+        args = PyObject_CallMethod((PyObject*)obj, "__getinitargs__", NULL);
+        if(!args)
+            return NULL;
+        if(!PyTuple_Check(args)) {
+            Py_DECREF(args);
+            PyErr_SetString(PyExc_TypeError, "__getinitargs__ must return a tuple.");
+            return NULL;
+        }
+    }else{
+
+        extern const char *g_basepath;
+        const char *dir = ent->basedir;
+        if(!strncmp(dir, g_basepath, strlen(g_basepath)))
+            dir += strlen(g_basepath);
+
+        args = Py_BuildValue("(sss)", dir, ent->filename, ent->name);
+        if(!args)
+            return NULL;
+    }
+
+    if(Py_TYPE(obj) == &PyAnimEntity_type) {
+        kwargs = Py_BuildValue("{s:s}", "idle_clip", A_GetIdleClip(ent));
+    }else if(Py_TYPE(obj) == &PyCombatableEntity_type) {
+        kwargs = Py_BuildValue("{s:i,s:i,s:f}", "max_hp", ent->ca.max_hp, 
+            "base_dmg", ent->ca.base_dmg, "base_armour", ent->ca.base_armour_pc);
+    }else {
+        kwargs = PyDict_New();
+    }
+
+    if(!kwargs) {
+        Py_DECREF(args);
+        return NULL;
+    }
+
+    PyObject *ret = Py_BuildValue("(ONN)", (PyObject*)Py_TYPE(obj), args, kwargs);
+    return ret;
+}
+
+/* The script-owned state of an entity: the result of '__getstate__', if the 
+ * class defines it, otherwise the instance dictionary. */
+static PyObject *s_snapshot_state(PyEntityObject *obj)
+{
+    if(PyObject_HasAttrString((PyObject*)obj, "__getstate__"))
+        return PyObject_CallMethod((PyObject*)obj, "__getstate__", NULL);
+
+    PyObject **dictptr = _PyObject_GetDictPtr((PyObject*)obj);
+    if(dictptr && *dictptr) {
+        Py_INCREF(*dictptr);
+        return *dictptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static bool s_snapshot_set_state(PyObject *obj, PyObject *state)
+{
+    if(PyObject_HasAttrString(obj, "__setstate__")) {
+
+        PyObject *ret = PyObject_CallMethod(obj, "__setstate__", "(O)", state);
+        Py_XDECREF(ret);
+        return (ret != NULL);
+    }
+
+    if(state == Py_None)
+        return true;
+
+    PyObject *dict = PyObject_GetAttrString(obj, "__dict__");
+    if(!dict)
+        return false;
+    int ret = PyDict_Update(dict, state);
+    Py_DECREF(dict);
+    return (ret == 0);
+}
+
+/* Entities being saved in the snapshot are pickled as their index in it. 
+ * 'self' is a dictionary mapping object addresses to indices. */
+static PyObject *s_snapshot_persistent_id(PyObject *self, PyObject *obj)
+{
+    PyObject *key = PyLong_FromVoidPtr(obj);
+    if(!key)
+        return NULL;
+
+    PyObject *ret = PyDict_GetItem(self, key); /* borrowed */
+    Py_DECREF(key);
+
+    if(!ret)
+        Py_RETURN_NONE;
+    Py_INCREF(ret);
+    return ret;
+}
+
+static PyMethodDef s_persistent_id_def = {
+    "persistent_id", (PyCFunction)s_snapshot_persistent_id, METH_O, NULL
+};
+
+static PyObject *s_new_pickler(PyObject *file, PyObject *ids)
+{
+    PyObject *pickle_mod = PyImport_ImportModule("cPickle");
+    if(!pickle_mod)
+        return NULL;
+
+    PyObject *ret = PyObject_CallMethod(pickle_mod, "Pickler", "(Oi)", file, 2);
+    Py_DECREF(pickle_mod);
+    if(!ret || !ids)
+        return ret;
+
+    PyObject *persistent_id = PyCFunction_New(&s_persistent_id_def, ids);
+    if(!persistent_id || PyObject_SetAttrString(ret, "persistent_id", persistent_id) < 0) {
+        Py_XDECREF(persistent_id);
+        Py_DECREF(ret);
+        return NULL;
+    }
+    Py_DECREF(persistent_id);
+    return ret;
+}
+
+static PyObject *s_new_unpickler(PyObject *file, PyObject *objs)
+{
+    PyObject *pickle_mod = PyImport_ImportModule("cPickle");
+    if(!pickle_mod)
+        return NULL;
+
+    PyObject *ret = PyObject_CallMethod(pickle_mod, "Unpickler", "(O)", file);
+    Py_DECREF(pickle_mod);
+    if(!ret || !objs)
+        return ret;
+
+    PyObject *persistent_load = PyObject_GetAttrString(objs, "__getitem__");
+    if(!persistent_load || PyObject_SetAttrString(ret, "persistent_load", persistent_load) < 0) {
+        Py_XDECREF(persistent_load);
+        Py_DECREF(ret);
+        return NULL;
+    }
+    Py_DECREF(persistent_load);
+    return ret;
+}
+
+/* As for 'load_scene', the returned list holds the only references to the 
+ * restored entities. It keeps the order of 'S_Entity_GetAllList' so that it 
+ * compares equal to it when the snapshot was loaded into an empty game. Entities 
+ * that were alive before the load are left out. */
+static PyObject *s_restored_list(PyObject *objs)
+{
+    khash_t(PyObject) *restored = kh_init(PyObject);
+    if(!restored)
+        return PyErr_NoMemory();
+
+    for(int i = 0; i < PyList_GET_SIZE(objs); i++) {
+
+        PyObject *obj = PyList_GET_ITEM(objs, i);
+        int status;
+        khiter_t k = kh_put(PyObject, restored, ((PyEntityObject*)obj)->ent->uid, &status);
+        if(status == -1) {
+            kh_destroy(PyObject, restored);
+            return PyErr_NoMemory();
+        }
+        kh_value(restored, k) = obj;
+    }
+
+    PyObject *ret = PyList_New(0);
+    if(!ret)
+        goto fail_list;
+
+    uint32_t key;
+    PyObject *curr;
+    kh_foreach(s_uid_pyobj_table, key, curr, {
+
+        if(kh_get(PyObject, restored, key) == kh_end(restored))
+            continue;
+        if(0 != PyList_Append(ret, curr)) {
+            Py_CLEAR(ret);
+            goto fail_list;
+        }
+    });
+
+fail_list:
+    kh_destroy(PyObject, restored);
+    return ret;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1168,3 +1398,211 @@ PyObject *S_Entity_GetAllList(void)
     return ret;
 }
 
+bool S_Entity_SaveSnapshot(const char *path, PyObject *state)
+{
+    bool ret = false;
+
+    pentity_kvec_t ents;
+    kv_init(ents);
+    G_GetActiveEntities(&ents);
+
+    /* Only the entities owned by the scripts can be re-created */
+    size_t num_ents = 0;
+    for(int i = 0; i < kv_size(ents); i++) {
+        if(S_Entity_ObjForUID(kv_A(ents, i)->uid))
+            kv_A(ents, num_ents++) = kv_A(ents, i);
+    }
+
+    PyObject *ctors = PyList_New(num_ents);
+    PyObject *states = PyList_New(num_ents);
+    PyObject *ids = PyDict_New();
+    if(!ctors || !states || !ids)
+        goto fail_lists;
+
+    for(int i = 0; i < num_ents; i++) {
+
+        PyEntityObject *obj = (PyEntityObject*)S_Entity_ObjForUID(kv_A(ents, i)->uid);
+        PyObject *ctor = s_snapshot_ctor(obj);
+        if(!ctor)
+            goto fail_lists;
+        PyList_SET_ITEM(ctors, i, ctor);
+
+        PyObject *ent_state = s_snapshot_state(obj);
+        if(!ent_state)
+            goto fail_lists;
+        PyList_SET_ITEM(states, i, ent_state);
+
+        PyObject *key = PyLong_FromVoidPtr(obj);
+        PyObject *idx = PyInt_FromLong(i);
+        int result = (key && idx) ? PyDict_SetItem(ids, key, idx) : -1;
+        Py_XDECREF(key);
+        Py_XDECREF(idx);
+        if(result < 0)
+            goto fail_lists;
+    }
+
+    /* The constructors are unpickled first, before any of the entities exist,
+     * so they are pickled separately from the state, which may refer to the
+     * entities. */
+    PyObject *stringio_mod = PyImport_ImportModule("cStringIO");
+    if(!stringio_mod)
+        goto fail_lists;
+    PyObject *file = PyObject_CallMethod(stringio_mod, "StringIO", NULL);
+    Py_DECREF(stringio_mod);
+    if(!file)
+        goto fail_lists;
+
+    PyObject *ctor_pickler = s_new_pickler(file, NULL);
+    if(!ctor_pickler)
+        goto fail_pickle;
+    PyObject *result = PyObject_CallMethod(ctor_pickler, "dump", "(O)", ctors);
+    Py_DECREF(ctor_pickler);
+    if(!result)
+        goto fail_pickle;
+    Py_DECREF(result);
+
+    PyObject *state_pickler = s_new_pickler(file, ids);
+    if(!state_pickler)
+        goto fail_pickle;
+    result = PyObject_CallMethod(state_pickler, "dump", "((OO))", states, state);
+    Py_DECREF(state_pickler);
+    if(!result)
+        goto fail_pickle;
+    Py_DECREF(result);
+
+    PyObject *blob = PyObject_CallMethod(file, "getvalue", NULL);
+    if(!blob || !PyString_Check(blob)) {
+        Py_XDECREF(blob);
+        goto fail_pickle;
+    }
+
+    ret = Scene_SaveSnapshot(path, ents.a, num_ents, PyString_AS_STRING(blob), PyString_GET_SIZE(blob));
+    if(!ret)
+        PyErr_SetString(PyExc_RuntimeError, "Unable to write the snapshot to the specified file.");
+    Py_DECREF(blob);
+
+fail_pickle:
+    Py_DECREF(file);
+fail_lists:
+    Py_XDECREF(ids);
+    Py_XDECREF(states);
+    Py_XDECREF(ctors);
+    kv_destroy(ents);
+    return ret;
+}
+
+PyObject *S_Entity_LoadSnapshot(const char *path)
+{
+    PyObject *ret = NULL;
+
+    struct snapshot *snap = Scene_OpenSnapshot(path);
+    if(!snap) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to read a snapshot from the specified file.");
+        goto fail_open;
+    }
+
+    size_t num_ents = Scene_SnapshotNumEntities(snap);
+    size_t blob_size;
+    const char *blob = Scene_SnapshotScriptState(snap, &blob_size);
+
+    PyObject *stringio_mod = PyImport_ImportModule("cStringIO");
+    if(!stringio_mod)
+        goto fail_file;
+    PyObject *file = PyObject_CallMethod(stringio_mod, "StringIO", "(s#)", blob, (int)blob_size);
+    Py_DECREF(stringio_mod);
+    if(!file)
+        goto fail_file;
+
+    PyObject *ctor_unpickler = s_new_unpickler(file, NULL);
+    if(!ctor_unpickler)
+        goto fail_ctors;
+    PyObject *ctors = PyObject_CallMethod(ctor_unpickler, "load", NULL);
+    Py_DECREF(ctor_unpickler);
+    if(!ctors)
+        goto fail_ctors;
+    if(!PyList_Check(ctors) || PyList_GET_SIZE(ctors) != num_ents) {
+        PyErr_SetString(PyExc_RuntimeError, "Malformed snapshot script state.");
+        goto fail_objs;
+    }
+
+    PyObject *objs = PyList_New(num_ents);
+    if(!objs)
+        goto fail_objs;
+
+    struct entity **ents = malloc(sizeof(struct entity*) * (num_ents ? num_ents : 1));
+    if(!ents) {
+        PyErr_NoMemory();
+        goto fail_ents;
+    }
+
+    for(int i = 0; i < num_ents; i++) {
+
+        PyObject *cls, *args, *kwargs;
+        if(!PyArg_ParseTuple(PyList_GET_ITEM(ctors, i), "OO!O!", 
+            &cls, &PyTuple_Type, &args, &PyDict_Type, &kwargs))
+            goto fail_restore;
+
+        PyObject *obj = PyObject_Call(cls, args, kwargs);
+        if(!obj)
+            goto fail_restore;
+        PyList_SET_ITEM(objs, i, obj);
+
+        if(!PyObject_IsInstance(obj, (PyObject*)&PyEntity_type)) {
+            PyErr_SetString(PyExc_TypeError, "Snapshot entity class must be a subclass of pf.Entity.");
+            goto fail_restore;
+        }
+        ents[i] = ((PyEntityObject*)obj)->ent;
+    }
+
+    /* The script state is read back before any of the entities are made active, 
+     * so that a malformed snapshot leaves the game untouched */
+    PyObject *state_unpickler = s_new_unpickler(file, objs);
+    if(!state_unpickler)
+        goto fail_restore;
+    PyObject *states = PyObject_CallMethod(state_unpickler, "load", NULL);
+    Py_DECREF(state_unpickler);
+    if(!states)
+        goto fail_restore;
+
+    PyObject *ent_states, *state;
+    if(!PyArg_ParseTuple(states, "O!O", &PyList_Type, &ent_states, &state)
+    || PyList_GET_SIZE(ent_states) != num_ents) {
+        PyErr_SetString(PyExc_RuntimeError, "Malformed snapshot script state.");
+        goto fail_states;
+    }
+
+    if(!Scene_RestoreSnapshot(snap, ents)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to restore the game state from the snapshot.");
+        goto fail_states;
+    }
+
+    for(int i = 0; i < num_ents; i++) {
+        if(!s_snapshot_set_state(PyList_GET_ITEM(objs, i), PyList_GET_ITEM(ent_states, i)))
+            goto fail_active;
+    }
+
+    PyObject *list = s_restored_list(objs);
+    if(!list)
+        goto fail_active;
+    ret = Py_BuildValue("(NO)", list, state);
+
+fail_active:
+    if(!ret) {
+        for(int i = 0; i < num_ents; i++)
+            G_RemoveEntity(ents[i]);
+    }
+fail_states:
+    Py_DECREF(states);
+fail_restore:
+    free(ents);
+fail_ents:
+    Py_DECREF(objs);
+fail_objs:
+    Py_DECREF(ctors);
+fail_ctors:
+    Py_DECREF(file);
+fail_file:
+    Scene_CloseSnapshot(snap);
+fail_open:
+    return ret;
+}
@@ -45,6 +45,13 @@ void      S_Entity_PyRegister(PyObject *module);
 PyObject *S_Entity_ObjForUID(uint32_t uid);
 /* Returned list has a stolen reference to each object */
 PyObject *S_Entity_GetAllList(void);
+/* Write a snapshot of the game with the active entities and their script 
+ * state, along with the given object. A Python exception is set on failure. */
+bool      S_Entity_SaveSnapshot(const char *path, PyObject *state);
+/* Re-create the entities of a snapshot and restore the game state. Returns a 
+ * tuple of the list of restored entities (holding the only reference to each, 
+ * as for the list returned by 'load_scene') and the object saved with them. */
+PyObject *S_Entity_LoadSnapshot(const char *path);
 
 #endif
 
@@ -48,10 +48,12 @@
 #include "../event.h"
 #include "../config.h"
 #include "../scene.h"
+#include "../asset_load.h"
 
 #include <SDL.h>
 
 #include <stdio.h>
+#include <string.h>
 
 
 static PyObject *PyPf_new_game(PyObject *self, PyObject *args);
@@ -61,13 +63,21 @@ static PyObject *PyPf_set_ambient_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args);
 static PyObject *PyPf_load_scene(PyObject *self, PyObject *args);
+static PyObject *PyPf_prefetch_entity(PyObject *self, PyObject *args);
+static PyObject *PyPf_save_snapshot(PyObject *self, PyObject *args);
+static PyObject *PyPf_load_snapshot(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_register_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_unregister_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_global_event(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_activate_camera(PyObject *self, PyObject *args);
+static PyObject *PyPf_set_active_camera_pos(PyObject *self, PyObject *args);
+static PyObject *PyPf_set_active_camera_orientation(PyObject *self, PyObject *args);
 static PyObject *PyPf_prev_frame_ms(PyObject *self);
+static PyObject *PyPf_prev_frame_perf(PyObject *self);
+static PyObject *PyPf_asset_stats(PyObject *self);
+static PyObject *PyPf_dump_next_frame(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_resolution(PyObject *self);
 static PyObject *PyPf_get_basedir(PyObject *self);
 static PyObject *PyPf_get_mouse_pos(PyObject *self);
@@ -134,6 +144,29 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_load_scene, METH_VARARGS,
     "Import list of entities from a PFSCENE file (specified as a path string)."},
 
+    {"prefetch_entity", 
+    (PyCFunction)PyPf_prefetch_entity, METH_VARARGS,
+    "Start loading the model for an entity (specified by a directory path and filename, "
+    "as for pf.Entity) in the background, so that creating entities with it later does "
+    "not stall the game."},
+
+    {"save_snapshot", 
+    (PyCFunction)PyPf_save_snapshot, METH_VARARGS,
+    "Save the state of the game (the factions and all the active entities along with their "
+    "movement, combat and animation state) to the specified file. The script-owned state of "
+    "each entity is pickled: this is the result of its' '__getstate__' method, if it has one, "
+    "otherwise its' '__dict__'. An optional second argument is pickled along with it. Entities "
+    "referred to by the pickled state must be active."},
+
+    {"load_snapshot", 
+    (PyCFunction)PyPf_load_snapshot, METH_VARARGS,
+    "Re-create the entities saved by 'save_snapshot' and restore the game state. The map "
+    "must already be loaded. Each entity is made by calling its' class with the result of "
+    "its' '__getinitargs__' method, if it has one, otherwise with the same arguments as "
+    "pf.Entity. Its' state is then restored with '__setstate__', if it has one, otherwise "
+    "by updating its' '__dict__'. Returns a tuple of the list of restored entities (as for "
+    "'load_scene') and the object that was saved with them."},
+
     {"register_event_handler", 
     (PyCFunction)PyPf_register_event_handler, METH_VARARGS,
     "Adds a script event handler to be called when the specified global event occurs. "
@@ -156,10 +189,37 @@ static PyMethodDef pf_module_methods[] = {
     "to the map boundaries as it is expected to be the main RTS camera. The other cameras "
     "are unrestricted."},
 
+    {"set_active_camera_pos", 
+    (PyCFunction)PyPf_set_active_camera_pos, METH_VARARGS,
+    "Set the worldspace position (specified as an XYZ list) of the active camera."},
+
+    {"set_active_camera_orientation", 
+    (PyCFunction)PyPf_set_active_camera_orientation, METH_VARARGS,
+    "Set the pitch and yaw (in degrees) of the active camera."},
+
     {"prev_frame_ms", 
     (PyCFunction)PyPf_prev_frame_ms, METH_NOARGS,
     "Get the duration of the previous game frame in milliseconds."},
 
+    {"prev_frame_perf", 
+    (PyCFunction)PyPf_prev_frame_perf, METH_NOARGS,
+    "Get a tuple of the CPU time and the GPU rendering time (in milliseconds, as floats) "
+    "of recent frames, followed by the number of frames that the GPU time lags behind. "
+    "The CPU time is for the previous frame. The GPU time is read back without stalling, "
+    "so it is for an older frame, which can vary when the GPU falls behind."},
+
+    {"asset_stats", 
+    (PyCFunction)PyPf_asset_stats, METH_NOARGS,
+    "Get a list of dictionaries with the load times (in milliseconds) and the memory use "
+    "(in bytes) of every model loaded so far, the slowest to load first. The material array "
+    "texture and the source textures it is packed from are reported separately. Textures and "
+    "animation clips shared between models are only counted for the model that loaded them "
+    "first."},
+
+    {"dump_next_frame", 
+    (PyCFunction)PyPf_dump_next_frame, METH_VARARGS,
+    "Write the contents of the next rendered frame to the specified path as a PPM image."},
+
     {"get_resolution", 
     (PyCFunction)PyPf_get_resolution, METH_NOARGS,
     "Get the currently set resolution of the game window."},
@@ -412,6 +472,63 @@ static PyObject *PyPf_load_scene(PyObject *self, PyObject *args)
     return S_Entity_GetAllList();
 }
 
+static PyObject *PyPf_save_snapshot(PyObject *self, PyObject *args)
+{
+    const char *path; 
+    PyObject *state = Py_None;
+
+    if(!PyArg_ParseTuple(args, "s|O", &path, &state)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and an optional object.");
+        return NULL;
+    }
+
+    if(!S_Entity_SaveSnapshot(path, state))
+        return NULL; /* Exception already set */
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_load_snapshot(PyObject *self, PyObject *args)
+{
+    const char *path; 
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    PyObject *ret = S_Entity_LoadSnapshot(path);
+    if(!ret)
+        return NULL; /* Exception already set */
+
+    G_MakeStaticObjsImpassable();
+    return ret;
+}
+
+static PyObject *PyPf_prefetch_entity(PyObject *self, PyObject *args)
+{
+    const char *dirpath, *filename;
+
+    if(!PyArg_ParseTuple(args, "ss", &dirpath, &filename)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two strings.");
+        return NULL;
+    }
+
+    extern const char *g_basepath;
+    char entity_path[512];
+    if(strlen(g_basepath) + strlen(dirpath) >= sizeof(entity_path)) {
+        PyErr_SetString(PyExc_RuntimeError, "The entity path is too long.");
+        return NULL;
+    }
+    strcpy(entity_path, g_basepath);
+    strcat(entity_path, dirpath);
+
+    if(!AL_PrefetchPFObj(entity_path, filename)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to queue the entity for loading.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args)
 {
     PyObject *list;
@@ -509,6 +626,108 @@ static PyObject *PyPf_prev_frame_ms(PyObject *self)
     return Py_BuildValue("i", g_last_frame_ms);
 }
 
+static PyObject *PyPf_set_active_camera_pos(PyObject *self, PyObject *args)
+{
+    PyObject *list;
+    vec3_t pos;
+
+    if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
+        return NULL; /* exception already set */
+
+    if(!s_vec3_from_pylist_arg(list, &pos))
+        return NULL; /* exception already set */
+
+    G_SetActiveCamPos(pos);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_set_active_camera_orientation(PyObject *self, PyObject *args)
+{
+    float pitch, yaw;
+
+    if(!PyArg_ParseTuple(args, "ff", &pitch, &yaw)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two floats (pitch and yaw).");
+        return NULL;
+    }
+
+    G_SetActiveCamOrientation(pitch, yaw);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_prev_frame_perf(PyObject *self)
+{
+    extern float g_last_frame_cpu_ms;
+    extern float g_last_frame_gpu_ms;
+    extern unsigned long g_last_frame_cpu_idx;
+    extern unsigned long g_last_frame_gpu_idx;
+
+    return Py_BuildValue("(f, f, k)", g_last_frame_cpu_ms, g_last_frame_gpu_ms, 
+        g_last_frame_cpu_idx - g_last_frame_gpu_idx);
+}
+
+static PyObject *PyPf_asset_stats(PyObject *self)
+{
+    size_t num_models = AL_NumLoadedModels();
+    struct asset_stats *stats = malloc(sizeof(struct asset_stats) * num_models);
+    if(num_models && !stats)
+        return PyErr_NoMemory();
+    num_models = AL_GetAssetStats(stats, num_models);
+
+    PyObject *ret = PyList_New(num_models);
+    if(!ret)
+        goto fail_list;
+
+    for(int i = 0; i < num_models; i++) {
+
+        const struct asset_stats *curr = &stats[i];
+        PyObject *dict = Py_BuildValue("{s:s, s:O, s:f, s:f, s:I, s:I, s:I, s:I, s:I, s:n, s:n, s:n, s:n}",
+            "name",             curr->name,
+            "binary",           curr->binary ? Py_True : Py_False,
+            "parse_ms",         curr->parse_ms,
+            "upload_ms",        curr->upload_ms,
+            "num_verts",        curr->num_verts,
+            "num_joints",       curr->num_joints,
+            "num_materials",    curr->num_materials,
+            "num_clips",        curr->num_clips,
+            "num_samples",      curr->num_samples,
+            "buffer_bytes",     (Py_ssize_t)curr->buff_bytes,
+            "array_bytes",      (Py_ssize_t)curr->arr_bytes,
+            "texture_bytes",    (Py_ssize_t)curr->tex_bytes,
+            "anim_bytes",       (Py_ssize_t)curr->anim_bytes);
+        if(!dict)
+            goto fail_dict;
+        PyList_SET_ITEM(ret, i, dict);
+    }
+
+    free(stats);
+    return ret;
+
+fail_dict:
+    Py_DECREF(ret);
+fail_list:
+    free(stats);
+    return NULL;
+}
+
+static PyObject *PyPf_dump_next_frame(PyObject *self, PyObject *args)
+{
+    extern char g_frame_dump_path[256];
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    if(strlen(path) >= sizeof(g_frame_dump_path)) {
+        PyErr_SetString(PyExc_RuntimeError, "The path is too long.");
+        return NULL;
+    }
+
+    strcpy(g_frame_dump_path, path);
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_get_resolution(PyObject *self)
 {
     return Py_BuildValue("(i, i)", CONFIG_RES_X, CONFIG_RES_Y);
@@ -756,11 +975,6 @@ static PyObject *PyPf_update_tile(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    if(!G_UpdateMinimapChunk(desc.chunk_r, desc.chunk_c)) {
-        PyErr_SetString(PyExc_RuntimeError, "Could not update minimap chunk.");
-        return NULL;
-    }
-
     Py_RETURN_NONE;
 }
 
@@ -36,7 +36,6 @@
 #include "ui_style_script.h"
 #include "../lib/public/nuklear.h"
 #include "../lib/public/khash.h"
-#include "../lib/public/stb_image.h"
 #include "../render/public/render.h"
 
 #include <string.h>
@@ -288,9 +287,9 @@ static bool image_load(const char *img_path, int *out_id)
     name = end + 1;
     *end = '\0';
 
-    stbi_set_flip_vertically_on_load(false);
+    R_Texture_SetFlipOnLoad(false);
     bool result = R_Texture_Load(path, name, out_id);
-    stbi_set_flip_vertically_on_load(true);
+    R_Texture_SetFlipOnLoad(true);
     if(!result) {
         PyErr_SetString(PyExc_RuntimeError, "Not able to load image.");
         return false;